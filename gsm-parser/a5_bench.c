@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+#include <osmocom/core/bits.h>
+#include <osmocom/gsm/a5.h>
+
+#include "bench.h"
+
+/*
+ * Generates A5/1 and A5/2 downlink keystreams for random keys and frame
+ * numbers with osmo_a5() one at a time and with osmo_a5_bulk() in batches,
+ * checks that both give the same packed streams and times them.
+ */
+
+#define KS_BYTES	15
+
+static const unsigned batch_sizes[] = { 4, 64, 256, 1024 };
+#define BATCH_SIZES	(sizeof(batch_sizes) / sizeof(batch_sizes[0]))
+
+static unsigned count = 100000;
+
+static const struct bench_opt opts[] = {
+	{ 'n', BENCH_UINT, &count, "<streams>", "Keystreams per algorithm and batch size" },
+	{ 0 }
+};
+
+static int a5_main(int argc, char *argv[])
+{
+	uint8_t *key_data;
+	const uint8_t **keys;
+	uint32_t *fn;
+	pbit_t *ref, *out, *ul_ref, *ul_out;
+	ubit_t dl_bits[114], ul_bits[114];
+	double secs, ref_secs;
+	unsigned i, j, b, n;
+
+	if (bench_getopt(&a5_bench, argc, argv) != argc || !count) {
+		bench_usage(&a5_bench);
+	}
+
+	key_data = malloc(count * 8);
+	keys = malloc(count * sizeof(*keys));
+	fn = malloc(count * sizeof(*fn));
+	ref = malloc(count * KS_BYTES);
+	out = malloc(count * KS_BYTES);
+	ul_ref = malloc(count * KS_BYTES);
+	ul_out = malloc(count * KS_BYTES);
+	if (!key_data || !keys || !fn || !ref || !out || !ul_ref || !ul_out) {
+		errx(1, "Cannot allocate %u keystreams", count);
+	}
+
+	/* A few keys, as on air, each used for runs of frame numbers */
+	srandom(1);
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < 8; j++) {
+			key_data[i * 8 + j] = random();
+		}
+		keys[i] = &key_data[(i / 51) * 8];
+		fn[i] = random() % (2048 * 26 * 51);
+	}
+
+	for (n = 1; n <= 2; n++) {
+		/* Same streams, both directions */
+		for (i = 0; i < count; i++) {
+			osmo_a5(n, keys[i], fn[i], dl_bits, ul_bits);
+			osmo_ubit2pbit(&ref[i * KS_BYTES], dl_bits, 114);
+			osmo_ubit2pbit(&ul_ref[i * KS_BYTES], ul_bits, 114);
+		}
+
+		for (b = 0; b < BATCH_SIZES; b++) {
+			memset(out, 0, count * KS_BYTES);
+			memset(ul_out, 0, count * KS_BYTES);
+			for (i = 0; i < count; i += batch_sizes[b]) {
+				j = count - i < batch_sizes[b] ? count - i : batch_sizes[b];
+				osmo_a5_bulk(n, &keys[i], &fn[i], j, &out[i * KS_BYTES], &ul_out[i * KS_BYTES]);
+			}
+			if (memcmp(ref, out, count * KS_BYTES) || memcmp(ul_ref, ul_out, count * KS_BYTES)) {
+				printf("MISMATCH in A5/%u with batches of %u\n", n, batch_sizes[b]);
+				return 1;
+			}
+		}
+		printf("A5/%u %u keystreams checked\n", n, count);
+
+		/* Downlink keystreams per second */
+		ref_secs = stats_secs();
+		for (i = 0; i < count; i++) {
+			osmo_a5(n, keys[i], fn[i], dl_bits, NULL);
+			osmo_ubit2pbit(&ref[i * KS_BYTES], dl_bits, 114);
+		}
+		ref_secs = stats_secs() - ref_secs;
+		printf("A5/%u %-12s %10u keystreams %8.3f s %10.0f keystreams/s\n",
+			n, "osmo_a5", count, ref_secs, count / ref_secs);
+
+		for (b = 0; b < BATCH_SIZES; b++) {
+			secs = stats_secs();
+			for (i = 0; i < count; i += batch_sizes[b]) {
+				j = count - i < batch_sizes[b] ? count - i : batch_sizes[b];
+				osmo_a5_bulk(n, &keys[i], &fn[i], j, &out[i * KS_BYTES], NULL);
+			}
+			secs = stats_secs() - secs;
+			printf("A5/%u bulk %-7u %10u keystreams %8.3f s %10.0f keystreams/s %6.1fx\n",
+				n, batch_sizes[b], count, secs, count / secs, ref_secs / secs);
+		}
+
+		if (memcmp(ref, out, count * KS_BYTES)) {
+			printf("MISMATCH in A5/%u downlink only\n", n);
+			return 1;
+		}
+	}
+
+	free(key_data);
+	free(keys);
+	free(fn);
+	free(ref);
+	free(out);
+	free(ul_ref);
+	free(ul_out);
+
+	return 0;
+}
+
+const struct bench_cmd a5_bench = {
+	.name = "a5",
+	.help = "A5/1 and A5/2 keystreams one by one and in bulk",
+	.opts = opts,
+	.main = a5_main,
+};
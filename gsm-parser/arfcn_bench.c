@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+#include <osmocom/gsm/gsm48_ie.h>
+
+#include "session.h"
+#include "cell_info.h"
+#include "arfcn_set.h"
+#include "bench.h"
+
+/*
+ * Decodes random frequency lists once into libosmocore's byte masks and
+ * once into ARFCN sets, checks that both hold the same ARFCNs and times
+ * counting them the way arfcn_count() used to and does now. Also prints
+ * what the ARFCN lists cost per cell and per session.
+ */
+
+#define LIST_LEN	16
+
+/* Cell and session used one mask byte per ARFCN */
+#define OLD_CELL_BYTES		(2 * 1024)
+#define OLD_SESSION_BYTES	1024
+
+static void make_list(uint8_t *cd)
+{
+	int i;
+
+	for (i = 0; i < LIST_LEN; i++) {
+		cd[i] = random();
+	}
+
+	/* Mostly bit map 0, the rest in one of the range formats */
+	if (random() % 4) {
+		cd[0] &= 0x0f;
+	}
+}
+
+static unsigned count_masks(struct gsm_sysinfo_freq *f, uint8_t mask)
+{
+	unsigned count = 0;
+	int i;
+
+	for (i = 0; i < 1024; i++) {
+		if (f[i].mask & mask) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static unsigned lists = 1000;
+static unsigned rounds = 1000;
+
+static const struct bench_opt opts[] = {
+	{ 'n', BENCH_UINT, &lists, "<lists>", "Number of frequency lists" },
+	{ 'r', BENCH_UINT, &rounds, "<rounds>", "Times every list is counted" },
+	{ 0 }
+};
+
+static int arfcn_main(int argc, char *argv[])
+{
+	struct gsm_sysinfo_freq *freq;
+	struct arfcn_set *sets;
+	struct cell_info *ci;
+	struct session_info *s;
+	uint8_t cd[LIST_LEN];
+	unsigned long mask_sum = 0, set_sum = 0;
+	double mask_secs, set_secs;
+	unsigned i, r;
+	int a;
+
+	if (bench_getopt(&arfcn_bench, argc, argv) != argc || !lists || !rounds) {
+		bench_usage(&arfcn_bench);
+	}
+
+	freq = calloc(lists, 1024 * sizeof(struct gsm_sysinfo_freq));
+	sets = calloc(lists, sizeof(struct arfcn_set));
+	if (!freq || !sets) {
+		errx(1, "Cannot allocate %u lists", lists);
+	}
+
+	srandom(1);
+	for (i = 0; i < lists; i++) {
+		make_list(cd);
+		gsm48_decode_freq_list(&freq[i * 1024], cd, LIST_LEN, 0xff, 0x01);
+		arfcn_set_decode(&sets[i], cd, LIST_LEN, 0xff);
+
+		for (a = 0; a < 1024; a++) {
+			if (!!(freq[i * 1024 + a].mask & 0x01) != arfcn_set_has(&sets[i], a)) {
+				printf("MISMATCH in list %u at ARFCN %d\n", i, a);
+				return 1;
+			}
+		}
+	}
+
+	mask_secs = stats_secs();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < lists; i++) {
+			mask_sum += count_masks(&freq[i * 1024], 0x01);
+		}
+	}
+	mask_secs = stats_secs() - mask_secs;
+
+	set_secs = stats_secs();
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < lists; i++) {
+			set_sum += arfcn_set_count(&sets[i]);
+		}
+	}
+	set_secs = stats_secs() - set_secs;
+
+	bench_print("byte masks", (uint64_t) lists * rounds, "counts", mask_secs, 0);
+	bench_print("ARFCN sets", (uint64_t) lists * rounds, "counts", set_secs, 0);
+
+	free(freq);
+	free(sets);
+
+	if (mask_sum != set_sum) {
+		printf("MISMATCH\n");
+		return 1;
+	}
+
+	printf("speedup %.1fx\n", mask_secs / set_secs);
+
+	printf("cell_info        %6zu bytes, ARFCN lists %5zu bytes (%d as byte masks)\n",
+		sizeof(*ci), sizeof(ci->arfcn_list) + sizeof(ci->arfcn_stored), OLD_CELL_BYTES);
+	printf("session_info     %6zu bytes, ARFCN lists %5zu bytes (%d as byte masks)\n",
+		sizeof(*s), sizeof(s->cell_arfcns), OLD_SESSION_BYTES);
+
+	return 0;
+}
+
+const struct bench_cmd arfcn_bench = {
+	.name = "arfcn",
+	.help = "Counting ARFCN lists as byte masks and as ARFCN sets",
+	.opts = opts,
+	.main = arfcn_main,
+};
@@ -0,0 +1,72 @@
+#include <stdint.h>
+#include <osmocom/gsm/gsm48_ie.h>
+
+#include "arfcn_set.h"
+
+unsigned arfcn_set_count(const struct arfcn_set *set)
+{
+	unsigned count = 0;
+	int i;
+
+	for (i = 0; i < ARFCN_SET_WORDS; i++) {
+		count += __builtin_popcountll(set->w[i]);
+	}
+
+	return count;
+}
+
+int arfcn_set_empty(const struct arfcn_set *set)
+{
+	int i;
+
+	for (i = 0; i < ARFCN_SET_WORDS; i++) {
+		if (set->w[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Lowest ARFCN in the set that is >= arfcn, or -1 */
+int arfcn_set_next(const struct arfcn_set *set, unsigned arfcn)
+{
+	unsigned i = arfcn >> 6;
+	uint64_t w;
+
+	if (arfcn >= ARFCN_SET_MAX) {
+		return -1;
+	}
+
+	w = set->w[i] & (~0ULL << (arfcn & 63));
+	while (!w) {
+		if (++i == ARFCN_SET_WORDS) {
+			return -1;
+		}
+		w = set->w[i];
+	}
+
+	return (i << 6) + __builtin_ctzll(w);
+}
+
+/* Replaces the set with a frequency list decoded by libosmocore */
+int arfcn_set_decode(struct arfcn_set *set, uint8_t *cd, uint8_t len, uint8_t mask)
+{
+	struct gsm_sysinfo_freq f[ARFCN_SET_MAX];
+	uint64_t w;
+	int ret;
+	int i, j;
+
+	memset(f, 0, sizeof(f));
+	ret = gsm48_decode_freq_list(f, cd, len, mask, 0x01);
+
+	for (i = 0; i < ARFCN_SET_WORDS; i++) {
+		w = 0;
+		for (j = 0; j < 64; j++) {
+			w |= (uint64_t) f[(i << 6) + j].mask << j;
+		}
+		set->w[i] = w;
+	}
+
+	return ret;
+}
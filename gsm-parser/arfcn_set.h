@@ -0,0 +1,35 @@
+#ifndef ARFCN_SET_H
+#define ARFCN_SET_H
+
+#include <stdint.h>
+#include <string.h>
+
+/* One bit per ARFCN, 0..1023 */
+#define ARFCN_SET_MAX	1024
+#define ARFCN_SET_WORDS	(ARFCN_SET_MAX / 64)
+
+struct arfcn_set {
+	uint64_t w[ARFCN_SET_WORDS];
+};
+
+static inline void arfcn_set_add(struct arfcn_set *set, unsigned arfcn)
+{
+	set->w[(arfcn & 1023) >> 6] |= 1ULL << (arfcn & 63);
+}
+
+static inline int arfcn_set_has(const struct arfcn_set *set, unsigned arfcn)
+{
+	return (set->w[(arfcn & 1023) >> 6] >> (arfcn & 63)) & 1;
+}
+
+static inline void arfcn_set_clear(struct arfcn_set *set)
+{
+	memset(set, 0, sizeof(*set));
+}
+
+unsigned arfcn_set_count(const struct arfcn_set *set);
+int arfcn_set_empty(const struct arfcn_set *set);
+int arfcn_set_next(const struct arfcn_set *set, unsigned arfcn);
+int arfcn_set_decode(struct arfcn_set *set, uint8_t *cd, uint8_t len, uint8_t mask);
+
+#endif
@@ -6,7 +6,38 @@
 
 #include "assignment.h"
 
-void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_freq *cell_arfcns, struct gsm_assignment *ga)
+/* Mobile allocation order is ARFCN 1 to 1023, then ARFCN 0 */
+static int ma_next(struct arfcn_set *list, int arfcn)
+{
+	if (!list || arfcn == 0) {
+		return -1;
+	}
+
+	arfcn = arfcn_set_next(list, arfcn + 1);
+	if (arfcn < 0 && arfcn_set_has(list, 0)) {
+		arfcn = 0;
+	}
+
+	return arfcn;
+}
+
+static int ma_first(struct arfcn_set *list)
+{
+	int arfcn;
+
+	if (!list) {
+		return -1;
+	}
+
+	arfcn = arfcn_set_next(list, 1);
+	if (arfcn < 0 && arfcn_set_has(list, 0)) {
+		arfcn = 0;
+	}
+
+	return arfcn;
+}
+
+void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct arfcn_set *cell_arfcns, struct gsm_assignment *ga)
 {
 	struct gsm48_ass_cmd *ac;
 	struct gsm48_ho_cmd *hoc;
@@ -17,7 +48,7 @@ void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_fr
 	uint8_t *ma = 0;
 	uint8_t ma_len;
 	uint8_t ch_type, ch_subch, ch_ts;
-	unsigned i, mask;
+	struct arfcn_set *list;
 
 	if (!ga)
 		return;
@@ -59,14 +90,14 @@ void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_fr
 
 	ma_len = 0;
 	ma = NULL;
-	mask = 0;
+	list = NULL;
 
 	/* Cell channel description */
 	if (TLVP_PRESENT(&tp, GSM48_IE_CELL_CH_DESC)) {
 		const uint8_t *v = TLVP_VAL(&tp, GSM48_IE_CELL_CH_DESC);
 		uint8_t len = TLVP_LEN(&tp, GSM48_IE_CELL_CH_DESC);
-		gsm48_decode_freq_list(cell_arfcns, (uint8_t *) v, len, 0xff, 0x02);
-		mask = 0x02;
+		arfcn_set_decode(&cell_arfcns[ASSIGN_ARFCN_CHAN], (uint8_t *) v, len, 0xff);
+		list = &cell_arfcns[ASSIGN_ARFCN_CHAN];
 	} else if (TLVP_PRESENT(&tp, GSM48_IE_MA_AFTER)) {
 		/* Mobile allocation */
 		const uint8_t *v = TLVP_VAL(&tp, GSM48_IE_MA_AFTER);
@@ -74,23 +105,20 @@ void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_fr
 
 		ma_len = len;
 		ma = (uint8_t *) v;
-		mask = 0x01;
+		list = &cell_arfcns[ASSIGN_ARFCN_CELL];
 	} else if (TLVP_PRESENT(&tp, GSM48_IE_FREQ_L_AFTER)) {
 		/* Frequency list after time */
 		const uint8_t *v = TLVP_VAL(&tp, GSM48_IE_FREQ_L_AFTER);
 		uint8_t len = TLVP_LEN(&tp, GSM48_IE_FREQ_L_AFTER);
-		gsm48_decode_freq_list(cell_arfcns, (uint8_t *) v, len, 0xff, 0x04);
+		arfcn_set_decode(&cell_arfcns[ASSIGN_ARFCN_FREQ], (uint8_t *) v, len, 0xff);
 		ma_len = 0;
 		ma = NULL;
-		mask = 0x04;
+		list = &cell_arfcns[ASSIGN_ARFCN_FREQ];
 	} else {
 		/* Use the old one */
-		for (i=0; i<1024; i++) {
-			cell_arfcns[i].mask &= ~0x02;
-			if (cell_arfcns[i].mask & 0x01) {
-				cell_arfcns[i].mask |= 0x02;
-				mask = 0x02;
-			}
+		cell_arfcns[ASSIGN_ARFCN_CHAN] = cell_arfcns[ASSIGN_ARFCN_CELL];
+		if (!arfcn_set_empty(&cell_arfcns[ASSIGN_ARFCN_CHAN])) {
+			list = &cell_arfcns[ASSIGN_ARFCN_CHAN];
 		}
 	}
 
@@ -121,7 +149,7 @@ void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_fr
 		ga->h0.band_arfcn = arfcn;
 	} else {
 		/* Hopping */
-		uint16_t arfcn;
+		int arfcn;
 		int i, j, k;
 
 		ga->tsc = cd->h1.tsc;
@@ -133,15 +161,13 @@ void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_fr
 			if (ma_len == 0) {
 				return;
 			}
-			for (i=1, j=0; i<=1024; i++) {
-				arfcn = i & 1023;
-				if (cell_arfcns[arfcn].mask & mask) {
-					k = ma_len - (j>>3) - 1;
-					if (ma[k] & (1 << (j&7))) {
-						ga->h1.ma[ga->h1.ma_len++] = arfcn;
-					}
-					j++;
+			j = 0;
+			for (arfcn = ma_first(list); arfcn >= 0; arfcn = ma_next(list, arfcn)) {
+				k = ma_len - (j>>3) - 1;
+				if (ma[k] & (1 << (j&7))) {
+					ga->h1.ma[ga->h1.ma_len++] = arfcn;
 				}
+				j++;
 			}
 			if (ga->h1.ma_len == 0) {
 				/* cell information not found */
@@ -155,11 +181,8 @@ void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_fr
 				}
 			}
 		} else {
-			for (i=1, j=0; i<=1024; i++) {
-				arfcn = i & 1023;
-				if (cell_arfcns[arfcn].mask & mask) {
-					ga->h1.ma[ga->h1.ma_len++] = arfcn;
-				}
+			for (arfcn = ma_first(list); arfcn >= 0; arfcn = ma_next(list, arfcn)) {
+				ga->h1.ma[ga->h1.ma_len++] = arfcn;
 			}
 		}
 	}
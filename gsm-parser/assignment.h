@@ -4,6 +4,17 @@
 #include <stdint.h>
 #include <osmocom/gsm/gsm48_ie.h>
 
+#include "arfcn_set.h"
+
+/* Frequency lists of a session */
+enum assign_arfcn {
+	ASSIGN_ARFCN_CELL = 0,	/* cell allocation from SI1 */
+	ASSIGN_ARFCN_CHAN,	/* cell channel description */
+	ASSIGN_ARFCN_FREQ,	/* frequency list after time */
+
+	ASSIGN_ARFCN_LISTS
+};
+
 struct gsm_assignment {
 	int chan_nr;
 	int tsc;
@@ -24,6 +35,6 @@ struct gsm_assignment {
 	uint16_t bcch_arfcn;
 };
 
-void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_freq *cell_arfcns, struct gsm_assignment *ga);
+void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct arfcn_set *cell_arfcns, struct gsm_assignment *ga);
 
 #endif
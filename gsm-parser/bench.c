@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+const char *bench_progname = "metagsm_bench";
+
+void bench_usage(const struct bench_cmd *cmd)
+{
+	const struct bench_cmd *const *c;
+	const struct bench_opt *o;
+	char arg[32];
+
+	printf("Usage: %s%s%s", bench_progname, cmd->name ? " " : "", cmd->name ? cmd->name : "");
+	for (o = cmd->opts; o && o->opt; o++) {
+		printf(" [-%c %s]", o->opt, o->arg);
+	}
+	printf("%s%s\n", cmd->operands ? " " : "", cmd->operands ? cmd->operands : "");
+	if (cmd->cmds) {
+		printf("       %s <benchmark> [options]\n", bench_progname);
+	}
+
+	for (o = cmd->opts; o && o->opt; o++) {
+		snprintf(arg, sizeof(arg), "-%c %s", o->opt, o->arg);
+		printf("	%-13s - %s", arg, o->help);
+		switch (o->type) {
+			case BENCH_UINT:
+				if (*(unsigned *) o->value) {
+					printf(" (default %u)", *(unsigned *) o->value);
+				}
+				break;
+			case BENCH_DOUBLE:
+				if (*(double *) o->value) {
+					printf(" (default %g)", *(double *) o->value);
+				}
+				break;
+			case BENCH_STRING:
+				if (*(const char **) o->value) {
+					printf(" (default %s)", *(const char **) o->value);
+				}
+				break;
+			case BENCH_CALL:
+				break;
+		}
+		printf("\n");
+	}
+
+	if (cmd->cmds) {
+		printf("Benchmarks run on their own, with their text output:\n");
+	}
+	for (c = cmd->cmds; c && *c; c++) {
+		printf("	%-13s - %s\n", (*c)->name, (*c)->help);
+	}
+	exit(1);
+}
+
+int bench_getopt(const struct bench_cmd *cmd, int argc, char *argv[])
+{
+	const struct bench_opt *o;
+	char optstring[64];
+	unsigned n = 0;
+	char *end;
+	int ch;
+
+	for (o = cmd->opts; o && o->opt && n + 3 < sizeof(optstring); o++) {
+		optstring[n++] = o->opt;
+		optstring[n++] = ':';
+	}
+	optstring[n] = 0;
+
+	while ((ch = getopt(argc, argv, optstring)) != -1) {
+		for (o = cmd->opts; o && o->opt; o++) {
+			if (o->opt == ch) {
+				break;
+			}
+		}
+		if (!o || !o->opt) {
+			bench_usage(cmd);
+		}
+
+		switch (o->type) {
+			case BENCH_UINT:
+				*(unsigned *) o->value = strtoul(optarg, &end, 0);
+				break;
+			case BENCH_DOUBLE:
+				*(double *) o->value = strtod(optarg, &end);
+				break;
+			case BENCH_STRING:
+				*(const char **) o->value = optarg;
+				end = "";
+				break;
+			case BENCH_CALL:
+				o->set(optarg);
+				end = "";
+				break;
+		}
+		if (*end || !*optarg) {
+			bench_usage(cmd);
+		}
+	}
+
+	return optind;
+}
+
+void bench_print(const char *name, uint64_t ops, const char *unit, double secs, double ref_secs)
+{
+	printf("%-16s %10llu %s %8.3f s %10.0f %s/s", name, (unsigned long long) ops, unit,
+		secs, ops / secs, unit);
+	if (ref_secs) {
+		printf(" %6.1fx", ref_secs / secs);
+	}
+	printf("\n");
+}
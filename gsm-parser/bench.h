@@ -0,0 +1,63 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#include "stats.h"
+
+/*
+ * Command line and result lines shared by the benchmarks of
+ * metagsm_bench. Each one is a subcommand with a table of options.
+ */
+
+enum bench_arg {
+	BENCH_UINT,
+	BENCH_DOUBLE,
+	BENCH_STRING,
+	BENCH_CALL,		/* set() is called with the argument */
+};
+
+struct bench_opt {
+	char opt;
+	enum bench_arg type;
+	void *value;		/* holds the default, printed if not 0 */
+	const char *arg;	/* name of the argument in the usage */
+	const char *help;
+	void (*set)(const char *arg);
+};
+
+struct bench_cmd {
+	const char *name;	/* NULL for the program itself */
+	const char *operands;	/* after the options in the usage */
+	const char *help;
+	const struct bench_opt *opts;	/* ends with opt 0 */
+	const struct bench_cmd *const *cmds;	/* subcommands, ends with NULL */
+	int (*main)(int argc, char *argv[]);
+};
+
+/* Name the program was started with, for the usage */
+extern const char *bench_progname;
+
+/* Prints the usage of the command and exits */
+void bench_usage(const struct bench_cmd *cmd);
+
+/* Parses the options into their values, returns the index of the first operand */
+int bench_getopt(const struct bench_cmd *cmd, int argc, char *argv[]);
+
+/* "name ops unit secs unit/s", with the speedup over ref_secs unless it is 0 */
+void bench_print(const char *name, uint64_t ops, const char *unit, double secs, double ref_secs);
+
+extern const struct bench_cmd a5_bench;
+extern const struct bench_cmd arfcn_bench;
+extern const struct bench_cmd burst_bench;
+extern const struct bench_cmd cell_bench;
+extern const struct bench_cmd crc_bench;
+extern const struct bench_cmd deinter_bench;
+extern const struct bench_cmd diag_read_bench;
+extern const struct bench_cmd gsmtap_bench;
+extern const struct bench_cmd per_bench;
+extern const struct bench_cmd sql_batch_bench;
+extern const struct bench_cmd sqlite_bench;
+extern const struct bench_cmd viterbi_bench;
+
+#endif
@@ -199,6 +199,24 @@ inline unsigned hamming_distance(uint8_t *v1, uint8_t *v2, unsigned len)
 	return diff;
 }
 
+/* Number of differing bits in len bytes */
+unsigned bit_distance(const uint8_t *v1, const uint8_t *v2, unsigned len)
+{
+	unsigned i, diff = 0;
+	uint64_t w1, w2;
+
+	for (i=0; i+8<=len; i+=8) {
+		memcpy(&w1, &v1[i], 8);
+		memcpy(&w2, &v2[i], 8);
+		diff += __builtin_popcountll(w1^w2);
+	}
+	for (; i<len; i++) {
+		diff += __builtin_popcount(v1[i]^v2[i]);
+	}
+
+	return diff;
+}
+
 unsigned fread_unescape(FILE *f, uint8_t *msg, unsigned len)
 {
 	unsigned i;
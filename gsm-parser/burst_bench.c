@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "process.h"
+#include "bit_func.h"
+#include "cch.h"
+#include "gsm_interleave.h"
+#include "bench.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define cycles()	__rdtsc()
+#define CYCLES_UNIT	"TSC cycles"
+#else
+#include <time.h>
+static uint64_t cycles()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#define CYCLES_UNIT	"ns"
+#endif
+
+/*
+ * Runs SACCH/SDCCH blocks through the burst stages of ccch.c, deciphering,
+ * soft bit deinterleaving and bit error counting, once with bursts expanded
+ * to one bit per byte as before and once on packed bursts as now. Checks
+ * that both give the same soft bits and bit error counts, and that the hard
+ * bit deinterleaver of gprs.c matches too, then reports cycles per block of
+ * each.
+ */
+
+struct block {
+	uint8_t bursts[4*BURST_BYTES];
+	uint8_t ks[4*BURST_BYTES];
+	uint8_t msg[23];
+	unsigned snr[4];
+};
+
+static void make_block(struct block *b)
+{
+	uint8_t coded[CONV_SIZE];
+	unsigned i, j;
+
+	for (i = 0; i < sizeof(b->msg); i++) {
+		b->msg[i] = random();
+	}
+	encode_signalling(b->msg, coded);
+
+	memset(b->bursts, 0, sizeof(b->bursts));
+	for (j = 0; j < 4; j++) {
+		for (i = 0; i < BURST_BITS; i++) {
+			if (random() % 100 < 5) {
+				coded[j*BURST_BITS + i] ^= 1;
+			}
+		}
+		compress_msb(&coded[j*BURST_BITS], &b->bursts[j*BURST_BYTES], BURST_BITS);
+		b->snr[j] = random() % 256;
+	}
+
+	/* keystreams are packed the same way, pad bits clear */
+	for (i = 0; i < sizeof(b->ks); i++) {
+		b->ks[i] = random();
+		if (i % BURST_BYTES == BURST_BYTES - 1) {
+			b->ks[i] &= 0xc0;
+		}
+	}
+	for (i = 0; i < sizeof(b->bursts); i++) {
+		b->bursts[i] ^= b->ks[i];
+	}
+}
+
+/* Expanded bursts, as process_ccch() stored them */
+static void unpacked_soft_bits(const struct block *b, const uint8_t *ks, int8_t *conv_data)
+{
+	uint8_t data[4*BURST_BITS];
+	int8_t deciphered[CONV_SIZE];
+	int8_t snr_amp;
+	unsigned i, j;
+
+	for (j = 0; j < 4; j++) {
+		expand_msb(&b->bursts[j*BURST_BYTES], &data[j*BURST_BITS], BURST_BITS);
+	}
+
+	for (j = 0; j < 4; j++) {
+		snr_amp = b->snr[j] >> 1;
+		for (i = 0; i < BURST_BITS; i++) {
+			uint8_t k = ks ? (ks[j*BURST_BYTES+i/8] >> (7-i%8)) & 1 : 0;
+
+			deciphered[j*BURST_BITS+i] = (data[j*BURST_BITS+i]^k ? -snr_amp : snr_amp);
+		}
+	}
+
+	gsm_deinter_sacch((uint8_t *) deciphered, (uint8_t *) conv_data);
+}
+
+static unsigned unpacked_ber(const struct block *b, const uint8_t *ks)
+{
+	uint8_t data[4*BURST_BITS];
+	uint8_t raw_coded[CONV_SIZE];
+	unsigned i, j, bit_errors = 0;
+
+	for (j = 0; j < 4; j++) {
+		expand_msb(&b->bursts[j*BURST_BYTES], &data[j*BURST_BITS], BURST_BITS);
+	}
+
+	encode_signalling(b->msg, raw_coded);
+
+	for (j = 0; j < 4; j++) {
+		for (i = 0; i < BURST_BITS; i++) {
+			uint8_t k = ks ? (ks[j*BURST_BYTES+i/8] >> (7-i%8)) & 1 : 0;
+
+			if ((raw_coded[j*BURST_BITS+i]^k) != data[j*BURST_BITS+i])
+				bit_errors++;
+		}
+	}
+
+	return bit_errors;
+}
+
+/* Hard bits of the 4 bursts of a block, as CS-4 takes them */
+static int check_hard_bits(const uint8_t *bursts)
+{
+	uint8_t data[4*BURST_BITS];
+	uint8_t ref[CONV_SIZE], out[CONV_SIZE];
+	unsigned j;
+
+	for (j = 0; j < 4; j++) {
+		expand_msb(&bursts[j*BURST_BYTES], &data[j*BURST_BITS], BURST_BITS);
+	}
+
+	gsm_deinter_sacch(data, ref);
+	gsm_deinter_sacch_packed(bursts, out);
+
+	return memcmp(ref, out, sizeof(ref));
+}
+
+/* Packed bursts, as process_ccch() stores them now */
+static void packed_soft_bits(const struct block *b, const uint8_t *ks, int8_t *conv_data)
+{
+	uint8_t deciphered[4*BURST_BYTES];
+	const uint8_t *bursts = b->bursts;
+	int8_t snr_amp[4];
+	unsigned i;
+
+	if (ks) {
+		for (i = 0; i < sizeof(deciphered); i++) {
+			deciphered[i] = b->bursts[i] ^ ks[i];
+		}
+		bursts = deciphered;
+	}
+
+	for (i = 0; i < 4; i++) {
+		snr_amp[i] = b->snr[i] >> 1;
+	}
+
+	gsm_deinter_soft(DEINTER_XCCH, bursts, snr_amp, conv_data);
+}
+
+static unsigned packed_ber(const struct block *b, const uint8_t *ks)
+{
+	uint8_t coded[4*BURST_BYTES];
+	unsigned i;
+
+	encode_signalling_packed(b->msg, coded);
+
+	if (ks) {
+		for (i = 0; i < sizeof(coded); i++) {
+			coded[i] ^= ks[i];
+		}
+	}
+
+	return bit_distance(coded, b->bursts, sizeof(coded));
+}
+
+static unsigned count = 100000;
+
+static const struct bench_opt opts[] = {
+	{ 'n', BENCH_UINT, &count, "<blocks>", "Number of blocks" },
+	{ 0 }
+};
+
+static int burst_main(int argc, char *argv[])
+{
+	struct block *blocks;
+	int8_t ref[CONV_SIZE], out[CONV_SIZE];
+	unsigned long ref_sum, sum;
+	uint64_t start, ref_cycles, new_cycles;
+	unsigned i, c;
+
+	if (bench_getopt(&burst_bench, argc, argv) != argc || !count) {
+		bench_usage(&burst_bench);
+	}
+
+	blocks = malloc(count * sizeof(*blocks));
+	if (!blocks) {
+		errx(1, "Cannot allocate %u blocks", count);
+	}
+
+	gsm_interleave_init();
+
+	srandom(1);
+	for (i = 0; i < count; i++) {
+		make_block(&blocks[i]);
+	}
+
+	/* Same soft bits and bit errors, with and without keystream */
+	for (i = 0; i < count; i++) {
+		for (c = 0; c < 2; c++) {
+			const uint8_t *ks = c ? blocks[i].ks : NULL;
+
+			unpacked_soft_bits(&blocks[i], ks, ref);
+			packed_soft_bits(&blocks[i], ks, out);
+			if (memcmp(ref, out, sizeof(ref))) {
+				printf("MISMATCH in soft bits of block %u%s\n", i, c ? " (ciphered)" : "");
+				return 1;
+			}
+			if (unpacked_ber(&blocks[i], ks) != packed_ber(&blocks[i], ks)) {
+				printf("MISMATCH in bit errors of block %u%s\n", i, c ? " (ciphered)" : "");
+				return 1;
+			}
+		}
+		if (check_hard_bits(blocks[i].bursts)) {
+			printf("MISMATCH in hard bits of block %u\n", i);
+			return 1;
+		}
+	}
+	printf("%u blocks checked\n", count);
+
+	/* Ciphered blocks, the costlier case */
+	ref_sum = sum = 0;
+	start = cycles();
+	for (i = 0; i < count; i++) {
+		unpacked_soft_bits(&blocks[i], blocks[i].ks, out);
+		ref_sum += out[i % CONV_SIZE];
+	}
+	ref_cycles = cycles() - start;
+
+	start = cycles();
+	for (i = 0; i < count; i++) {
+		packed_soft_bits(&blocks[i], blocks[i].ks, out);
+		sum += out[i % CONV_SIZE];
+	}
+	new_cycles = cycles() - start;
+
+	printf("%-16s %10u blocks %10.1f %s/block\n",
+		"soft unpacked", count, (double) ref_cycles / count, CYCLES_UNIT);
+	printf("%-16s %10u blocks %10.1f %s/block %6.1fx\n",
+		"soft packed", count, (double) new_cycles / count, CYCLES_UNIT, (double) ref_cycles / new_cycles);
+
+	start = cycles();
+	for (i = 0; i < count; i++) {
+		ref_sum += unpacked_ber(&blocks[i], blocks[i].ks);
+	}
+	ref_cycles = cycles() - start;
+
+	start = cycles();
+	for (i = 0; i < count; i++) {
+		sum += packed_ber(&blocks[i], blocks[i].ks);
+	}
+	new_cycles = cycles() - start;
+
+	printf("%-16s %10u blocks %10.1f %s/block\n",
+		"BER unpacked", count, (double) ref_cycles / count, CYCLES_UNIT);
+	printf("%-16s %10u blocks %10.1f %s/block %6.1fx\n",
+		"BER packed", count, (double) new_cycles / count, CYCLES_UNIT, (double) ref_cycles / new_cycles);
+
+	free(blocks);
+
+	if (ref_sum != sum) {
+		printf("MISMATCH\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+const struct bench_cmd burst_bench = {
+	.name = "burst",
+	.help = "Deciphering and deinterleaving bursts unpacked and packed",
+	.opts = opts,
+	.main = burst_main,
+};
@@ -21,5 +21,11 @@ struct l1ctl_burst_ind {
 
 #endif
 
+/* One burst of a burst_import file, sessions may interleave */
+struct burst_record {
+	uint32_t session;	/* network order, as the other fields */
+	struct l1ctl_burst_ind bi;
+} __attribute__((packed));
+
 #endif
 
@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <err.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "diag_input.h"
+#include "session.h"
+#include "process.h"
+#include "ccch.h"
+#include "output.h"
+#include "burst_desc.h"
+#include "stats.h"
+
+/*
+ * Runs files of struct burst_record through the L1 decoder, deinterleaving,
+ * deciphering, Viterbi and parity check, and on into the L3 handlers as
+ * diag_import does for decoded messages. Bursts of different sessions may
+ * interleave; each gets its own session_info, with the Kc of a key file.
+ */
+
+#define SESSION_HASH	1024
+
+struct burst_session {
+	uint32_t id;
+	struct session_info *s;
+	struct burst_session *next;
+};
+
+static struct burst_session *session_hash[SESSION_HASH];
+static unsigned session_count = 0;
+
+struct burst_key {
+	uint32_t id;
+	uint8_t kc[8];
+	uint8_t cipher;
+};
+
+static struct burst_key *keys = NULL;
+static unsigned key_count = 0;
+
+static int alloc_stats = 0;
+static int stats_output = STATS_NONE;
+
+static void usage(const char *progname, const char *reason)
+{
+	printf("%s\n", reason);
+	printf("Usage: %s [-s <id>] [-c <id>] [-k <keyfile>] [-b <blocks>] [filenames]\n", progname);
+	printf("	-s <id>       - First session_info ID to be used for SQL\n");
+	printf("	-c <id>       - First cell_info ID to be used for SQL\n");
+	printf("	-g <target>   - Target host for GSMTAP UDP stream\n");
+	printf("	-a <appid>    - Set appid to <appid> (in hex)\n");
+	printf("	-k <keyfile>  - Read Kc per session from <keyfile>, lines of\n");
+	printf("	                <session> <Kc in hex> [<A5 version if ciphered from the start>]\n");
+	printf("	-b <blocks>   - Blocks Viterbi decoded together (default %u)\n", metagsm_default_ctx()->ccch_batch);
+	printf("	-n            - Skip re-encoding decoded blocks to count bit errors\n");
+	printf("	-m            - Print message allocations and memory use to stderr\n");
+	printf("	-T <format>   - Print stage statistics as text or json to stderr,\n");
+	printf("	                at the end and on SIGUSR1\n");
+	printf("	[filenames]   - Read burst records from [filenames]\n");
+	exit(1);
+}
+
+static void read_keys(const char *filename)
+{
+	FILE *f;
+	char line[256];
+	char kc[17];
+	unsigned id, cipher, i, n;
+	int l = 0;
+
+	f = fopen(filename, "r");
+	if (!f) {
+		err(1, "Cannot open key file: %s", filename);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		++l;
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+
+		cipher = 0;
+		n = sscanf(line, "%u %16s %u", &id, kc, &cipher);
+		if (n < 2 || strlen(kc) != 16 || cipher > 3) {
+			errx(1, "Invalid key in %s:%d", filename, l);
+		}
+
+		keys = realloc(keys, (key_count + 1) * sizeof(*keys));
+		if (!keys) {
+			errx(1, "Cannot allocate keys");
+		}
+		keys[key_count].id = id;
+		for (i = 0; i < 8; i++) {
+			if (sscanf(&kc[2*i], "%2hhx", &keys[key_count].kc[i]) != 1) {
+				errx(1, "Invalid key in %s:%d", filename, l);
+			}
+		}
+		keys[key_count].cipher = cipher;
+		key_count++;
+	}
+
+	fclose(f);
+}
+
+static struct burst_key *find_key(uint32_t id)
+{
+	unsigned i;
+
+	for (i = 0; i < key_count; i++) {
+		if (keys[i].id == id) {
+			return &keys[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Session of a record, created on its first burst */
+static struct session_info *find_session(uint32_t id)
+{
+	struct metagsm_ctx *ctx = metagsm_default_ctx();
+	struct burst_session **bs = &session_hash[id % SESSION_HASH];
+	struct burst_key *key;
+	struct session_info *s;
+
+	while (*bs) {
+		if ((*bs)->id == id) {
+			return (*bs)->s;
+		}
+		bs = &(*bs)->next;
+	}
+
+	key = find_key(id);
+
+	s = session_create_ctx(ctx, -1, NULL, key ? key->kc : NULL, 0, 0, 0, 0, NULL);
+	if (!s) {
+		errx(1, "Cannot allocate session structure");
+	}
+	s->sql_callback = ctx->s[0].sql_callback;
+	s->appid = ctx->s[0].appid;
+	s->rat = RAT_GSM;
+	s->started = 1;
+	if (key) {
+		s->cipher = key->cipher;
+	}
+
+	*bs = malloc(sizeof(struct burst_session));
+	if (!*bs) {
+		errx(1, "Cannot allocate session structure");
+	}
+	(*bs)->id = id;
+	(*bs)->s = s;
+	(*bs)->next = NULL;
+	session_count++;
+
+	return s;
+}
+
+static void close_sessions()
+{
+	struct burst_session *bs;
+	unsigned i;
+
+	for (i = 0; i < SESSION_HASH; i++) {
+		while (session_hash[i]) {
+			bs = session_hash[i];
+			session_hash[i] = bs->next;
+
+			session_close(bs->s);
+			session_free(bs->s);
+			free(bs);
+		}
+	}
+}
+
+static uint64_t process_burst_file(const char *infile_name)
+{
+	struct burst_record *r;
+	struct stat st;
+	uint8_t *map;
+	uint64_t i, count;
+	int fd;
+
+	fd = open(infile_name, O_RDONLY);
+	if (fd < 0) {
+		err(1, "Cannot open input file: %s", infile_name);
+	}
+	if (fstat(fd, &st) < 0) {
+		err(1, "Cannot stat input file: %s", infile_name);
+	}
+	if (st.st_size % sizeof(struct burst_record)) {
+		errx(1, "Truncated burst record in %s", infile_name);
+	}
+	count = st.st_size / sizeof(struct burst_record);
+	if (!count) {
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		err(1, "Cannot map input file: %s", infile_name);
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	r = (struct burst_record *) map;
+	for (i = 0; i < count; i++) {
+		process_handle_burst(find_session(ntohl(r[i].session)), &r[i].bi);
+		net_poll();
+	}
+	net_flush();
+
+	munmap(map, st.st_size);
+	close(fd);
+
+	return count;
+}
+
+static void print_l1_stats(uint64_t bursts, double secs)
+{
+	struct metagsm_ctx *ctx = metagsm_default_ctx();
+	uint64_t decoded = ctx->l1_blocks - ctx->l1_failed;
+
+	fprintf(stderr, "%llu bursts of %u sessions in %.3f s, %.0f bursts/s\n",
+		(unsigned long long) bursts, session_count, secs, secs > 0 ? bursts / secs : 0);
+	fprintf(stderr, "%llu SDCCH/SACCH blocks, %llu decoded, %llu CRC failures (%.2f%%)\n",
+		(unsigned long long) ctx->l1_blocks,
+		(unsigned long long) decoded,
+		(unsigned long long) ctx->l1_failed,
+		ctx->l1_blocks ? 100.0 * ctx->l1_failed / ctx->l1_blocks : 0);
+	fprintf(stderr, "%llu FACCH blocks decoded\n", (unsigned long long) ctx->l1_facch);
+	if (ctx->l1_ber) {
+		fprintf(stderr, "%llu bit errors corrected by Viterbi, %.2f per block, BER %.4f\n",
+			(unsigned long long) ctx->l1_bit_errors,
+			decoded ? (double) ctx->l1_bit_errors / decoded : 0,
+			decoded ? (double) ctx->l1_bit_errors / (decoded * CONV_SIZE) : 0);
+	}
+}
+
+static void print_alloc_stats()
+{
+	struct metagsm_ctx *ctx = metagsm_default_ctx();
+	struct radio_msg_pool *pool = &ctx->msg_pool;
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	fprintf(stderr, "%llu messages, %llu allocated, %u peak in use, max RSS %ld kB\n",
+		(unsigned long long) pool->allocs,
+		(unsigned long long) pool->mallocs,
+		pool->peak, ru.ru_maxrss);
+}
+
+int main(int argc, char *argv[])
+{
+	struct metagsm_ctx *ctx;
+	char *gsmtap_target = NULL;
+	char *key_file = NULL;
+	uint32_t appid = 0;
+	unsigned sid = 0;
+	unsigned cid = 0;
+	unsigned batch = 0;
+	int no_ber = 0;
+	uint64_t bursts = 0;
+	double secs;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "s:c:g:a:k:b:nmT:")) != -1) {
+		switch (ch) {
+			case 's':
+				sid = atol(optarg);
+				break;
+			case 'c':
+				cid = atol(optarg);
+				break;
+			case 'g':
+				gsmtap_target = strdup(optarg);
+				break;
+			case 'a':
+				appid = strtol(optarg, (char **)NULL, 16);
+				break;
+			case 'k':
+				key_file = strdup(optarg);
+				break;
+			case 'b':
+				batch = atoi(optarg);
+				if (!batch) {
+					usage(argv[0], "Invalid batch size");
+				}
+				break;
+			case 'n':
+				no_ber = 1;
+				break;
+			case 'm':
+				alloc_stats = 1;
+				break;
+			case 'T':
+				stats_output = stats_parse_output(optarg);
+				if (stats_output < 0) {
+					usage(argv[0], "Invalid statistics format");
+				}
+				stats_signal_init();
+				break;
+			case '?':
+			default:
+				usage(argv[0], "Invalid arguments");
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc == 0)
+	{
+		errx(1, "Invalid arguments");
+	}
+
+	if (key_file)
+	{
+		read_keys(key_file);
+	}
+
+	printf("PARSER_OK\n");
+	fflush(stdout);
+
+	diag_init(sid, cid, gsmtap_target, NULL, appid);
+	process_init();
+
+	/* Sessions are closed here, not by the L3 handlers */
+	auto_reset = 0;
+
+	ctx = metagsm_default_ctx();
+	if (batch)
+	{
+		ctx->ccch_batch = batch;
+	}
+	ctx->l1_ber = !no_ber;
+	ctx->stats.output = stats_output;
+
+	secs = stats_secs();
+	while (argc > 0)
+	{
+		bursts += process_burst_file(argv[0]);
+		argc--;
+		argv++;
+	}
+	ccch_flush(ctx);
+	secs = stats_secs() - secs;
+
+	close_sessions();
+	diag_destroy(&sid, &cid);
+
+	print_l1_stats(bursts, secs);
+	if (alloc_stats)
+	{
+		print_alloc_stats();
+	}
+
+	return 0;
+}
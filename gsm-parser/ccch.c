@@ -1,4 +1,5 @@
 #include "cch.h"
+#include "ccch.h"
 #include "bit_func.h"
 #include "l3_handler.h"
 #include "gsm_interleave.h"
@@ -10,90 +11,266 @@
 #include <osmocom/gsm/a5.h>
 #include <assert.h>
 
-uint8_t compute_ber(struct session_info *s, struct radio_message *m)
+/*
+ * Keystreams for the 4 bursts of count blocks, generated together by
+ * algorithm. ks[b] holds the 4 packed keystreams of block b, all zero if
+ * its algorithm is not supported.
+ */
+static void ccch_keystream(unsigned count, const uint8_t **key, const uint8_t *cipher,
+			   struct radio_message **m, uint8_t (*ks)[4*BURST_BYTES])
 {
-	unsigned i, j, uplink;
-	unsigned bit_errors = 0;
-	uint8_t raw_coded[CONV_SIZE];
+	const uint8_t *keys[4*CCH_BATCH_MAX];
+	uint32_t fn[4*CCH_BATCH_MAX];
+	pbit_t dl[4*CCH_BATCH_MAX*BURST_BYTES];
+	pbit_t ul[4*CCH_BATCH_MAX*BURST_BYTES];
+	unsigned b, j, n, alg;
+	int have_dl, have_ul, uplink;
+
+	assert(count <= CCH_BATCH_MAX);
+
+	for (b = 0; b < count; b++) {
+		memset(ks[b], 0, sizeof(ks[b]));
+	}
 
-	encode_signalling(m->msg, raw_coded);
+	for (alg = 1; alg <= 2; alg++) {
+		n = 0;
+		have_dl = have_ul = 0;
+		for (b = 0; b < count; b++) {
+			if (cipher[b] != alg)
+				continue;
+			for (j = 0; j < 4; j++) {
+				keys[n] = key[b];
+				fn[n] = m[b]->bb.fn[j];
+				n++;
+			}
+			if (m[b]->bb.arfcn[0] & ARFCN_UPLINK)
+				have_ul = 1;
+			else
+				have_dl = 1;
+		}
+		if (!n)
+			continue;
+
+		osmo_a5_bulk(alg, keys, fn, n, have_dl ? dl : NULL, have_ul ? ul : NULL);
+
+		n = 0;
+		for (b = 0; b < count; b++) {
+			if (cipher[b] != alg)
+				continue;
+			uplink = !!(m[b]->bb.arfcn[0] & ARFCN_UPLINK);
+			memcpy(ks[b], (uplink ? ul : dl) + n*BURST_BYTES, 4*BURST_BYTES);
+			n += 4;
+		}
+	}
+}
 
-	uplink = !!(m->bb.arfcn[0] & ARFCN_UPLINK);
+uint8_t compute_ber(struct session_info *s, struct radio_message *m)
+{
+	unsigned j, bit_errors;
+	uint8_t coded[4*BURST_BYTES];
+	uint8_t ks[1][4*BURST_BYTES];
+	const uint8_t *key = s->key;
+
+	encode_signalling_packed(m->msg, coded);
 
 	if (m->flags & MSG_CIPHERED) {
-		uint8_t ks[114];
+		ccch_keystream(1, &key, &s->cipher, &m, ks);
 
-		for (j=0; j<4; j++) {
-			if (uplink)
-				osmo_a5(s->cipher, s->key, m->bb.fn[j], 0, ks);
-			else
-				osmo_a5(s->cipher, s->key, m->bb.fn[j], ks, 0);
+		for (j=0; j<sizeof(coded); j++) {
+			coded[j] ^= ks[0][j];
+		}
+	}
 
-			for (i=0; i<114; i++) {
-				if ((raw_coded[j*114+i]^ks[i]) != m->bb.data[j*114+i])
-					bit_errors++;
-			}
+	bit_errors = bit_distance(coded, m->bb.data, sizeof(coded));
+
+	return (bit_errors > CONV_SIZE/2 ? CONV_SIZE/2 : bit_errors);
+}
+
+/* Decipher with the packed keystream ks (or none) and deinterleave the 4 bursts of a block into soft bits */
+static void ccch_soft_bits(struct radio_message *m, const uint8_t *ks, int8_t *conv_data)
+{
+	unsigned i;
+	int8_t snr_amp[4];
+	uint8_t deciphered[4*BURST_BYTES];
+	const uint8_t *bursts = m->bb.data;
+
+	if (ks) {
+		for (i=0; i<sizeof(deciphered); i++) {
+			deciphered[i] = m->bb.data[i] ^ ks[i];
 		}
-	} else {
-		for (j=0; j<4; j++) {
-			for (i=0; i<114; i++) {
-				if (raw_coded[j*114+i] != m->bb.data[j*114+i])
-					bit_errors++;
-			}
+		bursts = deciphered;
+	}
+
+	for (i=0; i<4; i++) {
+		snr_amp[i] = m->bb.snr[i] >> 1;
+	}
+
+	gsm_deinter_soft(DEINTER_XCCH, bursts, snr_amp, conv_data);
+}
+
+/* Coded bits of a decoded block that differ from its bursts, ks as for ccch_soft_bits() */
+static unsigned ccch_bit_errors(struct radio_message *m, const uint8_t *ks)
+{
+	unsigned j;
+	uint8_t coded[4*BURST_BYTES];
+
+	encode_signalling_packed(m->msg, coded);
+
+	if (ks) {
+		for (j=0; j<sizeof(coded); j++) {
+			coded[j] ^= ks[j];
 		}
 	}
 
-	return (bit_errors > CONV_SIZE/2 ? CONV_SIZE/2 : bit_errors);
+	return bit_distance(coded, m->bb.data, sizeof(coded));
+}
+
+/* Hand a decoded block to the L3 handlers, drop a failed one */
+static void ccch_decoded(struct session_info *s, struct radio_message *m, const uint8_t *ks, int ret)
+{
+	struct metagsm_ctx *ctx = s->ctx;
+
+	ctx->l1_blocks++;
+
+	if (!ret) {
+		ctx->l1_failed++;
+		s->new_msg = NULL;
+		radio_msg_free(ctx, m);
+		return;
+	}
+
+	m->msg_len = 23;
+	m->rat = RAT_GSM;
+
+	if (ctx->l1_ber) {
+		ctx->l1_bit_errors += ccch_bit_errors(m, ks);
+	}
+
+	handle_radio_msg(s, m);
 }
 
 int try_decode(struct session_info *s, struct radio_message *m)
 {
-	int ret, uplink;
-	unsigned i, j;
-	int8_t snr_amp;
-	int8_t deciphered[CONV_SIZE];
+	int ret;
 	int8_t conv_data[CONV_SIZE];
-
-	uplink = !!(m->bb.arfcn[0] & ARFCN_UPLINK);
+	uint8_t ks[1][4*BURST_BYTES];
+	const uint8_t *key = s->key;
+	const uint8_t *block_ks = NULL;
 
 	if (m->flags & MSG_CIPHERED) {
-		uint8_t ks[114];
+		ccch_keystream(1, &key, &s->cipher, &m, ks);
+		block_ks = ks[0];
+	}
 
-		for (j=0; j<4; j++) {
-			if (uplink)
-				osmo_a5(s->cipher, s->key, m->bb.fn[j], 0, ks);
-			else
-				osmo_a5(s->cipher, s->key, m->bb.fn[j], ks, 0);
+	ccch_soft_bits(m, block_ks, conv_data);
 
-			snr_amp = m->bb.snr[j] >> 1;
-			for (i=0; i<114; i++) {
-				deciphered[j*114+i] = (m->bb.data[j*114+i]^ks[i] ? -snr_amp : snr_amp);
-			}
+	ret = decode_signalling(conv_data, m->msg);
+
+	ccch_decoded(s, m, block_ks, ret);
+
+	return ret;
+}
+
+/*
+ * Blocks of all channels and timeslots wait here for one batch keystream
+ * and Viterbi pass. A session has at most one block queued, as decoding it
+ * may change the cipher state used for its next block.
+ */
+void ccch_flush(struct metagsm_ctx *ctx)
+{
+	struct ccch_queue *q = ctx->ccch_queue;
+	uint8_t *msg[CCH_BATCH_MAX];
+	const uint8_t *key[CCH_BATCH_MAX];
+	uint8_t cipher[CCH_BATCH_MAX];
+	uint8_t ks[CCH_BATCH_MAX][4*BURST_BYTES];
+	int len[CCH_BATCH_MAX];
+	unsigned b, k;
+
+	if (!q || !q->count) {
+		return;
+	}
+
+	for (b = 0; b < q->count; b++) {
+		key[b] = q->key[b];
+		cipher[b] = (q->m[b]->flags & MSG_CIPHERED) ? q->cipher[b] : 0;
+	}
+
+	ccch_keystream(q->count, key, cipher, q->m, ks);
+
+	for (b = 0; b < q->count; b++) {
+		ccch_soft_bits(q->m[b], (q->m[b]->flags & MSG_CIPHERED) ? ks[b] : NULL, q->conv[b]);
+		for (k = 0; k < CONV_SIZE; k++) {
+			q->soft[k*q->count + b] = q->conv[b][k];
 		}
-	} else {
-		for (j=0; j<4; j++) {
-			snr_amp = m->bb.snr[j] >> 1;
-			for (i=0; i<114; i++) {
-				deciphered[j*114+i] = (m->bb.data[j*114+i] ? -snr_amp : snr_amp);
-			}
+		msg[b] = q->m[b]->msg;
+	}
+
+	decode_signalling_batch(q->soft, msg, len, q->count);
+
+	/* Same order as the bursts came in */
+	for (b = 0; b < q->count; b++) {
+		q->s[b]->new_msg = q->m[b];
+		ccch_decoded(q->s[b], q->m[b], (q->m[b]->flags & MSG_CIPHERED) ? ks[b] : NULL, len[b]);
+	}
+
+	q->count = 0;
+}
+
+/* Decode the queued block of s, if any, so that what comes next sees its result */
+void ccch_flush_session(struct session_info *s)
+{
+	struct ccch_queue *q = s->ctx->ccch_queue;
+	unsigned b;
+
+	if (!q) {
+		return;
+	}
+
+	for (b = 0; b < q->count; b++) {
+		if (q->s[b] == s) {
+			ccch_flush(s->ctx);
+			return;
 		}
 	}
+}
 
-	gsm_deinter_sacch((uint8_t*)deciphered, (uint8_t*)conv_data);
+static void ccch_queue_block(struct session_info *s, struct radio_message *m)
+{
+	struct metagsm_ctx *ctx = s->ctx;
+	struct ccch_queue *q = ctx->ccch_queue;
+	unsigned batch;
+
+	if (!q) {
+		q = (struct ccch_queue *) malloc(sizeof(struct ccch_queue));
+		if (!q) {
+			printf("Cannot allocate decoding queue\n");
+			exit(1);
+		}
+		q->count = 0;
+		ctx->ccch_queue = q;
+	}
 
-	ret = decode_signalling(conv_data, m->msg);
-	if (ret) {
-		m->flags |= MSG_DECODED;
-		m->msg_len = 23;
-		m->rat = RAT_GSM;
+	s->new_msg = m;
+
+	q->s[q->count] = s;
+	q->m[q->count] = m;
+	memcpy(q->key[q->count], s->key, sizeof(q->key[0]));
+	q->cipher[q->count] = s->cipher;
+	q->count++;
 
-		if (m->flags & MSG_SACCH)
-			handle_lapdm(s, &s->chan_sacch[uplink], &m->msg[2], 21, m->bb.fn[0], uplink);
-		else
-			handle_lapdm(s, &s->chan_sdcch[uplink], m->msg, 23, m->bb.fn[0], uplink);
+	batch = ctx->ccch_batch < CCH_BATCH_MAX ? ctx->ccch_batch : CCH_BATCH_MAX;
+	if (q->count >= batch) {
+		ccch_flush(ctx);
 	}
+}
 
-	return ret;
+void ccch_queue_free(struct metagsm_ctx *ctx)
+{
+	if (ctx->ccch_queue) {
+		assert(ctx->ccch_queue->count == 0);
+		free(ctx->ccch_queue);
+		ctx->ccch_queue = NULL;
+	}
 }
 
 uint8_t chan_burst_id(uint8_t chan_nr)
@@ -112,7 +289,8 @@ void process_ccch(struct session_info *s, struct burst_buf *bb, struct l1ctl_bur
 
 	assert(bb->count <= 3);
 
-	expand_msb(bi->bits, bb->data + bb->count * 114, 114);
+	memcpy(bb->data + bb->count * BURST_BYTES, bi->bits, BURST_BYTES);
+	bb->data[bb->count * BURST_BYTES + BURST_BYTES - 1] &= 0xc0;
 
 	fn = ntohl(bi->frame_nr);
 	arfcn = ntohs(bi->band_arfcn);
@@ -143,7 +321,7 @@ void process_ccch(struct session_info *s, struct burst_buf *bb, struct l1ctl_bur
 		return;
 
 	/* fill new message structure */
-	m = malloc(sizeof(struct radio_message));
+	m = radio_msg_alloc(s->ctx, 4 * BURST_BYTES);
 	m->chan_nr = bi->chan_nr;
 
 	if (bi->flags & BI_FLG_SACCH) {
@@ -152,17 +330,23 @@ void process_ccch(struct session_info *s, struct burst_buf *bb, struct l1ctl_bur
 		m->flags = MSG_SDCCH;
 	}
 
+	/* A queued Ciphering Mode Command of this session changes s->cipher */
+	ccch_flush_session(s);
+
 	if (s->cipher || (type && not_zero(s->key, 8)))
 		m->flags |= MSG_CIPHERED;
 
-	memcpy(&m->bb, bb, sizeof(*bb));
+	memcpy(&m->bb, bb, offsetof(struct burst_buf, data) + 4 * BURST_BYTES);
 
 	m->info[0] = 0;
 
-	s->new_msg = m;
-
 	/* ready for decoding */
-	try_decode(s, m);
+	if (s->ctx->ccch_batch > 1) {
+		ccch_queue_block(s, m);
+	} else {
+		s->new_msg = m;
+		try_decode(s, m);
+	}
 
 	/* reset burst buffer */
 	bb->count = 0;
@@ -1,7 +1,32 @@
 #ifndef _CCCH_H
 #define _CCCH_H
 
+#include <stdint.h>
+
+#include "cch.h"
+
+struct session_info;
+struct radio_message;
+struct burst_buf;
+struct l1ctl_burst_ind;
+struct metagsm_ctx;
+
+/* Blocks waiting for osmo_a5_bulk() and decode_signalling_batch() */
+struct ccch_queue {
+	struct session_info *s[CCH_BATCH_MAX];
+	struct radio_message *m[CCH_BATCH_MAX];
+	uint8_t key[CCH_BATCH_MAX][8];
+	uint8_t cipher[CCH_BATCH_MAX];
+	int8_t conv[CCH_BATCH_MAX][CONV_SIZE];
+	int8_t soft[CCH_BATCH_MAX * CONV_SIZE];
+	unsigned count;
+};
+
 int try_decode(struct session_info *s, struct radio_message *m);
 void process_ccch(struct session_info *s, struct burst_buf *bb, struct l1ctl_burst_ind *bi);
+int process_tch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *msg);
+void ccch_flush(struct metagsm_ctx *ctx);
+void ccch_flush_session(struct session_info *s);
+void ccch_queue_free(struct metagsm_ctx *ctx);
 
 #endif
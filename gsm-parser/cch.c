@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <string.h>
+#include <assert.h>
+#include <pthread.h>
 
 #include "cch.h"
 #include "crc.h"
@@ -32,6 +34,14 @@ static const unsigned char parity_remainder[PARITY_SIZE] = {
    1, 1, 1, 1, 1, 1, 1, 1
 };
 
+static struct parity_poly parity_fire;
+static pthread_once_t parity_once = PTHREAD_ONCE_INIT;
+
+static void parity_init(void)
+{
+	parity_poly_init(&parity_fire, parity_polynomial, parity_remainder, PARITY_SIZE);
+}
+
 /*
  * 	Decode a "common" control channel
  *
@@ -49,37 +59,50 @@ static const unsigned char parity_remainder[PARITY_SIZE] = {
  *
  */
 
-void encode_signalling(const uint8_t *msg, uint8_t *raw_data)
+static void encode_block(const uint8_t *msg, uint8_t *coded_data)
 {
 	uint8_t decoded_data[PARITY_OUTPUT_SIZE];
-	uint8_t coded_data[CONV_SIZE];
 
 	expand_lsb(msg, decoded_data, DATA_BLOCK_SIZE);
 
 	memset(&decoded_data[DATA_BLOCK_SIZE], 0, CONV_INPUT_SIZE-DATA_BLOCK_SIZE);
 
-        parity_encode(decoded_data, DATA_BLOCK_SIZE, parity_polynomial,
-		 	&decoded_data[DATA_BLOCK_SIZE], PARITY_SIZE);
+	pthread_once(&parity_once, parity_init);
+
+	parity_poly_encode(&parity_fire, decoded_data, DATA_BLOCK_SIZE, &decoded_data[DATA_BLOCK_SIZE]);
 
 	conv_cch_encode(decoded_data, coded_data, PARITY_OUTPUT_SIZE);
+}
+
+void encode_signalling(const uint8_t *msg, uint8_t *raw_data)
+{
+	uint8_t coded_data[CONV_SIZE];
+
+	encode_block(msg, coded_data);
 
 	gsm_inter_sacch(coded_data, raw_data);
 }
 
-int decode_signalling(const int8_t *soft_data, uint8_t *msg)
+/* Same, as 4 packed bursts */
+void encode_signalling_packed(const uint8_t *msg, uint8_t *bursts)
+{
+	uint8_t coded_data[CONV_SIZE];
+
+	encode_block(msg, coded_data);
+
+	gsm_inter_sacch_packed(coded_data, bursts);
+}
+
+/* Parity check and FIRE correction of a Viterbi decoded block */
+static int signalling_check(uint8_t *decoded_data, uint8_t *msg)
 {
 	int ret;
-	uint8_t decoded_data[PARITY_OUTPUT_SIZE];
 	FC_CTX fc_ctx;
 
-	// soft_data: 0 -> 127, 1-> -127
-
-	/* Viterbi decoding */
-	conv_cch_decode((int8_t *) soft_data, decoded_data, CONV_INPUT_SIZE);
+	pthread_once(&parity_once, parity_init);
 
 	/* parity check: if error detected try to fix it */
-	ret = parity_check(decoded_data, DATA_BLOCK_SIZE, parity_polynomial,
-			   parity_remainder, PARITY_SIZE);
+	ret = parity_poly_check(&parity_fire, decoded_data, DATA_BLOCK_SIZE);
 	if (ret) {
 		FC_init(&fc_ctx, PARITY_SIZE, DATA_BLOCK_SIZE);
 		unsigned char crc_result[DATA_BLOCK_SIZE + PARITY_SIZE];
@@ -95,3 +118,37 @@ int decode_signalling(const int8_t *soft_data, uint8_t *msg)
 	return 23;
 }
 
+int decode_signalling(const int8_t *soft_data, uint8_t *msg)
+{
+	uint8_t decoded_data[PARITY_OUTPUT_SIZE];
+
+	// soft_data: 0 -> 127, 1-> -127
+
+	/* Viterbi decoding */
+	conv_cch_decode((int8_t *) soft_data, decoded_data, CONV_INPUT_SIZE);
+
+	return signalling_check(decoded_data, msg);
+}
+
+/*
+ * Decode count blocks at once, soft bit k of block b is soft_data[k*count + b].
+ * Message b goes to msg[b], its length (23 or 0) to len[b].
+ */
+void decode_signalling_batch(const int8_t *soft_data, uint8_t **msg, int *len, int count)
+{
+	uint8_t decoded_data[CCH_BATCH_MAX][PARITY_OUTPUT_SIZE];
+	uint8_t *out[CCH_BATCH_MAX];
+	int b;
+
+	assert(count <= CCH_BATCH_MAX);
+
+	for (b = 0; b < count; b++) {
+		out[b] = decoded_data[b];
+	}
+
+	conv_cch_decode_batch(soft_data, out, CONV_INPUT_SIZE, count);
+
+	for (b = 0; b < count; b++) {
+		len[b] = signalling_check(decoded_data[b], msg[b]);
+	}
+}
@@ -11,7 +11,12 @@
 #define CONV_INPUT_SIZE		PARITY_OUTPUT_SIZE
 #define CONV_SIZE		(2 * CONV_INPUT_SIZE)
 
+/* Most blocks in one decode_signalling_batch() call */
+#define CCH_BATCH_MAX		32
+
 void encode_signalling(const uint8_t *msg, uint8_t *raw_data);
+void encode_signalling_packed(const uint8_t *msg, uint8_t *bursts);
 int decode_signalling(const int8_t *soft_data, uint8_t *sig_msg);
+void decode_signalling_batch(const int8_t *soft_data, uint8_t **sig_msg, int *len, int count);
 
 #endif
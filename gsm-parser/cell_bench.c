@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+#include <osmocom/gsm/protocol/gsm_04_08.h>
+
+#include "session.h"
+#include "cell_info.h"
+#include "bench.h"
+
+/*
+ * Feeds a synthetic stream of SI1, SI2, SI3 and SI4 messages for a
+ * number of cells through handle_sysinfo(), once with the cell hashes
+ * and once scanning cell_list, and checks that both runs end up with
+ * the same cells.
+ */
+
+#define SI_TYPES 4
+
+static const uint8_t si_types[SI_TYPES] = {
+	GSM48_MT_RR_SYSINFO_1,
+	GSM48_MT_RR_SYSINFO_2,
+	GSM48_MT_RR_SYSINFO_3,
+	GSM48_MT_RR_SYSINFO_4,
+};
+
+struct si_msg {
+	uint8_t l2_plen;
+	uint8_t proto;
+	uint8_t msg_type;
+	uint8_t data[20];
+} __attribute__((packed));
+
+static void make_si(struct si_msg *si, unsigned cell, int type)
+{
+	unsigned i;
+
+	memset(si, 0x2b, sizeof(*si));
+	si->l2_plen = (sizeof(*si) - 1) << 2 | 1;
+	si->proto = GSM48_PDISC_RR;
+	si->msg_type = si_types[type];
+
+	switch (si->msg_type) {
+	case GSM48_MT_RR_SYSINFO_1:
+	case GSM48_MT_RR_SYSINFO_2:
+		/* Bit map 0 frequency list and RACH control */
+		for (i = 0; i < 19; i++) {
+			si->data[i] = random();
+		}
+		si->data[0] &= 0x0f;
+		break;
+	case GSM48_MT_RR_SYSINFO_3:
+		/* Cell identity, LAI, control channel, options, selection, RACH */
+		si->data[0] = cell >> 8;
+		si->data[1] = cell;
+		si->data[2] = 0x62;
+		si->data[3] = 0xf2;
+		si->data[4] = 0x10;
+		si->data[5] = cell >> 12;
+		si->data[6] = random();
+		for (i = 7; i < 16; i++) {
+			si->data[i] = random();
+		}
+		break;
+	case GSM48_MT_RR_SYSINFO_4:
+		/* LAI, selection, RACH */
+		si->data[0] = 0x62;
+		si->data[1] = 0xf2;
+		si->data[2] = 0x10;
+		si->data[3] = cell >> 12;
+		for (i = 4; i < 10; i++) {
+			si->data[i] = random();
+		}
+		si->data[4] = cell;
+		si->data[5] = cell >> 8;
+		break;
+	}
+}
+
+static uint32_t cell_checksum(struct metagsm_ctx *ctx, unsigned *count)
+{
+	struct cell_info *ci;
+	uint32_t sum = 0;
+	int i;
+
+	*count = 0;
+	llist_for_each_entry(ci, &ctx->cell_list, entry) {
+		sum = sum * 31 + ci->id;
+		sum = sum * 31 + ci->mcc * 1000 + ci->mnc;
+		sum = sum * 31 + (ci->lac << 16 | ci->cid);
+		for (i = 0; i < SI_MAX; i++) {
+			sum = sum * 31 + ci->si_counter[i];
+		}
+		(*count)++;
+	}
+
+	return sum;
+}
+
+static double run(struct si_msg *stream, unsigned count, int hashed, uint32_t *sum, unsigned *cells)
+{
+	struct metagsm_ctx *ctx;
+	struct radio_message m;
+	struct session_info *s;
+	unsigned last_cid;
+	double secs;
+	unsigned i;
+
+	ctx = metagsm_ctx_alloc();
+	session_init_ctx(ctx, 0, 0, NULL, CALLBACK_NONE);
+	cell_init_ctx(ctx, 0, 1, CALLBACK_NONE);
+	if (!hashed) {
+		free(ctx->cell_cid_hash);
+		free(ctx->cell_si_hash);
+		ctx->cell_cid_hash = NULL;
+		ctx->cell_si_hash = NULL;
+	}
+
+	s = &ctx->s[0];
+	memset(&m, 0, sizeof(m));
+	m.flags = MSG_BCCH | MSG_DECODED;
+	s->new_msg = &m;
+
+	secs = stats_secs();
+	for (i = 0; i < count; i++) {
+		m.timestamp.tv_sec = i;
+		handle_sysinfo(s, (struct gsm48_hdr *) &stream[i].proto, sizeof(stream[i]) - 1);
+	}
+	secs = stats_secs() - secs;
+
+	*sum = cell_checksum(ctx, cells);
+
+	s->new_msg = NULL;
+	cell_destroy_ctx(ctx, &last_cid);
+	metagsm_ctx_free(ctx);
+
+	return secs;
+}
+
+static unsigned cells = 10000;
+static unsigned rounds = 3;
+
+static const struct bench_opt opts[] = {
+	{ 'n', BENCH_UINT, &cells, "<cells>", "Number of cells on air" },
+	{ 'r', BENCH_UINT, &rounds, "<rounds>", "Times every SI message is repeated" },
+	{ 0 }
+};
+
+static int cell_main(int argc, char *argv[])
+{
+	struct si_msg *stream;
+	unsigned count, i, j;
+	unsigned scan_cells, hash_cells;
+	uint32_t scan_sum, hash_sum;
+	double scan_secs, hash_secs;
+
+	if (bench_getopt(&cell_bench, argc, argv) != argc || !cells || !rounds) {
+		bench_usage(&cell_bench);
+	}
+
+	/* Every round repeats the same messages, cells in random order */
+	count = cells * SI_TYPES * rounds;
+	stream = malloc(count * sizeof(struct si_msg));
+	if (!stream) {
+		errx(1, "Cannot allocate %u messages", count);
+	}
+
+	srandom(1);
+	for (i = 0; i < cells * SI_TYPES; i++) {
+		make_si(&stream[i], i / SI_TYPES, i % SI_TYPES);
+	}
+	for (i = cells * SI_TYPES - 1; i > 0; i--) {
+		struct si_msg tmp;
+
+		j = random() % (i + 1);
+		tmp = stream[i];
+		stream[i] = stream[j];
+		stream[j] = tmp;
+	}
+	for (i = 1; i < rounds; i++) {
+		memcpy(&stream[i * cells * SI_TYPES], stream, cells * SI_TYPES * sizeof(struct si_msg));
+	}
+
+	scan_secs = run(stream, count, 0, &scan_sum, &scan_cells);
+	printf("%-16s %10u messages %8u cells %8.3f s %10.0f msg/s\n",
+		"list scan", count, scan_cells, scan_secs, count / scan_secs);
+
+	hash_secs = run(stream, count, 1, &hash_sum, &hash_cells);
+	printf("%-16s %10u messages %8u cells %8.3f s %10.0f msg/s\n",
+		"hashed", count, hash_cells, hash_secs, count / hash_secs);
+
+	free(stream);
+
+	if (scan_sum != hash_sum || scan_cells != hash_cells) {
+		printf("MISMATCH\n");
+		return 1;
+	}
+
+	printf("speedup %.1fx\n", scan_secs / hash_secs);
+
+	return 0;
+}
+
+const struct bench_cmd cell_bench = {
+	.name = "cell",
+	.help = "SI messages through the cell hashes and a cell_list scan",
+	.opts = opts,
+	.main = cell_main,
+};
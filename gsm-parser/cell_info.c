@@ -15,13 +15,13 @@
 #include "sqlite_api.h"
 #endif
 
-#define MASK_BCCH	0x01
-#define MASK_NEIGH_2	0x02
-#define MASK_NEIGH_2b	0x04
-#define MASK_NEIGH_2t	0x08
-#define MASK_NEIGH_5	0x10
-#define MASK_NEIGH_5b	0x20
-#define MASK_NEIGH_5t	0x40
+#define MASK_BCCH	(1 << ARFCN_BCCH)
+#define MASK_NEIGH_2	(1 << ARFCN_NEIGH_2)
+#define MASK_NEIGH_2b	(1 << ARFCN_NEIGH_2b)
+#define MASK_NEIGH_2t	(1 << ARFCN_NEIGH_2t)
+#define MASK_NEIGH_5	(1 << ARFCN_NEIGH_5)
+#define MASK_NEIGH_5b	(1 << ARFCN_NEIGH_5b)
+#define MASK_NEIGH_5t	(1 << ARFCN_NEIGH_5t)
 
 #ifndef SQLITE_QUERY
 #define SQLITE_QUERY 0
@@ -41,28 +41,6 @@
 #include <osmocom/gsm/gsm48_ie.h>
 #include <osmocom/gsm/protocol/gsm_04_08.h>
 
-static unsigned cell_info_id;
-static struct llist_head cell_list;
-static unsigned output_sqlite = 1;
-static uint32_t previous_ts = 0;
-static struct session_info s;
-unsigned paging_count[3];
-unsigned paging_imsi;
-unsigned paging_tmsi;
-unsigned paging_null;
-
-enum si_index {
-	SI1 = 0,
-	SI2, SI2b, SI2t, SI2q,
-	SI3,
-	SI4,
-	SI5, SI5b, SI5t,
-	SI6,
-	SI13,
-
-	SI_MAX
-};
-
 const char * si_name[] = {
 	"SI1",
 	"SI2", "SI2b", "SI2t", "SI2q",
@@ -73,93 +51,115 @@ const char * si_name[] = {
 	"SI13"
 };
 
-struct cell_info {
-	uint32_t id;
-	uint8_t stored;
-	struct timeval first_seen;
-	struct timeval last_seen;
-	/* DIAG or Android */
-	uint16_t mcc;
-	uint16_t mnc;
-	uint16_t lac;
-	uint32_t cid;
-	uint16_t rat;
-	uint16_t bcch_arfcn;
-	int c1;
-	int c2;
-	uint32_t power_sum;
-	uint32_t power_count;
-	/* SI3 */
-	uint8_t msc_ver;
-	uint8_t combined;
-	uint8_t agch_blocks;
-	uint8_t pag_mframes;
-	uint8_t t3212;
-	uint8_t dtx;
-	/* SI3 & SI4 */
-	uint8_t cro;
-	uint8_t temp_offset;
-	uint8_t pen_time;
-	uint8_t pwr_offset;
-	uint8_t gprs;
-
-	struct gsm_sysinfo_freq arfcn_list[1024];
-
-	uint32_t si_counter[SI_MAX];
-	uint8_t si_data[SI_MAX][20];
-	uint16_t a_count[SI_MAX];
-
-	struct llist_head entry;
-} __attribute__((packed));
-
-void cell_make_sql(struct cell_info *ci, char *query, unsigned len, int sqlite);
-void arfcn_list_make_sql(struct cell_info *ci, enum si_index index, char *query, unsigned len, int sqlite);
-void paging_make_sql(unsigned epoch_now, char *query, unsigned len, int sqlite);
-
-static void paging_reset()
+void cell_make_sql(struct metagsm_ctx *ctx, struct cell_info *ci, char *query, unsigned len, int sqlite);
+unsigned arfcn_list_make_sql(struct metagsm_ctx *ctx, struct cell_info *ci, enum si_index index, char *query, unsigned len, int sqlite);
+void paging_make_sql(struct metagsm_ctx *ctx, unsigned epoch_now, char *query, unsigned len, int sqlite);
+
+static void cell_hash_reset(struct metagsm_ctx *ctx)
 {
-	paging_count[0] = 0;
-	paging_count[1] = 0;
-	paging_count[2] = 0;
-	paging_imsi = 0;
-	paging_tmsi = 0;
+	if (!ctx->cell_cid_hash) {
+		ctx->cell_cid_hash = calloc(CELL_HASH_SIZE, sizeof(struct cell_info *));
+		ctx->cell_si_hash = calloc(CELL_SI_HASH_SIZE, sizeof(struct cell_si_ref *));
+		assert(ctx->cell_cid_hash && ctx->cell_si_hash);
+	} else {
+		memset(ctx->cell_cid_hash, 0, CELL_HASH_SIZE * sizeof(struct cell_info *));
+		memset(ctx->cell_si_hash, 0, CELL_SI_HASH_SIZE * sizeof(struct cell_si_ref *));
+	}
+	memset(ctx->cell_si_len, 0, sizeof(ctx->cell_si_len));
 }
 
-void cell_and_paging_dump(uint32_t timestamp, int forced, int on_destroy)
+static void cell_hash_free(struct metagsm_ctx *ctx)
+{
+	free(ctx->cell_cid_hash);
+	free(ctx->cell_si_hash);
+	ctx->cell_cid_hash = NULL;
+	ctx->cell_si_hash = NULL;
+}
+
+static void paging_reset(struct metagsm_ctx *ctx)
+{
+	ctx->paging_count[0] = 0;
+	ctx->paging_count[1] = 0;
+	ctx->paging_count[2] = 0;
+	ctx->paging_imsi = 0;
+	ctx->paging_tmsi = 0;
+}
+
+/* Rows a dump of every cell would write for this one */
+static unsigned cell_rows(struct cell_info *ci)
+{
+	unsigned rows = 1;
+	int i;
+
+	for (i = 0; i < SI_MAX; i++) {
+		if (si_arfcn_source(i) >= 0 && ci->si_counter[i]) {
+			rows += ci->a_count[i];
+		}
+	}
+
+	return rows;
+}
+
+void cell_and_paging_dump_ctx(struct metagsm_ctx *ctx, uint32_t timestamp, int forced, int on_destroy)
 {
 	char query[8192];
 	struct cell_info *ci, *ci2;
 	unsigned time_delta;
+	unsigned rows, written;
 	int i;
 
 	/* Elapsed time from measurement start */
-	time_delta = timestamp - previous_ts;
+	time_delta = timestamp - ctx->previous_ts;
 
 	/* Handle large out of sequence messages */
 	if (time_delta > 86400) {
-		previous_ts = timestamp;
+		ctx->previous_ts = timestamp;
 		return;
 	}
 
 	if (!forced && RATE_LIMIT && (time_delta < DUMP_INTERVAL))
 		return;
 
-	/* Dump cell_info and arfcn_list */
-	llist_for_each_entry_safe(ci, ci2, &cell_list, entry) {
-		/* Store main cell_info */
-		cell_make_sql(ci, query, sizeof(query), output_sqlite);
-		if (s.sql_callback && strlen(query))
-			(*s.sql_callback)(query);
-
-		/* Append queries for ARFCN storage */
-		for (i = 0; i < SI_MAX; i++) {
-			arfcn_list_make_sql(ci, i, query, sizeof(query), output_sqlite);
-			if (s.sql_callback && strlen(query)) {
-				(*s.sql_callback)(query);
+	/* Dump cell_info and arfcn_list rows changed since the last dump */
+	llist_for_each_entry_safe(ci, ci2, &ctx->cell_list, entry) {
+		if (ctx->cell_full_dump) {
+			ci->dirty = 1;
+			ci->si_dirty = (1 << SI_MAX) - 1;
+			memset(ci->arfcn_stored, 0, sizeof(ci->arfcn_stored));
+		}
+
+		rows = cell_rows(ci);
+		if (!ci->dirty) {
+			ctx->cell_rows_avoided += rows;
+			continue;
+		}
+
+#ifdef USE_SQLITE
+		if (ctx->output_stmt) {
+			written = sqlite_api_cell(ctx, ci);
+		} else
+#endif
+		{
+			/* Store main cell_info */
+			cell_make_sql(ctx, ci, query, sizeof(query), ctx->cell_output_sqlite);
+			cell_sql(ctx, query);
+			written = 1;
+
+			/* Append queries for ARFCN storage */
+			for (i = 0; i < SI_MAX; i++) {
+				if (ci->si_dirty & (1 << i)) {
+					written += arfcn_list_make_sql(ctx, ci, i, query, sizeof(query), ctx->cell_output_sqlite);
+					cell_sql(ctx, query);
+				}
 			}
 		}
 
+		ctx->cell_rows += written;
+		ctx->cell_rows_avoided += rows - written;
+
 		ci->stored = 1;
+		ci->dirty = 0;
+		ci->si_dirty = 0;
 		//llist_del(&ci->entry);
                 /*
                  * FIXME: Elements should be deallocated on deletion. However,
@@ -170,30 +170,43 @@ void cell_and_paging_dump(uint32_t timestamp, int forced, int on_destroy)
 	}
 
 	/* dump paging info */
-	if (timestamp) {
-		paging_make_sql(timestamp, query, sizeof(query), output_sqlite);
-	} else {
-		paging_make_sql(previous_ts, query, sizeof(query), output_sqlite);
-	}
-	if (s.sql_callback && strlen(query)) {
-		(*s.sql_callback)(query);
+#ifdef USE_SQLITE
+	if (ctx->output_stmt) {
+		sqlite_api_paging(ctx, timestamp ? timestamp : ctx->previous_ts);
+	} else
+#endif
+	{
+		if (timestamp) {
+			paging_make_sql(ctx, timestamp, query, sizeof(query), ctx->cell_output_sqlite);
+		} else {
+			paging_make_sql(ctx, ctx->previous_ts, query, sizeof(query), ctx->cell_output_sqlite);
+		}
+		cell_sql(ctx, query);
 	}
 
 	/* Destroy event */
 	if (on_destroy) {
-		llist_for_each_entry_safe(ci, ci2, &cell_list, entry) {
+		llist_for_each_entry_safe(ci, ci2, &ctx->cell_list, entry) {
 			llist_del(&ci->entry);
 			free(ci);
 		}
+		if (ctx->cell_cid_hash) {
+			cell_hash_reset(ctx);
+		}
 	}
 
 	/* reset counters */
-	paging_reset();
+	paging_reset(ctx);
 
-	previous_ts = timestamp;
+	ctx->previous_ts = timestamp;
 }
 
-static void console_callback(const char *sql)
+void cell_and_paging_dump(uint32_t timestamp, int forced, int on_destroy)
+{
+	cell_and_paging_dump_ctx(metagsm_default_ctx(), timestamp, forced, on_destroy);
+}
+
+static void console_callback(struct metagsm_ctx *ctx __attribute__((unused)), const char *sql)
 {
 	assert(sql != NULL);
 
@@ -201,30 +214,55 @@ static void console_callback(const char *sql)
 	fflush(stdout);
 }
 
-void cell_init(unsigned start_id, uint32_t unix_time, int callback)
+static void spool_callback(struct metagsm_ctx *ctx __attribute__((unused)), const char *sql)
+{
+	session_spool(SQL_ID_CELL, sql);
+}
+
+void cell_sql(struct metagsm_ctx *ctx, const char *sql)
 {
-	INIT_LLIST_HEAD(&cell_list);
+	if (ctx->cell_sql_callback && strlen(sql)) {
+		uint64_t t = stats_begin(&ctx->stats, STAGE_SQL_SINK);
+
+		(*ctx->cell_sql_callback)(ctx, sql);
 
-	paging_reset();
+		stats_end(&ctx->stats, STAGE_SQL_SINK, t);
+	}
+}
+
+void cell_init_ctx(struct metagsm_ctx *ctx, unsigned start_id, uint32_t unix_time, int callback)
+{
+	struct session_info s;
+
+	INIT_LLIST_HEAD(&ctx->cell_list);
+	cell_hash_reset(ctx);
+
+	paging_reset(ctx);
 
 	if (unix_time) {
-		previous_ts = unix_time;
+		ctx->previous_ts = unix_time;
 	} else {
 		struct timeval t1;
 
 		gettimeofday(&t1, NULL);
 
-		previous_ts = t1.tv_sec;
+		ctx->previous_ts = t1.tv_sec;
 	}
 
-	cell_info_id = start_id;
+	ctx->cell_info_id = start_id;
+	ctx->cell_rows = 0;
+	ctx->cell_rows_avoided = 0;
+
+	/* The output modules set up the callback of a session */
+	memset(&s, 0, sizeof(s));
+	s.ctx = ctx;
 
 	switch (callback) {
 	case CALLBACK_NONE:
 		break;
 #ifdef USE_MYSQL
 	case CALLBACK_MYSQL:
-		output_sqlite = 0;
+		ctx->cell_output_sqlite = 0;
 		mysql_api_init(&s);
 		break;
 #endif
@@ -236,13 +274,33 @@ void cell_init(unsigned start_id, uint32_t unix_time, int callback)
 	case CALLBACK_CONSOLE:
 		s.sql_callback = console_callback;
 		break;
+	case CALLBACK_SPOOL:
+		/* Same SQL dialect as the output it is replayed to */
+#ifdef USE_MYSQL
+		ctx->cell_output_sqlite = 0;
+#endif
+		s.sql_callback = spool_callback;
+		break;
 	}
+
+	ctx->cell_sql_callback = s.sql_callback;
+}
+
+void cell_init(unsigned start_id, uint32_t unix_time, int callback)
+{
+	cell_init_ctx(metagsm_default_ctx(), start_id, unix_time, callback);
+}
+
+void cell_destroy_ctx(struct metagsm_ctx *ctx, unsigned *last_cid)
+{
+	cell_and_paging_dump_ctx(ctx, 0, 1, 1);
+	cell_hash_free(ctx);
+	*last_cid = ctx->cell_info_id;
 }
 
 void cell_destroy(unsigned *last_cid)
 {
-	cell_and_paging_dump(0, 1, 1);
-	*last_cid = cell_info_id;
+	cell_destroy_ctx(metagsm_default_ctx(), last_cid);
 }
 
 uint16_t get_mcc(uint8_t *digits)
@@ -329,9 +387,124 @@ uint8_t si_mask(enum si_index index)
 	return 0;
 }
 
-struct cell_info * get_from_si(uint8_t msg_type, uint8_t *data, uint8_t len)
+/* Index into arfcn_list, -1 for SI types without a frequency list */
+int si_arfcn_source(enum si_index index)
+{
+	uint8_t mask = si_mask(index);
+
+	if (!mask) {
+		return -1;
+	}
+
+	return __builtin_ctz(mask);
+}
+
+static uint32_t cid_key(uint16_t mcc, uint16_t mnc, uint16_t lac, uint32_t cid)
+{
+	uint32_t hash = 2166136261u;
+
+	hash = (hash ^ mcc) * 16777619u;
+	hash = (hash ^ mnc) * 16777619u;
+	hash = (hash ^ lac) * 16777619u;
+	hash = (hash ^ cid) * 16777619u;
+
+	return hash ^ (hash >> 15);
+}
+
+static uint32_t si_key(int index, uint8_t *data, unsigned len)
+{
+	uint32_t hash = 2166136261u;
+	unsigned i;
+
+	hash = (hash ^ index) * 16777619u;
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+
+	return hash ^ (hash >> 15);
+}
+
+static void cell_hash_cid(struct metagsm_ctx *ctx, struct cell_info *ci)
+{
+	struct cell_info **pos;
+	uint32_t hash;
+
+	hash = cid_key(ci->mcc, ci->mnc, ci->lac, ci->cid);
+	if (ci->cid_hashed && ci->cid_hash == hash) {
+		return;
+	}
+
+	if (ci->cid_hashed) {
+		pos = &ctx->cell_cid_hash[ci->cid_hash % CELL_HASH_SIZE];
+		while (*pos != ci) {
+			pos = &(*pos)->cid_next;
+		}
+		*pos = ci->cid_next;
+	}
+
+	pos = &ctx->cell_cid_hash[hash % CELL_HASH_SIZE];
+	ci->cid_hash = hash;
+	ci->cid_next = *pos;
+	ci->cid_hashed = 1;
+	*pos = ci;
+}
+
+static void cell_hash_si(struct metagsm_ctx *ctx, struct cell_info *ci, int index, unsigned len)
+{
+	struct cell_si_ref *ref = &ci->si_ref[index];
+	struct cell_si_ref **pos;
+	uint32_t hash;
+
+	hash = si_key(index, ci->si_data[index], len);
+	if (ref->hashed && ref->hash == hash && ref->len == len) {
+		return;
+	}
+
+	if (ref->hashed) {
+		pos = &ctx->cell_si_hash[ref->hash % CELL_SI_HASH_SIZE];
+		while (*pos != ref) {
+			pos = &(*pos)->next;
+		}
+		*pos = ref->next;
+	}
+
+	pos = &ctx->cell_si_hash[hash % CELL_SI_HASH_SIZE];
+	ref->ci = ci;
+	ref->hash = hash;
+	ref->index = index;
+	ref->len = len;
+	ref->hashed = 1;
+	ref->next = *pos;
+	*pos = ref;
+
+	/* Hash lookups need the same data length on every cell */
+	if (!ctx->cell_si_len[index]) {
+		ctx->cell_si_len[index] = len;
+	} else if (ctx->cell_si_len[index] != len) {
+		ctx->cell_si_len[index] = 0xff;
+	}
+}
+
+static int is_zero(uint8_t *data, unsigned len)
+{
+	unsigned i;
+
+	for (i = 0; i < len; i++) {
+		if (data[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Both lookups return the most recently added match, as a scan of
+ * cell_list would */
+struct cell_info * get_from_si(struct metagsm_ctx *ctx, uint8_t msg_type, uint8_t *data, uint8_t len)
 {
 	struct cell_info *ci = NULL;
+	struct cell_si_ref *ref;
+	uint32_t hash;
 	int index;
 
 	assert(data != NULL);
@@ -342,23 +515,56 @@ struct cell_info * get_from_si(uint8_t msg_type, uint8_t *data, uint8_t len)
 		return 0;
 	}
 
-	llist_for_each_entry(ci, &cell_list, entry) {
-		if (!memcmp(ci->si_data[index], data, len)) {
-			return ci;
+	/* Zeroed data also matches cells that never had this SI type, and
+	 * data of another length compares by prefix, so scan the list */
+	if (!ctx->cell_si_hash || is_zero(data, len) ||
+	    (ctx->cell_si_len[index] && ctx->cell_si_len[index] != len)) {
+		llist_for_each_entry(ci, &ctx->cell_list, entry) {
+			if (!memcmp(ci->si_data[index], data, len)) {
+				return ci;
+			}
 		}
+		return 0;
 	}
 
-	return 0;
+	hash = si_key(index, data, len);
+	for (ref = ctx->cell_si_hash[hash % CELL_SI_HASH_SIZE]; ref; ref = ref->next) {
+		if (ref->hash != hash || ref->index != index) {
+			continue;
+		}
+		if (memcmp(ref->ci->si_data[index], data, len)) {
+			continue;
+		}
+		if (!ci || ref->ci->id > ci->id) {
+			ci = ref->ci;
+		}
+	}
+
+	return ci;
 }
 
 struct cell_info * get_from_cid(struct session_info *s)
 {
 	struct cell_info *ci;
+	struct cell_info *found = NULL;
+	uint32_t hash;
 
 	assert(s != NULL);
 
-	// in RAM storage
-	llist_for_each_entry(ci, &cell_list, entry) {
+	if (!s->ctx->cell_cid_hash) {
+		llist_for_each_entry(ci, &s->ctx->cell_list, entry) {
+			if (ci->mcc == s->mcc && ci->mnc == s->mnc &&
+			    ci->lac == s->lac && ci->cid == s->cid) {
+				return ci;
+			}
+		}
+		return 0;
+	}
+
+	hash = cid_key(s->mcc, s->mnc, s->lac, s->cid);
+	for (ci = s->ctx->cell_cid_hash[hash % CELL_HASH_SIZE]; ci; ci = ci->cid_next) {
+		if (ci->cid_hash != hash)
+			continue;
 		if (ci->mcc != s->mcc)
 			continue;
 		if (ci->mnc != s->mnc)
@@ -368,39 +574,33 @@ struct cell_info * get_from_cid(struct session_info *s)
 		if (ci->cid != s->cid)
 			continue;
 
-		return ci;
+		if (!found || ci->id > found->id) {
+			found = ci;
+		}
 	}
 
-	return ci;
+	return found;
 }
 
 uint16_t arfcn_count(struct cell_info *ci, enum si_index index)
 {
-	int i;
-	uint16_t count = 0;
-	uint8_t mask;
+	int src;
 
 	assert(ci != 0);
 	assert(index >= 0);
 	assert(index < SI_MAX);
 
-	mask = si_mask(index);
+	src = si_arfcn_source(index);
 
-	if (!mask) {
-		return count;
+	if (src < 0) {
+		return 0;
 	}
 
 	if (ci->si_counter[index] == 0) {
-		return count;
-	}
-
-	for (i=0; i<1024; i++) {
-		if (ci->arfcn_list[i].mask & mask) {
-			count++;
-		}
+		return 0;
 	}
 
-	return count;
+	return arfcn_set_count(&ci->arfcn_list[src]);
 }
 
 /* code imported from Osmocom-BB sysinfo.c */
@@ -574,16 +774,16 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 	}
 
 	/* Find cell in list */
-	ci = get_from_si(dtap->msg_type, dtap->data, data_len);
+	ci = get_from_si(s->ctx, dtap->msg_type, dtap->data, data_len);
 	if (ci) {
-		if (msg_verbose > 1) {
+		if (s->ctx->msg_verbose > 1) {
 			fprintf(stderr, "handle_sysinfo-> Found reference cell\n");
 		}
 		/* Found reference */
 		append = 0;
 	} else {
 		/* Allocate new cell */
-		if (msg_verbose > 1) {
+		if (s->ctx->msg_verbose > 1) {
 			fprintf(stderr, "handle_sysinfo-> Allocating a new cell\n");
 		}
 		ci = (struct cell_info *) malloc(sizeof(struct cell_info));
@@ -595,32 +795,32 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 		if (!append)
 			break;
 		si1 = (struct gsm48_system_information_type_1 *) ((uint8_t *)dtap - 1);
-		gsm48_decode_freq_list(	ci->arfcn_list, si1->cell_channel_description,
-					sizeof(si1->cell_channel_description), 0xff, MASK_BCCH);
+		arfcn_set_decode(&ci->arfcn_list[ARFCN_BCCH], si1->cell_channel_description,
+					sizeof(si1->cell_channel_description), 0xff);
 		break;
 
 	case GSM48_MT_RR_SYSINFO_2:
 		if (!append)
 			break;
 		si2 = (struct gsm48_system_information_type_2 *) ((uint8_t *)dtap - 1);
-		gsm48_decode_freq_list(	ci->arfcn_list, si2->bcch_frequency_list,
-					sizeof(si2->bcch_frequency_list), 0xff, MASK_NEIGH_2);
+		arfcn_set_decode(&ci->arfcn_list[ARFCN_NEIGH_2], si2->bcch_frequency_list,
+					sizeof(si2->bcch_frequency_list), 0xff);
 		break;
 
 	case GSM48_MT_RR_SYSINFO_2bis:
 		if (!append)
 			break;
 		si2b = (struct gsm48_system_information_type_2bis *) ((uint8_t *)dtap - 1);
-		gsm48_decode_freq_list(	ci->arfcn_list, si2b->bcch_frequency_list,
-					sizeof(si2b->bcch_frequency_list), 0xff, MASK_NEIGH_2b);
+		arfcn_set_decode(&ci->arfcn_list[ARFCN_NEIGH_2b], si2b->bcch_frequency_list,
+					sizeof(si2b->bcch_frequency_list), 0xff);
 		break;
 
 	case GSM48_MT_RR_SYSINFO_2ter:
 		if (!append)
 			break;
 		si2t = (struct gsm48_system_information_type_2ter *) ((uint8_t *)dtap - 1);
-		gsm48_decode_freq_list(	ci->arfcn_list, si2t->ext_bcch_frequency_list,
-					sizeof(si2t->ext_bcch_frequency_list), 0xff, MASK_NEIGH_2t);
+		arfcn_set_decode(&ci->arfcn_list[ARFCN_NEIGH_2t], si2t->ext_bcch_frequency_list,
+					sizeof(si2t->ext_bcch_frequency_list), 0xff);
 		break;
 
 	case GSM48_MT_RR_SYSINFO_2quater:
@@ -663,7 +863,7 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 
 	case GSM48_MT_RR_SYSINFO_5:
 		if (s->ci) {
-			if (msg_verbose > 1) {
+			if (s->ctx->msg_verbose > 1) {
 				fprintf(stderr, "session was associated with Cell ID? %p\n", s->ci);
 			}
 			if (append) {
@@ -675,8 +875,8 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 			s->ci = ci;
 		}
 		si5 = (struct gsm48_system_information_type_5 *) dtap;
-		gsm48_decode_freq_list(	ci->arfcn_list, si5->bcch_frequency_list,
-					sizeof(si5->bcch_frequency_list), 0xff, MASK_NEIGH_5);
+		arfcn_set_decode(&ci->arfcn_list[ARFCN_NEIGH_5], si5->bcch_frequency_list,
+					sizeof(si5->bcch_frequency_list), 0xff);
 		break;
 
 	case GSM48_MT_RR_SYSINFO_5bis:
@@ -689,8 +889,8 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 			s->ci = ci;
 		}
 		si5b = (struct gsm48_system_information_type_5bis *) dtap;
-		gsm48_decode_freq_list(	ci->arfcn_list, si5b->bcch_frequency_list,
-					sizeof(si5b->bcch_frequency_list), 0xff, MASK_NEIGH_5b);
+		arfcn_set_decode(&ci->arfcn_list[ARFCN_NEIGH_5b], si5b->bcch_frequency_list,
+					sizeof(si5b->bcch_frequency_list), 0xff);
 		break;
 
 	case GSM48_MT_RR_SYSINFO_5ter:
@@ -703,8 +903,8 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 			s->ci = ci;
 		}
 		si5t = (struct gsm48_system_information_type_5ter *) dtap;
-		gsm48_decode_freq_list(	ci->arfcn_list, si5t->bcch_frequency_list,
-					sizeof(si5t->bcch_frequency_list), 0xff, MASK_NEIGH_5t);
+		arfcn_set_decode(&ci->arfcn_list[ARFCN_NEIGH_5t], si5t->bcch_frequency_list,
+					sizeof(si5t->bcch_frequency_list), 0xff);
 		break;
 
 	case GSM48_MT_RR_SYSINFO_6:
@@ -741,41 +941,49 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 	ci->si_counter[index]++;
 	ci->a_count[index] = arfcn_count(ci, index);
 	memcpy(ci->si_data[index], dtap->data, data_len);
+	ci->dirty = 1;
+	ci->si_dirty |= 1 << index;
 
 	/* Append to cell list */
 	if (append) {
 		ci->first_seen = s->new_msg->timestamp;
-		ci->id = cell_info_id++;
-		llist_add(&ci->entry, &cell_list);
-		if (msg_verbose > 1) {
+		ci->id = s->ctx->cell_info_id++;
+		llist_add(&ci->entry, &s->ctx->cell_list);
+		if (s->ctx->msg_verbose > 1) {
 			printf("linking ptr %p to cell_list\n", ci);
 		}
 	}
+
+	/* Keep lookups current, SI3, SI4 and SI6 update the cell identity */
+	if (s->ctx->cell_si_hash) {
+		cell_hash_si(s->ctx, ci, index, data_len);
+		cell_hash_cid(s->ctx, ci);
+	}
 }
 
-void paging_inc(int pag_type, uint8_t mi_type)
+void paging_inc(struct metagsm_ctx *ctx, int pag_type, uint8_t mi_type)
 {
 	assert(pag_type < 4);
 
 	/* Ignore dummy pagings */
 	if ((pag_type > 0) && (mi_type != GSM_MI_TYPE_NONE)) {
-		paging_count[pag_type - 1]++;
+		ctx->paging_count[pag_type - 1]++;
 	}
 
 	switch (mi_type) {
 	case GSM_MI_TYPE_NONE:
-		paging_null++;
+		ctx->paging_null++;
 		break;
 	case GSM_MI_TYPE_IMSI:
-		paging_imsi++;
+		ctx->paging_imsi++;
 		break;
 	case GSM_MI_TYPE_TMSI:
-		paging_tmsi++;
+		ctx->paging_tmsi++;
 		break;
 	}
 }
 
-void handle_paging1(uint8_t *data, unsigned len)
+void handle_paging1(struct metagsm_ctx *ctx, uint8_t *data, unsigned len)
 {
 	struct gsm48_paging1 *pag;
 	int len1, mi_type, tag;
@@ -792,7 +1000,7 @@ void handle_paging1(uint8_t *data, unsigned len)
 		mi_type = 0;
 	}
 
-	paging_inc(1, mi_type);
+	paging_inc(ctx, 1, mi_type);
 
 	if (len < sizeof(*pag) + 2 + len1 + 3)
 		return;
@@ -802,10 +1010,10 @@ void handle_paging1(uint8_t *data, unsigned len)
 	if (tag != GSM48_IE_MOBILE_ID)
 		return;
 
-	paging_inc(0, mi_type);
+	paging_inc(ctx, 0, mi_type);
 }
 
-void handle_paging2(uint8_t *data, unsigned len)
+void handle_paging2(struct metagsm_ctx *ctx, uint8_t *data, unsigned len)
 {
 	struct gsm48_paging2 *pag;
 	int tag, mi_type;
@@ -815,8 +1023,8 @@ void handle_paging2(uint8_t *data, unsigned len)
 
 	pag = (struct gsm48_paging2 *) (data - 1);
 
-	paging_inc(2, GSM_MI_TYPE_TMSI);
-	paging_inc(0, GSM_MI_TYPE_TMSI);
+	paging_inc(ctx, 2, GSM_MI_TYPE_TMSI);
+	paging_inc(ctx, 0, GSM_MI_TYPE_TMSI);
 
 	/* no optional element */
 	if (len < sizeof(*pag) + 3)
@@ -828,21 +1036,26 @@ void handle_paging2(uint8_t *data, unsigned len)
 	if (tag != GSM48_IE_MOBILE_ID)
 		return;
 
-	paging_inc(0, mi_type);
+	paging_inc(ctx, 0, mi_type);
 }
 
-void handle_paging3()
+void handle_paging3(struct metagsm_ctx *ctx)
 {
-	paging_inc(3, GSM_MI_TYPE_TMSI);
-	paging_inc(0, GSM_MI_TYPE_TMSI);
-	paging_inc(0, GSM_MI_TYPE_TMSI);
-	paging_inc(0, GSM_MI_TYPE_TMSI);
+	paging_inc(ctx, 3, GSM_MI_TYPE_TMSI);
+	paging_inc(ctx, 0, GSM_MI_TYPE_TMSI);
+	paging_inc(ctx, 0, GSM_MI_TYPE_TMSI);
+	paging_inc(ctx, 0, GSM_MI_TYPE_TMSI);
 }
 
-void arfcn_list_make_sql(struct cell_info *ci, enum si_index index, char *query, unsigned len, int sqlite)
+/* Rows are never deleted from arfcn_list, so only ARFCNs that are not
+ * in arfcn_stored yet are written. Returns the number of rows. */
+unsigned arfcn_list_make_sql(struct metagsm_ctx *ctx, struct cell_info *ci, enum si_index index, char *query, unsigned len, int sqlite)
 {
+	char id[SQL_ID_LEN];
+	struct arfcn_set *list, *stored;
 	unsigned offset;
-	uint8_t mask;
+	unsigned rows = 0;
+	int src;
 	int i;
 
 	assert(ci != NULL);
@@ -851,43 +1064,56 @@ void arfcn_list_make_sql(struct cell_info *ci, enum si_index index, char *query,
 	assert(index < SI_MAX);
 
 	if (!len) {
-		return;
+		return 0;
 	}
 
 	query[0] = 0;
 
 	/* Sanity checks */
-	mask = si_mask(index);
-	if (!mask) {
-		return;
+	src = si_arfcn_source(index);
+	if (src < 0) {
+		return 0;
 	}
 	if (ci->si_counter[index] == 0) {
-		return;
+		return 0;
 	}
 	if (ci->a_count[index] == 0) {
-		return;
+		return 0;
 	}
 
 	snprintf(query, len, "INSERT %sIGNORE INTO arfcn_list (id, source, arfcn) VALUES ", sqlite ? "OR " : "");
+	sql_id(ctx, id, SQL_ID_CELL, ci->id);
 
-	for (i = 0; i < 1024; i++) {
-		if (ci->arfcn_list[i].mask & mask) {
+	list = &ci->arfcn_list[src];
+	stored = &ci->arfcn_stored[src];
+	for (i = arfcn_set_next(list, 0); i >= 0; i = arfcn_set_next(list, i + 1)) {
+		if (!arfcn_set_has(stored, i)) {
 			offset = strlen(query);
-			snprintf(&query[offset], len-offset, "(%d,'%s',%d),", ci->id, si_name[index], i); 
+			snprintf(&query[offset], len-offset, "(%s,'%s',%d),", id, si_name[index], i);
+			arfcn_set_add(stored, i);
+			rows++;
 		}
 	}
 
+	if (!rows) {
+		query[0] = 0;
+		return 0;
+	}
+
 	offset = strlen(query);
 
 	assert(offset > 0);
 
 	snprintf(&query[offset-1], len-offset+1, ";");
+
+	return rows;
 }
 
-void cell_make_sql(struct cell_info *ci, char *query, unsigned len, int sqlite)
+void cell_make_sql(struct metagsm_ctx *ctx, struct cell_info *ci, char *query, unsigned len, int sqlite)
 {
 	char first_ts[40];
 	char last_ts[40];
+	char id[SQL_ID_LEN];
 	char *si_hex[SI_MAX];
 	int i;
 
@@ -928,7 +1154,7 @@ void cell_make_sql(struct cell_info *ci, char *query, unsigned len, int sqlite)
 			"count_si4,count_si5,count_si5b,"
 			"count_si5t,count_si6,count_si13,"
 			"si1,si2,si2b,si2t,si2q,si3,si4,si5,si5b,si5t,si6,si13) VALUES ("
-			"%d,%s,%s,%d,%d,%d,%d,"
+			"%s,%s,%s,%d,%d,%d,%d,"
 			"%d,%d,%d,%d,%d,%d,"
 			"%d,%d,%d,%d,%d,"
 			"%u,%u,%u,%u,"
@@ -940,7 +1166,7 @@ void cell_make_sql(struct cell_info *ci, char *query, unsigned len, int sqlite)
 			"%s,%s,%s,%s,"
 			"%s,%s,%s,%s,"
 			"%s,%s,%s,%s);",
-			ci->id, first_ts, last_ts, ci->mcc, ci->mnc, ci->lac, ci->cid,
+			sql_id(ctx, id, SQL_ID_CELL, ci->id), first_ts, last_ts, ci->mcc, ci->mnc, ci->lac, ci->cid,
 			ci->msc_ver, ci->combined, ci->agch_blocks, ci->pag_mframes, ci->t3212, ci->dtx,
 			ci->cro, ci->temp_offset, ci->pen_time, ci->pwr_offset, ci->gprs,
 			ci->a_count[SI1], ci->a_count[SI2], ci->a_count[SI2b], ci->a_count[SI2t],
@@ -966,7 +1192,7 @@ void cell_make_sql(struct cell_info *ci, char *query, unsigned len, int sqlite)
 			"count_si5t=%u,count_si6=%u,count_si13=%u,"
 			"si1=%s,si2=%s,si2b=%s,si2t=%s,si2q=%s,si3=%s,"
 			"si4=%s,si5=%s,si5b=%s,si5t=%s,si6=%s,si13=%s "
-			"WHERE id = %d;",
+			"WHERE id = %s;",
 			first_ts, last_ts, ci->mcc, ci->mnc, ci->lac, ci->cid,
 			ci->msc_ver, ci->combined, ci->agch_blocks, ci->pag_mframes, ci->t3212, ci->dtx,
 			ci->cro, ci->temp_offset, ci->pen_time, ci->pwr_offset, ci->gprs,
@@ -979,7 +1205,7 @@ void cell_make_sql(struct cell_info *ci, char *query, unsigned len, int sqlite)
 			si_hex[SI1], si_hex[SI2], si_hex[SI2b], si_hex[SI2t],
 			si_hex[SI2q], si_hex[SI3], si_hex[SI4], si_hex[SI5],
 			si_hex[SI5b], si_hex[SI5t], si_hex[SI6], si_hex[SI13],
-			ci->id);
+			sql_id(ctx, id, SQL_ID_CELL, ci->id));
 	}
 
 	/* Free hex strings */
@@ -990,7 +1216,7 @@ void cell_make_sql(struct cell_info *ci, char *query, unsigned len, int sqlite)
 	}
 }
 
-void paging_make_sql(unsigned epoch_now, char *query, unsigned len, int sqlite)
+void paging_make_sql(struct metagsm_ctx *ctx, unsigned epoch_now, char *query, unsigned len, int sqlite)
 {
 	char paging_ts[40];
 	float time_delta;
@@ -1008,16 +1234,16 @@ void paging_make_sql(unsigned epoch_now, char *query, unsigned len, int sqlite)
 		snprintf(paging_ts, sizeof(paging_ts), "FROM_UNIXTIME(%u)", epoch_now);
 	}
 
-	time_delta = (float) (epoch_now-previous_ts);
+	time_delta = (float) (epoch_now-ctx->previous_ts);
 
 	if (time_delta > 0.0) {
 		snprintf(query, len, "INSERT INTO paging_info VALUES (%s, %f, %f, %f, %f, %f);",
 				paging_ts,
-				(float)paging_count[0]/time_delta,
-				(float)paging_count[1]/time_delta,
-				(float)paging_count[2]/time_delta,
-				(float)paging_imsi/time_delta,
-				(float)paging_tmsi/time_delta);
+				(float)ctx->paging_count[0]/time_delta,
+				(float)ctx->paging_count[1]/time_delta,
+				(float)ctx->paging_count[2]/time_delta,
+				(float)ctx->paging_imsi/time_delta,
+				(float)ctx->paging_tmsi/time_delta);
 	} else {
 		query[0] = 0;
 	}
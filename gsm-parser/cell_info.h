@@ -2,19 +2,120 @@
 #define CELL_INFO_H
 
 #include <stdint.h>
+#include <sys/time.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/gsm/gsm48_ie.h>
 
-struct cell_info;
+#include "arfcn_set.h"
+
+enum si_index {
+	SI1 = 0,
+	SI2, SI2b, SI2t, SI2q,
+	SI3,
+	SI4,
+	SI5, SI5b, SI5t,
+	SI6,
+	SI13,
+
+	SI_MAX
+};
+
+/* Frequency lists of a cell, one ARFCN set each */
+enum arfcn_source {
+	ARFCN_BCCH = 0,
+	ARFCN_NEIGH_2, ARFCN_NEIGH_2b, ARFCN_NEIGH_2t,
+	ARFCN_NEIGH_5, ARFCN_NEIGH_5b, ARFCN_NEIGH_5t,
+
+	ARFCN_SOURCES
+};
+
+/* Entry of the SI payload hash, one per SI type seen on a cell */
+struct cell_si_ref {
+	struct cell_si_ref *next;
+	struct cell_info *ci;
+	uint32_t hash;
+	uint8_t index;
+	uint8_t len;
+	uint8_t hashed;
+};
+
+#define CELL_HASH_SIZE		4096
+#define CELL_SI_HASH_SIZE	16384
+
+struct cell_info {
+	uint32_t id;
+	uint8_t stored;
+	struct timeval first_seen;
+	struct timeval last_seen;
+	/* DIAG or Android */
+	uint16_t mcc;
+	uint16_t mnc;
+	uint16_t lac;
+	uint32_t cid;
+	uint16_t rat;
+	uint16_t bcch_arfcn;
+	int c1;
+	int c2;
+	uint32_t power_sum;
+	uint32_t power_count;
+	/* SI3 */
+	uint8_t msc_ver;
+	uint8_t combined;
+	uint8_t agch_blocks;
+	uint8_t pag_mframes;
+	uint8_t t3212;
+	uint8_t dtx;
+	/* SI3 & SI4 */
+	uint8_t cro;
+	uint8_t temp_offset;
+	uint8_t pen_time;
+	uint8_t pwr_offset;
+	uint8_t gprs;
+
+	struct arfcn_set arfcn_list[ARFCN_SOURCES] __attribute__((aligned(8)));
+
+	uint32_t si_counter[SI_MAX];
+	uint8_t si_data[SI_MAX][20];
+	uint16_t a_count[SI_MAX];
+
+	struct llist_head entry;
+
+	/* Changes since the last dump */
+	uint8_t dirty;
+	uint16_t si_dirty;		/* 1 << si_index */
+	struct arfcn_set arfcn_stored[ARFCN_SOURCES] __attribute__((aligned(8)));	/* already in arfcn_list */
+
+	/* Hash on (mcc, mnc, lac, cid) and on si_data */
+	struct cell_info *cid_next;
+	uint32_t cid_hash;
+	uint8_t cid_hashed;
+	struct cell_si_ref si_ref[SI_MAX] __attribute__((aligned(8)));
+} __attribute__((packed));
+
+extern const char * si_name[];
+uint8_t si_mask(enum si_index index);
+int si_arfcn_source(enum si_index index);
 
 struct session_info;
 
+struct metagsm_ctx;
+
+void cell_init_ctx(struct metagsm_ctx *ctx, unsigned start_id, uint32_t unix_time, int callback);
+void cell_destroy_ctx(struct metagsm_ctx *ctx, unsigned *last_cid);
+void cell_and_paging_dump_ctx(struct metagsm_ctx *ctx, uint32_t timestamp, int forced, int on_destroy);
+void cell_sql(struct metagsm_ctx *ctx, const char *sql);
+
+/* Same as above, on the default context */
 void cell_init(unsigned start_id, uint32_t unix_time, int callback);
 void cell_destroy();
 void cell_and_paging_dump(uint32_t timestamp, int forced, int on_destroy);
 uint16_t get_mcc(uint8_t *digits);
 uint16_t get_mnc(uint8_t *digits);
+struct cell_info *get_from_si(struct metagsm_ctx *ctx, uint8_t msg_type, uint8_t *data, uint8_t len);
+struct cell_info *get_from_cid(struct session_info *s);
 void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len);
-void handle_paging1(uint8_t *data, unsigned len);
-void handle_paging2(uint8_t *data, unsigned len);
-void handle_paging3();
+void handle_paging1(struct metagsm_ctx *ctx, uint8_t *data, unsigned len);
+void handle_paging2(struct metagsm_ctx *ctx, uint8_t *data, unsigned len);
+void handle_paging3(struct metagsm_ctx *ctx);
 
 #endif
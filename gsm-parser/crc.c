@@ -5,6 +5,8 @@
 #include "crc.h"
 #include <stdio.h>
 #include <string.h>
+#include <assert.h>
+#include <pthread.h>
 
 #define REM(x, y)	(x) % (y)
 
@@ -19,7 +21,7 @@ int FC_init(FC_CTX *ctx, unsigned int crc_size, unsigned int data_size)
 	return 0;
 }
 
-int FC_check_crc(FC_CTX *ctx, unsigned char *input_bits, unsigned char *control_data)
+int FC_check_crc_ref(FC_CTX *ctx, unsigned char *input_bits, unsigned char *control_data)
 { 
 	int j,error_count = 0, error_index = 0, success_flag = 0, syn_index = 0;
 	unsigned int i;
@@ -144,8 +146,8 @@ static int FC_syndrome_shift(FC_CTX *ctx, unsigned int bit)
     return error_count;
 }
  
-void parity_encode(const uint8_t *data, unsigned dsize, const uint8_t *poly,
-		   uint8_t *parity, unsigned psize) {
+void parity_encode_ref(const uint8_t *data, unsigned dsize, const uint8_t *poly,
+		       uint8_t *parity, unsigned psize) {
 
 	int i;
 	unsigned char buf[dsize + psize], *q;
@@ -162,8 +164,8 @@ void parity_encode(const uint8_t *data, unsigned dsize, const uint8_t *poly,
 }
 
 
-int parity_check(const uint8_t *data, unsigned dsize, const uint8_t *poly,
-		 const uint8_t *remainder, unsigned psize) {
+int parity_check_ref(const uint8_t *data, unsigned dsize, const uint8_t *poly,
+		     const uint8_t *remainder, unsigned psize) {
 
 	unsigned int i;
 	unsigned char buf[dsize + psize], *q;
@@ -177,3 +179,224 @@ int parity_check(const uint8_t *data, unsigned dsize, const uint8_t *poly,
 	return memcmp(buf + dsize, remainder, psize);
 }
 
+
+/*
+ * Word versions of the above. Bit i of the FIRE syndrome word is
+ * syndrome_reg[REM(syn_start+i, 40)] of FC_syndrome_shift(), so a shift
+ * is a word shift with the feedback taps of g(x) and the input taps.
+ */
+
+#define FIRE_SIZE	40
+#define FIRE_MASK	((1ULL << FIRE_SIZE) - 1)
+#define FIRE_FEEDBACK	((1ULL << 0) | (1ULL << 3) | (1ULL << 17) | (1ULL << 23) | (1ULL << 26))
+#define FIRE_INPUT	((1ULL << 0) | (1ULL << 4) | (1ULL << 6) | (1ULL << 10) | (1ULL << 16) | \
+			 (1ULL << 27) | (1ULL << 29) | (1ULL << 33) | (1ULL << 39))
+
+/* Longest correctable burst, the rest of the syndrome must be zero */
+#define FIRE_BURST	12
+#define FIRE_TRAP_MASK	((1ULL << (FIRE_SIZE - FIRE_BURST)) - 1)
+
+/* Syndrome after 8 shifts, by its top byte and by the 8 input bits */
+static uint64_t fire_state[256];
+static uint64_t fire_input[256];
+static pthread_once_t fire_once = PTHREAD_ONCE_INIT;
+
+static inline uint64_t fire_shift(uint64_t syn, unsigned bit)
+{
+	uint64_t top = syn >> (FIRE_SIZE - 1);
+
+	return ((syn << 1) & FIRE_MASK) ^ (-top & FIRE_FEEDBACK) ^ (-(uint64_t) bit & FIRE_INPUT);
+}
+
+static void fire_init(void)
+{
+	uint64_t syn;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		syn = (uint64_t) i << (FIRE_SIZE - 8);
+		for (j = 0; j < 8; j++) {
+			syn = fire_shift(syn, 0);
+		}
+		fire_state[i] = syn;
+
+		syn = 0;
+		for (j = 7; j >= 0; j--) {
+			syn = fire_shift(syn, (i >> j) & 1);
+		}
+		fire_input[i] = syn;
+	}
+}
+
+/* 8 unpacked bits, first bit in the MSB */
+static inline unsigned pack_bits(const uint8_t *bits)
+{
+	return bits[0] << 7 | bits[1] << 6 | bits[2] << 5 | bits[3] << 4 |
+	       bits[4] << 3 | bits[5] << 2 | bits[6] << 1 | bits[7];
+}
+
+/* Shift in len bits, each one XOR inv */
+static uint64_t fire_feed(uint64_t syn, const uint8_t *bits, unsigned len, unsigned inv)
+{
+	unsigned i;
+
+	for (i = 0; i + 8 <= len; i += 8) {
+		syn = ((syn << 8) & FIRE_MASK) ^ fire_state[syn >> (FIRE_SIZE - 8)] ^
+		      fire_input[pack_bits(&bits[i]) ^ (inv ? 0xff : 0)];
+	}
+	for (; i < len; i++) {
+		syn = fire_shift(syn, bits[i] ^ inv);
+	}
+
+	return syn;
+}
+
+int FC_check_crc(FC_CTX *ctx, unsigned char *input_bits, unsigned char *control_data)
+{
+	unsigned total = ctx->data_size + ctx->crc_size;
+	unsigned error_index, syn_index, j;
+	uint64_t syn;
+
+	assert(ctx->crc_size == FIRE_SIZE);
+
+	pthread_once(&fire_once, fire_init);
+
+	memcpy(control_data, input_bits, ctx->data_size);
+
+	syn = fire_feed(0, input_bits, ctx->data_size, 0);
+	syn = fire_feed(syn, &input_bits[ctx->data_size], ctx->crc_size, 1);
+
+	// Find position of error burst
+	error_index = 0;
+	if (syn & FIRE_TRAP_MASK) {
+		syn = fire_shift(syn, 0);
+		error_index = 2;
+		while (error_index < total) {
+			syn = fire_shift(syn, 0);
+			error_index++;
+			if (!(syn & FIRE_TRAP_MASK))
+				break;
+		}
+	}
+
+	if (error_index == total)
+		return 0;
+
+	syn_index = error_index ? error_index - 1 : 0;
+
+	if (error_index < ctx->data_size) {
+		// error burst lies within data bits
+		for (j = error_index; j < error_index + FIRE_BURST && j < ctx->data_size; j++) {
+			control_data[j] ^= (syn >> ((FIRE_SIZE - 1 - j + syn_index) % FIRE_SIZE)) & 1;
+		}
+	} else if (error_index > total - FIRE_BURST) {
+		// error burst wraps around into the first data bits
+		for (j = 0; j < error_index - (total - FIRE_BURST); j++) {
+			control_data[j] ^= (syn >> ((FIRE_SIZE - 1 - j - total + syn_index) % FIRE_SIZE)) & 1;
+		}
+	}
+
+	return 1;
+}
+
+void parity_poly_init(struct parity_poly *p, const uint8_t *poly,
+		      const uint8_t *remainder, unsigned psize)
+{
+	uint64_t r, top;
+	unsigned i, j;
+
+	assert(psize >= 1 && psize <= 56);
+
+	p->psize = psize;
+	p->mask = (1ULL << psize) - 1;
+	top = 1ULL << (psize - 1);
+
+	/* poly[0] is the x^psize term */
+	p->poly = 0;
+	for (i = 1; i <= psize; i++) {
+		p->poly = p->poly << 1 | !!poly[i];
+	}
+
+	p->remainder = 0;
+	for (i = 0; remainder && i < psize; i++) {
+		p->remainder = p->remainder << 1 | !!remainder[i];
+	}
+
+	/* Shorter polynomials are divided bit by bit */
+	if (psize < 8)
+		return;
+
+	for (i = 0; i < 256; i++) {
+		r = (uint64_t) i << (psize - 8);
+		for (j = 0; j < 8; j++) {
+			r = (r & top) ? (r << 1) ^ p->poly : r << 1;
+		}
+		p->table[i] = r & p->mask;
+	}
+}
+
+/* Remainder of data * x^psize, first bit in the MSB */
+static uint64_t parity_divide(const struct parity_poly *p, const uint8_t *data, unsigned dsize)
+{
+	uint64_t r = 0, top;
+	unsigned i = 0;
+
+	if (p->psize >= 8) {
+		for (; i + 8 <= dsize; i += 8) {
+			r = ((r << 8) & p->mask) ^
+			    p->table[((r >> (p->psize - 8)) ^ pack_bits(&data[i])) & 0xff];
+		}
+	}
+	for (; i < dsize; i++) {
+		top = ((r >> (p->psize - 1)) ^ data[i]) & 1;
+		r = ((r << 1) & p->mask) ^ (-top & p->poly);
+	}
+
+	return r;
+}
+
+void parity_poly_encode(const struct parity_poly *p, const uint8_t *data, unsigned dsize,
+			uint8_t *parity)
+{
+	uint64_t r = parity_divide(p, data, dsize);
+	unsigned i;
+
+	for (i = 0; i < p->psize; i++) {
+		parity[i] = !((r >> (p->psize - 1 - i)) & 1);
+	}
+}
+
+int parity_poly_check(const struct parity_poly *p, const uint8_t *data, unsigned dsize)
+{
+	uint64_t r = parity_divide(p, data, dsize);
+	uint64_t parity = 0;
+	unsigned i;
+
+	for (i = 0; i < p->psize; i++) {
+		parity = parity << 1 | data[dsize + i];
+	}
+
+	return (r ^ parity) != p->remainder;
+}
+
+/*
+ * One-shot versions, they build the division table on each call. Keep
+ * a struct parity_poly for polynomials used more than once.
+ */
+void parity_encode(const uint8_t *data, unsigned dsize, const uint8_t *poly,
+		   uint8_t *parity, unsigned psize)
+{
+	struct parity_poly p;
+
+	parity_poly_init(&p, poly, NULL, psize);
+	parity_poly_encode(&p, data, dsize, parity);
+}
+
+int parity_check(const uint8_t *data, unsigned dsize, const uint8_t *poly,
+		 const uint8_t *remainder, unsigned psize)
+{
+	struct parity_poly p;
+
+	parity_poly_init(&p, poly, remainder, psize);
+	return parity_poly_check(&p, data, dsize);
+}
@@ -33,6 +33,19 @@ typedef struct
 	int syndrome_reg[40];
 } FC_CTX;
 
+/*
+ * Parity polynomial of up to 56 bits, packed into a word with its
+ * byte-at-a-time division table from 8 bits on. Set up with
+ * parity_poly_init().
+ */
+struct parity_poly {
+	unsigned psize;
+	uint64_t mask;
+	uint64_t poly;
+	uint64_t remainder;
+	uint64_t table[256];
+};
+
 int FC_init(FC_CTX *ctx, unsigned int crc_size, unsigned int data_size);
 int FC_check_crc(FC_CTX *ctx, unsigned char *input_bits, unsigned char *control_data);
 
@@ -42,4 +55,21 @@ void parity_encode(const uint8_t *data, unsigned dsize, const uint8_t *poly,
 int parity_check(const uint8_t *data, unsigned dsize, const uint8_t *poly,
 		 const uint8_t *remainder, unsigned psize);
 
+void parity_poly_init(struct parity_poly *p, const uint8_t *poly,
+		      const uint8_t *remainder, unsigned psize);
+
+void parity_poly_encode(const struct parity_poly *p, const uint8_t *data, unsigned dsize,
+			uint8_t *parity);
+
+int parity_poly_check(const struct parity_poly *p, const uint8_t *data, unsigned dsize);
+
+/* Bit-serial reference versions, only for checking the above in tests */
+int FC_check_crc_ref(FC_CTX *ctx, unsigned char *input_bits, unsigned char *control_data);
+
+void parity_encode_ref(const uint8_t *data, unsigned dsize, const uint8_t *poly,
+		       uint8_t *parity, unsigned psize);
+
+int parity_check_ref(const uint8_t *data, unsigned dsize, const uint8_t *poly,
+		     const uint8_t *remainder, unsigned psize);
+
 #endif
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+
+#include "crc.h"
+#include "bench.h"
+
+/*
+ * Checks the word FIRE decoder against the bit array one on every single
+ * burst error pattern it can correct, at every position of a block, and
+ * on blocks with random errors. Checks the table parity check and encoder
+ * against the bit array ones for the FIRE code and for CRC-16 (CCITT) at
+ * the GPRS block sizes. Then times each of them.
+ */
+
+#define FIRE_DATA	184
+#define FIRE_PARITY	40
+#define FIRE_TOTAL	(FIRE_DATA + FIRE_PARITY)
+#define FIRE_BURST	12
+
+#define MAX_BITS	(431 + 16)
+
+static const uint8_t fire_poly[FIRE_PARITY + 1] = {
+	1, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 1, 0,
+	0, 1, 0, 0, 0, 0, 0, 1,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 1, 0, 0,
+	1
+};
+
+static const uint8_t fire_rem[FIRE_PARITY] = {
+	1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1
+};
+
+static const uint8_t ccitt_poly[16 + 1] = {
+	1, 0, 0, 0, 1, 0, 0, 0,
+	0, 0, 0, 1, 0, 0, 0, 0,
+	1
+};
+
+static const uint8_t ccitt_rem[16] = {
+	1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1
+};
+
+static const unsigned ccitt_sizes[] = { 271, 315, 431 };
+#define CCITT_SIZES	(sizeof(ccitt_sizes) / sizeof(ccitt_sizes[0]))
+
+static void make_block(uint8_t *bits, unsigned dsize, const uint8_t *poly, unsigned psize)
+{
+	unsigned i;
+
+	for (i = 0; i < dsize; i++) {
+		bits[i] = random() & 1;
+	}
+	parity_encode_ref(bits, dsize, poly, &bits[dsize], psize);
+}
+
+static int check_fire(uint8_t *bits, unsigned block, unsigned pos, unsigned pattern)
+{
+	uint8_t ref[FIRE_TOTAL], out[FIRE_TOTAL];
+	FC_CTX ctx;
+	int ref_ret, ret;
+
+	FC_init(&ctx, FIRE_PARITY, FIRE_DATA);
+	ref_ret = FC_check_crc_ref(&ctx, bits, ref);
+	FC_init(&ctx, FIRE_PARITY, FIRE_DATA);
+	ret = FC_check_crc(&ctx, bits, out);
+
+	if (ref_ret != ret || memcmp(ref, out, FIRE_DATA)) {
+		printf("MISMATCH in FIRE block %u, burst %03x at bit %u\n", block, pattern, pos);
+		return 1;
+	}
+
+	return 0;
+}
+
+static void flip_burst(uint8_t *bits, unsigned pos, unsigned pattern)
+{
+	unsigned i;
+
+	for (i = 0; i < FIRE_BURST; i++) {
+		if (pattern & (1 << i)) {
+			bits[(pos + i) % FIRE_TOTAL] ^= 1;
+		}
+	}
+}
+
+static unsigned count = 100000;
+static unsigned exhaustive = 1;
+
+static const struct bench_opt opts[] = {
+	{ 'n', BENCH_UINT, &count, "<blocks>", "Blocks with random errors" },
+	{ 'e', BENCH_UINT, &exhaustive, "<blocks>", "Blocks with every burst error" },
+	{ 0 }
+};
+
+static int crc_main(int argc, char *argv[])
+{
+	struct parity_poly fire, ccitt;
+	uint8_t *blocks, *bits;
+	uint8_t ref[MAX_BITS], out[MAX_BITS];
+	unsigned i, j, pos, pattern, size;
+	unsigned long ref_sum = 0, sum = 0;
+	double secs, ref_secs;
+	FC_CTX ctx;
+
+	if (bench_getopt(&crc_bench, argc, argv) != argc || !count) {
+		bench_usage(&crc_bench);
+	}
+
+	blocks = calloc(count, MAX_BITS);
+	if (!blocks) {
+		errx(1, "Cannot allocate %u blocks", count);
+	}
+
+	parity_poly_init(&fire, fire_poly, fire_rem, FIRE_PARITY);
+	parity_poly_init(&ccitt, ccitt_poly, ccitt_rem, 16);
+
+	/* Every correctable burst at every position, including the wrap around */
+	srandom(1);
+	for (i = 0; i < exhaustive; i++) {
+		bits = blocks;
+		make_block(bits, FIRE_DATA, fire_poly, FIRE_PARITY);
+		for (pos = 0; pos < FIRE_TOTAL; pos++) {
+			for (pattern = 1; pattern < (1 << FIRE_BURST); pattern += 2) {
+				flip_burst(bits, pos, pattern);
+				if (check_fire(bits, i, pos, pattern)) {
+					return 1;
+				}
+				flip_burst(bits, pos, pattern);
+			}
+		}
+	}
+	printf("%u blocks checked with %u bursts each\n", exhaustive, FIRE_TOTAL << (FIRE_BURST - 1));
+
+	/* Random errors, mostly uncorrectable */
+	for (i = 0; i < count; i++) {
+		bits = &blocks[i * MAX_BITS];
+		make_block(bits, FIRE_DATA, fire_poly, FIRE_PARITY);
+		for (j = random() % 16; j > 0; j--) {
+			bits[random() % FIRE_TOTAL] ^= 1;
+		}
+		if (check_fire(bits, i, 0, 0)) {
+			return 1;
+		}
+		if (!parity_check_ref(bits, FIRE_DATA, fire_poly, fire_rem, FIRE_PARITY) !=
+		    !parity_poly_check(&fire, bits, FIRE_DATA)) {
+			printf("MISMATCH in FIRE parity check of block %u\n", i);
+			return 1;
+		}
+
+		parity_encode_ref(bits, FIRE_DATA, fire_poly, ref, FIRE_PARITY);
+		parity_poly_encode(&fire, bits, FIRE_DATA, out);
+		if (memcmp(ref, out, FIRE_PARITY)) {
+			printf("MISMATCH in FIRE parity of block %u\n", i);
+			return 1;
+		}
+
+		size = ccitt_sizes[i % CCITT_SIZES];
+		make_block(ref, size, ccitt_poly, 16);
+		if (i % 2) {
+			ref[random() % (size + 16)] ^= 1;
+		}
+		if (!parity_check_ref(ref, size, ccitt_poly, ccitt_rem, 16) !=
+		    !parity_poly_check(&ccitt, ref, size) ||
+		    !parity_check(ref, size, ccitt_poly, ccitt_rem, 16) !=
+		    !parity_poly_check(&ccitt, ref, size)) {
+			printf("MISMATCH in CRC-16 check of block %u (%u bits)\n", i, size);
+			return 1;
+		}
+	}
+	printf("%u blocks checked with random errors\n", count);
+
+	/* Blocks per second */
+	ref_secs = stats_secs();
+	for (i = 0; i < count; i++) {
+		FC_init(&ctx, FIRE_PARITY, FIRE_DATA);
+		ref_sum += FC_check_crc_ref(&ctx, &blocks[i * MAX_BITS], ref);
+	}
+	ref_secs = stats_secs() - ref_secs;
+
+	secs = stats_secs();
+	for (i = 0; i < count; i++) {
+		FC_init(&ctx, FIRE_PARITY, FIRE_DATA);
+		sum += FC_check_crc(&ctx, &blocks[i * MAX_BITS], out);
+	}
+	secs = stats_secs() - secs;
+
+	bench_print("FIRE bits", count, "blocks", ref_secs, 0);
+	bench_print("FIRE words", count, "blocks", secs, ref_secs);
+
+	ref_secs = stats_secs();
+	for (i = 0; i < count; i++) {
+		ref_sum += !parity_check_ref(&blocks[i * MAX_BITS], FIRE_DATA, fire_poly, fire_rem, FIRE_PARITY);
+	}
+	ref_secs = stats_secs() - ref_secs;
+
+	secs = stats_secs();
+	for (i = 0; i < count; i++) {
+		sum += !parity_poly_check(&fire, &blocks[i * MAX_BITS], FIRE_DATA);
+	}
+	secs = stats_secs() - secs;
+
+	bench_print("parity bits", count, "blocks", ref_secs, 0);
+	bench_print("parity table", count, "blocks", secs, ref_secs);
+
+	ref_secs = stats_secs();
+	for (i = 0; i < count; i++) {
+		ref_sum += !parity_check_ref(&blocks[i * MAX_BITS], 431, ccitt_poly, ccitt_rem, 16);
+	}
+	ref_secs = stats_secs() - ref_secs;
+
+	secs = stats_secs();
+	for (i = 0; i < count; i++) {
+		sum += !parity_poly_check(&ccitt, &blocks[i * MAX_BITS], 431);
+	}
+	secs = stats_secs() - secs;
+
+	bench_print("CRC-16 bits", count, "blocks", ref_secs, 0);
+	bench_print("CRC-16 table", count, "blocks", secs, ref_secs);
+
+	free(blocks);
+
+	if (ref_sum != sum) {
+		printf("MISMATCH\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+const struct bench_cmd crc_bench = {
+	.name = "crc",
+	.help = "FIRE and CRC-16 parity bit by bit and on words",
+	.opts = opts,
+	.main = crc_main,
+};
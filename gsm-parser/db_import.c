@@ -125,11 +125,7 @@ int explore_session(int id)
 		char *data = row[3];
 		struct radio_message *m;
 
-		m = (struct radio_message *) malloc(sizeof(struct radio_message));
-		if (m == 0)
-			return 0;
-
-		memset(m, 0, sizeof(struct radio_message));
+		m = radio_msg_alloc(s->ctx, 0);
 
 		m->rat = RAT_GSM;
 		m->domain = DOMAIN_CS;
@@ -148,7 +144,7 @@ int explore_session(int id)
 		default:
 			printf("unhandled channel %d in session %d\n", channel, id);
 			fflush(stdout);
-			free(m);
+			radio_msg_free(s->ctx, m);
 			continue;
 		}
 		m->msg_len = 23;
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+
+#include "process.h"
+#include "bit_func.h"
+#include "punct.h"
+#include "gsm_interleave.h"
+#include "bench.h"
+
+/*
+ * Interleaves random coded blocks with gsm_inter_sacch() or
+ * gsm_inter_facch(), packs them into bursts and checks that the fused
+ * kernels give back every coded bit with the amplitude of its burst, and
+ * zero at punctured positions, for each coding scheme. The scalar and the
+ * selected kernel must agree with the separate deinterleave and depuncture
+ * passes gprs.c used before. Then times the three per scheme.
+ */
+
+#define CODED_BITS	456
+#define MAX_SOFT	676
+
+struct block {
+	uint8_t bursts[8*BURST_BYTES];
+	uint8_t coded[CODED_BITS];
+	int8_t amp[8];
+};
+
+static const char *scheme_names[DEINTER_SCHEMES] = { "xCCH", "FACCH", "CS-2", "CS-3" };
+
+static unsigned pattern[DEINTER_SCHEMES][CODED_BITS];
+
+static unsigned scheme_bursts(enum deinter_scheme scheme)
+{
+	return scheme == DEINTER_FACCH ? 8 : 4;
+}
+
+static void make_block(struct block *b, enum deinter_scheme scheme, int hard)
+{
+	uint8_t raw[8*BURST_BITS];
+	unsigned i;
+
+	for (i = 0; i < sizeof(raw); i++) {
+		raw[i] = random() & 1;
+	}
+	for (i = 0; i < CODED_BITS; i++) {
+		b->coded[i] = random() & 1;
+	}
+
+	if (scheme == DEINTER_FACCH) {
+		gsm_inter_facch(b->coded, raw);
+	} else {
+		gsm_inter_sacch(b->coded, raw);
+	}
+
+	memset(b->bursts, 0, sizeof(b->bursts));
+	for (i = 0; i < scheme_bursts(scheme); i++) {
+		compress_msb(&raw[i*BURST_BITS], &b->bursts[i*BURST_BYTES], BURST_BITS);
+		b->amp[i] = hard ? 127 : 1 + random() % 127;
+	}
+}
+
+/* Separate passes: expand, deinterleave, then depuncture or map to soft bits */
+static void separate_passes(const struct block *b, enum deinter_scheme scheme, int8_t *soft)
+{
+	uint8_t raw[8*BURST_BITS];
+	uint8_t hard[CODED_BITS];
+	unsigned i, n = scheme_bursts(scheme);
+
+	for (i = 0; i < n; i++) {
+		expand_msb(&b->bursts[i*BURST_BYTES], &raw[i*BURST_BITS], BURST_BITS);
+	}
+
+	if (scheme == DEINTER_FACCH) {
+		gsm_deinter_facch(raw, hard);
+	} else {
+		gsm_deinter_sacch(raw, hard);
+	}
+
+	if (scheme == DEINTER_CS2 || scheme == DEINTER_CS3) {
+		depunct((int8_t *) hard, soft, gsm_deinter_size(scheme), pattern[scheme]);
+	} else {
+		for (i = 0; i < CODED_BITS; i++) {
+			soft[i] = hard[i] ? -b->amp[i % n] : b->amp[i % n];
+		}
+	}
+}
+
+/* Each coded bit back with the amplitude of its burst, punctured bits 0 */
+static int check_round_trip(const struct block *b, enum deinter_scheme scheme, const int8_t *soft)
+{
+	int8_t ref[MAX_SOFT] = {0};
+	unsigned i, n = scheme_bursts(scheme);
+
+	for (i = 0; i < CODED_BITS; i++) {
+		ref[pattern[scheme][i]] = b->coded[i] ? -b->amp[i % n] : b->amp[i % n];
+	}
+
+	return memcmp(ref, soft, gsm_deinter_size(scheme));
+}
+
+static unsigned count = 100000;
+
+static const struct bench_opt opts[] = {
+	{ 'n', BENCH_UINT, &count, "<blocks>", "Blocks per coding scheme" },
+	{ 0 }
+};
+
+static int deinter_main(int argc, char *argv[])
+{
+	struct block *blocks;
+	int8_t ref[MAX_SOFT], out[MAX_SOFT];
+	unsigned long ref_sum, sum;
+	double secs, ref_secs;
+	unsigned i, size;
+	int hard;
+	enum deinter_scheme scheme;
+
+	if (bench_getopt(&deinter_bench, argc, argv) != argc || !count) {
+		bench_usage(&deinter_bench);
+	}
+
+	blocks = malloc(count * sizeof(*blocks));
+	if (!blocks) {
+		errx(1, "Cannot allocate %u blocks", count);
+	}
+
+	gsm_interleave_init();
+
+	for (i = 0; i < CODED_BITS; i++) {
+		pattern[DEINTER_XCCH][i] = i;
+		pattern[DEINTER_FACCH][i] = i;
+	}
+	fill_punct_cs2(pattern[DEINTER_CS2]);
+	fill_punct_cs3(pattern[DEINTER_CS3]);
+
+	srandom(1);
+	for (scheme = 0; scheme < DEINTER_SCHEMES; scheme++) {
+		size = gsm_deinter_size(scheme);
+
+		/* Punctured schemes only ever see hard bits */
+		hard = (scheme == DEINTER_CS2 || scheme == DEINTER_CS3);
+
+		for (i = 0; i < count; i++) {
+			make_block(&blocks[i], scheme, hard);
+
+			memset(out, 0x55, sizeof(out));
+			gsm_deinter_soft_scalar(scheme, blocks[i].bursts, blocks[i].amp, out);
+			if (check_round_trip(&blocks[i], scheme, out)) {
+				printf("MISMATCH in %s round trip of block %u\n", scheme_names[scheme], i);
+				return 1;
+			}
+
+			separate_passes(&blocks[i], scheme, ref);
+			if (memcmp(ref, out, size)) {
+				printf("MISMATCH in %s block %u against separate passes\n", scheme_names[scheme], i);
+				return 1;
+			}
+
+			memset(out, 0x55, sizeof(out));
+			gsm_deinter_soft(scheme, blocks[i].bursts, blocks[i].amp, out);
+			if (memcmp(ref, out, size)) {
+				printf("MISMATCH in %s block %u with %s\n", scheme_names[scheme], i, gsm_deinter_impl_name());
+				return 1;
+			}
+		}
+		printf("%-6s %u blocks checked\n", scheme_names[scheme], count);
+
+		/* Blocks per second */
+		ref_sum = sum = 0;
+		ref_secs = stats_secs();
+		for (i = 0; i < count; i++) {
+			separate_passes(&blocks[i], scheme, out);
+			ref_sum += out[i % size];
+		}
+		ref_secs = stats_secs() - ref_secs;
+		printf("%-6s %-10s %10u blocks %8.3f s %10.0f blocks/s\n",
+			scheme_names[scheme], "separate", count, ref_secs, count / ref_secs);
+
+		secs = stats_secs();
+		for (i = 0; i < count; i++) {
+			gsm_deinter_soft_scalar(scheme, blocks[i].bursts, blocks[i].amp, out);
+			sum += out[i % size];
+		}
+		secs = stats_secs() - secs;
+		printf("%-6s %-10s %10u blocks %8.3f s %10.0f blocks/s %6.1fx\n",
+			scheme_names[scheme], "scalar", count, secs, count / secs, ref_secs / secs);
+
+		secs = stats_secs();
+		for (i = 0; i < count; i++) {
+			gsm_deinter_soft(scheme, blocks[i].bursts, blocks[i].amp, out);
+			sum += out[i % size];
+		}
+		secs = stats_secs() - secs;
+		printf("%-6s %-10s %10u blocks %8.3f s %10.0f blocks/s %6.1fx\n",
+			scheme_names[scheme], gsm_deinter_impl_name(), count, secs, count / secs, ref_secs / secs);
+
+		if (2 * ref_sum != sum) {
+			printf("MISMATCH in %s timing runs\n", scheme_names[scheme]);
+			return 1;
+		}
+	}
+
+	free(blocks);
+
+	return 0;
+}
+
+const struct bench_cmd deinter_bench = {
+	.name = "deinter",
+	.help = "Fused deinterleaving and depuncturing against separate passes",
+	.opts = opts,
+	.main = deinter_main,
+};
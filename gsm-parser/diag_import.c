@@ -3,20 +3,47 @@
 #include <string.h>
 #include <unistd.h>
 #include <err.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
 #include "diag_input.h"
-#include "bit_func.h"
+#include "diag_reader.h"
+#include "session.h"
+#include "output.h"
 #include <stdlib.h>
 
+struct worker {
+	pid_t pid;
+	FILE *spool;
+	int done;
+};
+
+static int alloc_stats = 0;
+static int full_dump = 0;
+static int stats_output = STATS_NONE;
+
+/* ID counts reported back by the workers, in shared memory */
+struct worker_result {
+	long sid;
+	long cid;
+};
+
 static void usage(const char *progname, const char *reason)
 {
 	printf("%s\n", reason);
-	printf("Usage: %s [-s <id>] [-c <id>] [-f <filelist>] [filenames]\n", progname);
+	printf("Usage: %s [-s <id>] [-c <id>] [-j <jobs>] [-f <filelist>] [filenames]\n", progname);
 	printf("	-s <id>       - First session_info ID to be used for SQL\n");
 	printf("	-c <id>       - First cell_info ID to be used for SQL\n");
 	printf("	-g <target>   - Target host for GSMTAP UDP stream\n");
 	printf("	-f <filelist> - Read list of input files from <filelist>\n");
 	printf("	-a <appid>    - Set appid to <appid> (in hex)\n");
+	printf("	-j <jobs>     - Parse up to <jobs> files in parallel\n");
+	printf("	-m            - Print message allocations and memory use to stderr\n");
+	printf("	-F            - Rewrite every cell on each dump, not only changed ones\n");
+	printf("	-T <format>   - Print stage statistics as text or json to stderr,\n");
+	printf("	                at the end of each file and on SIGUSR1\n");
 	printf("	[filenames]   - Read DIAG data from [filenames]\n");
 	exit(1);
 }
@@ -31,19 +58,256 @@ chop_newline(char *line)
 	}
 }
 
+static void
+print_alloc_stats(const char *infile_name)
+{
+	struct metagsm_ctx *ctx = metagsm_default_ctx();
+	struct radio_msg_pool *pool = &ctx->msg_pool;
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	fprintf(stderr, "%s: %llu messages, %llu allocated, %u peak in use, %u kB peak per session, max RSS %ld kB\n",
+		infile_name,
+		(unsigned long long) pool->allocs,
+		(unsigned long long) pool->mallocs,
+		pool->peak, ctx->session_peak / 1024,
+		ru.ru_maxrss);
+	fprintf(stderr, "%s: %llu cell rows written, %llu avoided\n",
+		infile_name,
+		(unsigned long long) ctx->cell_rows,
+		(unsigned long long) ctx->cell_rows_avoided);
+}
+
+/* Replace relocatable IDs in a spooled query, returns the new length */
+static unsigned
+rebase_ids(const char *in, unsigned len, char *out, long sid_base, long cid_base)
+{
+	const char *end = in + len;
+	const char *mark;
+	unsigned out_len = 0;
+	long id;
+
+	while (in < end) {
+		mark = memchr(in, SQL_ID_MARK, end - in);
+		if (!mark) {
+			mark = end;
+		}
+		memcpy(&out[out_len], in, mark - in);
+		out_len += mark - in;
+		if (mark == end) {
+			break;
+		}
+
+		id = strtol(mark + 2, (char **) &in, 10);
+		if (mark[1] == SQL_ID_CELL) {
+			id += cid_base;
+		} else {
+			id += sid_base;
+		}
+		out_len += sprintf(&out[out_len], "%d", (int) id);
+		/* skip closing mark */
+		in++;
+	}
+	out[out_len] = 0;
+
+	return out_len;
+}
+
+/* Copy a worker's spooled output in place of a serial run */
+static void
+merge_spool(FILE *spool, long sid_base, long cid_base)
+{
+	struct stat st;
+	uint8_t *map, *ptr, *end, *next;
+	char *query = NULL;
+	unsigned query_size = 0;
+
+	fflush(spool);
+	if (fstat(fileno(spool), &st) < 0)
+	{
+		err(1, "Cannot stat spool file");
+	}
+	if (st.st_size == 0)
+	{
+		return;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(spool), 0);
+	if (map == MAP_FAILED)
+	{
+		err(1, "Cannot map spool file");
+	}
+
+	ptr = map;
+	end = map + st.st_size;
+	while (ptr < end) {
+		next = memchr(ptr, 0, end - ptr);
+		if (!next) {
+			next = end;
+		}
+
+		/* Plain console output */
+		fwrite(ptr, 1, next - ptr, stdout);
+		if (next == end) {
+			break;
+		}
+
+		/* SQL record: '\0' <type> <query> '\0' */
+		if (end - next < 2) {
+			errx(1, "Truncated record in spool file");
+		}
+		ptr = next + 2;
+		next = memchr(ptr, 0, end - ptr);
+		if (!next) {
+			errx(1, "Unterminated record in spool file");
+		}
+
+		/* A marked ID takes at least four bytes, a rebased one
+		 * at most eleven */
+		if (query_size < 3 * (next - ptr) + 1) {
+			query_size = 3 * (next - ptr) + 1;
+			query = realloc(query, query_size);
+			if (!query) {
+				err(1, "Cannot allocate query");
+			}
+		}
+		rebase_ids((char *) ptr, next - ptr, query, sid_base, cid_base);
+		diag_sql_replay(ptr[-1], query);
+
+		ptr = next + 1;
+	}
+
+	free(query);
+	munmap(map, st.st_size);
+}
+
+static void
+start_worker(struct worker *w, struct worker_result *res, char *infile_name, uint32_t appid)
+{
+	long sid = 0;
+	long cid = 0;
+
+	w->spool = tmpfile();
+	if (!w->spool)
+	{
+		err(1, "Cannot create spool file");
+	}
+
+	fflush(stdout);
+	w->pid = fork();
+	if (w->pid < 0)
+	{
+		err(1, "Cannot fork");
+	}
+	if (w->pid > 0)
+	{
+		return;
+	}
+
+	/* Worker: parse with IDs starting at zero, rebased on merge */
+	if (dup2(fileno(w->spool), STDOUT_FILENO) < 0)
+	{
+		err(1, "Cannot redirect output");
+	}
+	diag_spool = 1;
+	process_file(&sid, &cid, NULL, infile_name, appid);
+	fflush(stdout);
+
+	res->sid = sid;
+	res->cid = cid;
+	_exit(0);
+}
+
+/*
+ * Parse files in separate processes, at most jobs at a time. Output is
+ * merged in file order and IDs are allocated as in a serial run.
+ */
+static void
+process_parallel(long *sid, long *cid, char **files, int count, int jobs, uint32_t appid)
+{
+	struct worker *workers;
+	struct worker_result *results;
+	int next_start = 0;
+	int next_merge = 0;
+	int running = 0;
+	int status;
+	unsigned unused1, unused2;
+	pid_t pid;
+	int i;
+
+	workers = calloc(count, sizeof(struct worker));
+	results = mmap(NULL, count * sizeof(struct worker_result), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (!workers || results == MAP_FAILED)
+	{
+		err(1, "Cannot allocate workers");
+	}
+
+	/* Output of the merged spools */
+	diag_init(0, 0, NULL, NULL, 0);
+
+	while (next_merge < count) {
+		/* Bound the number of finished but unmerged spools */
+		while (running < jobs && next_start < count && next_start < next_merge + 4 * jobs) {
+			start_worker(&workers[next_start], &results[next_start], files[next_start], appid);
+			next_start++;
+			running++;
+		}
+
+		pid = wait(&status);
+		if (pid < 0)
+		{
+			err(1, "Cannot wait for workers");
+		}
+		for (i = next_merge; i < next_start; i++) {
+			if (workers[i].pid == pid) {
+				break;
+			}
+		}
+		if (i == next_start)
+		{
+			continue;
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+		{
+			errx(1, "Worker failed on input file: %s", files[i]);
+		}
+		workers[i].done = 1;
+		running--;
+
+		while (next_merge < next_start && workers[next_merge].done) {
+			merge_spool(workers[next_merge].spool, *sid, *cid);
+			fclose(workers[next_merge].spool);
+			*sid += results[next_merge].sid;
+			*cid += results[next_merge].cid;
+			next_merge++;
+		}
+	}
+
+	diag_destroy(&unused1, &unused2);
+
+	munmap(results, count * sizeof(struct worker_result));
+	free(workers);
+}
+
 int main(int argc, char *argv[])
 {
 	char infile_name[FILENAME_MAX];
 	FILE *filelist = NULL;
 	char *filelist_name = NULL;
 	char *gsmtap_target = NULL;
+	char **files = NULL;
+	int file_count = 0;
 	uint32_t appid = 0;
 	int ch;
 	long sid = 0;
 	long cid = 0;
+	int jobs = 1;
 	int line = 0;
+	int i;
 
-	while ((ch = getopt(argc, argv, "s:c:g:f:a:")) != -1) {
+	while ((ch = getopt(argc, argv, "s:c:g:f:a:j:mFT:")) != -1) {
 		switch (ch) {
 			case 's':
 				sid = atol(optarg);
@@ -60,6 +324,22 @@ int main(int argc, char *argv[])
 			case 'a':
 				appid = strtol(optarg, (char **)NULL, 16);
 				break;
+			case 'j':
+				jobs = atoi(optarg);
+				break;
+			case 'm':
+				alloc_stats = 1;
+				break;
+			case 'F':
+				full_dump = 1;
+				break;
+			case 'T':
+				stats_output = stats_parse_output(optarg);
+				if (stats_output < 0) {
+					usage(argv[0], "Invalid statistics format");
+				}
+				stats_signal_init();
+				break;
 			case '?':
 			default:
 				usage(argv[0], "Invalid arguments");
@@ -74,18 +354,29 @@ int main(int argc, char *argv[])
 		errx(1, "Invalid arguments");
 	}
 
+	if (jobs < 1)
+	{
+		usage(argv[0], "Invalid number of jobs");
+	}
+
+	if (jobs > 1 && gsmtap_target)
+	{
+		usage(argv[0], "GSMTAP output cannot be used with parallel jobs");
+	}
+
 	printf("PARSER_OK\n");
 	fflush(stdout);
 
-	//  Handle files passed to command line first
+	//  Files passed to command line first
+	files = malloc((argc + 1) * sizeof(char *));
 	while (argc > 0)
 	{
-		process_file(&sid, &cid, gsmtap_target, argv[0], appid);
+		files[file_count++] = argv[0];
 		argc--;
 		argv++;
 	};
 
-	//  Handle file list
+	//  Then the file list
 	if (filelist_name)
 	{
 		filelist = fopen(filelist_name, "rb");
@@ -94,54 +385,67 @@ int main(int argc, char *argv[])
 			err(1, "Cannot open file list: %s", filelist_name);
 		}
 
-		while (!feof(filelist))
+		while (fgets(infile_name, sizeof(infile_name), filelist))
 		{
-			fgets(infile_name, sizeof(infile_name), filelist);
 			++line;
-			if (ferror(filelist))
-			{
-				err(1, "Cannot open file in %s:%d", filelist_name, line);
-			}
 			chop_newline(infile_name);
-			process_file(&sid, &cid, gsmtap_target, infile_name, appid);
+			files = realloc(files, (file_count + 1) * sizeof(char *));
+			files[file_count++] = strdup(infile_name);
+		}
+		if (ferror(filelist))
+		{
+			err(1, "Cannot open file in %s:%d", filelist_name, line);
 		}
 		fclose(filelist);
 	}
 
+	if (jobs > 1)
+	{
+		process_parallel(&sid, &cid, files, file_count, jobs, appid);
+	} else
+	{
+		for (i = 0; i < file_count; i++)
+		{
+			process_file(&sid, &cid, gsmtap_target, files[i], appid);
+		}
+	}
+
 	return 0;
 }
 
 void
 process_file(long *sid, long *cid, char *gsmtap_target, char *infile_name, uint32_t appid)
 {
-	uint8_t msg[4096];
-	FILE *infile = NULL;
-	unsigned len = 0;
+	struct diag_reader *reader;
+	struct metagsm_ctx *ctx;
+	uint8_t *msg;
+	unsigned len;
+	uint64_t t;
 
-	if (strcmp(infile_name, "-") == 0)
-	{
-		infile = stdin;
-	} else
-	{
-		infile = fopen(infile_name, "rb");
-	}
-
-	if (!infile)
+	reader = diag_reader_open(infile_name);
+	if (!reader)
 	{
 		err(1, "Cannot open input file: %s", infile_name);
 	}
 
 	diag_init(*sid, *cid, gsmtap_target, infile_name, appid);
+	ctx = metagsm_default_ctx();
+	ctx->cell_full_dump = full_dump;
+	ctx->stats.output = stats_output;
 	for (;;) {
-		memset(msg, 0x2b, sizeof(msg));
-		len = fread_unescape(infile, msg, sizeof(msg));
-
-		if (!len) {
+		t = stats_begin(&ctx->stats, STAGE_INPUT);
+		if (!diag_reader_next(reader, &msg, &len)) {
 			break;
 		}
-
+		stats_end(&ctx->stats, STAGE_INPUT, t);
 		handle_diag(msg, len);
+		net_poll();
 	}
 	diag_destroy(sid, cid);
-	fclose(infile);
+	diag_reader_close(reader);
+
+	if (alloc_stats)
+	{
+		print_alloc_stats(infile_name);
+	}
 }
@@ -28,13 +28,17 @@ struct diag_packet {
 	uint8_t data[0];
 } __attribute__ ((packed));
 
-void diag_init(unsigned start_sid, unsigned start_cid, const char *gsmtap_target, char *filename, uint32_t appid)
+/* Spool SQL to stdout with relocatable IDs, used by diag_import -j */
+uint8_t diag_spool = 0;
+
+void diag_init_ctx(struct metagsm_ctx *ctx, unsigned start_sid, unsigned start_cid, const char *gsmtap_target, char *filename, uint32_t appid)
 {
+	struct session_info *_s = ctx->s;
 	int callback_type;
 
 #ifdef USE_MYSQL
 	callback_type = CALLBACK_MYSQL;
-	msg_verbose = 0;
+	ctx->msg_verbose = 0;
 #else
 #ifdef USE_SQLITE
 	callback_type = CALLBACK_SQLITE;
@@ -43,13 +47,16 @@ void diag_init(unsigned start_sid, unsigned start_cid, const char *gsmtap_target
 	//msg_verbose = 1;
 #endif
 #endif
+	if (diag_spool) {
+		callback_type = CALLBACK_SPOOL;
+	}
 #ifdef USE_AUTOTIME
 	auto_timestamp = 1;
 #else
 	auto_timestamp = 0;
 #endif
 
-	session_init(start_sid, 0, gsmtap_target, callback_type);
+	session_init_ctx(ctx, start_sid, 0, gsmtap_target, callback_type);
 
 	if (filename && (filename[0] != '-')) {
 		session_from_filename(filename, &_s[0]);
@@ -62,12 +69,44 @@ void diag_init(unsigned start_sid, unsigned start_cid, const char *gsmtap_target
 		_s[1].appid = appid;
 	}
 
-	cell_init(start_cid, _s[0].timestamp.tv_sec, callback_type);
+	cell_init_ctx(ctx, start_cid, _s[0].timestamp.tv_sec, callback_type);
+
+	stats_reset(&ctx->stats, filename);
+}
+
+void diag_init(unsigned start_sid, unsigned start_cid, const char *gsmtap_target, char *filename, uint32_t appid)
+{
+#ifdef USE_MYSQL
+	msg_verbose = 0;
+#endif
+	diag_init_ctx(metagsm_default_ctx(), start_sid, start_cid, gsmtap_target, filename, appid);
+}
+
+void diag_destroy_ctx(struct metagsm_ctx *ctx, unsigned *last_sid, unsigned *last_cid)
+{
+	session_destroy_ctx(ctx, last_sid, last_cid);
+
+	stats_dump(&ctx->stats);
 }
 
 void diag_destroy(unsigned *last_sid, unsigned *last_cid)
 {
-	session_destroy(last_sid, last_cid);
+	diag_destroy_ctx(metagsm_default_ctx(), last_sid, last_cid);
+}
+
+/* Pass a spooled query to the output set up by diag_init() */
+void diag_sql_replay_ctx(struct metagsm_ctx *ctx, char type, const char *sql)
+{
+	if (type == SQL_ID_CELL) {
+		cell_sql(ctx, sql);
+	} else if (ctx->s[0].sql_callback) {
+		ctx->s[0].sql_callback(ctx, sql);
+	}
+}
+
+void diag_sql_replay(char type, const char *sql)
+{
+	diag_sql_replay_ctx(metagsm_default_ctx(), type, sql);
 }
 
 inline
@@ -114,7 +153,7 @@ void print_common(struct diag_packet *dp, unsigned len)
 	printf("[%03u] %s\n", dp->data_len, osmo_hexdump_nospc(dp->data, len-2-sizeof(struct diag_packet)));
 }
 
-struct radio_message * handle_3G(struct diag_packet *dp, unsigned len)
+struct radio_message * handle_3G(struct metagsm_ctx *ctx, struct diag_packet *dp, unsigned len)
 {
 	unsigned payload_len;
 	struct radio_message *m;
@@ -133,9 +172,7 @@ struct radio_message * handle_3G(struct diag_packet *dp, unsigned len)
 		return 0;
 	}
 
-	m = (struct radio_message *) malloc(sizeof(struct radio_message));
-
-	memset(m, 0, sizeof(struct radio_message));
+	m = radio_msg_alloc(ctx, payload_len);
 
 	m->rat = RAT_UMTS;
 
@@ -159,10 +196,10 @@ struct radio_message * handle_3G(struct diag_packet *dp, unsigned len)
 		m->bb.arfcn[0] = 0;
 		break;
 	default:
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			printf("Discarding 3G message type=%d data=%s\n", dp->msg_type, osmo_hexdump_nospc(dp->data, payload_len));
 		}
-		free(m);
+		radio_msg_free(ctx, m);
 		return 0;
 	}
 
@@ -173,7 +210,7 @@ struct radio_message * handle_3G(struct diag_packet *dp, unsigned len)
 	return m;
 }
 
-struct radio_message * handle_4G(struct diag_packet *dp, unsigned len)
+struct radio_message * handle_4G(struct metagsm_ctx *ctx, struct diag_packet *dp, unsigned len)
 {
 	unsigned payload_len;
 	struct radio_message *m;
@@ -192,9 +229,7 @@ struct radio_message * handle_4G(struct diag_packet *dp, unsigned len)
 		return 0;
 	}
 
-	m = (struct radio_message *) malloc(sizeof(struct radio_message));
-
-	memset(m, 0, sizeof(struct radio_message));
+	m = radio_msg_alloc(ctx, payload_len);
 
 	m->rat = RAT_LTE;
 
@@ -207,6 +242,7 @@ struct radio_message * handle_4G(struct diag_packet *dp, unsigned len)
 		} else {
 			// Downlink
 		}
+		radio_msg_free(ctx, m);
 		return 0;
 		break;
 	case 0xb0e0: // LTE NAS ESM DL (protected)
@@ -230,10 +266,10 @@ struct radio_message * handle_4G(struct diag_packet *dp, unsigned len)
 		m->bb.arfcn[0] = ARFCN_UPLINK;
 		break;
 	default:
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			printf("Discarding 4G message type=%d data=%s\n", dp->msg_type, osmo_hexdump_nospc(dp->data, payload_len));
 		}
-		free(m);
+		radio_msg_free(ctx, m);
 		return 0;
 	}
 
@@ -244,7 +280,7 @@ struct radio_message * handle_4G(struct diag_packet *dp, unsigned len)
 	return m;
 }
 
-struct radio_message * handle_nas(struct diag_packet *dp, unsigned len)
+struct radio_message * handle_nas(struct metagsm_ctx *ctx, struct diag_packet *dp, unsigned len)
 {
 	/* sanity checks */
 	if (dp->msg_subtype + sizeof(struct diag_packet) + 2 > len)
@@ -253,10 +289,10 @@ struct radio_message * handle_nas(struct diag_packet *dp, unsigned len)
 	if (!dp->msg_subtype)
 		return 0;
 
-	return new_l3(&dp->data[2], dp->msg_subtype, RAT_GSM, DOMAIN_CS, get_fn(dp), dp->msg_type, MSG_SDCCH);
+	return new_l3(ctx, &dp->data[2], dp->msg_subtype, RAT_GSM, DOMAIN_CS, get_fn(dp), dp->msg_type, MSG_SDCCH);
 }
 
-struct radio_message * handle_bcch_and_rr(struct diag_packet *dp, unsigned len)
+struct radio_message * handle_bcch_and_rr(struct metagsm_ctx *ctx, struct diag_packet *dp, unsigned len)
 {
 	unsigned dtap_len;
 
@@ -273,7 +309,7 @@ struct radio_message * handle_bcch_and_rr(struct diag_packet *dp, unsigned len)
 		case 50: // Ciphering mode complete
 		case 52: // GPRS susp. request
 		case 96: // UTRAN classmark change
-			return new_l3(dp->data, dtap_len, RAT_GSM, DOMAIN_CS, get_fn(dp), 1, MSG_SDCCH);
+			return new_l3(ctx, dp->data, dtap_len, RAT_GSM, DOMAIN_CS, get_fn(dp), 1, MSG_SDCCH);
 		default:
 			print_common(dp, len);
 		}
@@ -281,19 +317,19 @@ struct radio_message * handle_bcch_and_rr(struct diag_packet *dp, unsigned len)
 	case 4: // SACCH UL
 		switch (dp->msg_subtype) {
 		case 21: // Measurement report
-			return new_l3(dp->data, dtap_len, RAT_GSM, DOMAIN_CS, get_fn(dp), 1, MSG_SACCH);
+			return new_l3(ctx, dp->data, dtap_len, RAT_GSM, DOMAIN_CS, get_fn(dp), 1, MSG_SACCH);
 		default:
 			print_common(dp, len);
 		}
 		break;
 	case 128: /* SDCCH DL RR */
-		return new_l3(dp->data, dtap_len, RAT_GSM, DOMAIN_CS, get_fn(dp), 0, MSG_SDCCH);
+		return new_l3(ctx, dp->data, dtap_len, RAT_GSM, DOMAIN_CS, get_fn(dp), 0, MSG_SDCCH);
 	case 129: /* BCCH */
-		return new_l2(dp->data, dp->data_len, RAT_GSM, DOMAIN_CS, get_fn(dp), 0, MSG_BCCH);
+		return new_l2(ctx, dp->data, dp->data_len, RAT_GSM, DOMAIN_CS, get_fn(dp), 0, MSG_BCCH);
 	case 131: /* CCCH */
-		return new_l2(dp->data, dp->data_len, RAT_GSM, DOMAIN_CS, get_fn(dp), 0, MSG_BCCH);
+		return new_l2(ctx, dp->data, dp->data_len, RAT_GSM, DOMAIN_CS, get_fn(dp), 0, MSG_BCCH);
 	case 132: /* SACCH DL RR */
-		return new_l3(dp->data, dtap_len, RAT_GSM, DOMAIN_CS, get_fn(dp), 0, MSG_SACCH);
+		return new_l3(ctx, dp->data, dtap_len, RAT_GSM, DOMAIN_CS, get_fn(dp), 0, MSG_SACCH);
 	default:
 		print_common(dp, len);
 	}
@@ -301,20 +337,20 @@ struct radio_message * handle_bcch_and_rr(struct diag_packet *dp, unsigned len)
 	return 0;
 }
 
-void handle_gsm_l1_txlev_timing_advance(struct diag_packet *dp, unsigned len)
+void handle_gsm_l1_txlev_timing_advance(struct metagsm_ctx *ctx, struct diag_packet *dp, unsigned len)
 {
 	struct gsm_l1_txlev_timing_advance *decoded = (struct gsm_l1_txlev_timing_advance*) &dp->msg_type;
 
 	decoded->arfcn_and_band = ntohs(decoded->arfcn_and_band);
 
 	if (len-16-2 != 4) {
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			printf("x gsm_l1_txlev_timing_advance length incorrect\n");
 		}
 		return;
 	}
 
-	if (msg_verbose > 1) {
+	if (ctx->msg_verbose > 1) {
 		printf("x gsm_l1_txlev_timing_advance\n");
 		//printf("x %s\n", osmo_hexdump_nospc(&dp->msg_type, len-16) );
 		printf("x -> arfcn: %d\n", get_arfcn_from_arfcn_and_band(decoded->arfcn_and_band));
@@ -324,19 +360,19 @@ void handle_gsm_l1_txlev_timing_advance(struct diag_packet *dp, unsigned len)
 	}
 }
 
-void handle_gsm_l1_surround_cell_ba_list(struct diag_packet *dp, unsigned len)
+void handle_gsm_l1_surround_cell_ba_list(struct metagsm_ctx *ctx, struct diag_packet *dp, unsigned len)
 {
 	struct gsm_l1_surround_cell_ba_list *cl = (struct gsm_l1_surround_cell_ba_list *)&dp->msg_type;
 	struct surrounding_cell *sc = cl->surr_cells;
 
 	if (len-16-2 != sizeof(struct surrounding_cell)*cl->cell_count + 1) {
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			printf("x gsm_l1_surround_cell_ba_list length incorrect\n");
 		}
 		return;
 	}
 
-	if (msg_verbose > 1) {
+	if (ctx->msg_verbose > 1) {
 		int i;
 
 		for (i = 0; i < cl->cell_count; i++) {
@@ -350,18 +386,18 @@ void handle_gsm_l1_surround_cell_ba_list(struct diag_packet *dp, unsigned len)
 	}
 }
 
-void handle_gsm_l1_burst_metrics(struct diag_packet *dp, unsigned len)
+void handle_gsm_l1_burst_metrics(struct metagsm_ctx *ctx, struct diag_packet *dp, unsigned len)
 {
 	struct gsm_l1_burst_metrics *dat = (struct gsm_l1_burst_metrics *)&dp->msg_type;
 
 	if (len-16-2 != sizeof(struct gsm_l1_burst_metrics)) {
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			printf("x gsm_l1_burst_metrics length incorrect\n");
 		}
 		return;
 	}
 
-	if (msg_verbose > 1) {
+	if (ctx->msg_verbose > 1) {
 		int i;
 
 		printf("x gsm_l1_burst_metrics\n");
@@ -380,18 +416,18 @@ void handle_gsm_l1_burst_metrics(struct diag_packet *dp, unsigned len)
 	}
 }
 
-void handle_gsm_l1_neighbor_cell_auxiliary_measurments(struct diag_packet *dp, unsigned len)
+void handle_gsm_l1_neighbor_cell_auxiliary_measurments(struct metagsm_ctx *ctx, struct diag_packet *dp, unsigned len)
 {
 	struct gsm_l1_neighbor_cell_auxiliary_measurments *cl = (struct gsm_l1_neighbor_cell_auxiliary_measurments *)&dp->msg_type;
 
 	if (len-16-2 != sizeof(struct cell)*cl->cell_count + 1) {
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			printf("x gsm_l1_neighbor_cell_auxiliary_measurments length icorrect\n");
 		}
 		return;
 	}
 
-	if (msg_verbose > 1) {
+	if (ctx->msg_verbose > 1) {
 		int i;
 
 		printf("x gsm_l1_neighbor_cell_auxiliary_measurments\n");
@@ -407,18 +443,18 @@ void handle_gsm_l1_neighbor_cell_auxiliary_measurments(struct diag_packet *dp, u
 	}
 }
 
-void handle_gsm_monitor_bursts_v2(struct diag_packet *dp, unsigned len)
+void handle_gsm_monitor_bursts_v2(struct metagsm_ctx *ctx, struct diag_packet *dp, unsigned len)
 {
 	struct gsm_monitor_bursts_v2 *cl = (struct gsm_monitor_bursts_v2 *)&dp->msg_type;
 
 	if (len-16-2 != sizeof(struct monitor_record)*cl->number_of_records + 4) {
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			printf("x gsm_monitor_bursts_v2 length incorrect\n");
 		}
 		return;
 	}
 
-	if (msg_verbose > 1) {
+	if (ctx->msg_verbose > 1) {
 		int i;
 
 		printf("x gsm_monitor_bursts_v2\n");
@@ -435,20 +471,20 @@ void handle_gsm_monitor_bursts_v2(struct diag_packet *dp, unsigned len)
 	}
 }
 
-void handle_gprs_grr_cell_reselection_measurements(struct diag_packet *dp, unsigned len)
+void handle_gprs_grr_cell_reselection_measurements(struct metagsm_ctx *ctx, struct diag_packet *dp, unsigned len)
 {
 	struct gprs_grr_cell_reselection_measurements *cl = (struct gprs_grr_cell_reselection_measurements *)&dp->msg_type;
 
 	//printf("num %d len: %d, shoudl be %d\n", cl->neighboring_6_strongest_cells_count, len-16-2, sizeof(struct neighbor)*cl->neighboring_6_strongest_cells_count + 26);
 	//assert(len-16-2 == sizeof(struct neighbor)*cl->neighboring_6_strongest_cells_count + 26);
 	if (len-16-2 != sizeof(struct gprs_grr_cell_reselection_measurements)) {
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			printf("x gprs_grr_cell_reselection_measurements length incorrect\n");
 		}
 		return;
 	}
 
-	if (msg_verbose > 1) {
+	if (ctx->msg_verbose > 1) {
 		int i;
 
 		printf("x gprs_grr_cell_reselection_measurements\n");
@@ -467,10 +503,14 @@ void handle_gprs_grr_cell_reselection_measurements(struct diag_packet *dp, unsig
 	}
 }
 
-void handle_diag(uint8_t *msg, unsigned len)
+void handle_diag_ctx(struct metagsm_ctx *ctx, uint8_t *msg, unsigned len)
 {
+	struct session_info *_s = ctx->s;
 	struct diag_packet *dp = (struct diag_packet *) msg;
 	struct radio_message *m = NULL;
+	uint64_t t;
+
+	stats_poll(&ctx->stats);
 
 	if (dp->msg_class != 0x0010) {
 		if (dp->msg_class == 0x001d) {
@@ -478,7 +518,7 @@ void handle_diag(uint8_t *msg, unsigned len)
 			_s[0].timestamp.tv_sec = get_epoch(&msg[3]);
 			_s[1].timestamp = _s[0].timestamp;
 		}
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "Class %04x is not supported\n", dp->msg_class);
 		}
 		return;
@@ -486,29 +526,31 @@ void handle_diag(uint8_t *msg, unsigned len)
 
 	assert(len > 10);
 
-	now = get_epoch(&msg[10]);
-	cell_and_paging_dump(now, 0, 0);
+	t = stats_begin(&ctx->stats, STAGE_DIAG);
+
+	*ctx->now = get_epoch(&msg[10]);
+	cell_and_paging_dump_ctx(ctx, *ctx->now, 0, 0);
 
 	switch(dp->msg_protocol) {
 	case 0x5071:
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "handle_gsm_l1_surround_cell_ba_list\n");
 		}
-		handle_gsm_l1_surround_cell_ba_list(dp, len);
+		handle_gsm_l1_surround_cell_ba_list(ctx, dp, len);
 		break;
 
 	case 0x506C:
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "handle_gsm_l1_burst_metrics\n");
 		}
-		handle_gsm_l1_burst_metrics(dp, len);
+		handle_gsm_l1_burst_metrics(ctx, dp, len);
 		break;
 
 	case 0x5076:
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "handle_gsm_l1_txlev_timing_advance\n");
 		}
-		handle_gsm_l1_txlev_timing_advance(dp, len);
+		handle_gsm_l1_txlev_timing_advance(ctx, dp, len);
 		break;
 
 	case 0x507A:
@@ -517,51 +559,51 @@ void handle_diag(uint8_t *msg, unsigned len)
 		break;
 
 	case 0x507B:
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "handle_gsm_l1_neighbor_cell_auxiliary_measurments\n");
 		}
-		handle_gsm_l1_neighbor_cell_auxiliary_measurments(dp,len);
+		handle_gsm_l1_neighbor_cell_auxiliary_measurments(ctx, dp, len);
 		break;
 
 	case 0x5082:
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "handle_gsm_monitor_bursts_v2\n");
 		}
-		handle_gsm_monitor_bursts_v2(dp, len);
+		handle_gsm_monitor_bursts_v2(ctx, dp, len);
 		break;
 
 	case 0x51FC:
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "handle_gprs_grr_cell_reselection_measurements\n");
 		}
-		handle_gprs_grr_cell_reselection_measurements(dp, len);
+		handle_gprs_grr_cell_reselection_measurements(ctx, dp, len);
 		break;
 
 	case 0x412f: // 3G RRC
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "-> Handling 3G\n");
 		}
-		m = handle_3G(dp, len);
+		m = handle_3G(ctx, dp, len);
 		break;
 
 	case 0x512f: // GSM RR
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "Handling GSM RR\n");
 		}
-		m = handle_bcch_and_rr(dp, len);
+		m = handle_bcch_and_rr(ctx, dp, len);
 		break;
 
 	case 0x5230: // GPRS GMM (doubled msg)
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "-> Not handling GPRS GMM\n");
 		}
 		break;
 
 	case 0x713a: // DTAP (2G, 3G)
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "-> Handling NAS\n");
 		}
-		m = handle_nas(dp, len);
+		m = handle_nas(ctx, dp, len);
 		break;
 
 	case 0xb0c0: // LTE RRC
@@ -573,14 +615,14 @@ void handle_diag(uint8_t *msg, unsigned len)
 	case 0xb0eb: // LTE NAS EMM UL (protected)
 	case 0xb0ec: // LTE NAS EMM DL
 	case 0xb0ed: // LTE NAS EMM UL
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "-> Handling 4G\n");
 		}
-		m = handle_4G(dp, len);
+		m = handle_4G(ctx, dp, len);
 		break;
 
 	default:
-		if (msg_verbose > 1) {
+		if (ctx->msg_verbose > 1) {
 			fprintf(stderr, "-> Handling default case\n");
 		}
 		print_common(dp, len);
@@ -588,8 +630,15 @@ void handle_diag(uint8_t *msg, unsigned len)
 	}
 
 	if (m) {
-		m->timestamp.tv_sec = now;
+		m->timestamp.tv_sec = *ctx->now;
 
 		handle_radio_msg(_s, m);
 	}
+
+	stats_end_proto(&ctx->stats, STAGE_DIAG, dp->msg_protocol, t);
+}
+
+void handle_diag(uint8_t *msg, unsigned len)
+{
+	handle_diag_ctx(metagsm_default_ctx(), msg, len);
 }
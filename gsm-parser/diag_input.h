@@ -3,9 +3,21 @@
 
 #include <stdint.h>
 
+struct metagsm_ctx;
+
+void diag_init_ctx(struct metagsm_ctx *ctx, unsigned start_sid, unsigned start_cid, const char *gsmtap_target, char *filename, uint32_t appid);
+void handle_diag_ctx(struct metagsm_ctx *ctx, uint8_t *msg, unsigned len);
+void diag_destroy_ctx(struct metagsm_ctx *ctx, unsigned *last_sid, unsigned *last_cid);
+void diag_sql_replay_ctx(struct metagsm_ctx *ctx, char type, const char *sql);
+
+/* Same as above, on the default context */
 void diag_init(unsigned start_sid, unsigned start_cid, const char *gsmtap_target, char *filename, uint32_t appid);
 void handle_diag(uint8_t *msg, unsigned len);
 void diag_destroy();
+void diag_sql_replay(char type, const char *sql);
+
 void process_file(long *sid, long *cid, char *gsmtap_target, char *infile_name, uint32_t appid);
 
+extern uint8_t diag_spool;
+
 #endif
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+
+#include "bit_func.h"
+#include "diag_reader.h"
+#include "bench.h"
+
+/*
+ * Compares the byte-at-a-time fread_unescape() loop with the mapped
+ * diag_reader on the same DIAG file. Only framing is measured, frames
+ * are checksummed but not parsed.
+ */
+
+struct bench_result {
+	uint64_t frames;
+	uint64_t bytes;
+	uint32_t sum;
+	double secs;
+};
+
+static uint32_t checksum(uint32_t sum, const uint8_t *msg, unsigned len)
+{
+	unsigned i;
+
+	for (i = 0; i < len; i++) {
+		sum = sum * 31 + msg[i];
+	}
+
+	return sum;
+}
+
+static void generate(const char *filename, unsigned mib)
+{
+	FILE *f;
+	uint8_t frame[512];
+	uint8_t out[1024];
+	uint64_t written = 0;
+	unsigned i, len, olen;
+
+	f = fopen(filename, "wb");
+	if (!f) {
+		err(1, "Cannot create %s", filename);
+	}
+
+	srandom(1);
+	while (written < (uint64_t) mib << 20) {
+		len = 32 + random() % 256;
+		for (i = 0; i < len; i++) {
+			frame[i] = random();
+		}
+		/* log packet header, class 0x0010 */
+		frame[0] = 0x10;
+		frame[1] = 0x00;
+
+		olen = 0;
+		for (i = 0; i < len; i++) {
+			if (frame[i] == 0x7e || frame[i] == 0x7d) {
+				out[olen++] = 0x7d;
+				out[olen++] = frame[i] ^ 0x20;
+			} else {
+				out[olen++] = frame[i];
+			}
+		}
+		out[olen++] = 0x7e;
+
+		if (fwrite(out, 1, olen, f) != olen) {
+			err(1, "Cannot write %s", filename);
+		}
+		written += olen;
+	}
+
+	fclose(f);
+}
+
+static void bench_fread(const char *filename, struct bench_result *res)
+{
+	FILE *f;
+	uint8_t msg[4096];
+	unsigned len;
+
+	memset(res, 0, sizeof(*res));
+
+	f = fopen(filename, "rb");
+	if (!f) {
+		err(1, "Cannot open input file: %s", filename);
+	}
+
+	res->secs = stats_secs();
+	for (;;) {
+		memset(msg, 0x2b, sizeof(msg));
+		len = fread_unescape(f, msg, sizeof(msg));
+		if (!len) {
+			break;
+		}
+		res->frames++;
+		res->bytes += len;
+		res->sum = checksum(res->sum, msg, len);
+	}
+	res->secs = stats_secs() - res->secs;
+
+	fclose(f);
+}
+
+static void bench_reader(const char *filename, struct bench_result *res)
+{
+	struct diag_reader *r;
+	uint8_t *msg;
+	unsigned len;
+
+	memset(res, 0, sizeof(*res));
+
+	res->secs = stats_secs();
+	r = diag_reader_open(filename);
+	if (!r) {
+		err(1, "Cannot open input file: %s", filename);
+	}
+	while (diag_reader_next(r, &msg, &len)) {
+		res->frames++;
+		res->bytes += len;
+		res->sum = checksum(res->sum, msg, len);
+	}
+	diag_reader_close(r);
+	res->secs = stats_secs() - res->secs;
+}
+
+static void print_result(const char *name, struct bench_result *res)
+{
+	printf("%-16s %10llu frames %8.1f MiB %8.3f s %8.1f MiB/s  sum %08x\n",
+		name,
+		(unsigned long long) res->frames,
+		res->bytes / 1048576.0,
+		res->secs,
+		res->bytes / 1048576.0 / res->secs,
+		res->sum);
+}
+
+static unsigned gen_mib = 0;
+
+static const struct bench_opt opts[] = {
+	{ 'g', BENCH_UINT, &gen_mib, "<MiB>", "Write a synthetic DIAG file of <MiB> size first" },
+	{ 0 }
+};
+
+static int diag_read_main(int argc, char *argv[])
+{
+	struct bench_result old_res, new_res;
+
+	if (bench_getopt(&diag_read_bench, argc, argv) != argc - 1) {
+		bench_usage(&diag_read_bench);
+	}
+
+	if (gen_mib) {
+		generate(argv[optind], gen_mib);
+	}
+
+	bench_fread(argv[optind], &old_res);
+	print_result("fread_unescape", &old_res);
+
+	bench_reader(argv[optind], &new_res);
+	print_result("diag_reader", &new_res);
+
+	if (old_res.frames != new_res.frames || old_res.sum != new_res.sum) {
+		printf("MISMATCH\n");
+		return 1;
+	}
+
+	printf("speedup %.1fx\n", old_res.secs / new_res.secs);
+
+	return 0;
+}
+
+const struct bench_cmd diag_read_bench = {
+	.name = "diag_read",
+	.operands = "<file>",
+	.help = "Framing DIAG files with fread_unescape() and diag_reader",
+	.opts = opts,
+	.main = diag_read_main,
+};
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "diag_reader.h"
+
+/* Undo HDLC escaping in place, returns the unescaped length */
+unsigned diag_unescape(uint8_t *msg, unsigned len)
+{
+	uint8_t *in, *out, *end;
+
+	/* Most frames carry no escapes at all */
+	in = memchr(msg, 0x7d, len);
+	if (!in) {
+		return len;
+	}
+
+	out = in;
+	end = msg + len;
+	while (in < end) {
+		if (*in == 0x7d) {
+			if (in + 1 == end)
+				break;
+			*out++ = (in[1] & 0x0f) | 0x70;
+			in += 2;
+		} else {
+			*out++ = *in++;
+		}
+	}
+
+	return out - msg;
+}
+
+struct diag_reader *diag_reader_open(const char *filename)
+{
+	struct diag_reader *r;
+	struct stat st;
+	void *map;
+
+	r = malloc(sizeof(struct diag_reader));
+	if (!r) {
+		return NULL;
+	}
+	memset(r, 0, sizeof(struct diag_reader));
+
+	if (strcmp(filename, "-") == 0) {
+		r->fd = STDIN_FILENO;
+	} else {
+		r->fd = open(filename, O_RDONLY);
+		if (r->fd < 0) {
+			free(r);
+			return NULL;
+		}
+	}
+
+	if (fstat(r->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		if (st.st_size == 0) {
+			r->mapped = 1;
+			return r;
+		}
+
+		/* Private writable mapping, frames are unescaped and
+		 * modified by the handlers in place */
+		map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, r->fd, 0);
+		if (map != MAP_FAILED) {
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			r->buf = map;
+			r->size = st.st_size;
+			r->mapped = 1;
+			return r;
+		}
+	}
+
+	/* Pipes, sockets or mmap failure: fall back to large reads */
+	r->buf = malloc(DIAG_READER_CHUNK + DIAG_READER_PAD);
+	if (!r->buf) {
+		diag_reader_close(r);
+		return NULL;
+	}
+	memset(r->buf, 0x2b, DIAG_READER_CHUNK + DIAG_READER_PAD);
+
+	return r;
+}
+
+static void diag_reader_fill(struct diag_reader *r)
+{
+	ssize_t ret;
+
+	if (r->pos) {
+		memmove(r->buf, r->buf + r->pos, r->size - r->pos);
+		r->size -= r->pos;
+		r->pos = 0;
+	}
+
+	do {
+		ret = read(r->fd, r->buf + r->size, DIAG_READER_CHUNK - r->size);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret <= 0) {
+		if (ret < 0) {
+			perror("diag_reader");
+		}
+		r->eof = 1;
+		ret = 0;
+	}
+	r->size += ret;
+
+	memset(r->buf + r->size, 0x2b, DIAG_READER_PAD);
+}
+
+/*
+ * Return the next unescaped frame as a view into the reader's buffer.
+ * The frame stays valid until the next call, at least DIAG_READER_PAD
+ * bytes starting at *frame may be read.
+ */
+int diag_reader_next(struct diag_reader *r, uint8_t **frame, unsigned *len)
+{
+	uint8_t *start, *end;
+	size_t avail;
+	unsigned n;
+
+	for (;;) {
+		avail = r->size - r->pos;
+		start = r->buf + r->pos;
+		end = avail ? memchr(start, 0x7e, avail) : NULL;
+
+		if (!end) {
+			if (!r->mapped && !r->eof && (r->pos || r->size < DIAG_READER_CHUNK)) {
+				diag_reader_fill(r);
+				continue;
+			}
+			if (!avail) {
+				return 0;
+			}
+			/* Unterminated trailing data or oversized frame */
+			end = start + avail;
+		}
+
+		r->pos += end - start;
+		if (r->pos < r->size) {
+			r->pos++;
+		}
+
+		n = diag_unescape(start, end - start);
+		if (!n) {
+			continue;
+		}
+
+		/* Do not let handlers read past the end of the mapping */
+		if (r->mapped && (size_t)(start - r->buf) + DIAG_READER_PAD > r->size) {
+			memcpy(r->tail, start, n);
+			memset(r->tail + n, 0x2b, DIAG_READER_PAD - n);
+			start = r->tail;
+		}
+
+		*frame = start;
+		*len = n;
+		return 1;
+	}
+}
+
+void diag_reader_close(struct diag_reader *r)
+{
+	if (!r) {
+		return;
+	}
+
+	if (r->mapped) {
+		if (r->buf) {
+			munmap(r->buf, r->size);
+		}
+	} else {
+		free(r->buf);
+	}
+
+	if (r->fd != STDIN_FILENO) {
+		close(r->fd);
+	}
+
+	free(r);
+}
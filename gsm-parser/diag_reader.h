@@ -0,0 +1,28 @@
+#ifndef DIAG_READER_H
+#define DIAG_READER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Minimum readable size of every returned frame buffer */
+#define DIAG_READER_PAD		4096
+/* Read size used when the input cannot be memory-mapped */
+#define DIAG_READER_CHUNK	(1 << 20)
+
+struct diag_reader {
+	int fd;
+	int mapped;
+	int eof;
+	uint8_t *buf;
+	size_t size;
+	size_t pos;
+	uint8_t tail[DIAG_READER_PAD];
+};
+
+struct diag_reader *diag_reader_open(const char *filename);
+int diag_reader_next(struct diag_reader *r, uint8_t **frame, unsigned *len);
+void diag_reader_close(struct diag_reader *r);
+
+unsigned diag_unescape(uint8_t *msg, unsigned len);
+
+#endif
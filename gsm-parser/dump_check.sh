@@ -0,0 +1,58 @@
+#!/bin/bash
+#
+# Replays traffic_gen captures with different output settings into
+# fresh SQLite databases and compares their contents, which must not
+# depend on the settings. Run from the directory holding the tools of
+# an SQLITE=1 build, e.g. with "make SQLITE=1 check".
+
+SRC=$(cd "$(dirname "$0")" && pwd)
+BIN=$(pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+TABLES="session_info sid_appid sms_meta cell_info arfcn_list paging_info"
+FAILED=0
+
+# run <name> <command> [args]: runs the command in an empty database
+# and dumps the tables to $TMP/<name>.dump
+run() {
+	local name=$1
+	shift
+
+	mkdir $TMP/$name
+	cat $SRC/si.sql $SRC/sms.sql $SRC/cell_info.sql | grep -v '^/\*!' | sqlite3 $TMP/$name/metadata.db
+	(cd $TMP/$name && "$@" > stdout.txt 2>&1) || {
+		echo "FAILED $name: $*"
+		tail $TMP/$name/stdout.txt
+		exit 1
+	}
+	for t in $TABLES; do
+		echo "== $t"
+		sqlite3 $TMP/$name/metadata.db "SELECT * FROM $t" | sort
+	done > $TMP/$name.dump
+}
+
+# compare <name> <name> <description>
+compare() {
+	if cmp -s $TMP/$1.dump $TMP/$2.dump; then
+		echo "OK       $3"
+	else
+		echo "MISMATCH $3"
+		diff $TMP/$1.dump $TMP/$2.dump | head -20
+		FAILED=1
+	fi
+}
+
+# Cells dumped when changed (default) or all of them each time (-F)
+$BIN/traffic_gen -S 1 -n 2000 -w $TMP/check.diag > /dev/null || exit 1
+run dirty $BIN/diag_import -s 100 -c 10 $TMP/check.diag
+run full $BIN/diag_import -s 100 -c 10 -F $TMP/check.diag
+compare dirty full "diag_import with and without -F"
+
+# Blocks decoded one by one or in batches, ciphering starting mid-batch
+$BIN/traffic_gen -f burst -S 7 -n 200 -k $TMP/check.keys -w $TMP/check.bursts > /dev/null || exit 1
+run single $BIN/burst_import -k $TMP/check.keys -b 1 $TMP/check.bursts
+run batch $BIN/burst_import -k $TMP/check.keys $TMP/check.bursts
+compare single batch "burst_import with -b 1 and default batch"
+
+exit $FAILED
@@ -3,21 +3,31 @@
 
 #include "bit_func.h"
 #include "cch.h"
-#include "punct.h"
 #include "viterbi.h"
 #include "gprs.h"
 #include "rlcmac.h"
 #include "gsm_interleave.h"
 #include "crc.h"
 
-static unsigned map_cs2[456];
-static unsigned map_cs3[456];
+/* Hard bits as Viterbi input, 0 -> 127 and 1 -> -127 */
+static const int8_t hard_amp[4] = {127, 127, 127, 127};
+
+/* CRC-16 (CCITT) of CS-2 to CS-4 */
+static const uint8_t ccitt_poly[16 + 1] = {1, 0, 0, 0, 1, 0, 0, 0,
+					   0, 0, 0, 1, 0, 0, 0, 0,
+					   1};
+
+static const uint8_t ccitt_rem[16] = {1, 1, 1, 1, 1, 1, 1, 1,
+				      1, 1, 1, 1, 1, 1, 1, 1};
+
+static struct parity_poly ccitt;
 
 void gprs_init()
 {
-	fill_punct_cs2(map_cs2);
-	fill_punct_cs3(map_cs3);
-	memset(tbf_table, 0, sizeof(tbf_table));
+	struct metagsm_ctx *ctx = metagsm_default_ctx();
+
+	parity_poly_init(&ccitt, ccitt_poly, ccitt_rem, 16);
+	memset(ctx->tbf_table, 0, sizeof(ctx->tbf_table));
 }
 
 inline unsigned distance(const uint8_t *a, const uint8_t *b, const unsigned size)
@@ -118,14 +128,8 @@ int process_pdch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *gp
 	struct burst_buf *bb;
 	struct radio_message m;
 	uint8_t conv_data[CONV_SIZE];
-	int8_t depunct_data[2*CONV_SIZE];
+	int8_t soft_data[2*CONV_SIZE];
 	uint8_t decoded_data[2*CONV_SIZE];
-	const uint8_t ccitt_poly[16 + 1] = {1, 0, 0, 0, 1, 0, 0, 0,
-					    0, 0, 0, 1, 0, 0, 0, 0,
-					    1};
-
-	const uint8_t ccitt_rem[16] = {1, 1, 1, 1, 1, 1, 1, 1,
-				       1, 1, 1, 1, 1, 1, 1, 1};
 
 	/* get burst parameters */
 	fn = ntohl(bi->frame_nr);
@@ -144,7 +148,8 @@ int process_pdch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *gp
 		return 0;
 
 	/* enqueue data into message buffer */
-	expand_msb(bi->bits, bb->data + bb->count * 114, 114);
+	memcpy(bb->data + bb->count * BURST_BYTES, bi->bits, BURST_BYTES);
+	bb->data[bb->count * BURST_BYTES + BURST_BYTES - 1] &= 0xc0;
 
 	/* save stealing flags */
 	bb->sbit[bb->count * 2 + 0] = !!(bi->bits[14] & 0x10);
@@ -160,22 +165,21 @@ int process_pdch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *gp
 	if (bb->count < 4)
 		return 0;
 
-	/* de-interleaving */
-	memset(conv_data, 0, sizeof(conv_data));
-	gsm_deinter_sacch(bb->data, conv_data);
-
 	len = 0;
 
 	switch (cs_estimate(bb->sbit)) {
 	case CS1:
-		len = decode_signalling(conv_data, gprs_msg);
+		/* de-interleave and convert to soft bits */
+		gsm_deinter_soft(DEINTER_XCCH, bb->data, hard_amp, soft_data);
+
+		len = decode_signalling(soft_data, gprs_msg);
 		break;
 	case CS2:
-		/* depuncture and convert to soft bits */
-		depunct(conv_data, depunct_data, 294*2, map_cs2);
+		/* de-interleave, depuncture and convert to soft bits */
+		gsm_deinter_soft(DEINTER_CS2, bb->data, hard_amp, soft_data);
 
 		/* Viterbi decode */
-		conv_cch_decode(depunct_data, decoded_data, 294);
+		conv_cch_decode(soft_data, decoded_data, 294);
 
 		/* decode USF bits */
 		usf = usf6_estimate(decoded_data);
@@ -186,7 +190,7 @@ int process_pdch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *gp
 		decoded_data[5] = (usf >> 0) & 1;
 
 		/* compute CRC-16 (CCITT) */
-		ret = parity_check(decoded_data + 3, 271, ccitt_poly, ccitt_rem, 16);
+		ret = parity_poly_check(&ccitt, decoded_data + 3, 271);
 
 		if (!ret) {
 			compress_lsb(decoded_data + 3, gprs_msg, 33 * 8);
@@ -194,11 +198,11 @@ int process_pdch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *gp
 		}
 		break;
 	case CS3:
-		/* depuncture and convert to soft bits */
-		depunct(conv_data, depunct_data, 338*2, map_cs3);
+		/* de-interleave, depuncture and convert to soft bits */
+		gsm_deinter_soft(DEINTER_CS3, bb->data, hard_amp, soft_data);
 
 		/* Viterbi decode */
-		conv_cch_decode(depunct_data, decoded_data, 338);
+		conv_cch_decode(soft_data, decoded_data, 338);
 
 		/* decode USF bits */
 		usf = usf6_estimate(decoded_data);
@@ -209,7 +213,7 @@ int process_pdch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *gp
 		decoded_data[5] = (usf >> 0) & 1;
 
 		/* compute CRC-16 (CCITT) */
-		ret = parity_check(decoded_data + 3, 315, ccitt_poly, ccitt_rem, 16);
+		ret = parity_poly_check(&ccitt, decoded_data + 3, 315);
 
 		if (!ret) {
 			compress_lsb(decoded_data + 3, gprs_msg, 39 * 8);
@@ -217,6 +221,9 @@ int process_pdch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *gp
 		}
 		break;
 	case CS4:
+		/* de-interleaving, CS-4 has no convolutional code */
+		gsm_deinter_sacch_packed(bb->data, conv_data);
+
 		/* decode USF bits */
 		usf = usf12_estimate(conv_data);
 
@@ -226,7 +233,7 @@ int process_pdch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *gp
 		conv_data[11] = (usf >> 0) & 1;
 
 		/* compute CRC-16 (CCITT) */
-		ret = parity_check(conv_data + 9, 431, ccitt_poly, ccitt_rem, 16);
+		ret = parity_poly_check(&ccitt, conv_data + 9, 431);
 
 		if (!ret) {
 			compress_lsb(conv_data + 9, gprs_msg, 53 * 8);
@@ -246,11 +253,11 @@ int process_pdch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *gp
 		memcpy(m.msg, gprs_msg, len);
 
 		/* call handler */
-		rlc_type_handler(&m);
+		rlc_type_handler(s->ctx->tbf_table, &m);
 	}
 
 	/* reset buffer */
-	memset(bb->data, 0, sizeof(bb->data));
+	memset(bb->data, 0, 4 * BURST_BYTES);
 	bb->count = 0;
 
 	return len;
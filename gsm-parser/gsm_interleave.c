@@ -1,8 +1,48 @@
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GSM_DEINTER_X86 1
+#include <immintrin.h>
+#endif
+
 #include "gsm_interleave.h"
+#include "process.h"
+#include "punct.h"
 
 static unsigned _sacch_map[456];
 static unsigned _facch_map[456];
 
+/* Same maps for packed bursts: byte offset << 3 | bit shift */
+static uint16_t _sacch_pmap[456];
+static uint16_t _facch_pmap[456];
+
+/*
+ * Fused deinterleave, depuncture and soft bit tables, one entry per Viterbi
+ * input bit: byte offset in the packed bursts << 8 | bit shift << 4 |
+ * amplitude index. Punctured bits use the zero amplitude DEINTER_PUNCT.
+ */
+#define DEINTER_PUNCT		8
+#define DEINTER_ENTRY(p, a)	((p) >> 3 << 8 | ((p) & 7) << 4 | (a))
+#define DEINTER_MAX		676
+
+static uint16_t _deinter_map[DEINTER_SCHEMES][DEINTER_MAX];
+
+static const unsigned _deinter_size[DEINTER_SCHEMES] = { 456, 456, 588, 676 };
+static const unsigned _deinter_bursts[DEINTER_SCHEMES] = { 4, 8, 4, 4 };
+
+typedef void (*gsm_deinter_func)(enum deinter_scheme, const uint8_t *, const int8_t *, int8_t *);
+static gsm_deinter_func _deinter_func;
+static const char *_deinter_name;
+
+static void gsm_deinter_soft_init();
+
+static uint16_t packed_pos(unsigned pos)
+{
+	unsigned B = pos / BURST_BITS, j = pos % BURST_BITS;
+
+	return (B * BURST_BYTES + j / 8) << 3 | (7 - j % 8);
+}
+
 void gsm_interleave_init()
 {
 	int j, k, B;
@@ -12,6 +52,7 @@ void gsm_interleave_init()
 		B = k % 4;
 		j = 2 * ((49 * k) % 57) + ((k % 8) / 4);
 		_sacch_map[k] = B * 114 + j;
+		_sacch_pmap[k] = packed_pos(_sacch_map[k]);
 	}
 
 	/* facch map */
@@ -19,7 +60,10 @@ void gsm_interleave_init()
 		B = k % 8;
 		j = 2 * ((49 * k) % 57) + ((k % 8) / 4);
 		_facch_map[k] = B * 114 + j;
+		_facch_pmap[k] = packed_pos(_facch_map[k]);
 	}
+
+	gsm_deinter_soft_init();
 }
 
 void gsm_inter_sacch(const uint8_t *src, uint8_t *dst)
@@ -50,3 +94,134 @@ void gsm_deinter_facch(const uint8_t *src, uint8_t *dst)
 		dst[k] = src[_facch_map[k]];
 }
 
+
+#define PMAP_BIT(src, p)	(((src)[(p) >> 3] >> ((p) & 7)) & 1)
+
+/* One bit per byte to 4 packed bursts, pad bits clear */
+void gsm_inter_sacch_packed(const uint8_t *src, uint8_t *dst)
+{
+	int k;
+	memset(dst, 0, 4 * BURST_BYTES);
+	for (k = 0; k < 456; k++)
+		dst[_sacch_pmap[k] >> 3] |= (src[k] & 1) << (_sacch_pmap[k] & 7);
+}
+
+/* 4 packed bursts to one bit per byte */
+void gsm_deinter_sacch_packed(const uint8_t *src, uint8_t *dst)
+{
+	int k;
+	for (k = 0; k < 456; k++)
+		dst[k] = PMAP_BIT(src, _sacch_pmap[k]);
+}
+
+/* Puncturing pattern: deinterleaved bit k goes to Viterbi input pattern[k] */
+static void deinter_fill(enum deinter_scheme scheme, const uint16_t *pmap, const unsigned *pattern)
+{
+	uint16_t *map = _deinter_map[scheme];
+	unsigned k;
+
+	for (k = 0; k < DEINTER_MAX; k++)
+		map[k] = DEINTER_ENTRY(0, DEINTER_PUNCT);
+	for (k = 0; k < 456; k++)
+		map[pattern ? pattern[k] : k] = DEINTER_ENTRY(pmap[k], (pmap[k] >> 3) / BURST_BYTES);
+}
+
+static inline void deinter_soft_range(const uint16_t *map, const uint8_t *src,
+				      const int8_t *amps, int8_t *dst, unsigned k, unsigned n)
+{
+	uint8_t b;
+
+	for (; k < n; k++) {
+		b = (src[map[k] >> 8] >> ((map[k] >> 4) & 15)) & 1;
+		/* b ? -amp : amp, without a branch */
+		dst[k] = (amps[map[k] & 15] ^ -b) + b;
+	}
+}
+
+void gsm_deinter_soft_scalar(enum deinter_scheme scheme, const uint8_t *src, const int8_t *amp, int8_t *dst)
+{
+	int8_t amps[DEINTER_PUNCT + 1] = {0};
+
+	memcpy(amps, amp, _deinter_bursts[scheme]);
+
+	deinter_soft_range(_deinter_map[scheme], src, amps, dst, 0, _deinter_size[scheme]);
+}
+
+#ifdef GSM_DEINTER_X86
+/* 8 bits per step: gather the word holding each bit, shift and map to +-amp */
+__attribute__((target("avx2")))
+static void gsm_deinter_soft_avx2(enum deinter_scheme scheme, const uint8_t *src, const int8_t *amp, int8_t *dst)
+{
+	const uint16_t *map = _deinter_map[scheme];
+	unsigned k, n = _deinter_size[scheme];
+	uint8_t buf[8 * BURST_BYTES + 4] = {0};
+	int32_t amp32[8] = {0};
+	int8_t amps[DEINTER_PUNCT + 1] = {0};
+	__m256i e, w, bit, a, v;
+	__m128i v16;
+
+	/* gathers read 4 bytes from the offset of each bit */
+	memcpy(buf, src, _deinter_bursts[scheme] * BURST_BYTES);
+	memcpy(amps, amp, _deinter_bursts[scheme]);
+	for (k = 0; k < _deinter_bursts[scheme]; k++)
+		amp32[k] = amp[k];
+
+	const __m256i ampv = _mm256_loadu_si256((const __m256i *) amp32);
+	const __m256i punct = _mm256_set1_epi32(DEINTER_PUNCT);
+	const __m256i low4 = _mm256_set1_epi32(15);
+	const __m256i one = _mm256_set1_epi32(1);
+
+	for (k = 0; k + 8 <= n; k += 8) {
+		e = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) &map[k]));
+		w = _mm256_i32gather_epi32((const int *) buf, _mm256_srli_epi32(e, 8), 1);
+		bit = _mm256_and_si256(_mm256_srlv_epi32(w, _mm256_and_si256(_mm256_srli_epi32(e, 4), low4)), one);
+
+		e = _mm256_and_si256(e, low4);
+		a = _mm256_permutevar8x32_epi32(ampv, e);
+		a = _mm256_andnot_si256(_mm256_cmpeq_epi32(e, punct), a);
+
+		v = _mm256_add_epi32(_mm256_xor_si256(a, _mm256_sub_epi32(_mm256_setzero_si256(), bit)), bit);
+		v16 = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+		_mm_storel_epi64((__m128i *) &dst[k], _mm_packs_epi16(v16, v16));
+	}
+
+	deinter_soft_range(map, buf, amps, dst, k, n);
+}
+#endif
+
+static void gsm_deinter_soft_init()
+{
+	unsigned pattern[456];
+
+	deinter_fill(DEINTER_XCCH, _sacch_pmap, NULL);
+	deinter_fill(DEINTER_FACCH, _facch_pmap, NULL);
+	fill_punct_cs2(pattern);
+	deinter_fill(DEINTER_CS2, _sacch_pmap, pattern);
+	fill_punct_cs3(pattern);
+	deinter_fill(DEINTER_CS3, _sacch_pmap, pattern);
+
+	_deinter_func = gsm_deinter_soft_scalar;
+	_deinter_name = "scalar";
+#ifdef GSM_DEINTER_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		_deinter_func = gsm_deinter_soft_avx2;
+		_deinter_name = "avx2";
+	}
+#endif
+}
+
+void gsm_deinter_soft(enum deinter_scheme scheme, const uint8_t *src, const int8_t *amp, int8_t *dst)
+{
+	_deinter_func(scheme, src, amp, dst);
+}
+
+unsigned gsm_deinter_size(enum deinter_scheme scheme)
+{
+	return _deinter_size[scheme];
+}
+
+const char *gsm_deinter_impl_name()
+{
+	return _deinter_name;
+}
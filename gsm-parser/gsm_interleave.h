@@ -11,4 +11,28 @@ void gsm_deinter_sacch(const uint8_t *src, uint8_t *dst);
 void gsm_inter_facch(const uint8_t *src, uint8_t *dst);
 void gsm_deinter_facch(const uint8_t *src, uint8_t *dst);
 
+/* Same, from bursts packed as in struct burst_buf */
+void gsm_inter_sacch_packed(const uint8_t *src, uint8_t *dst);
+void gsm_deinter_sacch_packed(const uint8_t *src, uint8_t *dst);
+
+/* Coding schemes with a fused deinterleave and depuncture table */
+enum deinter_scheme {
+	DEINTER_XCCH,	/* SACCH, SDCCH and CS-1, 456 bits */
+	DEINTER_FACCH,	/* FACCH over 8 bursts, 456 bits */
+	DEINTER_CS2,	/* 588 bits, 132 punctured */
+	DEINTER_CS3,	/* 676 bits, 220 punctured */
+	DEINTER_SCHEMES
+};
+
+/*
+ * Packed bursts straight to Viterbi input, amp[B] being the amplitude of
+ * burst B and punctured bits 0. Writes gsm_deinter_size() soft bits.
+ */
+void gsm_deinter_soft(enum deinter_scheme scheme, const uint8_t *src, const int8_t *amp, int8_t *dst);
+unsigned gsm_deinter_size(enum deinter_scheme scheme);
+
+/* The fastest kernel is picked at init, the scalar one is kept for tests */
+void gsm_deinter_soft_scalar(enum deinter_scheme scheme, const uint8_t *src, const int8_t *amp, int8_t *dst);
+const char *gsm_deinter_impl_name();
+
 #endif
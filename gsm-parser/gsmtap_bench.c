@@ -0,0 +1,430 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <err.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <osmocom/gsm/rsl.h>
+#include <osmocom/core/gsmtap.h>
+#include <osmocom/core/gsmtap_util.h>
+#include <osmocom/core/select.h>
+
+#include "output.h"
+#include "bench.h"
+
+/*
+ * Checks the batched GSMTAP output against the msgb per message one it
+ * replaced, kept below as ref_*: both send the same radio messages, LLC
+ * and RLC/MAC blocks to a socket bound to the GSMTAP port on loopback,
+ * which must receive the same datagrams. Then times both, a child process
+ * draining the socket.
+ */
+
+#define CHECK_CHUNK	32
+
+static struct gsmtap_inst *ref_gti = NULL;
+
+static void ref_net_send_rlcmac(uint8_t *msg, int len, int ts, uint8_t ul)
+{
+	if (ref_gti) {
+		gsmtap_send(ref_gti, ul?ARFCN_UPLINK:0, ts, GSMTAP_CHANNEL_PACCH, 0, 0, 0, 0, msg, len);
+	}
+}
+
+static void ref_net_send_llc(uint8_t *data, int len, uint8_t ul)
+{
+	struct msgb *msg;
+	struct gsmtap_hdr *gh;
+	uint8_t *dst;
+
+	if (!ref_gti)
+		return;
+
+	if ((data[0] == 0x43) &&
+	    (data[1] == 0xc0) &&
+	    (data[2] == 0x01))
+		return;
+
+	msg = msgb_alloc(sizeof(*gh) + len, "gsmtap_tx");
+	if (!msg)
+		return;
+
+	gh = (struct gsmtap_hdr *) msgb_put(msg, sizeof(*gh));
+
+	gh->version = GSMTAP_VERSION;
+	gh->hdr_len = sizeof(*gh)/4;
+	gh->type = 8;
+	gh->timeslot = 0;
+	gh->sub_slot = 0;
+	gh->arfcn = ul ? htons(ARFCN_UPLINK) : 0;
+	gh->snr_db = 0;
+	gh->signal_dbm = 0;
+	gh->frame_number = 0;
+	gh->sub_type = 0;
+	gh->antenna_nr = 0;
+
+	dst = msgb_put(msg, len);
+	memcpy(dst, data, len);
+
+	gsmtap_sendmsg(ref_gti, msg);
+}
+
+static void ref_net_send_msg(struct radio_message *m)
+{
+	struct msgb *msgb = 0;
+	uint8_t gsmtap_channel;
+
+	if (!(ref_gti && (m->flags & MSG_DECODED)))
+		return;
+
+	switch (m->rat) {
+	case RAT_GSM: {
+		uint8_t ts, type, subch;
+
+		rsl_dec_chan_nr(m->chan_nr, &type, &subch, &ts);
+
+		gsmtap_channel = chantype_rsl2gsmtap(type, (m->flags & MSG_SACCH) ? 0x40 : 0);
+
+		msgb = gsmtap_makemsg(m->bb.arfcn[0], ts, gsmtap_channel, subch,
+				 m->bb.fn[0], m->bb.rxl[0], m->bb.snr[0], m->msg, m->msg_len);
+		break;
+	}
+
+	case RAT_UMTS:
+		if (m->flags & MSG_SDCCH) {
+			if (m->bb.arfcn[0] & ARFCN_UPLINK) {
+				gsmtap_channel = GSMTAP_RRC_SUB_UL_DCCH_Message;
+			} else {
+				gsmtap_channel = GSMTAP_RRC_SUB_DL_DCCH_Message;
+			}
+		} else if (m->flags & MSG_FACCH) {
+			if (m->bb.arfcn[0] & ARFCN_UPLINK) {
+				gsmtap_channel = GSMTAP_RRC_SUB_UL_CCCH_Message;
+			} else {
+				gsmtap_channel = GSMTAP_RRC_SUB_DL_CCCH_Message;
+			}
+		} else {
+			/* no other types defined */
+			return;
+		}
+		msgb = gsmtap_makemsg_ex(GSMTAP_TYPE_UMTS_RRC, m->bb.arfcn[0], 0,
+				 gsmtap_channel, 0, 0, 0, 0, m->bb.data, m->msg_len);
+		break;
+	case RAT_LTE:
+		msgb = gsmtap_makemsg_ex(0x0e, m->bb.arfcn[0], 0,
+					 0, 0, 0, 0, 0, m->bb.data, m->msg_len);
+		break;
+	}
+
+	if (msgb) {
+		int ret = gsmtap_sendmsg(ref_gti, msgb);
+		if (ret != 0) {
+			msgb_free(msgb);
+		} else {
+			osmo_select_main(1);
+		}
+	}
+}
+
+/* Channel numbers of every type rsl_dec_chan_nr() knows, timeslot 0 */
+static const uint8_t chan_nrs[] = { 0x08, 0x10, 0x18, 0x20, 0x38, 0x40, 0x78, 0x80, 0x88, 0x90 };
+
+/* Radio messages of every RAT and channel, LLC frames and RLC/MAC blocks */
+struct sample {
+	uint8_t kind;	/* 0 radio message, 1 LLC, 2 RLC/MAC */
+	uint8_t ul;
+	uint8_t ts;
+	struct radio_message m;
+};
+
+static void make_sample(struct sample *s)
+{
+	struct radio_message *m = &s->m;
+	unsigned i, len;
+
+	memset(s, 0, sizeof(*s));
+
+	s->kind = rand() % 8 == 0 ? 1 + rand() % 2 : 0;
+	s->ul = rand() & 1;
+	s->ts = rand() % 8;
+
+	m->rat = rand() % 3;
+	m->flags = MSG_DECODED;
+	switch (rand() % 4) {
+	case 0: m->flags |= MSG_SDCCH; break;
+	case 1: m->flags |= MSG_SACCH; break;
+	case 2: m->flags |= MSG_FACCH; break;
+	}
+	m->chan_nr = chan_nrs[rand() % sizeof(chan_nrs)] | s->ts;
+	m->bb.arfcn[0] = rand() % 1024 | (s->ul ? ARFCN_UPLINK : 0);
+	m->bb.fn[0] = rand() % 2715648;
+	m->bb.rxl[0] = rand() % 64;
+	m->bb.snr[0] = rand() % 64;
+
+	if (m->rat == RAT_GSM && !s->kind) {
+		len = 1 + rand() % sizeof(m->msg);
+	} else {
+		len = 1 + rand() % (rand() % 16 ? 256 : sizeof(m->bb.data));
+	}
+	m->msg_len = len;
+	for (i = 0; i < len; i++) {
+		m->msg[i % sizeof(m->msg)] = rand();
+		m->bb.data[i] = rand();
+	}
+}
+
+static void send_sample(struct sample *s, int ref)
+{
+	struct radio_message *m = &s->m;
+
+	switch (s->kind) {
+	case 0:
+		if (ref) {
+			ref_net_send_msg(m);
+		} else {
+			net_send_msg(m);
+		}
+		break;
+	case 1:
+		if (ref) {
+			ref_net_send_llc(m->bb.data, m->msg_len < 3 ? 3 : m->msg_len, s->ul);
+		} else {
+			net_send_llc(m->bb.data, m->msg_len < 3 ? 3 : m->msg_len, s->ul);
+		}
+		break;
+	case 2:
+		if (ref) {
+			ref_net_send_rlcmac(m->msg, m->msg_len > 64 ? 64 : m->msg_len, s->ts, s->ul);
+		} else {
+			net_send_rlcmac(m->msg, m->msg_len > 64 ? 64 : m->msg_len, s->ts, s->ul);
+		}
+		break;
+	}
+}
+
+struct datagram {
+	unsigned len;
+	uint8_t data[2048];
+};
+
+/* Receives up to max datagrams, waiting a little for stragglers */
+static unsigned receive(int fd, struct datagram *d, unsigned max)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	unsigned n = 0;
+	ssize_t ret;
+
+	while (n < max && poll(&pfd, 1, 100) > 0) {
+		ret = recv(fd, d[n].data, sizeof(d[n].data), 0);
+		if (ret < 0) {
+			err(1, "recv");
+		}
+		d[n++].len = ret;
+	}
+
+	return n;
+}
+
+/* Ignores the reserved header octet, left uninitialized by libosmocore */
+static int same_datagram(struct datagram *a, struct datagram *b)
+{
+	struct gsmtap_hdr *gh;
+
+	if (a->len != b->len || a->len < sizeof(*gh))
+		return 0;
+
+	gh = (struct gsmtap_hdr *) a->data;
+	gh->res = ((struct gsmtap_hdr *) b->data)->res;
+
+	return !memcmp(a->data, b->data, a->len);
+}
+
+/* Counts datagrams until one shorter than a GSMTAP header, then writes the count */
+static void drain(int fd, int out)
+{
+	static uint8_t buf[64][2048];
+	struct mmsghdr msgs[64];
+	struct iovec iov[64];
+	unsigned long count = 0;
+	int i, ret;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < 64; i++) {
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = sizeof(buf[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	while (1) {
+		ret = recvmmsg(fd, msgs, 64, MSG_WAITFORONE, NULL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			err(1, "recvmmsg");
+		}
+		for (i = 0; i < ret; i++) {
+			if (msgs[i].msg_len < sizeof(struct gsmtap_hdr)) {
+				if (write(out, &count, sizeof(count)) != sizeof(count))
+					err(1, "write");
+				return;
+			}
+			count++;
+		}
+	}
+}
+
+/* Times sending the samples in a loop, returns messages per second */
+static double timed_send(int fd, struct sample *samples, unsigned count, unsigned n, int ref, unsigned long *received)
+{
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	int pipefd[2];
+	double t;
+	unsigned i;
+	pid_t pid;
+	int end;
+
+	if (pipe(pipefd) < 0)
+		err(1, "pipe");
+
+	pid = fork();
+	if (pid < 0)
+		err(1, "fork");
+	if (!pid) {
+		close(pipefd[0]);
+		drain(fd, pipefd[1]);
+		_exit(0);
+	}
+	close(pipefd[1]);
+
+	t = stats_secs();
+	for (i = 0; i < n; i++) {
+		send_sample(&samples[i % count], ref);
+	}
+	net_flush();
+	t = stats_secs() - t;
+
+	/* End marker after all datagrams, loopback keeps the order */
+	getsockname(fd, (struct sockaddr *) &addr, &addr_len);
+	end = socket(AF_INET, SOCK_DGRAM, 0);
+	if (end < 0 || sendto(end, "", 1, 0, (struct sockaddr *) &addr, addr_len) != 1)
+		err(1, "Cannot send end marker");
+	close(end);
+
+	if (read(pipefd[0], received, sizeof(*received)) != sizeof(*received))
+		errx(1, "Cannot read received count");
+	close(pipefd[0]);
+	waitpid(pid, NULL, 0);
+
+	return n / t;
+}
+
+static unsigned messages = 1000000;
+static unsigned checked = 10000;
+
+static const struct bench_opt opts[] = {
+	{ 'n', BENCH_UINT, &messages, "<messages>", "Messages timed" },
+	{ 'c', BENCH_UINT, &checked, "<messages>", "Messages checked" },
+	{ 0 }
+};
+
+static int gsmtap_main(int argc, char *argv[])
+{
+	unsigned count = 4096;
+	struct sample *samples;
+	struct datagram *ref_d, *new_d;
+	struct sockaddr_in addr;
+	unsigned long ref_received, new_received;
+	double ref_rate, new_rate;
+	unsigned i, j, k, ref_n, new_n;
+	int fd, size;
+
+	if (bench_getopt(&gsmtap_bench, argc, argv) != argc) {
+		bench_usage(&gsmtap_bench);
+	}
+
+	/* Taking the GSMTAP port first keeps net_init() from adding its sink,
+	 * libosmocore reports the failed bind */
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		err(1, "socket");
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(GSMTAP_UDP_PORT);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		err(1, "Cannot bind 127.0.0.1:%u", GSMTAP_UDP_PORT);
+	size = 8 << 20;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	ref_gti = gsmtap_source_init("127.0.0.1", GSMTAP_UDP_PORT, 0);
+	if (!ref_gti)
+		errx(1, "Cannot initialize GSMTAP");
+	net_init("127.0.0.1");
+
+	srand(1);
+	samples = malloc(count * sizeof(*samples));
+	ref_d = malloc(CHECK_CHUNK * sizeof(*ref_d));
+	new_d = malloc(CHECK_CHUNK * sizeof(*new_d));
+	if (!samples || !ref_d || !new_d)
+		errx(1, "Cannot allocate samples");
+	for (i = 0; i < count; i++) {
+		make_sample(&samples[i]);
+	}
+
+	for (i = 0; i < checked; i += CHECK_CHUNK) {
+		k = checked - i < CHECK_CHUNK ? checked - i : CHECK_CHUNK;
+
+		for (j = 0; j < k; j++) {
+			send_sample(&samples[(i + j) % count], 1);
+		}
+		ref_n = receive(fd, ref_d, CHECK_CHUNK);
+
+		for (j = 0; j < k; j++) {
+			send_sample(&samples[(i + j) % count], 0);
+		}
+		net_flush();
+		new_n = receive(fd, new_d, CHECK_CHUNK);
+
+		if (ref_n != new_n) {
+			printf("MISMATCH at message %u, %u datagrams, expected %u\n", i, new_n, ref_n);
+			return 1;
+		}
+		for (j = 0; j < ref_n; j++) {
+			if (!same_datagram(&new_d[j], &ref_d[j])) {
+				printf("MISMATCH in datagram %u of messages %u..%u\n", j, i, i + k - 1);
+				return 1;
+			}
+		}
+	}
+	printf("%u messages checked\n", checked);
+
+	ref_rate = timed_send(fd, samples, count, messages, 1, &ref_received);
+	new_rate = timed_send(fd, samples, count, messages, 0, &new_received);
+
+	printf("%-16s %10u msgs %10lu received %10.0f msgs/s\n",
+	       "gsmtap_sendmsg", messages, ref_received, ref_rate);
+	printf("%-16s %10u msgs %10lu received %10.0f msgs/s %6.1fx\n",
+	       "sendmmsg", messages, new_received, new_rate, new_rate / ref_rate);
+
+	net_destroy();
+	close(fd);
+
+	return 0;
+}
+
+const struct bench_cmd gsmtap_bench = {
+	.name = "gsmtap",
+	.help = "GSMTAP output through libosmocore and sendmmsg",
+	.opts = opts,
+	.main = gsmtap_main,
+};
@@ -15,6 +15,7 @@
 #include "process.h"
 #include "cell_info.h"
 #include "l3_handler.h"
+#include "output.h"
 
 void chantype_from_gsmtap(struct radio_message *m, uint8_t gsmtap_chantype, uint8_t timeslot)
 {
@@ -79,13 +80,11 @@ void process_gsmtap(const struct pcap_pkthdr* pkt_hdr, const u_char* pkt_data, u
 
 	offset += gh->hdr_len*4;
 
-	m = (struct radio_message *) malloc(sizeof(struct radio_message));
-	if (!m) {
-		printf("Cannot allocate memory for radio message\n");
-		exit(1);
+	if (pkt_hdr->len - offset > sizeof(m->bb.data)) {
+		return;
 	}
 
-	memset(m, 0, sizeof(*m));
+	m = radio_msg_alloc(_s->ctx, pkt_hdr->len - offset);
 
 	m->bb.fn[0] = ntohl(gh->frame_number);
 	m->bb.arfcn[0] = ntohs(gh->arfcn);
@@ -106,7 +105,7 @@ void process_gsmtap(const struct pcap_pkthdr* pkt_hdr, const u_char* pkt_data, u
 		memcpy(m->bb.data, &pkt_data[offset], m->msg_len);
 		break;
 	default:
-		free(m);
+		radio_msg_free(_s->ctx, m);
 		return;
 	}
 
@@ -114,6 +113,8 @@ void process_gsmtap(const struct pcap_pkthdr* pkt_hdr, const u_char* pkt_data, u
 		_s->timestamp = pkt_hdr->ts;
 		m->timestamp = pkt_hdr->ts;
 		handle_radio_msg(_s, m);
+	} else {
+		radio_msg_free(_s->ctx, m);
 	}
 }
 
@@ -166,6 +167,7 @@ void process_ethernet(u_char *arg, const struct pcap_pkthdr* pkt_hdr, const u_ch
 		process_vlan(pkt_hdr, pkt_data, 14);
 		break;
 	}
+	net_poll();
 }
 
 int main(int argc, char *argv[]) {
@@ -20,6 +20,7 @@
 #include "output.h"
 #include "umts_rrc.h"
 #include "lte_eps.h"
+#include "l3_handler.h"
 
 void handle_classmark(struct session_info *s, uint8_t *data, uint8_t type)
 {
@@ -526,15 +527,15 @@ void handle_rr(struct session_info *s, struct gsm48_hdr *dtap, unsigned len, uin
 		break;
 	case GSM48_MT_RR_PAG_REQ_1:
 		SET_MSG_INFO(s, "PAGING REQ 1");
-		handle_paging1(dtap, len);
+		handle_paging1(s->ctx, dtap, len);
 		break;
 	case GSM48_MT_RR_PAG_REQ_2:
 		SET_MSG_INFO(s, "PAGING REQ 2");
-		handle_paging2(dtap, len);
+		handle_paging2(s->ctx, dtap, len);
 		break;
 	case GSM48_MT_RR_PAG_REQ_3:
 		SET_MSG_INFO(s, "PAGING REQ 3");
-		handle_paging3();
+		handle_paging3(s->ctx);
 		break;
 	case GSM48_MT_RR_IMM_ASS:
 		SET_MSG_INFO(s, "IMM ASSIGNMENT");
@@ -974,6 +975,7 @@ int is_double(struct session_info *s, uint8_t *msg, size_t len)
 void handle_dtap(struct session_info *s, uint8_t *msg, size_t len, uint32_t fn, uint8_t ul)
 {
 	struct gsm48_hdr *dtap;
+	uint64_t t;
 
 	assert(s != NULL);
 	assert(s->new_msg != NULL);
@@ -992,6 +994,8 @@ void handle_dtap(struct session_info *s, uint8_t *msg, size_t len, uint32_t fn,
 		return;
 	}
 
+	t = stats_begin(&s->ctx->stats, STAGE_L3);
+
 	switch (dtap->proto_discr & GSM48_PDISC_MASK) {
 	case GSM48_PDISC_CC:
 		handle_cc(s, dtap, len, ul);
@@ -1041,6 +1045,8 @@ void handle_dtap(struct session_info *s, uint8_t *msg, size_t len, uint32_t fn,
 		SET_MSG_INFO(s, "Unknown proto_discr %s: %s", (ul ? "UL" : "DL"),
 			 osmo_hexdump_nospc((uint8_t *)dtap, len));
 	}
+
+	stats_end(&s->ctx->stats, STAGE_L3, t);
 }
 
 void handle_lapdm(struct session_info *s, struct lapdm_buf *mb_sapi, uint8_t *msg, unsigned len, uint32_t fn, uint8_t ul)
@@ -1137,7 +1143,7 @@ void handle_lapdm(struct session_info *s, struct lapdm_buf *mb_sapi, uint8_t *ms
 		break;
 	case 1:
 		/* S frame */
-		if (msg_verbose > 1) {
+		if (s->ctx->msg_verbose > 1) {
 			fprintf(stdout, "<S-FRAME>\n");
 		}
 		data_len = 0;
@@ -1147,7 +1153,7 @@ void handle_lapdm(struct session_info *s, struct lapdm_buf *mb_sapi, uint8_t *ms
 		flags = msg[1] & 0xec;
 		//001. 11.. = Command: Set Asynchronous Balanced Mode
 		if (flags == 0x2c) {
-			if (msg_verbose > 1) {
+			if (s->ctx->msg_verbose > 1) {
 				fprintf(stdout, "<SABM U-FRAME>\n");
 			}
 
@@ -1241,13 +1247,18 @@ void update_timestamps(struct session_info *s)
 void handle_radio_msg(struct session_info *s, struct radio_message *m)
 {
 	static int num_called  = 0;
-	if (msg_verbose > 1) {
+	struct metagsm_ctx *ctx = s->ctx;
+	uint64_t t;
+
+	if (s->ctx->msg_verbose > 1) {
 		fprintf(stderr, "handle_radio_msg %d\n", num_called++);
 	}
 
 	assert(s != NULL);
 	assert(m != NULL);
 
+	t = stats_begin(&ctx->stats, STAGE_RADIO_MSG);
+
 	uint8_t ul = !!(m->bb.arfcn[0] & ARFCN_UPLINK);
 
 	m->info[0] = 0;
@@ -1268,7 +1279,7 @@ void handle_radio_msg(struct session_info *s, struct radio_message *m)
 			if (s->rat != RAT_GSM)
 				break;
 
-			if (msg_verbose > 1) {
+			if (s->ctx->msg_verbose > 1) {
 				fprintf(stderr, "-> MSG_SACCH\n");
 			}
 			handle_lapdm(s, &s->chan_sacch[ul], &m->msg[2], m->msg_len-2, m->bb.fn[0], ul);
@@ -1277,36 +1288,30 @@ void handle_radio_msg(struct session_info *s, struct radio_message *m)
 			if (s->rat != RAT_GSM)
 				break;
 
-			if (msg_verbose > 1) {
+			if (s->ctx->msg_verbose > 1) {
 				fprintf(stderr, "-> MSG_SDCCH\n");
 			}
 			handle_lapdm(s, &s->chan_sdcch[ul], m->msg, m->msg_len, m->bb.fn[0], ul);
 			break;
 		case MSG_FACCH:
-			if (msg_verbose > 1) {
+			if (s->ctx->msg_verbose > 1) {
 				fprintf(stderr, "-> MSG_FACCH\n");
 			}
 			handle_lapdm(s, &s->chan_facch[ul], m->msg, m->msg_len, m->bb.fn[0], ul);
 			break;
 		case MSG_BCCH:
-			if (msg_verbose > 1) {
+			if (s->ctx->msg_verbose > 1) {
 				fprintf(stderr, "-> MSG_BCCH\n");
 			}
 			handle_dtap(s, &m->msg[1], m->msg_len-1, m->bb.fn[0], ul);
 			break;
 		default:
-			if (msg_verbose > 1) {
+			if (s->ctx->msg_verbose > 1) {
 				fprintf(stderr, "Wrong MSG flags %02x\n", m->flags);
 			}
 			printf("Wrong MSG flags %02x\n", m->flags);
 			abort();
 		}
-
-		//if s->new_msg is not m, then we have freed it.
-		if (msg_verbose && s->new_msg == m && m->flags & MSG_DECODED) {
-			printf("GSM %s %s %u : %s\n", m->domain ? "PS" : "CS", ul ? "UL" : "DL",
-				m->bb.fn[0], m->info[0] ? m->info : osmo_hexdump_nospc(m->msg, m->msg_len));
-		}
 		break;
 
 	case RAT_UMTS:
@@ -1325,21 +1330,14 @@ void handle_radio_msg(struct session_info *s, struct radio_message *m)
 		} else {
 			assert(0);
 		}
-		if (msg_verbose && s->new_msg == m && m->flags & MSG_DECODED) {
-			printf("RRC %s %s %u : %s\n", m->domain ? "PS" : "CS", ul ? "UL" : "DL",
-				m->bb.fn[0], m->info[0] ? m->info : osmo_hexdump_nospc(m->bb.data, m->msg_len));
-		}
 		break;
 
 	case RAT_LTE:
 		handle_eps(s, m->bb.data, m->msg_len);
-		if (msg_verbose && s->new_msg == m && m->flags & MSG_DECODED) {
-			printf("LTE %s %u : %s\n", ul ? "UL" : "DL",
-				m->bb.fn[0], m->info[0] ? m->info : osmo_hexdump_nospc(m->bb.data, m->msg_len));
-		}
 		break;
 
 	default:
+		stats_end(&ctx->stats, STAGE_RADIO_MSG, t);
 		return;
 	}
 
@@ -1350,17 +1348,20 @@ void handle_radio_msg(struct session_info *s, struct radio_message *m)
 
 		if (s->new_msg->flags & MSG_DECODED) {
 			assert(s->new_msg == m);
+			session_emit_msg(&s[m->domain], m);
 			link_to_msg_list(&s[m->domain], m);
 			s->new_msg = NULL;
-			net_send_msg(m);
 		} else {
-			free(m);
+			radio_msg_free(s->ctx, m);
 			s->new_msg = NULL;
 		}
 	}
+
+	stats_end(&ctx->stats, STAGE_RADIO_MSG, t);
 }
 
-unsigned encapsulate_lapdm(uint8_t *data, unsigned len, uint8_t ul, uint8_t sacch, uint8_t **output)
+/* Output needs LAPDM_MAX_LEN bytes */
+unsigned encapsulate_lapdm(uint8_t *data, unsigned len, uint8_t ul, uint8_t sacch, uint8_t *lapdm)
 {
 	if (!len)
 		return 0;
@@ -1378,15 +1379,6 @@ unsigned encapsulate_lapdm(uint8_t *data, unsigned len, uint8_t ul, uint8_t sacc
 		alloc_len = 3 + (len < 20 ? 20 : len);
 	}
 
-	/* Allocate message buffer */
-	uint8_t *lapdm = malloc(alloc_len);
-	if (lapdm == NULL) {
-		*output = NULL;
-		return 0;
-	} else {
-		*output = lapdm;
-	}
-
 	/* Fake SACCH L1 header */
 	unsigned offset = 0;
 	if (sacch) {
@@ -1412,18 +1404,14 @@ unsigned encapsulate_lapdm(uint8_t *data, unsigned len, uint8_t ul, uint8_t sacc
 	return alloc_len;
 }
 
-struct radio_message * new_l2(uint8_t *data, uint8_t len, uint8_t rat, uint8_t domain, uint32_t fn, uint8_t ul, uint8_t flags)
+struct radio_message * new_l2(struct metagsm_ctx *ctx, uint8_t *data, uint8_t len, uint8_t rat, uint8_t domain, uint32_t fn, uint8_t ul, uint8_t flags)
 {
 	struct radio_message *m;
 
 	assert(data != 0);
 
-	m = (struct radio_message *) malloc(sizeof(struct radio_message));
-
-	if (m == 0)
-		return 0;
-
-	memset(m, 0, sizeof(struct radio_message));
+	/* Payload goes to m->msg, bb.data is not used */
+	m = radio_msg_alloc(ctx, 0);
 
 	m->rat = rat;
 	m->domain = domain;
@@ -1447,27 +1435,24 @@ struct radio_message * new_l2(uint8_t *data, uint8_t len, uint8_t rat, uint8_t d
 	return m;
 }
 
-struct radio_message * new_l3(uint8_t *data, uint8_t len, uint8_t rat, uint8_t domain, uint32_t fn, uint8_t ul, uint8_t flags)
+struct radio_message * new_l3(struct metagsm_ctx *ctx, uint8_t *data, uint8_t len, uint8_t rat, uint8_t domain, uint32_t fn, uint8_t ul, uint8_t flags)
 {
 	assert(data != 0);
 
 	unsigned lapdm_len;
-	struct radio_message *m;
+	uint8_t lapdm[LAPDM_MAX_LEN];
 
 	if (len == 0)
 		return 0;
 
-	uint8_t *lapdm;
 	if (flags & MSG_SACCH) {
-		lapdm_len = encapsulate_lapdm(data, len, ul, 1, &lapdm);
+		lapdm_len = encapsulate_lapdm(data, len, ul, 1, lapdm);
 	} else {
-		lapdm_len = encapsulate_lapdm(data, len, ul, 0, &lapdm);
+		lapdm_len = encapsulate_lapdm(data, len, ul, 0, lapdm);
 	}
 
 	if (lapdm_len) {
-		m = new_l2(lapdm, lapdm_len, rat, domain, fn, ul, flags);
-		free(lapdm);
-		return m;
+		return new_l2(ctx, lapdm, lapdm_len, rat, domain, fn, ul, flags);
 	} else {
 		return 0;
 	}
@@ -0,0 +1,1346 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <err.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <osmocom/gsm/a5.h>
+#include <asn_arena.h>
+#include <osmocom/rrc/UL-DCCH-Message.h>
+#include <osmocom/rrc/DL-DCCH-Message.h>
+#include <osmocom/rrc/DL-CCCH-Message.h>
+
+#include "session.h"
+#include "process.h"
+#include "diag_input.h"
+#include "diag_reader.h"
+#include "cell_info.h"
+#include "l3_handler.h"
+#include "umts_rrc.h"
+#include "bit_func.h"
+#include "burst_desc.h"
+#include "ccch.h"
+#include "cch.h"
+#include "crc.h"
+#include "viterbi.h"
+#include "gsm_interleave.h"
+#include "bench.h"
+
+/*
+ * Times the hot paths of the parser one by one on fixed messages, then
+ * replays DIAG and burst files (e.g. written by traffic_gen) through the
+ * whole parser. Results are written as JSON, with ns and operations per
+ * second, heap allocations per operation and the peak RSS of the process
+ * after each benchmark, to be compared between releases.
+ *
+ * The benchmarks of single components, which compare an implementation
+ * with the one it replaced, are subcommands, e.g. "metagsm_bench crc".
+ */
+
+#define DIAG_FRAMES	5
+#define DTAP_MSGS	7
+#define UL_DCCH_MSGS	10
+#define DL_DCCH_MSGS	9
+#define DL_CCCH_MSGS	3
+#define ESCAPED_FRAMES	256
+#define SESSION_HASH	1024
+
+/* Every malloc(), calloc() and realloc(), libraries included */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static uint64_t alloc_count = 0;
+
+void *malloc(size_t size)
+{
+	alloc_count++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_count++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_count++;
+	return __libc_realloc(ptr, size);
+}
+#define ALLOC_COUNT	1
+#endif
+
+struct bench {
+	const char *name;
+	void (*setup)();
+	void (*run)(unsigned n);
+	void (*teardown)();
+};
+
+struct rrc_msg {
+	uint8_t len;
+	uint8_t data[40];
+};
+
+struct bench_result {
+	uint64_t ops;
+	uint64_t allocs;
+	double secs;
+	long peak_rss;
+};
+
+struct burst_session {
+	uint32_t id;
+	struct session_info *s;
+	struct burst_session *next;
+};
+
+struct burst_key {
+	uint32_t id;
+	uint8_t kc[8];
+	uint8_t cipher;
+};
+
+static double min_secs = 0.5;
+static const char *filter = NULL;
+static const char *out_name = NULL;
+static FILE *out;
+static int first_result = 1;
+
+/* Results are summed here so that no work can be left out */
+static volatile uint32_t sink;
+
+static struct metagsm_ctx *ctx;
+static struct session_info *s;
+static uint64_t sql_rows;
+
+static uint8_t diag_frames[DIAG_FRAMES][128];
+static unsigned diag_frame_len[DIAG_FRAMES];
+
+static uint8_t *escaped;
+static unsigned escaped_len;
+static FILE *escaped_file;
+
+static uint8_t coded_bits[4*BURST_BITS];
+static int8_t soft_bits[CONV_SIZE];
+static uint8_t crc_block[PARITY_OUTPUT_SIZE];
+static uint8_t a5_key[8];
+
+static struct burst_session *session_hash[SESSION_HASH];
+static struct burst_key *keys = NULL;
+static unsigned key_count = 0;
+
+/* SI3 as received on the BCCH, with the L2 pseudo length */
+static const uint8_t si3[23] = {
+	0x49, 0x06, 0x1b, 0x00, 0x01, 0x62, 0xf2, 0x20, 0x00, 0x01, 0xc9, 0x03,
+	0x05, 0x27, 0x47, 0x40, 0xe5, 0x04, 0x00, 0x2c, 0x0b, 0x2b, 0x2b
+};
+
+/* UL-DCCH messages as the UE logs them, UPER encoded (TS 25.331) */
+static const struct rrc_msg ul_dcch_msgs[UL_DCCH_MSGS] = {
+	/* UplinkDirectTransfer with a CM Service Request */
+	{ 16, { 0x6c, 0x00, 0x60, 0x29, 0x20, 0x88, 0x1a, 0xba, 0xc5, 0x30, 0x2f, 0xa0,
+		   0x91, 0xa2, 0xb3, 0xc0 } },
+	/* InitialDirectTransfer with a Location Updating Request, RACH measurements */
+	{ 32, { 0x17, 0x06, 0xa5, 0x00, 0x88, 0x28, 0x43, 0x83, 0x17, 0x91, 0x00, 0x00,
+		   0x09, 0x98, 0x41, 0x49, 0x31, 0x20, 0x81, 0x92, 0xa3, 0xb4, 0xc4, 0x4c,
+		   0x4a, 0x08, 0x78, 0xc4, 0x85, 0x91, 0xf2, 0xa3 } },
+	/* InitialDirectTransfer with a CM Service Request, RACH measurements */
+	{ 30, { 0x17, 0x05, 0x78, 0x00, 0x60, 0x29, 0x20, 0x88, 0x1a, 0xba, 0xc5, 0x30,
+		   0x2f, 0xa0, 0x91, 0xa2, 0xb3, 0xc4, 0x52, 0x8a, 0x08, 0x84, 0xc4, 0x86,
+		   0x4e, 0x44, 0x49, 0x00, 0xc5, 0x10 } },
+	/* InitialDirectTransfer with a Paging Response */
+	{ 22, { 0x17, 0x01, 0x78, 0x00, 0x60, 0x31, 0x38, 0x38, 0x1a, 0xba, 0xc5, 0x30,
+		   0x2f, 0xa0, 0x91, 0xa2, 0xb3, 0xc0, 0x46, 0x80, 0x62, 0x90 } },
+	/* InitialDirectTransfer with a GPRS Attach Request */
+	{ 38, { 0x17, 0x90, 0x9e, 0x00, 0xc8, 0x40, 0x08, 0x17, 0x2f, 0x01, 0x0b, 0x17,
+		   0x91, 0x00, 0x00, 0x0d, 0x08, 0x2f, 0xa6, 0x00, 0x91, 0xa2, 0xb3, 0x17,
+		   0x91, 0x00, 0x00, 0x08, 0x08, 0xb8, 0x04, 0x58, 0x0c, 0x48, 0x75, 0x4e,
+		   0x00, 0x10 } },
+	/* UplinkDirectTransfer with an Authentication Response, integrity protected */
+	{ 20, { 0xaf, 0x61, 0xd1, 0x68, 0x96, 0xc0, 0x05, 0x82, 0xaa, 0x1d, 0x4e, 0x28,
+		   0xf3, 0x90, 0x82, 0x62, 0x2e, 0xcd, 0x0f, 0x00 } },
+	/* UplinkDirectTransfer with an Identity Response, integrity protected */
+	{ 19, { 0xc5, 0x0b, 0xd9, 0xe2, 0x1e, 0xc0, 0x05, 0x02, 0x8c, 0x84, 0x14, 0x93,
+		   0x12, 0x08, 0x19, 0x2a, 0x3b, 0x4c, 0x00 } },
+	/* UplinkDirectTransfer with a Setup, integrity protected */
+	{ 32, { 0x8b, 0xf2, 0x64, 0xd0, 0x26, 0xc0, 0x0b, 0x81, 0x82, 0x82, 0x03, 0x30,
+		   0x02, 0x01, 0x00, 0x02, 0xc0, 0xaf, 0x04, 0xc0, 0x90, 0xa1, 0xb2, 0xc3,
+		   0x84, 0x90, 0xa1, 0xfa, 0x8a, 0x80, 0x80, 0x80 } },
+	/* UplinkDirectTransfer with a TMSI Reallocation Complete, integrity protected */
+	{ 10, { 0xe8, 0x61, 0xd9, 0x50, 0xae, 0xc0, 0x00, 0x82, 0xad, 0x80 } },
+	/* UplinkDirectTransfer with a GPRS Attach Complete, integrity protected */
+	{ 10, { 0x99, 0xd0, 0xe2, 0xf3, 0xb6, 0xc8, 0x00, 0x84, 0x01, 0x80 } }
+};
+
+/* DL-DCCH messages */
+static const struct rrc_msg dl_dcch_msgs[DL_DCCH_MSGS] = {
+	/* DownlinkDirectTransfer with an Authentication Request */
+	{ 22, { 0x14, 0x40, 0x24, 0x0a, 0x24, 0x00, 0x40, 0x44, 0x48, 0x4c, 0x50, 0x54,
+		   0x58, 0x5c, 0x60, 0x64, 0x68, 0x6c, 0x70, 0x74, 0x78, 0x7c } },
+	/* DownlinkDirectTransfer with a UMTS Authentication Request */
+	{ 40, { 0x14, 0x80, 0x48, 0x0a, 0x24, 0x04, 0x20, 0x22, 0x24, 0x26, 0x28, 0x2a,
+		   0x2c, 0x2e, 0x30, 0x32, 0x34, 0x36, 0x38, 0x3a, 0x3c, 0x3e, 0x40, 0x21,
+		   0x01, 0x03, 0x05, 0x07, 0x09, 0x0b, 0x0d, 0x0f, 0x11, 0x13, 0x15, 0x17,
+		   0x19, 0x1b, 0x1d, 0x1e } },
+	/* SecurityModeCommand r3, UEA1 and UIA1 */
+	{ 27, { 0xcd, 0x8f, 0x06, 0x22, 0x04, 0x0f, 0x80, 0x03, 0x00, 0x03, 0x6c, 0x20,
+		   0xc0, 0x00, 0x61, 0x00, 0xa1, 0x00, 0x88, 0xc0, 0x61, 0x1d, 0x2e, 0x0f,
+		   0x03, 0x86, 0x00 } },
+	/* SecurityModeCommand r3, UEA0 and UIA1 */
+	{ 27, { 0x8e, 0x16, 0x9f, 0x27, 0x84, 0x0e, 0x00, 0x03, 0x00, 0x03, 0x64, 0x20,
+		   0xc0, 0x00, 0x61, 0x00, 0xa1, 0x00, 0x88, 0xc0, 0x61, 0x3f, 0x05, 0xc8,
+		   0xd1, 0x86, 0x00 } },
+	/* SecurityModeCommand r7, UEA2 and UIA2 */
+	{ 23, { 0xb1, 0x78, 0xd0, 0x4d, 0x84, 0x29, 0x80, 0x03, 0x80, 0x03, 0x98, 0x40,
+		   0x00, 0xb0, 0x80, 0x90, 0x80, 0x65, 0x02, 0xf3, 0x7b, 0x8c, 0x60 } },
+	/* DownlinkDirectTransfer with an Identity Request, integrity protected */
+	{ 11, { 0xa5, 0xae, 0x36, 0xbf, 0x09, 0x48, 0x00, 0x40, 0xa3, 0x00, 0x20 } },
+	/* DownlinkDirectTransfer with a TMSI Reallocation Command, integrity protected */
+	{ 21, { 0xd0, 0x58, 0xe1, 0x69, 0x91, 0x4c, 0x01, 0x80, 0xa3, 0x4c, 0x5e, 0x44,
+		   0x00, 0x00, 0x20, 0xbe, 0x90, 0xec, 0xa8, 0x64, 0x20 } },
+	/* DownlinkDirectTransfer with a Call Proceeding, integrity protected */
+	{ 10, { 0x87, 0x8f, 0x16, 0x9e, 0x19, 0x40, 0x00, 0x30, 0x60, 0x40 } },
+	/* DownlinkDirectTransfer with a GPRS Attach Accept, integrity protected */
+	{ 26, { 0xaa, 0xd5, 0x19, 0xe6, 0x09, 0x46, 0x02, 0x21, 0x00, 0x40, 0x29, 0x20,
+		   0x8c, 0x5e, 0x44, 0x00, 0x00, 0x20, 0x23, 0x00, 0xbe, 0x98, 0x0c, 0xa8,
+		   0x64, 0x20 } }
+};
+
+/* DL-CCCH messages, the parser only reads their type */
+static const struct rrc_msg dl_ccch_msgs[DL_CCCH_MSGS] = {
+	/* RRCConnectionReject to an IMSI, redirected to another UARFCN */
+	{ 13, { 0x12, 0x09, 0x26, 0x20, 0x29, 0x87, 0x65, 0x43, 0x21, 0x02, 0x8a, 0x89,
+		   0x00 } },
+	/* RRCConnectionReject to a TMSI */
+	{ 11, { 0x10, 0x90, 0x5f, 0x48, 0x76, 0x52, 0x62, 0x01, 0x00, 0x00, 0xc0 } },
+	/* RRCConnectionReject to a P-TMSI, redirected to GSM */
+	{ 12, { 0x13, 0x2c, 0x01, 0x23, 0x45, 0x62, 0x62, 0x01, 0x00, 0x00, 0x80, 0x8e } }
+};
+
+static const struct {
+	uint8_t ul;
+	uint8_t len;
+	uint8_t data[24];
+} dtap_msgs[DTAP_MSGS] = {
+	/* Location Updating Request */
+	{ 1, 18, { 0x05, 0x08, 0x70, 0x62, 0xf2, 0x20, 0x00, 0x01, 0x33, 0x08,
+		   0x29, 0x26, 0x24, 0x10, 0x32, 0x54, 0x76, 0x98 } },
+	/* Identity Response */
+	{ 1, 11, { 0x05, 0x19, 0x08, 0x29, 0x26, 0x24, 0x10, 0x32, 0x54, 0x76, 0x98 } },
+	/* Ciphering Mode Command, A5/1 */
+	{ 0, 3, { 0x06, 0x35, 0x01 } },
+	/* TMSI Reallocation Command */
+	{ 0, 13, { 0x05, 0x1a, 0x62, 0xf2, 0x20, 0x00, 0x01, 0x05, 0xf4, 0x87, 0x65, 0x43, 0x21 } },
+	/* CM Service Request */
+	{ 1, 13, { 0x05, 0x24, 0x11, 0x03, 0x57, 0x58, 0xa6, 0x05, 0xf4, 0x12, 0x34, 0x56, 0x78 } },
+	/* Setup */
+	{ 1, 24, { 0x03, 0x05, 0x04, 0x06, 0x60, 0x04, 0x02, 0x00, 0x05, 0x81, 0x5e, 0x09,
+		   0x81, 0x21, 0x43, 0x65, 0x87, 0x09, 0x21, 0x43, 0xf5, 0x15, 0x01, 0x01 } },
+	/* Paging Response */
+	{ 1, 13, { 0x06, 0x27, 0x07, 0x03, 0x57, 0x58, 0xa6, 0x05, 0xf4, 0x12, 0x34, 0x56, 0x78 } },
+};
+
+static void sql_count(struct metagsm_ctx *c __attribute__((unused)), const char *sql)
+{
+	sql_rows++;
+	sink += strlen(sql);
+}
+
+/* Parser context without any output, SQL is generated and counted */
+static struct metagsm_ctx *bench_ctx_new()
+{
+	struct metagsm_ctx *c;
+
+	c = metagsm_ctx_alloc();
+	session_init_ctx(c, 0, 0, NULL, CALLBACK_NONE);
+	cell_init_ctx(c, 0, 1609459200, CALLBACK_NONE);
+
+	c->s[0].sql_callback = sql_count;
+	c->s[1].sql_callback = sql_count;
+	c->cell_sql_callback = sql_count;
+
+	return c;
+}
+
+static void bench_ctx_free(struct metagsm_ctx *c)
+{
+	unsigned sid, cid;
+
+	diag_destroy_ctx(c, &sid, &cid);
+	metagsm_ctx_free(c);
+}
+
+/* Session as the L3 handlers find it on a dedicated channel */
+static void session_setup()
+{
+	ctx = bench_ctx_new();
+	s = &ctx->s[0];
+	s->started = 1;
+	s->rat = RAT_GSM;
+	s->new_msg = radio_msg_alloc(ctx, 8 * BURST_BYTES);
+	s->new_msg->flags = MSG_SDCCH;
+}
+
+static void session_teardown()
+{
+	radio_msg_free(ctx, s->new_msg);
+	s->new_msg = NULL;
+	bench_ctx_free(ctx);
+}
+
+static unsigned diag_frame(uint8_t *frame, uint16_t proto, uint8_t type, uint8_t subtype,
+			   uint8_t data_len, const uint8_t *data, unsigned len)
+{
+	/* 1.25 ms ticks since the GPS epoch, in 2021 */
+	uint64_t ts = (uint64_t) (1609459200 - 315964800) * 800 << 16;
+	unsigned i;
+
+	frame[0] = 0x10;
+	frame[1] = 0x00;
+	frame[2] = 15 + len;
+	frame[3] = 0;
+	frame[4] = 15 + len;
+	frame[5] = 0;
+	frame[6] = proto & 0xff;
+	frame[7] = proto >> 8;
+	for (i = 0; i < 8; i++) {
+		frame[8 + i] = ts >> (8 * i);
+	}
+	frame[16] = type;
+	frame[17] = subtype;
+	frame[18] = data_len;
+	memcpy(&frame[19], data, len);
+	/* CRC, not checked past the reader */
+	frame[19 + len] = 0;
+	frame[20 + len] = 0;
+
+	return 21 + len;
+}
+
+static void diag_setup()
+{
+	uint8_t data[64];
+
+	ctx = bench_ctx_new();
+	auto_reset = 0;
+
+	/* BCCH */
+	diag_frame_len[0] = diag_frame(diag_frames[0], 0x512f, 129, 0, sizeof(si3), si3, sizeof(si3));
+
+	/* SDCCH DL RR */
+	diag_frame_len[1] = diag_frame(diag_frames[1], 0x512f, 128, 53, dtap_msgs[2].len,
+				       dtap_msgs[2].data, dtap_msgs[2].len);
+
+	/* NAS UL */
+	memset(data, 0, sizeof(data));
+	memcpy(&data[2], dtap_msgs[0].data, dtap_msgs[0].len);
+	diag_frame_len[2] = diag_frame(diag_frames[2], 0x713a, 1, dtap_msgs[0].len, 0,
+				       data, dtap_msgs[0].len + 2);
+
+	/* 3G UL-DCCH */
+	memset(data, 0, sizeof(data));
+	memcpy(&data[1], ul_dcch_msgs[0].data, ul_dcch_msgs[0].len);
+	diag_frame_len[3] = diag_frame(diag_frames[3], 0x412f, 1, 0, 0, data, ul_dcch_msgs[0].len + 1);
+
+	/* GPRS GMM, ignored */
+	diag_frame_len[4] = diag_frame(diag_frames[4], 0x5230, 0, 0, 0, data, 8);
+}
+
+static void diag_teardown()
+{
+	auto_reset = 1;
+	bench_ctx_free(ctx);
+}
+
+static void run_handle_diag(unsigned n)
+{
+	uint8_t frame[128];
+	unsigned i, f;
+
+	for (i = 0; i < n; i++) {
+		f = i % DIAG_FRAMES;
+		/* handle_diag() may write to its input */
+		memcpy(frame, diag_frames[f], diag_frame_len[f]);
+		handle_diag_ctx(ctx, frame, diag_frame_len[f]);
+	}
+}
+
+static void escaped_setup()
+{
+	unsigned i, j, len;
+
+	escaped = malloc(ESCAPED_FRAMES * 2 * 300);
+	if (!escaped) {
+		errx(1, "Cannot allocate frames");
+	}
+
+	srandom(1);
+	escaped_len = 0;
+	for (i = 0; i < ESCAPED_FRAMES; i++) {
+		len = 32 + random() % 256;
+		for (j = 0; j < len; j++) {
+			uint8_t c = j < 2 ? (j ? 0x00 : 0x10) : random();
+
+			if (c == 0x7e || c == 0x7d) {
+				escaped[escaped_len++] = 0x7d;
+				escaped[escaped_len++] = c ^ 0x20;
+			} else {
+				escaped[escaped_len++] = c;
+			}
+		}
+		escaped[escaped_len++] = 0x7e;
+	}
+
+	escaped_file = fmemopen(escaped, escaped_len, "rb");
+	if (!escaped_file) {
+		err(1, "Cannot open frames");
+	}
+}
+
+static void escaped_teardown()
+{
+	fclose(escaped_file);
+	free(escaped);
+}
+
+static void run_fread_unescape(unsigned n)
+{
+	uint8_t msg[4096];
+	unsigned i, len;
+
+	for (i = 0; i < n; i++) {
+		len = fread_unescape(escaped_file, msg, sizeof(msg));
+		if (!len) {
+			rewind(escaped_file);
+			len = fread_unescape(escaped_file, msg, sizeof(msg));
+		}
+		sink += len + msg[0];
+	}
+}
+
+/* Setup split over two I frames */
+static void run_handle_lapdm(unsigned n)
+{
+	const uint8_t *l3 = dtap_msgs[5].data;
+	unsigned l3_len = dtap_msgs[5].len;
+	uint8_t frame[23];
+	unsigned i, first = 20;
+	uint8_t ns = 0;
+
+	for (i = 0; i < n; i++) {
+		memset(frame, 0x2b, sizeof(frame));
+		frame[0] = 0x01;
+		frame[1] = ns << 1;
+		if (i & 1) {
+			frame[2] = ((l3_len - first) << 2) | 0x01;
+			memcpy(&frame[3], &l3[first], l3_len - first);
+		} else {
+			frame[2] = (first << 2) | 0x03;
+			memcpy(&frame[3], l3, first);
+		}
+		ns = (ns + 1) % 8;
+
+		handle_lapdm(s, s->chan_sdcch, frame, sizeof(frame), i, 1);
+	}
+}
+
+static void run_handle_dtap(unsigned n)
+{
+	uint8_t msg[24];
+	unsigned i, m;
+
+	for (i = 0; i < n; i++) {
+		m = i % DTAP_MSGS;
+		memcpy(msg, dtap_msgs[m].data, dtap_msgs[m].len);
+		handle_dtap(s, msg, dtap_msgs[m].len, i, dtap_msgs[m].ul);
+	}
+}
+
+static void sysinfo_setup()
+{
+	session_setup();
+	s->started = 0;
+	s->new_msg->flags = MSG_BCCH;
+}
+
+static void run_handle_sysinfo(unsigned n)
+{
+	uint8_t msg[23];
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		memcpy(msg, si3, sizeof(msg));
+		/* cycle through 64 cells */
+		msg[4] = i % 64;
+		handle_sysinfo(s, (struct gsm48_hdr *) &msg[1], sizeof(msg) - 1);
+	}
+}
+
+/* Each op decodes the next message of the corpus */
+static void run_uper_decode(unsigned n)
+{
+	const struct rrc_msg *m;
+	UL_DCCH_Message_t *dcch;
+	asn_dec_rval_t rv;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		m = &ul_dcch_msgs[i % UL_DCCH_MSGS];
+		dcch = NULL;
+		rv = uper_decode(NULL, &asn_DEF_UL_DCCH_Message, (void **) &dcch, m->data, m->len, 0, 0);
+		if (rv.code != RC_OK || !dcch) {
+			errx(1, "Cannot decode UL-DCCH");
+		}
+		sink += rv.consumed;
+		ASN_STRUCT_FREE(asn_DEF_UL_DCCH_Message, dcch);
+	}
+}
+
+static void run_uper_decode_dl(unsigned n)
+{
+	const struct rrc_msg *m;
+	DL_DCCH_Message_t *dcch;
+	asn_dec_rval_t rv;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		m = &dl_dcch_msgs[i % DL_DCCH_MSGS];
+		dcch = NULL;
+		rv = uper_decode(NULL, &asn_DEF_DL_DCCH_Message, (void **) &dcch, m->data, m->len, 0, 0);
+		if (rv.code != RC_OK || !dcch) {
+			errx(1, "Cannot decode DL-DCCH");
+		}
+		sink += rv.consumed;
+		ASN_STRUCT_FREE(asn_DEF_DL_DCCH_Message, dcch);
+	}
+}
+
+static void run_uper_decode_ccch(unsigned n)
+{
+	const struct rrc_msg *m;
+	DL_CCCH_Message_t *ccch;
+	asn_dec_rval_t rv;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		m = &dl_ccch_msgs[i % DL_CCCH_MSGS];
+		ccch = NULL;
+		rv = uper_decode(NULL, &asn_DEF_DL_CCCH_Message, (void **) &ccch, m->data, m->len, 0, 0);
+		if (rv.code != RC_OK || !ccch) {
+			errx(1, "Cannot decode DL-CCCH");
+		}
+		sink += rv.consumed;
+		ASN_STRUCT_FREE(asn_DEF_DL_CCCH_Message, ccch);
+	}
+}
+
+static asn_arena_t *arena;
+
+static void arena_setup()
+{
+	arena = asn_arena_new(0);
+	if (!arena) {
+		errx(1, "Cannot allocate arena");
+	}
+}
+
+static void arena_teardown()
+{
+	asn_arena_free(arena);
+	arena = NULL;
+}
+
+/* Same, decoded into an arena as umts_rrc.c does */
+static void run_uper_decode_arena(unsigned n)
+{
+	const struct rrc_msg *m;
+	UL_DCCH_Message_t *dcch;
+	asn_codec_ctx_t codec;
+	asn_dec_rval_t rv;
+	unsigned i;
+
+	memset(&codec, 0, sizeof(codec));
+	codec.max_stack_size = 30000;
+	codec.arena = arena;
+
+	for (i = 0; i < n; i++) {
+		m = &ul_dcch_msgs[i % UL_DCCH_MSGS];
+		dcch = NULL;
+		rv = uper_decode(&codec, &asn_DEF_UL_DCCH_Message, (void **) &dcch, m->data, m->len, 0, 0);
+		if (rv.code != RC_OK || !dcch) {
+			errx(1, "Cannot decode UL-DCCH");
+		}
+		sink += rv.consumed;
+		asn_arena_reset(arena);
+	}
+}
+
+static void run_uper_decode_dl_arena(unsigned n)
+{
+	const struct rrc_msg *m;
+	DL_DCCH_Message_t *dcch;
+	asn_codec_ctx_t codec;
+	asn_dec_rval_t rv;
+	unsigned i;
+
+	memset(&codec, 0, sizeof(codec));
+	codec.max_stack_size = 30000;
+	codec.arena = arena;
+
+	for (i = 0; i < n; i++) {
+		m = &dl_dcch_msgs[i % DL_DCCH_MSGS];
+		dcch = NULL;
+		rv = uper_decode(&codec, &asn_DEF_DL_DCCH_Message, (void **) &dcch, m->data, m->len, 0, 0);
+		if (rv.code != RC_OK || !dcch) {
+			errx(1, "Cannot decode DL-DCCH");
+		}
+		sink += rv.consumed;
+		asn_arena_reset(arena);
+	}
+}
+
+/* NAS message of a DirectTransfer, NULL for other messages */
+static const OCTET_STRING_t *ul_nas(const UL_DCCH_Message_t *dcch)
+{
+	switch (dcch->message.present) {
+	case UL_DCCH_MessageType_PR_initialDirectTransfer:
+		return &dcch->message.choice.initialDirectTransfer.nas_Message;
+	case UL_DCCH_MessageType_PR_uplinkDirectTransfer:
+		return &dcch->message.choice.uplinkDirectTransfer.nas_Message;
+	default:
+		return NULL;
+	}
+}
+
+static int same_nas(const OCTET_STRING_t *a, const OCTET_STRING_t *b)
+{
+	if (!a || !b) {
+		return a == b;
+	}
+
+	return a->size == b->size && !memcmp(a->buf, b->buf, a->size);
+}
+
+static size_t ul_dcch_bits[UL_DCCH_MSGS];
+
+/* Decodes the corpus fully and selectively, both must read the same
+ * bits and NAS messages */
+static void select_setup()
+{
+	UL_DCCH_Message_t *dcch, *sel;
+	asn_codec_ctx_t codec;
+	asn_dec_rval_t rv;
+	unsigned i;
+
+	arena_setup();
+	memset(&codec, 0, sizeof(codec));
+	codec.max_stack_size = 30000;
+	codec.arena = arena;
+	codec.select = ul_dcch_select;
+	codec.zero_copy = 1;
+
+	for (i = 0; i < UL_DCCH_MSGS; i++) {
+		dcch = NULL;
+		rv = uper_decode(NULL, &asn_DEF_UL_DCCH_Message, (void **) &dcch,
+				 ul_dcch_msgs[i].data, ul_dcch_msgs[i].len, 0, 0);
+		if (rv.code != RC_OK || !dcch) {
+			errx(1, "Cannot decode UL-DCCH message %u", i);
+		}
+		ul_dcch_bits[i] = rv.consumed;
+
+		sel = NULL;
+		rv = uper_decode(&codec, &asn_DEF_UL_DCCH_Message, (void **) &sel,
+				 ul_dcch_msgs[i].data, ul_dcch_msgs[i].len, 0, 0);
+		if (rv.code != RC_OK || !sel || !same_nas(ul_nas(dcch), ul_nas(sel))) {
+			errx(1, "UL-DCCH message %u differs when selected", i);
+		}
+		ASN_STRUCT_FREE(asn_DEF_UL_DCCH_Message, dcch);
+		asn_arena_reset(arena);
+	}
+}
+
+/* Same, decoding only the members umts_rrc.c reads */
+static void run_uper_decode_select(unsigned n)
+{
+	const struct rrc_msg *m;
+	UL_DCCH_Message_t *dcch;
+	asn_codec_ctx_t codec;
+	asn_dec_rval_t rv;
+	unsigned i;
+
+	memset(&codec, 0, sizeof(codec));
+	codec.max_stack_size = 30000;
+	codec.arena = arena;
+	codec.select = ul_dcch_select;
+	codec.zero_copy = 1;
+
+	for (i = 0; i < n; i++) {
+		m = &ul_dcch_msgs[i % UL_DCCH_MSGS];
+		dcch = NULL;
+		rv = uper_decode(&codec, &asn_DEF_UL_DCCH_Message, (void **) &dcch, m->data, m->len, 0, 0);
+		if (rv.code != RC_OK || !dcch) {
+			errx(1, "Cannot decode UL-DCCH");
+		}
+		/* Skipping must end where decoding does */
+		if (rv.consumed != ul_dcch_bits[i % UL_DCCH_MSGS]) {
+			errx(1, "UL-DCCH selection read %zu bits instead of %zu",
+			     rv.consumed, ul_dcch_bits[i % UL_DCCH_MSGS]);
+		}
+		sink += rv.consumed;
+		asn_arena_reset(arena);
+	}
+}
+
+/* NAS message of an r3 DownlinkDirectTransfer, NULL for other messages */
+static const OCTET_STRING_t *dl_nas(const DL_DCCH_Message_t *dcch)
+{
+	if (dcch->message.present != DL_DCCH_MessageType_PR_downlinkDirectTransfer ||
+	    dcch->message.choice.downlinkDirectTransfer.present != DownlinkDirectTransfer_PR_r3) {
+		return NULL;
+	}
+
+	return &dcch->message.choice.downlinkDirectTransfer.choice.r3.downlinkDirectTransfer_r3.nas_Message;
+}
+
+static size_t dl_dcch_bits[DL_DCCH_MSGS];
+
+static void dl_select_setup()
+{
+	DL_DCCH_Message_t *dcch, *sel;
+	asn_codec_ctx_t codec;
+	asn_dec_rval_t rv;
+	unsigned i;
+
+	arena_setup();
+	memset(&codec, 0, sizeof(codec));
+	codec.max_stack_size = 30000;
+	codec.arena = arena;
+	codec.select = dl_dcch_select;
+	codec.zero_copy = 1;
+
+	for (i = 0; i < DL_DCCH_MSGS; i++) {
+		dcch = NULL;
+		rv = uper_decode(NULL, &asn_DEF_DL_DCCH_Message, (void **) &dcch,
+				 dl_dcch_msgs[i].data, dl_dcch_msgs[i].len, 0, 0);
+		if (rv.code != RC_OK || !dcch) {
+			errx(1, "Cannot decode DL-DCCH message %u", i);
+		}
+		dl_dcch_bits[i] = rv.consumed;
+
+		sel = NULL;
+		rv = uper_decode(&codec, &asn_DEF_DL_DCCH_Message, (void **) &sel,
+				 dl_dcch_msgs[i].data, dl_dcch_msgs[i].len, 0, 0);
+		if (rv.code != RC_OK || !sel || !same_nas(dl_nas(dcch), dl_nas(sel))) {
+			errx(1, "DL-DCCH message %u differs when selected", i);
+		}
+		ASN_STRUCT_FREE(asn_DEF_DL_DCCH_Message, dcch);
+		asn_arena_reset(arena);
+	}
+}
+
+/* DL-DCCH as umts_rrc.c decodes it, with zero copy. None of the NAS
+ * messages of the corpus is octet aligned, they are shifted into the
+ * arena. */
+static void run_uper_decode_dl_select(unsigned n)
+{
+	const struct rrc_msg *m;
+	DL_DCCH_Message_t *dcch;
+	asn_codec_ctx_t codec;
+	asn_dec_rval_t rv;
+	unsigned i;
+
+	memset(&codec, 0, sizeof(codec));
+	codec.max_stack_size = 30000;
+	codec.arena = arena;
+	codec.select = dl_dcch_select;
+	codec.zero_copy = 1;
+
+	for (i = 0; i < n; i++) {
+		m = &dl_dcch_msgs[i % DL_DCCH_MSGS];
+		dcch = NULL;
+		rv = uper_decode(&codec, &asn_DEF_DL_DCCH_Message, (void **) &dcch, m->data, m->len, 0, 0);
+		if (rv.code != RC_OK || !dcch) {
+			errx(1, "Cannot decode DL-DCCH");
+		}
+		if (rv.consumed != dl_dcch_bits[i % DL_DCCH_MSGS]) {
+			errx(1, "DL-DCCH selection read %zu bits instead of %zu",
+			     rv.consumed, dl_dcch_bits[i % DL_DCCH_MSGS]);
+		}
+		sink += rv.consumed;
+		asn_arena_reset(arena);
+	}
+}
+
+/* Session filled in by the L3 handlers */
+static void dtap_setup()
+{
+	unsigned i;
+
+	session_setup();
+	auto_reset = 0;
+	run_handle_dtap(DTAP_MSGS);
+	s->id = 1000000;
+	for (i = 0; i < 4; i++) {
+		s->old_tmsi[i] = 0x11 * (i + 1);
+	}
+	s->timestamp.tv_sec = 1609459200;
+}
+
+static void dtap_teardown()
+{
+	auto_reset = 1;
+	session_teardown();
+}
+
+static void run_session_make_sql(unsigned n)
+{
+	char query[8192];
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		session_make_sql(s, query, sizeof(query), 1);
+		sink += query[i % 64];
+	}
+}
+
+static void conv_setup()
+{
+	uint8_t data[CONV_INPUT_SIZE] = {0};
+	uint8_t coded[CONV_SIZE];
+	unsigned i;
+
+	srandom(1);
+	for (i = 0; i < DATA_BLOCK_SIZE + PARITY_SIZE; i++) {
+		data[i] = random() & 1;
+	}
+	conv_cch_encode(data, coded, CONV_INPUT_SIZE);
+	for (i = 0; i < CONV_SIZE; i++) {
+		/* some noise, a few wrong bits */
+		soft_bits[i] = (coded[i] ? -100 : 100) + (int) (random() % 61) - 30;
+		if (random() % 100 < 2) {
+			soft_bits[i] = -soft_bits[i];
+		}
+	}
+}
+
+static void run_conv_cch_decode(unsigned n)
+{
+	uint8_t decoded[CONV_INPUT_SIZE];
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		sink += conv_cch_decode(soft_bits, decoded, CONV_INPUT_SIZE);
+	}
+}
+
+static void crc_setup()
+{
+	static const uint8_t fire_poly[PARITY_SIZE + 1] = {
+		1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0,
+		0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 1, 0, 0, 1
+	};
+	unsigned i;
+
+	srandom(1);
+	memset(crc_block, 0, sizeof(crc_block));
+	for (i = 0; i < DATA_BLOCK_SIZE; i++) {
+		crc_block[i] = random() & 1;
+	}
+	parity_encode_ref(crc_block, DATA_BLOCK_SIZE, fire_poly, &crc_block[DATA_BLOCK_SIZE], PARITY_SIZE);
+	/* inverted parity, as sent */
+	for (i = DATA_BLOCK_SIZE; i < DATA_BLOCK_SIZE + PARITY_SIZE; i++) {
+		crc_block[i] ^= 1;
+	}
+}
+
+/* Parity check of a decoded xCCH block, as decode_signalling() does */
+static void run_fc_check_crc(unsigned n)
+{
+	uint8_t result[DATA_BLOCK_SIZE];
+	FC_CTX fc;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		FC_init(&fc, PARITY_SIZE, DATA_BLOCK_SIZE);
+		sink += FC_check_crc(&fc, crc_block, result);
+	}
+}
+
+static void a5_setup()
+{
+	unsigned i;
+
+	srandom(1);
+	for (i = 0; i < sizeof(a5_key); i++) {
+		a5_key[i] = random();
+	}
+}
+
+static void run_a5(int algo, unsigned n)
+{
+	ubit_t dl[114], ul[114];
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		osmo_a5(algo, a5_key, i, dl, ul);
+		sink += dl[i % 114] + ul[i % 114];
+	}
+}
+
+static void run_a5_1(unsigned n)
+{
+	run_a5(1, n);
+}
+
+static void run_a5_2(unsigned n)
+{
+	run_a5(2, n);
+}
+
+static void deinter_setup()
+{
+	unsigned i;
+
+	srandom(1);
+	for (i = 0; i < 4 * BURST_BITS; i++) {
+		coded_bits[i] = random() & 1;
+	}
+}
+
+static void run_gsm_deinter_sacch(unsigned n)
+{
+	uint8_t data[2 * CONV_INPUT_SIZE];
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		gsm_deinter_sacch(coded_bits, data);
+		sink += data[i % sizeof(data)];
+	}
+}
+
+static const struct bench benches[] = {
+	{ "fread_unescape", escaped_setup, run_fread_unescape, escaped_teardown },
+	{ "handle_diag", diag_setup, run_handle_diag, diag_teardown },
+	{ "handle_lapdm", session_setup, run_handle_lapdm, session_teardown },
+	{ "handle_dtap", dtap_setup, run_handle_dtap, dtap_teardown },
+	{ "handle_sysinfo", sysinfo_setup, run_handle_sysinfo, session_teardown },
+	{ "uper_decode/UL-DCCH", NULL, run_uper_decode, NULL },
+	{ "uper_decode/DL-DCCH", NULL, run_uper_decode_dl, NULL },
+	{ "uper_decode/DL-CCCH", NULL, run_uper_decode_ccch, NULL },
+	{ "uper_decode/UL-DCCH/arena", arena_setup, run_uper_decode_arena, arena_teardown },
+	{ "uper_decode/DL-DCCH/arena", arena_setup, run_uper_decode_dl_arena, arena_teardown },
+	{ "uper_decode/UL-DCCH/select", select_setup, run_uper_decode_select, arena_teardown },
+	{ "uper_decode/DL-DCCH/select", dl_select_setup, run_uper_decode_dl_select, arena_teardown },
+	{ "session_make_sql", dtap_setup, run_session_make_sql, dtap_teardown },
+	{ "conv_cch_decode", conv_setup, run_conv_cch_decode, NULL },
+	{ "FC_check_crc", crc_setup, run_fc_check_crc, NULL },
+	{ "osmo_a5/1", a5_setup, run_a5_1, NULL },
+	{ "osmo_a5/2", a5_setup, run_a5_2, NULL },
+	{ "gsm_deinter_sacch", deinter_setup, run_gsm_deinter_sacch, NULL },
+};
+#define BENCHES		(sizeof(benches) / sizeof(benches[0]))
+
+static long peak_rss()
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ru.ru_maxrss;
+}
+
+static void json_string(const char *str)
+{
+	fputc('"', out);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\') {
+			fprintf(out, "\\%c", *str);
+		} else if ((unsigned char) *str < 0x20) {
+			fprintf(out, "\\u%04x", *str);
+		} else {
+			fputc(*str, out);
+		}
+	}
+	fputc('"', out);
+}
+
+static void print_result(const char *name, const char *kind, const char *input, struct bench_result *res)
+{
+	fprintf(out, "%s\n\t\t{ \"name\": ", first_result ? "" : ",");
+	json_string(name);
+	fprintf(out, ", \"kind\": \"%s\"", kind);
+	if (input) {
+		fprintf(out, ", \"input\": ");
+		json_string(input);
+	}
+	fprintf(out, ", \"ops\": %llu, \"secs\": %.6f, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f",
+		(unsigned long long) res->ops, res->secs,
+		res->ops ? res->secs * 1e9 / res->ops : 0,
+		res->secs > 0 ? res->ops / res->secs : 0);
+#ifdef ALLOC_COUNT
+	fprintf(out, ", \"allocs_per_op\": %.3f",
+		res->ops ? (double) res->allocs / res->ops : 0);
+#else
+	fprintf(out, ", \"allocs_per_op\": null");
+#endif
+	fprintf(out, ", \"peak_rss_kb\": %ld }", res->peak_rss);
+	first_result = 0;
+}
+
+static uint64_t allocs()
+{
+#ifdef ALLOC_COUNT
+	return alloc_count;
+#else
+	return 0;
+#endif
+}
+
+/* Doubles the iterations, up to 100 times, until a run takes min_secs */
+static void run_bench(const struct bench *b)
+{
+	struct bench_result res;
+	uint64_t a;
+	unsigned n = 1;
+	double t, scale;
+
+	if (b->setup) {
+		b->setup();
+	}
+	b->run(1);
+
+	for (;;) {
+		a = allocs();
+		t = stats_secs();
+		b->run(n);
+		res.secs = stats_secs() - t;
+		res.allocs = allocs() - a;
+		res.ops = n;
+
+		if (res.secs >= min_secs || n >= 1u << 30) {
+			break;
+		}
+		scale = res.secs > 0 ? 1.2 * min_secs / res.secs : 100;
+		if (scale < 2) {
+			scale = 2;
+		}
+		if (scale > 100) {
+			scale = 100;
+		}
+		n = n * scale > 1u << 30 ? 1u << 30 : n * scale;
+	}
+
+	if (b->teardown) {
+		b->teardown();
+	}
+
+	res.peak_rss = peak_rss();
+	print_result(b->name, "micro", NULL, &res);
+}
+
+/* One pass over a DIAG file, as diag_import does, frames as ops */
+static uint64_t replay_diag(const char *filename)
+{
+	struct metagsm_ctx *c;
+	struct diag_reader *reader;
+	uint8_t *msg;
+	unsigned len;
+	uint64_t frames = 0;
+
+	reader = diag_reader_open(filename);
+	if (!reader) {
+		err(1, "Cannot open input file: %s", filename);
+	}
+
+	c = bench_ctx_new();
+	while (diag_reader_next(reader, &msg, &len)) {
+		handle_diag_ctx(c, msg, len);
+		frames++;
+	}
+	bench_ctx_free(c);
+	diag_reader_close(reader);
+
+	return frames;
+}
+
+static void read_keys(const char *filename)
+{
+	FILE *f;
+	char line[256];
+	char kc[17];
+	unsigned id, cipher, i, n;
+	int l = 0;
+
+	f = fopen(filename, "r");
+	if (!f) {
+		err(1, "Cannot open key file: %s", filename);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		++l;
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+
+		cipher = 0;
+		n = sscanf(line, "%u %16s %u", &id, kc, &cipher);
+		if (n < 2 || strlen(kc) != 16 || cipher > 3) {
+			errx(1, "Invalid key in %s:%d", filename, l);
+		}
+
+		keys = realloc(keys, (key_count + 1) * sizeof(*keys));
+		if (!keys) {
+			errx(1, "Cannot allocate keys");
+		}
+		keys[key_count].id = id;
+		for (i = 0; i < 8; i++) {
+			if (sscanf(&kc[2*i], "%2hhx", &keys[key_count].kc[i]) != 1) {
+				errx(1, "Invalid key in %s:%d", filename, l);
+			}
+		}
+		keys[key_count].cipher = cipher;
+		key_count++;
+	}
+
+	fclose(f);
+}
+
+static struct session_info *find_session(struct metagsm_ctx *c, uint32_t id)
+{
+	struct burst_session **bs = &session_hash[id % SESSION_HASH];
+	struct burst_key *key = NULL;
+	struct session_info *bs_s;
+	unsigned i;
+
+	while (*bs) {
+		if ((*bs)->id == id) {
+			return (*bs)->s;
+		}
+		bs = &(*bs)->next;
+	}
+
+	for (i = 0; i < key_count; i++) {
+		if (keys[i].id == id) {
+			key = &keys[i];
+			break;
+		}
+	}
+
+	bs_s = session_create_ctx(c, -1, NULL, key ? key->kc : NULL, 0, 0, 0, 0, NULL);
+	if (!bs_s) {
+		errx(1, "Cannot allocate session structure");
+	}
+	bs_s->sql_callback = sql_count;
+	bs_s->rat = RAT_GSM;
+	bs_s->started = 1;
+	if (key) {
+		bs_s->cipher = key->cipher;
+	}
+
+	*bs = malloc(sizeof(struct burst_session));
+	if (!*bs) {
+		errx(1, "Cannot allocate session structure");
+	}
+	(*bs)->id = id;
+	(*bs)->s = bs_s;
+	(*bs)->next = NULL;
+
+	return bs_s;
+}
+
+/* One pass over a burst file, as burst_import does, bursts as ops */
+static uint64_t replay_bursts(const char *filename)
+{
+	struct metagsm_ctx *c;
+	struct burst_record r;
+	struct burst_session *bs;
+	uint64_t bursts = 0;
+	FILE *f;
+	unsigned i;
+
+	f = fopen(filename, "rb");
+	if (!f) {
+		err(1, "Cannot open input file: %s", filename);
+	}
+
+	c = bench_ctx_new();
+	auto_reset = 0;
+	while (fread(&r, sizeof(r), 1, f) == 1) {
+		process_handle_burst(find_session(c, ntohl(r.session)), &r.bi);
+		bursts++;
+	}
+	ccch_flush(c);
+
+	for (i = 0; i < SESSION_HASH; i++) {
+		while (session_hash[i]) {
+			bs = session_hash[i];
+			session_hash[i] = bs->next;
+
+			session_close(bs->s);
+			session_free(bs->s);
+			free(bs);
+		}
+	}
+	auto_reset = 1;
+	bench_ctx_free(c);
+	fclose(f);
+
+	return bursts;
+}
+
+/* Whole passes over the file until they took min_secs */
+static void run_replay(const char *name, const char *filename, uint64_t (*replay)(const char *))
+{
+	struct bench_result res;
+	uint64_t a;
+	double t;
+
+	memset(&res, 0, sizeof(res));
+
+	a = allocs();
+	t = stats_secs();
+	do {
+		res.ops += replay(filename);
+		res.secs = stats_secs() - t;
+	} while (res.secs < min_secs);
+	res.allocs = allocs() - a;
+
+	res.peak_rss = peak_rss();
+	print_result(name, "macro", filename, &res);
+}
+
+static int selected(const char *name)
+{
+	return !filter || strstr(name, filter);
+}
+
+static const char **diag_files = NULL;
+static const char **burst_files = NULL;
+static unsigned diag_count = 0;
+static unsigned burst_count = 0;
+
+static void add_diag_file(const char *name)
+{
+	diag_files = realloc(diag_files, (diag_count + 1) * sizeof(*diag_files));
+	if (!diag_files) {
+		errx(1, "Cannot allocate file list");
+	}
+	diag_files[diag_count++] = name;
+}
+
+static void add_burst_file(const char *name)
+{
+	burst_files = realloc(burst_files, (burst_count + 1) * sizeof(*burst_files));
+	if (!burst_files) {
+		errx(1, "Cannot allocate file list");
+	}
+	burst_files[burst_count++] = name;
+}
+
+static const struct bench_opt opts[] = {
+	{ 't', BENCH_DOUBLE, &min_secs, "<secs>", "Least time per benchmark" },
+	{ 'f', BENCH_STRING, &filter, "<name>", "Only run benchmarks with <name> in their name" },
+	{ 'o', BENCH_STRING, &out_name, "<file>", "Write JSON to <file> instead of stdout" },
+	{ 'd', BENCH_CALL, NULL, "<file>", "Replay DIAG file (repeatable)", add_diag_file },
+	{ 'b', BENCH_CALL, NULL, "<file>", "Replay burst record file (repeatable)", add_burst_file },
+	{ 'k', BENCH_CALL, NULL, "<keyfile>", "Kc per session of the burst files, as for burst_import", read_keys },
+	{ 0 }
+};
+
+static const struct bench_cmd *const cmds[] = {
+	&a5_bench,
+	&arfcn_bench,
+	&burst_bench,
+	&cell_bench,
+	&crc_bench,
+	&deinter_bench,
+	&diag_read_bench,
+	&gsmtap_bench,
+	&per_bench,
+	&sql_batch_bench,
+#ifdef USE_SQLITE
+	&sqlite_bench,
+#endif
+	&viterbi_bench,
+	NULL
+};
+
+static const struct bench_cmd suite = {
+	.opts = opts,
+	.cmds = cmds,
+};
+
+int main(int argc, char *argv[])
+{
+	unsigned i;
+
+	bench_progname = argv[0];
+
+	/* A single benchmark */
+	if (argc > 1 && argv[1][0] != '-') {
+		for (i = 0; cmds[i]; i++) {
+			if (!strcmp(argv[1], cmds[i]->name)) {
+				return cmds[i]->main(argc - 1, argv + 1);
+			}
+		}
+		bench_usage(&suite);
+	}
+
+	if (bench_getopt(&suite, argc, argv) != argc || min_secs <= 0) {
+		bench_usage(&suite);
+	}
+
+	if (out_name) {
+		out = fopen(out_name, "w");
+	} else {
+		out = fdopen(dup(STDOUT_FILENO), "w");
+	}
+	if (!out) {
+		err(1, "Cannot create %s", out_name ? out_name : "output");
+	}
+
+	/* The parser prints on session resets */
+	if (!freopen("/dev/null", "w", stdout)) {
+		err(1, "Cannot redirect stdout");
+	}
+
+	msg_verbose = 0;
+	process_init();
+
+	fprintf(out, "{\n\t\"conv_cch_impl\": \"%s\",\n", conv_cch_impl_name());
+	fprintf(out, "\t\"deinter_impl\": \"%s\",\n", gsm_deinter_impl_name());
+	fprintf(out, "\t\"min_secs\": %.3f,\n", min_secs);
+	fprintf(out, "\t\"benchmarks\": [");
+
+	for (i = 0; i < BENCHES; i++) {
+		if (selected(benches[i].name)) {
+			run_bench(&benches[i]);
+		}
+	}
+
+	if (selected("replay_diag")) {
+		for (i = 0; i < diag_count; i++) {
+			run_replay("replay_diag", diag_files[i], replay_diag);
+		}
+	}
+	if (selected("replay_bursts")) {
+		for (i = 0; i < burst_count; i++) {
+			run_replay("replay_bursts", burst_files[i], replay_bursts);
+		}
+	}
+
+	fprintf(out, "\n\t],\n\t\"sql_rows\": %llu\n}\n", (unsigned long long) sql_rows);
+
+	fclose(out);
+
+	return 0;
+}
@@ -17,65 +17,175 @@
 #define MYSQL_DBNAME "celldb"
 #endif
 
+/* Rows and bytes in one multi-row INSERT */
+#ifndef MYSQL_BATCH_ROWS
+#define MYSQL_BATCH_ROWS 1000
+#endif
+#ifndef MYSQL_BATCH_BYTES
+#define MYSQL_BATCH_BYTES (512*1024)
+#endif
+/* Batches waiting for the flush thread before the parser blocks */
+#ifndef MYSQL_QUEUE_LEN
+#define MYSQL_QUEUE_LEN 16
+#endif
+/* Attempts after a lost connection, first delay in ms */
+#ifndef MYSQL_RETRIES
+#define MYSQL_RETRIES 5
+#endif
+#ifndef MYSQL_RETRY_MS
+#define MYSQL_RETRY_MS 100
+#endif
+
 #ifdef USE_MYSQL
 #include <mysql.h>
-static MYSQL *meta_db;
+#include <errmsg.h>
+#include <mysqld_error.h>
 #endif
 
-void mysql_api_query_cb(const char *input)
+void mysql_api_query_cb(struct metagsm_ctx *ctx, const char *input)
 {
-	const char *ptr = input;
-	char query[4096];
-	int ret;
-
 	assert(input != NULL);
 
 	if (input[0] == 0) {
 		return;
 	}
 
-	#ifdef USE_MYSQL
-	while (sgets(query, sizeof(query), &ptr)) {
-		ret = mysql_query(meta_db, query);
-		if (ret) {
-			printf("Error executing query:\n%s\n", query);
-			printf("MySQL error: %s\n", mysql_error(meta_db));
-			exit(1);
-		}
+	if (ctx->mysql_batch) {
+		sql_batch_add(ctx->mysql_batch, input);
 	}
-	#endif
+}
+
+#ifdef USE_MYSQL
+/* The flush thread is the only user of the connection of a context */
+static void mysql_api_thread_start(void *priv __attribute__((unused)))
+{
+	mysql_thread_init();
+}
+
+static void mysql_api_thread_stop(void *priv)
+{
+	mysql_close((MYSQL *) priv);
+	mysql_thread_end();
+}
+
+static int mysql_api_sink(void *priv, const char *query, unsigned len)
+{
+	MYSQL *db = (MYSQL *) priv;
+	unsigned err;
+
+	if (!mysql_real_query(db, query, len)) {
+		return SQL_SINK_OK;
+	}
+
+	err = mysql_errno(db);
+	switch (err) {
+	case CR_SERVER_GONE_ERROR:
+	case CR_SERVER_LOST:
+	case CR_CONNECTION_ERROR:
+	case CR_CONN_HOST_ERROR:
+	case ER_LOCK_WAIT_TIMEOUT:
+	case ER_LOCK_DEADLOCK:
+		printf("MySQL error: %s, retrying\n", mysql_error(db));
+		/* Reconnects with MYSQL_OPT_RECONNECT */
+		mysql_ping(db);
+		return SQL_SINK_RETRY;
+	default:
+		printf("Error executing query:\n%.*s\n", len > 1024 ? 1024 : len, query);
+		printf("MySQL error: %s\n", mysql_error(db));
+		return SQL_SINK_ERROR;
+	}
+}
+#endif
+
+static void mysql_api_open(struct metagsm_ctx *ctx, sql_batch_sink sink, void *priv,
+			   void (*thread_start)(void *), void (*thread_stop)(void *))
+{
+	struct sql_batch_conf conf;
+
+	assert(ctx->mysql_batch == NULL);
+
+	conf.queue_len = MYSQL_QUEUE_LEN;
+	conf.max_bytes = MYSQL_BATCH_BYTES;
+	conf.max_rows = MYSQL_BATCH_ROWS;
+	conf.max_retries = MYSQL_RETRIES;
+	conf.retry_ms = MYSQL_RETRY_MS;
+	conf.thread_start = thread_start;
+	conf.thread_stop = thread_stop;
+
+	ctx->mysql_batch = sql_batch_open(&conf, sink, priv);
+	if (!ctx->mysql_batch) {
+		printf("Cannot start database writer\n");
+		exit(1);
+	}
+}
+
+/* Mock sinks or other databases can be used with the same batching */
+void mysql_api_open_sink(struct metagsm_ctx *ctx, sql_batch_sink sink, void *priv)
+{
+	mysql_api_open(ctx, sink, priv, NULL, NULL);
 }
 
 void mysql_api_init(struct session_info *s)
 {
 	#ifdef USE_MYSQL
 	int ret, one = 1;
-	MYSQL *conn_check;
+	MYSQL *db, *conn_check;
+	#endif
+
+	/* Sessions and cells of a context share one connection */
+	if (s->ctx->mysql_batch) {
+		s->sql_callback = mysql_api_query_cb;
+		return;
+	}
 
+	#ifdef USE_MYSQL
 	/* Connect to database */
-	meta_db = mysql_init(NULL);
+	db = mysql_init(NULL);
 
-	ret = mysql_options(meta_db, MYSQL_OPT_RECONNECT, &one);
+	ret = mysql_options(db, MYSQL_OPT_RECONNECT, &one);
 	if (ret) {
 		printf("Cannot set database options\n");
 		exit(1);
 	}
 
-	conn_check = mysql_real_connect(meta_db, "localhost", MYSQL_USER, MYSQL_PASS, MYSQL_DBNAME, 3306, 0, 0);
+	conn_check = mysql_real_connect(db, "localhost", MYSQL_USER, MYSQL_PASS, MYSQL_DBNAME, 3306, 0, 0);
 	if (!conn_check) {
 		printf("Cannot open database\n");
 		exit(1);
 	}
 
+	mysql_api_open(s->ctx, mysql_api_sink, db, mysql_api_thread_start, mysql_api_thread_stop);
+
 	s->sql_callback = mysql_api_query_cb;
 	#else
 	s->sql_callback = NULL;
 	#endif
 }
 
-void mysql_api_destroy()
+void mysql_api_stats(struct metagsm_ctx *ctx, struct sql_batch_stats *stats)
 {
-	#ifdef USE_MYSQL
-	mysql_close(meta_db);
-	#endif
+	if (ctx->mysql_batch) {
+		sql_batch_get_stats(ctx->mysql_batch, stats);
+	} else {
+		memset(stats, 0, sizeof(*stats));
+	}
+}
+
+/* The flush thread closes the connection when it ends */
+void mysql_api_destroy(struct metagsm_ctx *ctx)
+{
+	struct sql_batch_stats stats;
+
+	if (!ctx->mysql_batch) {
+		return;
+	}
+
+	sql_batch_close(ctx->mysql_batch, &stats);
+	ctx->mysql_batch = NULL;
+
+	if (stats.failed) {
+		printf("MySQL: %llu of %llu rows failed\n",
+			(unsigned long long) stats.failed,
+			(unsigned long long) stats.queued);
+	}
 }
@@ -2,8 +2,14 @@
 #define META_MYSQL_API_H
 
 #include "session.h"
+#include "sql_batch.h"
 
 void mysql_api_init(struct session_info *s);
-void mysql_api_destroy();
+void mysql_api_destroy(struct metagsm_ctx *ctx);
+void mysql_api_query_cb(struct metagsm_ctx *ctx, const char *input);
+
+/* Batch into another sink, mysql_api_init() then only sets the callback */
+void mysql_api_open_sink(struct metagsm_ctx *ctx, sql_batch_sink sink, void *priv);
+void mysql_api_stats(struct metagsm_ctx *ctx, struct sql_batch_stats *stats);
 
 #endif
@@ -1,45 +1,230 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <osmocom/gsm/rsl.h>
 #include <osmocom/core/gsmtap.h>
 #include <osmocom/core/gsmtap_util.h>
+#include <osmocom/core/select.h>
 
 #include "output.h"
 
+/*
+ * GSMTAP output is process-wide: all contexts share the socket and the
+ * batch queue. net_lock serializes them, net_users counts the contexts
+ * between net_init() and net_destroy().
+ */
 static struct gsmtap_inst *gti = NULL;
+static unsigned net_users;
+static pthread_mutex_t net_lock = PTHREAD_MUTEX_INITIALIZER;
 
+#ifndef NO_GSMTAP_BATCH
+
+/* Datagrams sent with one sendmmsg() */
+#define GSMTAP_BATCH		64
+/* Largest datagram queued, header included, bigger ones take the
+ * libosmocore path after the queue is flushed */
+#define GSMTAP_SLOT_SIZE	2048
+/* Queued datagrams are not held longer than this */
+#define GSMTAP_FLUSH_NSEC	20000000
+
+/* Datagrams are built in place in preallocated slots and sent in one
+ * system call when the queue fills or its oldest entry gets too old,
+ * instead of a msgb, a write() and a select() per message. */
+static struct {
+	int fd;
+	int disabled;		/* sendmmsg() is not available */
+	unsigned count;
+	struct timespec first;	/* When the oldest datagram was queued */
+	struct mmsghdr msgs[GSMTAP_BATCH];
+	struct iovec iov[GSMTAP_BATCH];
+	uint8_t slot[GSMTAP_BATCH][GSMTAP_SLOT_SIZE];
+} batch;
+
+static void batch_init(int fd)
+{
+	unsigned i;
+
+	memset(&batch.msgs, 0, sizeof(batch.msgs));
+	for (i = 0; i < GSMTAP_BATCH; i++) {
+		batch.iov[i].iov_base = batch.slot[i];
+		batch.msgs[i].msg_hdr.msg_iov = &batch.iov[i];
+		batch.msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	batch.fd = fd;
+	batch.count = 0;
+}
+
+static void batch_flush()
+{
+	unsigned done = 0;
+	unsigned refused = 0;
+	int ret;
+
+	if (!batch.count)
+		return;
+
+	while (done < batch.count) {
+		if (batch.disabled) {
+			ret = write(batch.fd, batch.slot[done], batch.iov[done].iov_len);
+			if (ret >= 0)
+				ret = 1;
+		} else {
+			ret = sendmmsg(batch.fd, &batch.msgs[done], batch.count - done, 0);
+		}
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOSYS && !batch.disabled) {
+				batch.disabled = 1;
+				continue;
+			}
+			// An earlier datagram was refused by the receiver,
+			// the error is reported once and cleared
+			if (errno == ECONNREFUSED && refused++ < batch.count)
+				continue;
+			break;
+		}
+		done += ret;
+	}
+	batch.count = 0;
+
+	/* Drain the local sink */
+	osmo_select_main(1);
+}
+
+/* Oldest queued datagram waited long enough */
+static int batch_expired(const struct timespec *now)
+{
+	return (now->tv_sec - batch.first.tv_sec) * 1000000000LL +
+	       (now->tv_nsec - batch.first.tv_nsec) >= GSMTAP_FLUSH_NSEC;
+}
+
+void net_poll()
+{
+	struct timespec now;
+
+	if (!batch.count)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	pthread_mutex_lock(&net_lock);
+	if (batch_expired(&now))
+		batch_flush();
+	pthread_mutex_unlock(&net_lock);
+}
+
+/* Returns 0 if the datagram was queued, -1 if it has to be sent by libosmocore */
+static int net_queue(uint8_t type, uint16_t arfcn, uint8_t ts, uint8_t chan_type,
+		     uint8_t ss, uint32_t fn, int8_t signal_dbm, uint8_t snr,
+		     const uint8_t *data, unsigned len)
+{
+	struct gsmtap_hdr *gh;
+	struct timespec now;
+
+	if (sizeof(*gh) + len > GSMTAP_SLOT_SIZE) {
+		/* Keep the order of datagrams */
+		batch_flush();
+		return -1;
+	}
+
+	gh = (struct gsmtap_hdr *) batch.slot[batch.count];
+	gh->version = GSMTAP_VERSION;
+	gh->hdr_len = sizeof(*gh)/4;
+	gh->type = type;
+	gh->timeslot = ts;
+	gh->arfcn = htons(arfcn);
+	gh->signal_dbm = signal_dbm;
+	gh->snr_db = snr;
+	gh->frame_number = htonl(fn);
+	gh->sub_type = chan_type;
+	gh->antenna_nr = 0;
+	gh->sub_slot = ss;
+	gh->res = 0;
+	memcpy(gh + 1, data, len);
+	batch.iov[batch.count].iov_len = sizeof(*gh) + len;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!batch.count++)
+		batch.first = now;
+
+	if ((batch.count == GSMTAP_BATCH) || batch_expired(&now))
+		batch_flush();
+
+	return 0;
+}
+
+#else
+
+#define batch_init(fd)
+
+static void batch_flush()
+{
+}
+
+void net_poll()
+{
+}
+
+/* Everything is sent by libosmocore */
+#define net_queue(...)	(-1)
+
+#endif
+
+void net_flush()
+{
+	pthread_mutex_lock(&net_lock);
+	batch_flush();
+	pthread_mutex_unlock(&net_lock);
+}
+
+/* The first context opens the socket, later ones share it */
 void net_init(const char *target)
 {
-	gti = gsmtap_source_init(target, GSMTAP_UDP_PORT, 0);
-	if (!gti) {
-		fprintf(stderr, "Cannot initialize GSMTAP\n");
-		abort();
+	pthread_mutex_lock(&net_lock);
+	if (!net_users++) {
+		gti = gsmtap_source_init(target, GSMTAP_UDP_PORT, 0);
+		if (!gti) {
+			fprintf(stderr, "Cannot initialize GSMTAP\n");
+			abort();
+		}
+		gsmtap_source_add_sink(gti);
+		batch_init(gsmtap_inst_fd(gti));
 	}
-	gsmtap_source_add_sink(gti);
+	pthread_mutex_unlock(&net_lock);
 }
 
 void net_destroy()
 {
-	if (gti) {
+	pthread_mutex_lock(&net_lock);
+	if (net_users && !--net_users && gti) {
+		batch_flush();
 		// Found no counterpart to gsmtap_source_init that
 		// would free resources. Doing that by hand, otherwise
 		// we run out of file descriptors...
 		close(gti->wq.bfd.fd);
 		talloc_free(gti);
+		gti = NULL;
 	}
+	pthread_mutex_unlock(&net_lock);
 }
 
-void net_send_rlcmac(uint8_t *msg, int len, int ts, uint8_t ul)
+static void send_rlcmac(uint8_t *msg, int len, int ts, uint8_t ul)
 {
-	if (gti) {
+	if (gti && net_queue(GSMTAP_TYPE_UM, ul?ARFCN_UPLINK:0, ts, GSMTAP_CHANNEL_PACCH, 0, 0, 0, 0, msg, len)) {
 		//gsmtap_send(gti, ul?ARFCN_UPLINK:0, 0, 0xd, 0, 0, 0, 0, msg, len);
 		gsmtap_send(gti, ul?ARFCN_UPLINK:0, ts, GSMTAP_CHANNEL_PACCH, 0, 0, 0, 0, msg, len);
 
 	}
 }
 
-void net_send_llc(uint8_t *data, int len, uint8_t ul)
+static void send_llc(uint8_t *data, int len, uint8_t ul)
 {
 	struct msgb *msg;
 	struct gsmtap_hdr *gh;
@@ -53,6 +238,9 @@ void net_send_llc(uint8_t *data, int len, uint8_t ul)
 	    (data[2] == 0x01))
 		return;
 
+	if (!net_queue(8, ul ? ARFCN_UPLINK : 0, 0, 0, 0, 0, 0, 0, data, len))
+		return;
+
 	msg = msgb_alloc(sizeof(*gh) + len, "gsmtap_tx");
 	if (!msg)
 	        return;
@@ -77,7 +265,7 @@ void net_send_llc(uint8_t *data, int len, uint8_t ul)
 	gsmtap_sendmsg(gti, msg);
 }
 
-void net_send_msg(struct radio_message *m)
+static void send_msg(struct radio_message *m)
 {
 	struct msgb *msgb = 0;
 	uint8_t gsmtap_channel;
@@ -93,6 +281,9 @@ void net_send_msg(struct radio_message *m)
 
 		gsmtap_channel = chantype_rsl2gsmtap(type, (m->flags & MSG_SACCH) ? 0x40 : 0);
 
+		if (!net_queue(GSMTAP_TYPE_UM, m->bb.arfcn[0], ts, gsmtap_channel, subch,
+			       m->bb.fn[0], m->bb.rxl[0], m->bb.snr[0], m->msg, m->msg_len))
+			return;
 		msgb = gsmtap_makemsg(m->bb.arfcn[0], ts, gsmtap_channel, subch,
 				 m->bb.fn[0], m->bb.rxl[0], m->bb.snr[0], m->msg, m->msg_len);
 		break;
@@ -115,10 +306,16 @@ void net_send_msg(struct radio_message *m)
 			/* no other types defined */
 			return;
 		}
+		if (!net_queue(GSMTAP_TYPE_UMTS_RRC, m->bb.arfcn[0], 0,
+			       gsmtap_channel, 0, 0, 0, 0, m->bb.data, m->msg_len))
+			return;
 		msgb = gsmtap_makemsg_ex(GSMTAP_TYPE_UMTS_RRC, m->bb.arfcn[0], 0,
 				 gsmtap_channel, 0, 0, 0, 0, m->bb.data, m->msg_len);
 		break;
 	case RAT_LTE:
+		if (!net_queue(0x0e, m->bb.arfcn[0], 0,
+			       0, 0, 0, 0, 0, m->bb.data, m->msg_len))
+			return;
 		msgb = gsmtap_makemsg_ex(0x0e, m->bb.arfcn[0], 0,
 					 0, 0, 0, 0, 0, m->bb.data, m->msg_len);
 		break;
@@ -134,3 +331,24 @@ void net_send_msg(struct radio_message *m)
 	}
 }
 
+
+void net_send_rlcmac(uint8_t *msg, int len, int ts, uint8_t ul)
+{
+	pthread_mutex_lock(&net_lock);
+	send_rlcmac(msg, len, ts, ul);
+	pthread_mutex_unlock(&net_lock);
+}
+
+void net_send_llc(uint8_t *data, int len, uint8_t ul)
+{
+	pthread_mutex_lock(&net_lock);
+	send_llc(data, len, ul);
+	pthread_mutex_unlock(&net_lock);
+}
+
+void net_send_msg(struct radio_message *m)
+{
+	pthread_mutex_lock(&net_lock);
+	send_msg(m);
+	pthread_mutex_unlock(&net_lock);
+}
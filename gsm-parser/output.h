@@ -3,8 +3,17 @@
 
 #include "session.h"
 
+/*
+ * The GSMTAP socket and its batch queue are shared by all contexts of
+ * the process. The first net_init() opens the socket to target, the
+ * last net_destroy() closes it.
+ */
 void net_init(const char *target);
 void net_destroy();
+/* Sends the GSMTAP datagrams still queued */
+void net_flush();
+/* Sends them if the oldest has waited too long, called from input loops */
+void net_poll();
 void net_send_msg(struct radio_message *m);
 void net_send_llc(uint8_t *data, int len, uint8_t ul);
 void net_send_rlcmac(uint8_t *msg, int len, int ts, uint8_t ul);
@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+
+#include <per_support.h>
+
+#include "bench.h"
+
+/*
+ * Checks the word PER bit reader of libasn1c against the octet one it
+ * replaced, kept below as ref_*: every width at every bit offset of random
+ * buffers, with and without right alignment, then random reads across
+ * refill() boundaries as open types do. Then times both readers.
+ */
+
+#define BUF_LEN		64
+#define CHUNK_MAX	9
+#define STRING_PASS	10000
+
+static double min_secs = 1;
+
+static void ref_per_get_undo(asn_per_data_t *pd, int nbits)
+{
+	pd->nboff -= nbits;
+	pd->moved -= nbits;
+}
+
+/* per_get_few_bits() as it was, an octet at a time */
+static int32_t ref_per_get_few_bits(asn_per_data_t *pd, int nbits)
+{
+	size_t off;
+	ssize_t nleft;
+	uint32_t accum;
+	const uint8_t *buf;
+
+	if (nbits < 0)
+		return -1;
+
+	nleft = pd->nbits - pd->nboff;
+	if (nbits > nleft) {
+		int32_t tailv, vhead;
+		if (!pd->refill || nbits > 31) return -1;
+		tailv = ref_per_get_few_bits(pd, nleft);
+		if (tailv < 0) return -1;
+		if (pd->refill(pd))
+			return -1;
+		nbits -= nleft;
+		vhead = ref_per_get_few_bits(pd, nbits);
+		tailv = (tailv << nbits) | vhead;
+		return tailv;
+	}
+
+	if (pd->nboff >= 8) {
+		pd->buffer += (pd->nboff >> 3);
+		pd->nbits  -= (pd->nboff & ~0x07);
+		pd->nboff  &= 0x07;
+	}
+	pd->moved += nbits;
+	pd->nboff += nbits;
+	off = pd->nboff;
+	buf = pd->buffer;
+
+	if (off <= 8)
+		accum = nbits ? (buf[0]) >> (8 - off) : 0;
+	else if (off <= 16)
+		accum = ((buf[0] << 8) + buf[1]) >> (16 - off);
+	else if (off <= 24)
+		accum = ((buf[0] << 16) + (buf[1] << 8) + buf[2]) >> (24 - off);
+	else if (off <= 31)
+		accum = ((buf[0] << 24) + (buf[1] << 16)
+			+ (buf[2] << 8) + (buf[3])) >> (32 - off);
+	else if (nbits <= 31) {
+		asn_per_data_t tpd = *pd;
+		ref_per_get_undo(&tpd, nbits);
+		accum  = ref_per_get_few_bits(&tpd, nbits - 24) << 24;
+		accum |= ref_per_get_few_bits(&tpd, 24);
+	} else {
+		ref_per_get_undo(pd, nbits);
+		return -1;
+	}
+
+	accum &= (((uint32_t)1 << nbits) - 1);
+
+	return accum;
+}
+
+/* per_get_many_bits() as it was, 24 bits at a time */
+static int ref_per_get_many_bits(asn_per_data_t *pd, uint8_t *dst, int alright, int nbits)
+{
+	int32_t value;
+
+	if (alright && (nbits & 7)) {
+		value = ref_per_get_few_bits(pd, nbits & 0x07);
+		if (value < 0) return -1;
+		*dst++ = value;
+		nbits &= ~7;
+	}
+
+	while (nbits) {
+		if (nbits >= 24) {
+			value = ref_per_get_few_bits(pd, 24);
+			if (value < 0) return -1;
+			*(dst++) = value >> 16;
+			*(dst++) = value >> 8;
+			*(dst++) = value;
+			nbits -= 24;
+		} else {
+			value = ref_per_get_few_bits(pd, nbits);
+			if (value < 0) return -1;
+			if (nbits & 7) {
+				value <<= 8 - (nbits & 7),
+				nbits += 8 - (nbits & 7);
+				if (nbits > 24)
+					*dst++ = value >> 24;
+			}
+			if (nbits > 16)
+				*dst++ = value >> 16;
+			if (nbits > 8)
+				*dst++ = value >> 8;
+			*dst++ = value;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/* Stream of random chunks, handed out by refill() */
+struct chunked {
+	uint8_t data[BUF_LEN];
+	unsigned len;		/* Octets in data */
+	unsigned pos;		/* Octets handed out */
+};
+
+static int chunk_refill(asn_per_data_t *pd)
+{
+	struct chunked *c = pd->refill_key;
+	unsigned n;
+
+	if (c->pos >= c->len) {
+		return -1;
+	}
+	n = 1 + random() % CHUNK_MAX;
+	if (n > c->len - c->pos) {
+		n = c->len - c->pos;
+	}
+	pd->buffer = &c->data[c->pos];
+	pd->nboff = 0;
+	pd->nbits = 8 * n;
+	c->pos += n;
+
+	return 0;
+}
+
+static void pd_init(asn_per_data_t *pd, const uint8_t *buf, size_t nbits, size_t nboff)
+{
+	memset(pd, 0, sizeof(*pd));
+	pd->buffer = buf;
+	pd->nbits = nbits;
+	pd->nboff = nboff;
+}
+
+/* Same position, whether normalized or not */
+static int pd_differ(asn_per_data_t *ref, asn_per_data_t *pd)
+{
+	return (ref->buffer + (ref->nboff >> 3) != pd->buffer + (pd->nboff >> 3)) ||
+	       ((ref->nboff & 7) != (pd->nboff & 7)) ||
+	       (ref->nbits - ref->nboff != pd->nbits - pd->nboff) ||
+	       (ref->moved != pd->moved);
+}
+
+/* Stream lengths in bits, whole octets or not */
+static const unsigned lengths[] = { 8 * BUF_LEN, 8 * BUF_LEN - 5, 61, 13 };
+#define LENGTHS		(sizeof(lengths) / sizeof(lengths[0]))
+
+static int check_buffer(const uint8_t *data, unsigned n)
+{
+	uint8_t ref_out[BUF_LEN + 1], out[BUF_LEN + 1];
+	asn_per_data_t ref, pd;
+	int32_t ref_v, v;
+	unsigned off, nbits, len, i;
+	uint8_t *buf;
+	int alright;
+
+	for (i = 0; i < LENGTHS; i++) {
+		len = lengths[i];
+
+		/* Exactly the octets of the stream, reads past them are bugs */
+		buf = malloc((len + 7) / 8);
+		if (!buf) {
+			errx(1, "Cannot allocate buffer");
+		}
+		memcpy(buf, data, (len + 7) / 8);
+
+		for (off = 0; off <= len; off++) {
+			/* Every width, past the end too */
+			for (nbits = 0; nbits <= 33; nbits++) {
+				pd_init(&ref, buf, len, off);
+				pd_init(&pd, buf, len, off);
+				ref_v = ref_per_get_few_bits(&ref, nbits);
+				v = per_get_few_bits(&pd, nbits);
+				if (ref_v != v || pd_differ(&ref, &pd)) {
+					printf("MISMATCH in buffer %u, %u bits at %u of %u: %d, expected %d\n",
+					       n, nbits, off, len, v, ref_v);
+					return 1;
+				}
+			}
+
+			for (alright = 0; alright < 2; alright++) {
+				for (nbits = 0; nbits <= len - off + 1; nbits++) {
+					pd_init(&ref, buf, len, off);
+					pd_init(&pd, buf, len, off);
+					memset(ref_out, 0, sizeof(ref_out));
+					memset(out, 0, sizeof(out));
+					ref_v = ref_per_get_many_bits(&ref, ref_out, alright, nbits);
+					v = per_get_many_bits(&pd, out, alright, nbits);
+					if (ref_v != v || (!v && (memcmp(ref_out, out, sizeof(out)) ||
+					    pd_differ(&ref, &pd)))) {
+						printf("MISMATCH in buffer %u, %u bits%s at %u of %u\n",
+						       n, nbits, alright ? " right aligned" : "", off, len);
+						return 1;
+					}
+				}
+			}
+		}
+
+		free(buf);
+	}
+
+	return 0;
+}
+
+static int check_stream(unsigned n)
+{
+	uint8_t ref_out[BUF_LEN + 1], out[BUF_LEN + 1];
+	struct chunked ref_c, c;
+	asn_per_data_t ref, pd;
+	int32_t ref_v, v;
+	unsigned seed = random();
+	unsigned i, nbits;
+	int many, alright;
+
+	memset(&ref_c, 0, sizeof(ref_c));
+	ref_c.len = 1 + random() % BUF_LEN;
+	for (i = 0; i < ref_c.len; i++) {
+		ref_c.data[i] = random();
+	}
+	c = ref_c;
+
+	/* Both see the same chunks */
+	pd_init(&ref, NULL, 0, 0);
+	ref.refill = chunk_refill;
+	ref.refill_key = &ref_c;
+	pd_init(&pd, NULL, 0, 0);
+	pd.refill = chunk_refill;
+	pd.refill_key = &c;
+
+	for (i = 0; ; i++) {
+		many = random() % 4 == 0;
+		alright = random() & 1;
+		nbits = many ? random() % 100 : random() % 32;
+
+		srandom(seed + i);
+		if (many) {
+			memset(ref_out, 0, sizeof(ref_out));
+			ref_v = ref_per_get_many_bits(&ref, ref_out, alright, nbits);
+		} else {
+			ref_v = ref_per_get_few_bits(&ref, nbits);
+		}
+		srandom(seed + i);
+		if (many) {
+			memset(out, 0, sizeof(out));
+			v = per_get_many_bits(&pd, out, alright, nbits);
+		} else {
+			v = per_get_few_bits(&pd, nbits);
+		}
+
+		if (ref_v != v || (many && !v && memcmp(ref_out, out, sizeof(out)))) {
+			printf("MISMATCH in stream %u, read %u of %u bits\n", n, i, nbits);
+			return 1;
+		}
+		/* Past a failed read the position is undefined */
+		if (v < 0) {
+			break;
+		}
+		if (ref.moved != pd.moved || ref.nbits - ref.nboff != pd.nbits - pd.nboff) {
+			printf("MISMATCH in stream %u, position after read %u of %u bits\n", n, i, nbits);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Fields of a decode: a few bits, now and then an octet string */
+static unsigned long read_fields(int ref, const uint8_t *data, size_t data_bits, uint8_t *out, unsigned *reads)
+{
+	asn_per_data_t pd;
+	unsigned long sum = 0;
+	unsigned i;
+
+	pd_init(&pd, data, data_bits, 0);
+	for (i = 0; pd.nbits - pd.nboff >= 31 + 8 * 40; i++) {
+		if (i % 16 == 15) {
+			sum += ref ? ref_per_get_many_bits(&pd, out, 0, 8 * (1 + i % 40))
+				   : per_get_many_bits(&pd, out, 0, 8 * (1 + i % 40));
+		} else {
+			sum += ref ? ref_per_get_few_bits(&pd, 1 + i % 24)
+				   : per_get_few_bits(&pd, 1 + i % 24);
+		}
+	}
+	*reads += i;
+
+	return sum;
+}
+
+/* 256 octet strings, nboff bits off the octet boundary */
+static unsigned long read_strings(int ref, const uint8_t *data, size_t data_bits, uint8_t *out, size_t nboff)
+{
+	asn_per_data_t pd;
+	unsigned long sum = 0;
+	unsigned i;
+
+	for (i = 0; i < STRING_PASS; i++) {
+		pd_init(&pd, data, data_bits, nboff);
+		sum += ref ? ref_per_get_many_bits(&pd, out, 0, 8 * 256)
+			   : per_get_many_bits(&pd, out, 0, 8 * 256);
+		sum += out[i % 256];
+	}
+
+	return sum;
+}
+
+static unsigned buffers = 20;
+static unsigned streams = 100000;
+
+static const struct bench_opt opts[] = {
+	{ 'n', BENCH_UINT, &buffers, "<buffers>", "Random buffers read at every offset" },
+	{ 's', BENCH_UINT, &streams, "<streams>", "Random refilled streams" },
+	{ 't', BENCH_DOUBLE, &min_secs, "<secs>", "Least time per timed reader" },
+	{ 0 }
+};
+
+static int per_main(int argc, char *argv[])
+{
+	uint8_t buf[BUF_LEN];
+	uint8_t *data, *out;
+	unsigned reads, passes, i, j, n;
+	unsigned long ref_sum = 0, sum = 0;
+	double secs, ref_secs;
+	size_t data_bits;
+
+	if (bench_getopt(&per_bench, argc, argv) != argc || !streams || min_secs <= 0) {
+		bench_usage(&per_bench);
+	}
+
+	srandom(1);
+	for (i = 0; i < buffers; i++) {
+		for (j = 0; j < sizeof(buf); j++) {
+			buf[j] = random();
+		}
+		if (check_buffer(buf, i)) {
+			return 1;
+		}
+	}
+	printf("%u buffers checked at every offset and width\n", buffers);
+
+	for (i = 0; i < streams; i++) {
+		if (check_stream(i)) {
+			return 1;
+		}
+	}
+	printf("%u refilled streams checked\n", streams);
+
+	data_bits = 8 * 4096 * 8;
+	data = malloc(data_bits / 8);
+	out = malloc(data_bits / 8);
+	if (!data || !out) {
+		errx(1, "Cannot allocate buffers");
+	}
+	for (i = 0; i < data_bits / 8; i++) {
+		data[i] = random();
+	}
+
+	/* Passes until the octet reader took min_secs, as many for the other */
+	reads = 0;
+	passes = 0;
+	ref_secs = stats_secs();
+	do {
+		ref_sum += read_fields(1, data, data_bits, out, &reads);
+		passes++;
+	} while (stats_secs() - ref_secs < min_secs);
+	ref_secs = stats_secs() - ref_secs;
+
+	n = 0;
+	secs = stats_secs();
+	for (j = 0; j < passes; j++) {
+		sum += read_fields(0, data, data_bits, out, &n);
+	}
+	secs = stats_secs() - secs;
+
+	if (ref_sum != sum || n != reads) {
+		printf("MISMATCH in timed reads\n");
+		return 1;
+	}
+
+	bench_print("octet reader", reads, "reads", ref_secs, 0);
+	bench_print("word reader", reads, "reads", secs, ref_secs);
+
+	/* Octet strings, aligned and not */
+	for (j = 0; j < 2; j++) {
+		passes = 0;
+		ref_secs = stats_secs();
+		do {
+			ref_sum += read_strings(1, data, data_bits, out, j * 3);
+			passes++;
+		} while (stats_secs() - ref_secs < min_secs);
+		ref_secs = stats_secs() - ref_secs;
+
+		secs = stats_secs();
+		for (i = 0; i < passes; i++) {
+			sum += read_strings(0, data, data_bits, out, j * 3);
+		}
+		secs = stats_secs() - secs;
+
+		if (ref_sum != sum) {
+			printf("MISMATCH in timed strings\n");
+			return 1;
+		}
+
+		n = passes * STRING_PASS;
+		printf("%-16s %10u strings %8.3f s %10.0f MB/s\n",
+			j ? "octets +3 bits" : "octets aligned", n, ref_secs, 256.0 * n / ref_secs / 1e6);
+		printf("%-16s %10u strings %8.3f s %10.0f MB/s %6.1fx\n",
+			j ? "words +3 bits" : "words aligned", n, secs, 256.0 * n / secs / 1e6, ref_secs / secs);
+	}
+
+	free(data);
+	free(out);
+
+	return 0;
+}
+
+const struct bench_cmd per_bench = {
+	.name = "per",
+	.help = "PER bit reader of libasn1c, octets against words",
+	.opts = opts,
+	.main = per_main,
+};
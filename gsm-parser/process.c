@@ -36,6 +36,11 @@ int process_handle_burst(struct session_info *s, struct l1ctl_burst_ind *bi)
 	//uint32_t fn;
 	uint8_t type, subch, ts;
 	struct burst_buf *bb = 0;
+	uint8_t msg[23];
+	uint64_t t;
+
+	stats_poll(&s->ctx->stats);
+	t = stats_begin(&s->ctx->stats, STAGE_L1);
 
 	rsl_dec_chan_nr(bi->chan_nr, &type, &subch, &ts);
 
@@ -56,7 +61,7 @@ int process_handle_burst(struct session_info *s, struct l1ctl_burst_ind *bi)
 		} else {
 			//FIXME: detect type of channel
 			/* try TCH (FACCH) */
-			//len = process_tch(s, bi, msg);
+			process_tch(s, bi, msg);
 			/* try PDCH */
 			//len = process_pdch(s, bi, msg);
 		}
@@ -80,6 +85,8 @@ int process_handle_burst(struct session_info *s, struct l1ctl_burst_ind *bi)
 		printf("Type not handled! %.02x\n", type);
 	}
 
+	stats_end(&s->ctx->stats, STAGE_L1, t);
+
 	return 0;
 }
 
@@ -2,6 +2,7 @@
 #define PROCESS_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <sys/time.h>
 
 #include "burst_desc.h"
@@ -20,6 +21,10 @@
 #define MSG_CIPHERED	0x40
 #define MSG_DECODED	0x80
 
+/* Bursts are kept packed in burst_buf data, 114 bits MSB first each */
+#define BURST_BITS	114
+#define BURST_BYTES	15
+
 struct burst_buf {
 	unsigned count;
 	unsigned errors;
@@ -36,17 +41,30 @@ struct radio_message {
 	uint8_t rat;
 	uint8_t domain;
 	uint8_t flags;	/* MSG_* */
+	uint8_t pool;	/* RADIO_MSG_* size class */
 	struct timeval timestamp;
 	char info[128];
 	uint8_t chan_nr;
 	uint8_t msg[256];
 	uint32_t msg_len;
-	struct burst_buf bb;
 	struct radio_message *next;
 	struct radio_message *prev;
+	struct burst_buf bb;	/* last, cut short in compact messages */
 } __attribute__((packed));
 
+/* Size classes of pooled messages. Compact messages keep the burst_buf
+ * header but only RADIO_MSG_COMPACT_DATA bytes of bb.data and no sbit,
+ * enough for inputs that do not carry soft bits. */
+#define RADIO_MSG_FULL		0
+#define RADIO_MSG_COMPACT	1
+#define RADIO_MSG_CLASSES	2
+
+#define RADIO_MSG_COMPACT_DATA	256
+#define RADIO_MSG_COMPACT_SIZE	(offsetof(struct radio_message, bb.data) + RADIO_MSG_COMPACT_DATA)
+
+struct session_info;
+
 void process_init();
-//int process_handle_burst(struct session_info *s, struct l1ctl_burst_ind *bi);
+int process_handle_burst(struct session_info *s, struct l1ctl_burst_ind *bi);
 
 #endif
@@ -206,7 +206,7 @@ void process_blocks(struct gprs_tbf *t, int ul)
 	}
 }
 
-void rlc_data_handler(struct radio_message *m)
+void rlc_data_handler(struct gprs_tbf *tbf_table, struct radio_message *m)
 {
 	int ul;
 	int off;
@@ -342,7 +342,7 @@ void rlc_data_handler(struct radio_message *m)
 	process_blocks(t, ul);
 }
 
-void rlc_type_handler(struct radio_message *m)
+void rlc_type_handler(struct gprs_tbf *tbf_table, struct radio_message *m)
 {
 	uint8_t ul, ts;
 
@@ -377,7 +377,7 @@ void rlc_type_handler(struct radio_message *m)
 
 		net_send_rlcmac(m->msg, m->msg_len, ts, ul);
 		printf("DATA ");
-		rlc_data_handler(m);
+		rlc_data_handler(tbf_table, m);
 		printf("\n");
 		fflush(stdout);
 		break;
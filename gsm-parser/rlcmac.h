@@ -27,12 +27,10 @@ struct gprs_tbf {
 	struct gprs_frag frags[128];
 } __attribute__ ((packed));
 
-static struct gprs_tbf tbf_table[32*2]; // for one cell
-
 void print_pkt(uint8_t *msg, unsigned len);
 void process_blocks(struct gprs_tbf *t, int ul);
-void rlc_data_handler(struct radio_message *m);
-void rlc_type_handler(struct radio_message *m);
+void rlc_data_handler(struct gprs_tbf *tbf_table, struct radio_message *m);
+void rlc_type_handler(struct gprs_tbf *tbf_table, struct radio_message *m);
 
 #endif
 
@@ -2,12 +2,15 @@
 #include "output.h"
 #include "bit_func.h"
 #include "sms.h"
+#include "ccch.h"
+#include "umts_rrc.h"
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <assert.h>
+#include <osmocom/core/utils.h>
 #include <osmocom/gsm/gsm_utils.h>
 
 #ifdef USE_MYSQL
@@ -24,6 +27,21 @@
 #define MSG_VERBOSE 0
 #endif /* !MSG_VERBOSE */
 
+/* Free messages kept per size class, the rest goes back to malloc */
+#ifndef RADIO_MSG_POOL_MAX
+#define RADIO_MSG_POOL_MAX 1024
+#endif
+
+/* Messages kept per session once they have been passed to the sinks */
+#ifndef RADIO_MSG_WINDOW
+#define RADIO_MSG_WINDOW 16
+#endif
+
+/* SACCH/SDCCH blocks from bursts decoded in one batch */
+#ifndef CCCH_BATCH
+#define CCCH_BATCH 16
+#endif
+
 uint8_t privacy = 0;
 uint8_t msg_verbose = MSG_VERBOSE;
 uint8_t auto_reset = 1;
@@ -34,19 +52,24 @@ uint8_t auto_reset = 1;
 	uint8_t auto_timestamp = 0;
 #endif
 
-static uint8_t output_console = 1;
-static uint8_t output_gsmtap = 1;
-static uint8_t output_sqlite = 1;
-
-static uint32_t s_id = 0;
-static struct session_info *s_pointer = 0;
-pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 struct session_info _s[2];
-
 uint32_t now = 0;
 
-static void console_callback(const char *sql)
+/* Context behind the old global API */
+static struct metagsm_ctx default_ctx = {
+	.s = _s,
+	.now = &now,
+	.s_mutex = PTHREAD_MUTEX_INITIALIZER,
+	.output_console = 1,
+	.output_gsmtap = 1,
+	.output_sqlite = 1,
+	.cell_output_sqlite = 1,
+	.cell_list = LLIST_HEAD_INIT(default_ctx.cell_list),
+	.msg_window = RADIO_MSG_WINDOW,
+	.ccch_batch = CCCH_BATCH,
+};
+
+static void console_callback(struct metagsm_ctx *ctx __attribute__((unused)), const char *sql)
 {
 	assert(sql != NULL);
 
@@ -54,20 +77,132 @@ static void console_callback(const char *sql)
 	fflush(stdout);
 }
 
-void session_init(unsigned start_sid, int console, const char *gsmtap_target, int callback)
+static void console_msg_sink(struct session_info *s, struct radio_message *m)
 {
-	output_console = console;
-	output_gsmtap = (gsmtap_target == NULL ? 0 : 1);
+	uint8_t ul = !!(m->bb.arfcn[0] & ARFCN_UPLINK);
+
+	if (!s->ctx->msg_verbose) {
+		return;
+	}
+
+	switch (m->rat) {
+	case RAT_GSM:
+		printf("GSM %s %s %u : %s\n", m->domain ? "PS" : "CS", ul ? "UL" : "DL",
+			m->bb.fn[0], m->info[0] ? m->info : osmo_hexdump_nospc(m->msg, m->msg_len));
+		break;
+	case RAT_UMTS:
+		printf("RRC %s %s %u : %s\n", m->domain ? "PS" : "CS", ul ? "UL" : "DL",
+			m->bb.fn[0], m->info[0] ? m->info : osmo_hexdump_nospc(m->bb.data, m->msg_len));
+		break;
+	case RAT_LTE:
+		printf("LTE %s %u : %s\n", ul ? "UL" : "DL",
+			m->bb.fn[0], m->info[0] ? m->info : osmo_hexdump_nospc(m->bb.data, m->msg_len));
+		break;
+	}
+}
+
+static void gsmtap_msg_sink(struct session_info *s __attribute__((unused)), struct radio_message *m)
+{
+	net_send_msg(m);
+}
+
+void session_spool(char type, const char *sql)
+{
+	assert(sql != NULL);
+
+	putchar('\0');
+	putchar(type);
+	fputs(sql, stdout);
+	putchar('\0');
+}
+
+static void spool_callback(struct metagsm_ctx *ctx __attribute__((unused)), const char *sql)
+{
+	session_spool(SQL_ID_SESSION, sql);
+}
+
+const char *sql_id(struct metagsm_ctx *ctx, char *buf, char type, int id)
+{
+	if (ctx->output_spool) {
+		snprintf(buf, SQL_ID_LEN, "%c%c%d%c", SQL_ID_MARK, type, id, SQL_ID_MARK);
+	} else {
+		snprintf(buf, SQL_ID_LEN, "%d", id);
+	}
+
+	return buf;
+}
+
+struct metagsm_ctx *metagsm_ctx_alloc()
+{
+	struct metagsm_ctx *ctx;
+
+	ctx = (struct metagsm_ctx *) malloc(sizeof(struct metagsm_ctx));
+	memset(ctx, 0, sizeof(struct metagsm_ctx));
+
+	ctx->s = (struct session_info *) malloc(2 * sizeof(struct session_info));
+	memset(ctx->s, 0, 2 * sizeof(struct session_info));
+
+	ctx->now = &ctx->epoch;
+	pthread_mutex_init(&ctx->s_mutex, NULL);
+	ctx->msg_verbose = msg_verbose;
+	ctx->output_console = 1;
+	ctx->output_gsmtap = 1;
+	ctx->output_sqlite = 1;
+	ctx->cell_output_sqlite = 1;
+	ctx->msg_window = RADIO_MSG_WINDOW;
+	ctx->ccch_batch = CCCH_BATCH;
+	INIT_LLIST_HEAD(&ctx->cell_list);
+
+	return ctx;
+}
+
+void metagsm_ctx_free(struct metagsm_ctx *ctx)
+{
+	assert(ctx != &default_ctx);
+
+	ccch_queue_free(ctx);
+	umts_rrc_free(ctx);
+#ifdef USE_SQLITE
+	sqlite_api_destroy(ctx);
+#endif
+	radio_msg_pool_flush(ctx);
+	pthread_mutex_destroy(&ctx->s_mutex);
+	free(ctx->s);
+	free(ctx);
+}
+
+struct metagsm_ctx *metagsm_default_ctx()
+{
+	/* msg_verbose may be changed at any time by the tools */
+	default_ctx.msg_verbose = msg_verbose;
+
+	return &default_ctx;
+}
+
+void session_init_ctx(struct metagsm_ctx *ctx, unsigned start_sid, int console, const char *gsmtap_target, int callback)
+{
+	struct session_info *_s = ctx->s;
+
+	ctx->output_console = console;
+	ctx->output_gsmtap = (gsmtap_target == NULL ? 0 : 1);
+	ctx->output_spool = (callback == CALLBACK_SPOOL);
+	ctx->output_stmt = 0;
+
+	ctx->msg_sink_count = 0;
+	session_add_msg_sink(ctx, console_msg_sink);
+	session_add_msg_sink(ctx, gsmtap_msg_sink);
 
 	// Reset both domains
-	memset(_s, 0, sizeof(_s));
+	memset(_s, 0, 2 * sizeof(struct session_info));
+	_s[0].ctx = ctx;
+	_s[1].ctx = ctx;
 
 	switch (callback) {
 	case CALLBACK_NONE:
 		break;
 #ifdef USE_MYSQL
 	case CALLBACK_MYSQL:
-		output_sqlite = 0;
+		ctx->output_sqlite = 0;
 		mysql_api_init(&_s[0]);
 		mysql_api_init(&_s[1]);
 		break;
@@ -82,12 +217,20 @@ void session_init(unsigned start_sid, int console, const char *gsmtap_target, in
 		_s[0].sql_callback = console_callback;
 		_s[1].sql_callback = console_callback;
 		break;
+	case CALLBACK_SPOOL:
+		/* Same SQL dialect as the output it is replayed to */
+#ifdef USE_MYSQL
+		ctx->output_sqlite = 0;
+#endif
+		_s[0].sql_callback = spool_callback;
+		_s[1].sql_callback = spool_callback;
+		break;
 	}
 
-	s_id = start_sid;
+	ctx->s_id = start_sid;
 
-	_s[0].id = s_id++;
-	_s[1].id = s_id++;
+	_s[0].id = ctx->s_id++;
+	_s[1].id = ctx->s_id++;
 	_s[1].domain = DOMAIN_PS;
 
 	if (gsmtap_target != NULL)
@@ -96,43 +239,61 @@ void session_init(unsigned start_sid, int console, const char *gsmtap_target, in
 	}
 }
 
-void session_destroy(unsigned *last_sid, unsigned *last_cid)
+void session_init(unsigned start_sid, int console, const char *gsmtap_target, int callback)
+{
+	session_init_ctx(metagsm_default_ctx(), start_sid, console, gsmtap_target, callback);
+}
+
+void session_destroy_ctx(struct metagsm_ctx *ctx, unsigned *last_sid, unsigned *last_cid)
 {
-	if (msg_verbose > 1) {
+	struct session_info *_s = ctx->s;
+
+	if (ctx->msg_verbose > 1) {
 		printf("session_destroy!\n");
 	}
 
+	/* Blocks still waiting for the Viterbi decoder */
+	ccch_flush(ctx);
+
 	session_reset(&_s[0], 0);
 	_s[1].new_msg = NULL;
 	session_reset(&_s[1], 0);
-	*last_sid = s_id;
+	*last_sid = ctx->s_id;
 
-	cell_destroy(last_cid);
-	net_destroy();
+	cell_destroy_ctx(ctx, last_cid);
+	if (ctx->output_gsmtap) {
+		net_destroy();
+	}
 
-	if (_s[0].sql_callback) {
+	if (_s[0].sql_callback && !ctx->output_spool) {
 #ifdef USE_SQLITE
-		if (output_sqlite == 1) {
-			sqlite_api_destroy();
+		if (ctx->output_sqlite == 1) {
+			sqlite_api_destroy(ctx);
 		}
 #endif
 #ifdef USE_MYSQL
-		if (output_sqlite == 0) {
-			mysql_api_destroy();
+		if (ctx->output_sqlite == 0) {
+			mysql_api_destroy(ctx);
 		}
 #endif
 	}
 }
 
-struct session_info *session_create(int id, char* name, uint8_t *key, int mcc, int mnc, int lac, int cid, struct gsm_sysinfo_freq *ca)
+void session_destroy(unsigned *last_sid, unsigned *last_cid)
+{
+	session_destroy_ctx(metagsm_default_ctx(), last_sid, last_cid);
+}
+
+struct session_info *session_create_ctx(struct metagsm_ctx *ctx, int id, char* name, uint8_t *key, int mcc, int mnc, int lac, int cid, struct arfcn_set *ca)
 {
 	struct session_info *ns;
 
 	ns = (struct session_info *) malloc(sizeof(struct session_info));
 	memset(ns, 0, sizeof(struct session_info));
+	ns->ctx = ctx;
 
 	if (id < 0) {
-		ns->id = s_id++; 
+		ns->id = ctx->s_id++;
 	} else {
 		ns->id = id;
 	}
@@ -145,7 +306,7 @@ struct session_info *session_create(int id, char* name, uint8_t *key, int mcc, i
 	if (auto_timestamp) {
 		gettimeofday(&ns->timestamp, 0);
 	} else {
-		ns->timestamp.tv_sec  = now;
+		ns->timestamp.tv_sec  = *ctx->now;
 		ns->timestamp.tv_usec = 0;
 	}
 
@@ -160,33 +321,38 @@ struct session_info *session_create(int id, char* name, uint8_t *key, int mcc, i
 	ns->lac = lac;
 	ns->cid = cid;
 
-	/* Store cell ARFCNs */
+	/* Store cell allocation */
 	if (ca)
-		memcpy(ns->cell_arfcns, ca, 1024*sizeof(struct gsm_sysinfo_freq));
+		ns->cell_arfcns[ASSIGN_ARFCN_CELL] = *ca;
 
 	ns->decoded = 1;
 	rand_init_2b(&ns->null);
 	rand_init_2b(&ns->other_sdcch);
 	rand_init_2b(&ns->other_sacch);
 
-	pthread_mutex_lock(&s_mutex);
+	pthread_mutex_lock(&ctx->s_mutex);
 
-	if (s_pointer)
-		s_pointer->prev = ns;
-	ns->next = s_pointer;
-	s_pointer = ns;
+	if (ctx->s_pointer)
+		ctx->s_pointer->prev = ns;
+	ns->next = ctx->s_pointer;
+	ctx->s_pointer = ns;
 
-	pthread_mutex_unlock(&s_mutex);
+	pthread_mutex_unlock(&ctx->s_mutex);
 
 	return ns;
 }
 
-int session_enumerate(int output)
+struct session_info *session_create(int id, char* name, uint8_t *key, int mcc, int mnc, int lac, int cid, struct arfcn_set *ca)
+{
+	return session_create_ctx(metagsm_default_ctx(), id, name, key, mcc, mnc, lac, cid, ca);
+}
+
+int session_enumerate_ctx(struct metagsm_ctx *ctx, int output)
 {
 	struct session_info *s;
 	int count;
 
-	s = s_pointer;
+	s = ctx->s_pointer;
 	count = 0;
 
 	if (output)
@@ -207,6 +373,119 @@ int session_enumerate(int output)
 	return count;
 }
 
+int session_enumerate(int output)
+{
+	return session_enumerate_ctx(metagsm_default_ctx(), output);
+}
+
+/* Returns a zeroed message with room for data_len bytes in bb.data */
+struct radio_message *radio_msg_alloc(struct metagsm_ctx *ctx, unsigned data_len)
+{
+	struct radio_msg_pool *pool = &ctx->msg_pool;
+	struct radio_message *m;
+	unsigned size;
+	uint8_t class;
+
+	assert(data_len <= sizeof(m->bb.data));
+
+	if (data_len <= RADIO_MSG_COMPACT_DATA) {
+		class = RADIO_MSG_COMPACT;
+		size = RADIO_MSG_COMPACT_SIZE;
+	} else {
+		class = RADIO_MSG_FULL;
+		size = sizeof(struct radio_message);
+	}
+
+	m = pool->free_list[class];
+	if (m) {
+		pool->free_list[class] = m->next;
+		pool->free_count[class]--;
+	} else {
+		m = (struct radio_message *) malloc(size);
+		if (!m) {
+			printf("Cannot allocate memory for radio message\n");
+			exit(1);
+		}
+		pool->mallocs++;
+	}
+
+	memset(m, 0, size);
+	m->pool = class;
+
+	pool->allocs++;
+	pool->in_use++;
+	if (pool->in_use > pool->peak) {
+		pool->peak = pool->in_use;
+	}
+
+	return m;
+}
+
+void radio_msg_free(struct metagsm_ctx *ctx, struct radio_message *m)
+{
+	struct radio_msg_pool *pool = &ctx->msg_pool;
+
+	assert(m->pool < RADIO_MSG_CLASSES);
+	assert(pool->in_use > 0);
+
+	pool->in_use--;
+
+	if (pool->free_count[m->pool] >= RADIO_MSG_POOL_MAX) {
+		free(m);
+		return;
+	}
+
+	m->next = pool->free_list[m->pool];
+	pool->free_list[m->pool] = m;
+	pool->free_count[m->pool]++;
+}
+
+void radio_msg_pool_flush(struct metagsm_ctx *ctx)
+{
+	struct radio_msg_pool *pool = &ctx->msg_pool;
+	struct radio_message *m;
+	int i;
+
+	for (i = 0; i < RADIO_MSG_CLASSES; i++) {
+		while ((m = pool->free_list[i])) {
+			pool->free_list[i] = m->next;
+			free(m);
+		}
+		pool->free_count[i] = 0;
+	}
+}
+
+unsigned radio_msg_size(struct radio_message *m)
+{
+	if (m->pool == RADIO_MSG_COMPACT) {
+		return RADIO_MSG_COMPACT_SIZE;
+	}
+
+	return sizeof(struct radio_message);
+}
+
+void session_add_msg_sink(struct metagsm_ctx *ctx, radio_msg_sink sink)
+{
+	assert(ctx->msg_sink_count < MSG_SINKS_MAX);
+
+	ctx->msg_sinks[ctx->msg_sink_count++] = sink;
+}
+
+void session_emit_msg(struct session_info *s, struct radio_message *m)
+{
+	unsigned i;
+
+	for (i = 0; i < s->ctx->msg_sink_count; i++) {
+		s->ctx->msg_sinks[i](s, m);
+	}
+}
+
+/* Heap held by a session and its message list */
+unsigned session_mem(struct session_info *s)
+{
+	return sizeof(struct session_info) + s->msg_bytes;
+}
+
 void session_free_msg_list(struct session_info *s)
 {
 	struct radio_message *m;
@@ -215,13 +494,16 @@ void session_free_msg_list(struct session_info *s)
 
 	while (s->first_msg) {
 		m = s->first_msg;
-		if (msg_verbose > 1) {
+		if (s->ctx->msg_verbose > 1) {
 			printf("Freeing pointer %p\n", m);
 		}
 		s->first_msg = m->next;
 
-		free(m);
+		radio_msg_free(s->ctx, m);
 	}
+	s->last_msg = NULL;
+	s->msg_count = 0;
+	s->msg_bytes = 0;
 }
 
 void session_free_sms_list(struct session_info *s)
@@ -250,8 +532,8 @@ void session_free(struct session_info *s)
 	if (s->next) {
 		s->next->prev = s->prev;
 	}
-	if (s_pointer == s) {
-		s_pointer = s->next;
+	if (s->ctx->s_pointer == s) {
+		s->ctx->s_pointer = s->next;
 	}
 
 	session_free_msg_list(s);
@@ -465,7 +747,8 @@ void session_make_sql(struct session_info *s, char *query, unsigned q_len, uint8
 	char *msisdn;
 	char *pdpip;
 	char id_field[4];
-	char id_value[16];
+	char id_value[SQL_ID_LEN + 1];
+	char id_buf[SQL_ID_LEN];
 
 	assert(s != NULL);
 	assert(query != NULL);
@@ -479,7 +762,7 @@ void session_make_sql(struct session_info *s, char *query, unsigned q_len, uint8
 	/* Prepare strings */
 	if (s->id >= 0) {
 		strncpy(id_field, "id,", sizeof(id_field));
-		snprintf(id_value, sizeof(id_value), "%d,", s->id);
+		snprintf(id_value, sizeof(id_value), "%s,", sql_id(s->ctx, id_buf, SQL_ID_SESSION, s->id));
 	} else {
 		id_field[0] = 0;
 		id_value[0] = 0;
@@ -565,8 +848,20 @@ void session_make_sql(struct session_info *s, char *query, unsigned q_len, uint8
 	free(pdpip);
 }
 
+/* SQL statement to the output callback */
+static void session_sql(struct session_info *s, const char *sql)
+{
+	uint64_t t = stats_begin(&s->ctx->stats, STAGE_SQL_SINK);
+
+	s->sql_callback(s->ctx, sql);
+
+	stats_end(&s->ctx->stats, STAGE_SQL_SINK, t);
+}
+
 void session_close(struct session_info *s)
 {
+	uint64_t t;
+
 	assert(s != NULL);
 
 	s->processing = 0;
@@ -575,8 +870,8 @@ void session_close(struct session_info *s)
 	if (auto_timestamp) {
 		gettimeofday(&s->timestamp, NULL);
 	} else {
-		if (now) {
-			s->timestamp.tv_sec = now;
+		if (*s->ctx->now) {
+			s->timestamp.tv_sec = *s->ctx->now;
 			s->timestamp.tv_usec = 0;
 		}
 	}
@@ -620,34 +915,44 @@ void session_close(struct session_info *s)
 #endif
 
 	/* Output functions */
-	if (output_gsmtap && !auto_reset)
+	if (s->ctx->output_gsmtap && !auto_reset && !s->ctx->msg_window)
 		session_stream(s);
 
-	if (output_console)
+	if (s->ctx->output_console)
 		session_print(s);
 
+#ifdef USE_SQLITE
+	if (s->ctx->output_stmt) {
+		t = stats_begin(&s->ctx->stats, STAGE_SQL_SINK);
+		sqlite_api_session(s);
+		stats_end(&s->ctx->stats, STAGE_SQL_SINK, t);
+	} else
+#endif
 	if (s->sql_callback) {
 		char sql_buffer[8192];
+		char id_buf[SQL_ID_LEN];
 		struct sms_meta *sm;
 
-		session_make_sql(s, sql_buffer, sizeof(sql_buffer), output_sqlite);
+		t = stats_begin(&s->ctx->stats, STAGE_SQL_FORMAT);
+		session_make_sql(s, sql_buffer, sizeof(sql_buffer), s->ctx->output_sqlite);
+		stats_end(&s->ctx->stats, STAGE_SQL_FORMAT, t);
 
-		s->sql_callback(sql_buffer);
+		session_sql(s, sql_buffer);
 
 		sm = s->sms_list;
 		while (sm) {
-			sms_make_sql(s->id, sm, sql_buffer, sizeof(sql_buffer));
+			sms_make_sql(sql_id(s->ctx, id_buf, SQL_ID_SESSION, s->id), sm, sql_buffer, sizeof(sql_buffer));
 
-			s->sql_callback(sql_buffer);
+			session_sql(s, sql_buffer);
 
 			sm = sm->next;
 		}
 
 		if (s->appid) {
 			snprintf(sql_buffer, sizeof(sql_buffer),
-				 "INSERT INTO sid_appid VALUES (%d,'%08x');\n", s->id, s->appid); 
+				 "INSERT INTO sid_appid VALUES (%s,'%08x');\n", sql_id(s->ctx, id_buf, SQL_ID_SESSION, s->id), s->appid);
 
-			s->sql_callback(sql_buffer);
+			session_sql(s, sql_buffer);
 		}
 	}
 
@@ -656,7 +961,7 @@ void session_close(struct session_info *s)
 
 void link_to_msg_list(struct session_info* s, struct radio_message *m)
 {
-	if (msg_verbose > 1) {
+	if (s->ctx->msg_verbose > 1) {
 		printf("linking to domain %d message ptr %p\n", s->domain, m);
 	}
 
@@ -671,6 +976,23 @@ void link_to_msg_list(struct session_info* s, struct radio_message *m)
 	m->next = NULL;
 	m->prev = s->last_msg;
 	s->last_msg = m;
+
+	s->msg_count++;
+	s->msg_bytes += radio_msg_size(m);
+
+	/* Older messages have been passed to the sinks already */
+	while (s->ctx->msg_window && s->msg_count > s->ctx->msg_window) {
+		m = s->first_msg;
+		s->first_msg = m->next;
+		s->first_msg->prev = NULL;
+		s->msg_count--;
+		s->msg_bytes -= radio_msg_size(m);
+		radio_msg_free(s->ctx, m);
+	}
+
+	if (session_mem(s) > s->ctx->session_peak) {
+		s->ctx->session_peak = session_mem(s);
+	}
 }
 
 void session_reset(struct session_info *s, int forced_release)
@@ -681,7 +1003,7 @@ void session_reset(struct session_info *s, int forced_release)
 	if (auto_reset == 0) {
 		return;
 	}
-	if (msg_verbose > 1) {
+	if (s->ctx->msg_verbose > 1) {
 		printf("Session RESET! domain: %d, forced release: %d\n", s->domain, forced_release);
 	}
 
@@ -721,8 +1043,9 @@ void session_reset(struct session_info *s, int forced_release)
 
 	//Set up 's'
 	memset(s, 0, sizeof(struct session_info));
+	s->ctx = old_s.ctx;
 	if (old_s.started && old_s.closed) {
-		s->id = ++s_id;
+		s->id = ++s->ctx->s_id;
 	} else {
 		s->id = old_s.id;
 	}
@@ -762,7 +1085,7 @@ void session_reset(struct session_info *s, int forced_release)
 	/* Free allocated memory */
 
 	//TODO remove the check below, it's *expensive*
-	if (msg_verbose > 1) {
+	if (old_s.ctx->msg_verbose > 1) {
 		printf("session reset (at the end of the function), domain: %d\n", old_s.domain);
 	}
 	struct radio_message *tmp = old_s.first_msg;
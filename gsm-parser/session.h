@@ -3,13 +3,20 @@
 
 #include <stdint.h>
 #include <assert.h>
+#include <pthread.h>
 #include <sys/time.h>
+#include <osmocom/core/linuxlist.h>
 #include <osmocom/gsm/protocol/gsm_04_08.h>
 
 #include "process.h"
 #include "rand_check.h"
 #include "assignment.h"
 #include "cell_info.h"
+#include "rlcmac.h"
+#include "stats.h"
+
+struct sqlite_api;
+struct sql_batch;
 
 struct frame_count {
 	uint32_t unenc;
@@ -144,10 +151,12 @@ struct session_info {
 	struct radio_message *first_msg;
 	struct radio_message *last_msg;
 	struct radio_message *new_msg;
+	unsigned msg_count;	/* messages on the first_msg list */
+	unsigned msg_bytes;
 	struct sms_meta *sms_list;
 	struct session_info *next;
 	struct session_info *prev;
-	struct gsm_sysinfo_freq cell_arfcns[1024];
+	struct arfcn_set cell_arfcns[ASSIGN_ARFCN_LISTS] __attribute__((aligned(8)));
 	struct cell_info *ci;
 	struct rand_state null;
 	struct rand_state si5;
@@ -156,16 +165,98 @@ struct session_info {
 	struct rand_state si6;
 	struct rand_state other_sdcch;
 	struct rand_state other_sacch;
-	void (*sql_callback)(const char *);
+	void (*sql_callback)(struct metagsm_ctx *ctx, const char *);
 	int output_gsmtap;
+	struct metagsm_ctx *ctx;
 } __attribute__((packed));
 
+/* Receives every decoded message once, as soon as it is classified */
+typedef void (*radio_msg_sink)(struct session_info *s, struct radio_message *m);
+#define MSG_SINKS_MAX 4
+
+/* Freed radio messages kept for reuse, one list per size class */
+struct radio_msg_pool {
+	struct radio_message *free_list[RADIO_MSG_CLASSES];
+	unsigned free_count[RADIO_MSG_CLASSES];
+	unsigned in_use;
+	unsigned peak;
+	uint64_t allocs;
+	uint64_t mallocs;
+};
+
+/* Parser state, one context per independent input */
+struct metagsm_ctx {
+	/* session.c */
+	struct session_info *s;		/* CS and PS domain */
+	struct session_info *s_pointer;
+	pthread_mutex_t s_mutex;
+	uint32_t s_id;
+	uint32_t *now;			/* last DIAG timestamp, the global now for the default context */
+	uint32_t epoch;			/* behind now for allocated contexts */
+	uint8_t msg_verbose;
+	uint8_t output_console;
+	uint8_t output_gsmtap;
+	uint8_t output_sqlite;
+	uint8_t output_spool;
+	uint8_t output_stmt;		/* sqlite_api binds rows from the structs */
+	struct sqlite_api *sqlite;	/* connection of sqlite_api */
+	struct sql_batch *mysql_batch;	/* flush thread of mysql_api, owns its connection */
+	struct radio_msg_pool msg_pool;
+	radio_msg_sink msg_sinks[MSG_SINKS_MAX];
+	unsigned msg_sink_count;
+	unsigned msg_window;		/* messages kept per session, 0 keeps all */
+	unsigned session_peak;		/* bytes held by the largest session */
+
+	/* cell_info.c */
+	struct llist_head cell_list;
+	unsigned cell_info_id;
+	unsigned cell_output_sqlite;
+	uint32_t previous_ts;
+	unsigned paging_count[3];
+	unsigned paging_imsi;
+	unsigned paging_tmsi;
+	unsigned paging_null;
+	void (*cell_sql_callback)(struct metagsm_ctx *ctx, const char *);
+	struct cell_info **cell_cid_hash;	/* CELL_HASH_SIZE chains */
+	struct cell_si_ref **cell_si_hash;	/* CELL_SI_HASH_SIZE chains */
+	uint8_t cell_si_len[SI_MAX];		/* SI data length, 0xff if it varies */
+	uint8_t cell_full_dump;			/* write every cell on each dump */
+	uint64_t cell_rows;			/* cell_info and arfcn_list rows written */
+	uint64_t cell_rows_avoided;		/* rows a full dump would have repeated */
+
+	/* ccch.c */
+	struct ccch_queue *ccch_queue;
+	unsigned ccch_batch;		/* blocks Viterbi decoded together, 1 decodes each at once */
+	uint8_t l1_ber;			/* re-encode decoded blocks to count l1_bit_errors */
+	uint64_t l1_blocks;		/* SDCCH and SACCH blocks through the Viterbi decoder */
+	uint64_t l1_failed;		/* of which failed the parity check */
+	uint64_t l1_bit_errors;		/* coded bits corrected in the others */
+	uint64_t l1_facch;		/* FACCH blocks decoded (tch.c) */
+
+	/* rlcmac.c */
+	struct gprs_tbf tbf_table[32*2];	/* for one cell */
+
+	/* umts_rrc.c */
+	struct asn_arena_s *rrc_arena;		/* RRC messages are decoded into */
+
+	/* stats.c */
+	struct metagsm_stats stats;
+};
+
 inline void link_to_msg_list(struct session_info* s, struct radio_message *m);
 
 #define CALLBACK_NONE 0
 #define CALLBACK_MYSQL 1
 #define CALLBACK_SQLITE 2
 #define CALLBACK_CONSOLE 3
+#define CALLBACK_SPOOL 4
+
+/* Spooled SQL is written to stdout as '\0' <type> <query> '\0', IDs in
+ * spooled queries as SQL_ID_MARK <type> <relative id> SQL_ID_MARK */
+#define SQL_ID_MARK '\x01'
+#define SQL_ID_SESSION 'S'
+#define SQL_ID_CELL 'C'
+#define SQL_ID_LEN 16
 
 #define SET_MSG_INFO(s, ... )  { \
 	assert((s)->new_msg); \
@@ -174,22 +265,41 @@ inline void link_to_msg_list(struct session_info* s, struct radio_message *m);
 
 #define APPEND_MSG_INFO(s, ...) snprintf((s)->new_msg->info+strlen((s)->new_msg->info), sizeof((s)->new_msg->info)-strlen((s)->new_msg->info), ##__VA_ARGS__);
 
+struct metagsm_ctx *metagsm_ctx_alloc();
+void metagsm_ctx_free(struct metagsm_ctx *ctx);
+struct metagsm_ctx *metagsm_default_ctx();
+
+void session_init_ctx(struct metagsm_ctx *ctx, unsigned start_sid, int console, const char *gsmtap_target, int callback);
+void session_destroy_ctx(struct metagsm_ctx *ctx, unsigned *last_sid, unsigned *last_cid);
+struct session_info *session_create_ctx(struct metagsm_ctx *ctx, int id, char* name, uint8_t *key, int mcc, int mnc, int lac, int cid, struct arfcn_set *ca);
+int session_enumerate_ctx(struct metagsm_ctx *ctx, int output);
+struct radio_message *radio_msg_alloc(struct metagsm_ctx *ctx, unsigned data_len);
+void radio_msg_free(struct metagsm_ctx *ctx, struct radio_message *m);
+void radio_msg_pool_flush(struct metagsm_ctx *ctx);
+unsigned radio_msg_size(struct radio_message *m);
+void session_add_msg_sink(struct metagsm_ctx *ctx, radio_msg_sink sink);
+void session_emit_msg(struct session_info *s, struct radio_message *m);
+unsigned session_mem(struct session_info *s);
+
+/* Same as above, on the default context */
 void session_init(unsigned start_sid, int console, const char *gsmtap_target, int callback);
 void session_destroy();
-struct session_info *session_create(int id, char* name, uint8_t *key, int mcc, int mnc, int lac, int cid, struct gsm_sysinfo_freq *ca);
+struct session_info *session_create(int id, char* name, uint8_t *key, int mcc, int mnc, int lac, int cid, struct arfcn_set *ca);
 void session_close(struct session_info *s);
 void session_store(struct session_info *s);
 void session_reset(struct session_info *s, int forced_release);
+void session_make_sql(struct session_info *s, char *query, unsigned q_len, uint8_t sqlite);
 void session_free(struct session_info *s);
 int session_enumerate();
 int session_from_filename(const char *filename, struct session_info *s);
+void session_spool(char type, const char *sql);
+const char *sql_id(struct metagsm_ctx *ctx, char *buf, char type, int id);
 
 extern uint8_t privacy;
 extern uint8_t msg_verbose;
 extern uint8_t auto_reset;
 extern uint8_t auto_timestamp;
 extern struct session_info _s[2];
-
 extern uint32_t now;
 
 #endif
@@ -623,14 +623,14 @@ void handle_tpdu(struct session_info *s, uint8_t *msg, const unsigned len, uint8
 
 	/* User data length */
 	sm->length = msg[off++];
-	if (msg_verbose > 1) {
+	if (s->ctx->msg_verbose > 1) {
 		fprintf(stderr, "sm->length: %u\n", sm->length);
 	}
 
 	/* Data length sanity check */
 	if ((sm->dcs & 0xe0) != 0x20) {
 		if ((sm->length*7)/8 > (len - off)) {
-			if (msg_verbose) {
+			if (s->ctx->msg_verbose) {
 				printf("len %d off %d sm->len %d sm->adjusted %d\n", len, off, sm->length, ((len-off)*8)/7);
 			}
 			APPEND_INFO(sm, "<TRUNCATED> ");
@@ -640,7 +640,7 @@ void handle_tpdu(struct session_info *s, uint8_t *msg, const unsigned len, uint8
 		}
 	} else {
 		//FIXME: estimate compressed length
-		if (msg_verbose > 1) {
+		if (s->ctx->msg_verbose > 1) {
 			fprintf(stderr, "FIXME: estimate compressed length\n");
 		}
 	}
@@ -835,7 +835,7 @@ void handle_sms(struct session_info *s, struct gsm48_hdr *dtap, unsigned len)
 	}
 }
 
-void sms_make_sql(int sid, struct sms_meta *sm, char *query, unsigned len)
+void sms_make_sql(const char *sid, struct sms_meta *sm, char *query, unsigned len)
 {
 	char *smsc;
 	char *msisdn;
@@ -867,7 +867,7 @@ void sms_make_sql(int sid, struct sms_meta *sm, char *query, unsigned len)
 		"src_port,dst_port,ota,ota_iei,ota_enc,ota_enc_algo,"
 		"ota_sign,ota_sign_algo,ota_counter,ota_counter_value,ota_tar,ota_por,"
 		"smsc,msisdn,info,length,udh_length,real_length,data)"
-		" VALUES (%d,%d,%d,%d,%d,%d,"
+		" VALUES (%s,%d,%d,%d,%d,%d,"
 		"%d,%d,%d,%d,%d,"
 		"%d,%d,%d,%d,%d,%d,"
 		"%d,%d,%d,%s,%s,%d,"
@@ -0,0 +1,535 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "sql_batch.h"
+
+/* Tables with a batch being filled at the same time */
+#define SQL_BATCH_TABLES	8
+/* Upper bound of the retry delay */
+#define SQL_BATCH_MAX_DELAY	10000
+
+/* VALUES list of one added statement */
+struct sql_batch_part {
+	unsigned start;
+	unsigned len;
+	unsigned rows;
+};
+
+struct sql_batch_buf {
+	char *query;
+	unsigned len;
+	unsigned size;
+	unsigned prefix_len;	/* "INSERT ... VALUES " shared by all rows */
+	unsigned rows;
+	struct sql_batch_part *parts;
+	unsigned part_count;
+	unsigned part_size;
+};
+
+struct sql_batch {
+	struct sql_batch_conf conf;
+	sql_batch_sink sink;
+	void *priv;
+
+	/* Batches being filled, in order of creation */
+	struct sql_batch_buf *open[SQL_BATCH_TABLES];
+	unsigned open_count;
+
+	/* Batches waiting for the flush thread */
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+	pthread_cond_t idle;
+	struct sql_batch_buf **queue;
+	unsigned head;
+	unsigned count;
+	int busy;
+	int closing;
+	pthread_t thread;
+
+	struct sql_batch_stats stats;
+};
+
+static struct sql_batch_buf *buf_alloc(unsigned size)
+{
+	struct sql_batch_buf *buf;
+
+	buf = (struct sql_batch_buf *) malloc(sizeof(struct sql_batch_buf));
+	if (buf) {
+		memset(buf, 0, sizeof(struct sql_batch_buf));
+		buf->size = size + 1;
+		buf->query = (char *) malloc(buf->size);
+	}
+	if (!buf || !buf->query) {
+		printf("Cannot allocate SQL batch\n");
+		exit(1);
+	}
+	buf->query[0] = 0;
+
+	return buf;
+}
+
+static void buf_free(struct sql_batch_buf *buf)
+{
+	free(buf->parts);
+	free(buf->query);
+	free(buf);
+}
+
+static void buf_append(struct sql_batch_buf *buf, const char *data, unsigned len)
+{
+	if (buf->len + len + 1 > buf->size) {
+		while (buf->len + len + 1 > buf->size) {
+			buf->size *= 2;
+		}
+		buf->query = (char *) realloc(buf->query, buf->size);
+		if (!buf->query) {
+			printf("Cannot allocate SQL batch\n");
+			exit(1);
+		}
+	}
+
+	memcpy(&buf->query[buf->len], data, len);
+	buf->len += len;
+	buf->query[buf->len] = 0;
+}
+
+static void buf_add_part(struct sql_batch_buf *buf, unsigned start, unsigned rows)
+{
+	if (buf->part_count == buf->part_size) {
+		buf->part_size = buf->part_size ? 2 * buf->part_size : 64;
+		buf->parts = (struct sql_batch_part *) realloc(buf->parts, buf->part_size * sizeof(buf->parts[0]));
+		if (!buf->parts) {
+			printf("Cannot allocate SQL batch\n");
+			exit(1);
+		}
+	}
+
+	buf->parts[buf->part_count].start = start;
+	buf->parts[buf->part_count].len = buf->len - start;
+	buf->parts[buf->part_count].rows = rows;
+	buf->part_count++;
+	buf->rows += rows;
+}
+
+/* End of the statement starting at str, a ';' or '\0' outside of quotes */
+static const char *statement_end(const char *str)
+{
+	int quoted = 0;
+
+	for (; *str; str++) {
+		if (*str == '\'') {
+			quoted = !quoted;
+		} else if (*str == ';' && !quoted) {
+			break;
+		}
+	}
+
+	return str;
+}
+
+/* Number of tuples in a VALUES list */
+static unsigned count_rows(const char *values, unsigned len)
+{
+	unsigned i, rows = 0;
+	int depth = 0;
+	int quoted = 0;
+
+	for (i = 0; i < len; i++) {
+		if (values[i] == '\'') {
+			quoted = !quoted;
+		} else if (quoted) {
+			continue;
+		} else if (values[i] == '(') {
+			if (depth++ == 0)
+				rows++;
+		} else if (values[i] == ')') {
+			depth--;
+		}
+	}
+
+	return rows ? rows : 1;
+}
+
+static void enqueue(struct sql_batch *b, struct sql_batch_buf *buf)
+{
+	pthread_mutex_lock(&b->lock);
+
+	/* Backpressure, the parser waits for the sink */
+	while (b->count == b->conf.queue_len) {
+		b->stats.stalls++;
+		pthread_cond_wait(&b->not_full, &b->lock);
+	}
+
+	b->queue[(b->head + b->count) % b->conf.queue_len] = buf;
+	b->count++;
+	b->stats.queued += buf->rows;
+
+	pthread_cond_signal(&b->not_empty);
+	pthread_mutex_unlock(&b->lock);
+}
+
+static void push_open(struct sql_batch *b, unsigned index)
+{
+	enqueue(b, b->open[index]);
+
+	b->open_count--;
+	memmove(&b->open[index], &b->open[index + 1], (b->open_count - index) * sizeof(b->open[0]));
+}
+
+static void push_all_open(struct sql_batch *b)
+{
+	unsigned i;
+
+	for (i = 0; i < b->open_count; i++) {
+		enqueue(b, b->open[i]);
+	}
+	b->open_count = 0;
+}
+
+/* Table name of an INSERT or UPDATE, 0 if not recognized */
+static unsigned table_name(const char *stmt, unsigned len, const char **name)
+{
+	const char *p, *end = stmt + len;
+	unsigned n;
+
+	if (len > 7 && !strncmp(stmt, "UPDATE ", 7)) {
+		p = stmt + 7;
+	} else if (len > 7 && !strncmp(stmt, "INSERT ", 7)) {
+		p = strstr(stmt, " INTO ");
+		if (!p || p + 6 > end) {
+			return 0;
+		}
+		p += 6;
+	} else {
+		return 0;
+	}
+
+	for (n = 0; p + n < end && p[n] != ' ' && p[n] != '('; n++);
+
+	*name = p;
+	return n;
+}
+
+/* Queue the open batches writing to the table of stmt, all if unknown */
+static void push_table(struct sql_batch *b, const char *stmt, unsigned len)
+{
+	const char *name, *open_name;
+	unsigned name_len;
+	unsigned i;
+
+	name_len = table_name(stmt, len, &name);
+	if (!name_len) {
+		push_all_open(b);
+		return;
+	}
+
+	for (i = 0; i < b->open_count; ) {
+		if (table_name(b->open[i]->query, b->open[i]->prefix_len, &open_name) == name_len &&
+		    !memcmp(open_name, name, name_len)) {
+			push_open(b, i);
+		} else {
+			i++;
+		}
+	}
+}
+
+static void add_statement(struct sql_batch *b, const char *stmt, unsigned len)
+{
+	struct sql_batch_buf *buf = NULL;
+	const char *values;
+	unsigned prefix_len;
+	unsigned rows;
+	unsigned i;
+
+	values = NULL;
+	if (len > 7 && !strncmp(stmt, "INSERT ", 7)) {
+		values = strstr(stmt, " VALUES ");
+		if (values && values + 8 > stmt + len) {
+			values = NULL;
+		}
+	}
+
+	if (!values) {
+		/* Keep the order against rows added before */
+		push_table(b, stmt, len);
+
+		buf = buf_alloc(len);
+		buf_append(buf, stmt, len);
+		buf->rows = 1;
+		enqueue(b, buf);
+		return;
+	}
+
+	prefix_len = values + 8 - stmt;
+	rows = count_rows(values + 8, len - prefix_len);
+
+	for (i = 0; i < b->open_count; i++) {
+		if (b->open[i]->prefix_len == prefix_len &&
+		    !memcmp(b->open[i]->query, stmt, prefix_len)) {
+			buf = b->open[i];
+			break;
+		}
+	}
+
+	if (buf && (buf->rows + rows > b->conf.max_rows ||
+		    buf->len + 1 + len - prefix_len > b->conf.max_bytes)) {
+		push_open(b, i);
+		buf = NULL;
+	}
+
+	if (buf) {
+		buf_append(buf, ",", 1);
+	} else {
+		if (b->open_count == SQL_BATCH_TABLES) {
+			push_open(b, 0);
+		}
+		buf = buf_alloc(len > b->conf.max_bytes ? len : b->conf.max_bytes);
+		buf->prefix_len = prefix_len;
+		buf_append(buf, stmt, prefix_len);
+		b->open[b->open_count++] = buf;
+	}
+	buf_append(buf, stmt + prefix_len, len - prefix_len);
+	buf_add_part(buf, buf->len - (len - prefix_len), rows);
+}
+
+/* Add one or more ';' separated statements */
+void sql_batch_add(struct sql_batch *b, const char *input)
+{
+	const char *end;
+	unsigned len;
+
+	assert(b != NULL);
+	assert(input != NULL);
+
+	for (;;) {
+		while (*input == '\n' || *input == ' ') {
+			input++;
+		}
+		if (!*input) {
+			break;
+		}
+
+		end = statement_end(input);
+
+		len = end - input;
+		while (len && (input[len - 1] == '\n' || input[len - 1] == ' ')) {
+			len--;
+		}
+		if (len) {
+			add_statement(b, input, len);
+		}
+
+		input = *end ? end + 1 : end;
+	}
+}
+
+static int deliver(struct sql_batch *b, const char *query, unsigned len)
+{
+	unsigned attempt;
+	unsigned delay;
+	int ret;
+
+	delay = b->conf.retry_ms;
+
+	for (attempt = 0; ; attempt++) {
+		ret = (*b->sink)(b->priv, query, len);
+		if (ret != SQL_SINK_RETRY || attempt >= b->conf.max_retries) {
+			break;
+		}
+
+		pthread_mutex_lock(&b->lock);
+		b->stats.retries++;
+		pthread_mutex_unlock(&b->lock);
+
+		usleep(delay * 1000);
+		if (delay < SQL_BATCH_MAX_DELAY) {
+			delay *= 2;
+		}
+	}
+
+	return ret;
+}
+
+/* Returns the number of rows stored */
+static unsigned deliver_batch(struct sql_batch *b, struct sql_batch_buf *buf)
+{
+	struct sql_batch_part *part;
+	unsigned flushed = 0;
+	unsigned i;
+	int ret;
+
+	ret = deliver(b, buf->query, buf->len);
+	if (ret == SQL_SINK_OK) {
+		return buf->rows;
+	}
+
+	/* The database is gone, do not try every statement */
+	if (ret == SQL_SINK_RETRY || buf->part_count < 2) {
+		return 0;
+	}
+
+	/* Send the statements of a rejected batch one by one, so only the
+	 * offending ones are lost */
+	for (i = 0; i < buf->part_count; i++) {
+		part = &buf->parts[i];
+		memmove(&buf->query[buf->prefix_len], &buf->query[part->start], part->len);
+		buf->query[buf->prefix_len + part->len] = 0;
+		if (deliver(b, buf->query, buf->prefix_len + part->len) == SQL_SINK_OK) {
+			flushed += part->rows;
+		}
+	}
+
+	return flushed;
+}
+
+static void *sql_batch_thread(void *arg)
+{
+	struct sql_batch *b = (struct sql_batch *) arg;
+	struct sql_batch_buf *buf;
+	unsigned flushed;
+
+	if (b->conf.thread_start) {
+		b->conf.thread_start(b->priv);
+	}
+
+	pthread_mutex_lock(&b->lock);
+
+	for (;;) {
+		while (!b->count && !b->closing) {
+			pthread_cond_wait(&b->not_empty, &b->lock);
+		}
+		if (!b->count) {
+			break;
+		}
+
+		buf = b->queue[b->head];
+		b->head = (b->head + 1) % b->conf.queue_len;
+		b->count--;
+		b->busy = 1;
+		pthread_cond_signal(&b->not_full);
+		pthread_mutex_unlock(&b->lock);
+
+		flushed = deliver_batch(b, buf);
+
+		pthread_mutex_lock(&b->lock);
+		b->stats.flushed += flushed;
+		b->stats.failed += buf->rows - flushed;
+		b->busy = 0;
+		if (!b->count) {
+			pthread_cond_broadcast(&b->idle);
+		}
+
+		buf_free(buf);
+	}
+
+	pthread_mutex_unlock(&b->lock);
+
+	if (b->conf.thread_stop) {
+		b->conf.thread_stop(b->priv);
+	}
+
+	return NULL;
+}
+
+struct sql_batch *sql_batch_open(const struct sql_batch_conf *conf, sql_batch_sink sink, void *priv)
+{
+	struct sql_batch *b;
+
+	assert(conf != NULL);
+	assert(sink != NULL);
+
+	b = (struct sql_batch *) malloc(sizeof(struct sql_batch));
+	if (!b) {
+		return NULL;
+	}
+	memset(b, 0, sizeof(struct sql_batch));
+
+	b->conf = *conf;
+	if (!b->conf.queue_len)
+		b->conf.queue_len = 1;
+	if (!b->conf.max_rows)
+		b->conf.max_rows = 1;
+	if (!b->conf.retry_ms)
+		b->conf.retry_ms = 1;
+	b->sink = sink;
+	b->priv = priv;
+
+	b->queue = (struct sql_batch_buf **) malloc(b->conf.queue_len * sizeof(b->queue[0]));
+	if (!b->queue) {
+		free(b);
+		return NULL;
+	}
+
+	pthread_mutex_init(&b->lock, NULL);
+	pthread_cond_init(&b->not_empty, NULL);
+	pthread_cond_init(&b->not_full, NULL);
+	pthread_cond_init(&b->idle, NULL);
+
+	if (pthread_create(&b->thread, NULL, sql_batch_thread, b)) {
+		pthread_mutex_destroy(&b->lock);
+		pthread_cond_destroy(&b->not_empty);
+		pthread_cond_destroy(&b->not_full);
+		pthread_cond_destroy(&b->idle);
+		free(b->queue);
+		free(b);
+		return NULL;
+	}
+
+	return b;
+}
+
+/* Queue the batches being filled and wait until the sink took all */
+void sql_batch_flush(struct sql_batch *b)
+{
+	assert(b != NULL);
+
+	push_all_open(b);
+
+	pthread_mutex_lock(&b->lock);
+	while (b->count || b->busy) {
+		pthread_cond_wait(&b->idle, &b->lock);
+	}
+	pthread_mutex_unlock(&b->lock);
+}
+
+void sql_batch_get_stats(struct sql_batch *b, struct sql_batch_stats *stats)
+{
+	assert(b != NULL);
+	assert(stats != NULL);
+
+	pthread_mutex_lock(&b->lock);
+	*stats = b->stats;
+	pthread_mutex_unlock(&b->lock);
+}
+
+void sql_batch_close(struct sql_batch *b, struct sql_batch_stats *stats)
+{
+	if (!b) {
+		return;
+	}
+
+	sql_batch_flush(b);
+
+	pthread_mutex_lock(&b->lock);
+	b->closing = 1;
+	pthread_cond_signal(&b->not_empty);
+	pthread_mutex_unlock(&b->lock);
+
+	pthread_join(b->thread, NULL);
+
+	if (stats) {
+		*stats = b->stats;
+	}
+
+	pthread_mutex_destroy(&b->lock);
+	pthread_cond_destroy(&b->not_empty);
+	pthread_cond_destroy(&b->not_full);
+	pthread_cond_destroy(&b->idle);
+	free(b->queue);
+	free(b);
+}
@@ -0,0 +1,45 @@
+#ifndef SQL_BATCH_H
+#define SQL_BATCH_H
+
+#include <stdint.h>
+
+/*
+ * Groups INSERT statements for the same table into multi-row INSERTs
+ * and hands them to a sink from a background thread. Other statements
+ * are passed on alone, after everything queued before them.
+ */
+
+/* Sink return values */
+#define SQL_SINK_OK	0
+#define SQL_SINK_RETRY	1	/* transient error, send the batch again */
+#define SQL_SINK_ERROR	2	/* permanent error, drop the batch */
+
+typedef int (*sql_batch_sink)(void *priv, const char *query, unsigned len);
+
+struct sql_batch_stats {
+	uint64_t queued;	/* rows handed to the flush thread */
+	uint64_t flushed;	/* rows stored by the sink */
+	uint64_t failed;	/* rows dropped after a permanent error or too many retries */
+	uint64_t retries;	/* batches sent again */
+	uint64_t stalls;	/* producer waits on a full queue */
+};
+
+struct sql_batch_conf {
+	unsigned queue_len;	/* batches waiting for the sink */
+	unsigned max_bytes;	/* query size of one batch */
+	unsigned max_rows;	/* rows in one batch */
+	unsigned max_retries;	/* attempts after SQL_SINK_RETRY */
+	unsigned retry_ms;	/* first retry delay, doubled every attempt */
+	void (*thread_start)(void *priv);	/* in the flush thread before the first batch, or NULL */
+	void (*thread_stop)(void *priv);	/* in the flush thread after the last batch, or NULL */
+};
+
+struct sql_batch;
+
+struct sql_batch *sql_batch_open(const struct sql_batch_conf *conf, sql_batch_sink sink, void *priv);
+void sql_batch_add(struct sql_batch *b, const char *input);
+void sql_batch_flush(struct sql_batch *b);
+void sql_batch_get_stats(struct sql_batch *b, struct sql_batch_stats *stats);
+void sql_batch_close(struct sql_batch *b, struct sql_batch_stats *stats);
+
+#endif
@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+
+#include "sql_batch.h"
+#include "bench.h"
+
+/*
+ * Runs the batched writer against a mock sink that sleeps for a round
+ * trip on every query, and compares it with sending every statement
+ * synchronously. The mock can fail every n-th query with a transient
+ * error to exercise the retry path.
+ */
+
+struct mock_sink {
+	unsigned latency_us;
+	unsigned fail_every;
+	unsigned long queries;
+	unsigned long rows;
+};
+
+static void busy_wait(unsigned us)
+{
+	double end = stats_secs() + us / 1e6;
+
+	while (stats_secs() < end);
+}
+
+static int mock_query(void *priv, const char *query, unsigned len)
+{
+	struct mock_sink *mock = (struct mock_sink *) priv;
+	const char *p;
+
+	usleep(mock->latency_us);
+
+	mock->queries++;
+	if (mock->fail_every && mock->queries % mock->fail_every == 0) {
+		return SQL_SINK_RETRY;
+	}
+
+	for (p = query; (p = strstr(p, "),(")); p++) {
+		mock->rows++;
+	}
+	mock->rows++;
+
+	return SQL_SINK_OK;
+}
+
+static void make_query(char *query, unsigned len, unsigned i)
+{
+	snprintf(query, len, "INSERT INTO session_info (id,timestamp,mcc,mnc,lac,cid,imsi) VALUES "
+		"(%u,FROM_UNIXTIME(%u),262,%u,%u,%u,'26201%010u');\n",
+		i, 1595964000 + i, i % 10, i & 0xffff, (i * 7) & 0xffff, i);
+}
+
+static unsigned rows = 20000;
+static unsigned latency = 200;
+static unsigned work = 20;
+static unsigned fail_every = 0;
+
+static const struct bench_opt opts[] = {
+	{ 'n', BENCH_UINT, &rows, "<rows>", "Number of rows to write" },
+	{ 'l', BENCH_UINT, &latency, "<us>", "Round trip time of the mock database" },
+	{ 'w', BENCH_UINT, &work, "<us>", "Parsing time per row" },
+	{ 'f', BENCH_UINT, &fail_every, "<n>", "Fail every n-th query with a transient error" },
+	{ 0 }
+};
+
+static int sql_batch_main(int argc, char *argv[])
+{
+	struct sql_batch_conf conf;
+	struct sql_batch_stats stats;
+	struct sql_batch *b;
+	struct mock_sink mock;
+	char query[512];
+	double sync_secs, batch_secs;
+	unsigned i;
+
+	if (bench_getopt(&sql_batch_bench, argc, argv) != argc) {
+		bench_usage(&sql_batch_bench);
+	}
+
+	/* One synchronous query per statement */
+	memset(&mock, 0, sizeof(mock));
+	mock.latency_us = latency;
+	sync_secs = stats_secs();
+	for (i = 0; i < rows; i++) {
+		busy_wait(work);
+		make_query(query, sizeof(query), i);
+		mock_query(&mock, query, strlen(query));
+	}
+	sync_secs = stats_secs() - sync_secs;
+	printf("%-16s %10u rows %8lu queries %8.3f s %10.0f rows/s\n",
+		"synchronous", rows, mock.queries, sync_secs, rows / sync_secs);
+
+	/* Multi-row INSERTs from the flush thread */
+	memset(&mock, 0, sizeof(mock));
+	mock.latency_us = latency;
+	mock.fail_every = fail_every;
+
+	conf.queue_len = 16;
+	conf.max_bytes = 512 * 1024;
+	conf.max_rows = 1000;
+	conf.max_retries = 5;
+	conf.retry_ms = 1;
+	conf.thread_start = NULL;
+	conf.thread_stop = NULL;
+
+	batch_secs = stats_secs();
+	b = sql_batch_open(&conf, mock_query, &mock);
+	if (!b) {
+		errx(1, "Cannot start the batch writer");
+	}
+	for (i = 0; i < rows; i++) {
+		busy_wait(work);
+		make_query(query, sizeof(query), i);
+		sql_batch_add(b, query);
+	}
+	sql_batch_close(b, &stats);
+	batch_secs = stats_secs() - batch_secs;
+	printf("%-16s %10u rows %8lu queries %8.3f s %10.0f rows/s\n",
+		"batched", rows, mock.queries, batch_secs, rows / batch_secs);
+
+	printf("queued %llu flushed %llu failed %llu retries %llu stalls %llu\n",
+		(unsigned long long) stats.queued,
+		(unsigned long long) stats.flushed,
+		(unsigned long long) stats.failed,
+		(unsigned long long) stats.retries,
+		(unsigned long long) stats.stalls);
+
+	if (stats.queued != rows || stats.flushed + stats.failed != rows || mock.rows != stats.flushed) {
+		printf("MISMATCH\n");
+		return 1;
+	}
+
+	printf("speedup %.1fx\n", sync_secs / batch_secs);
+
+	return 0;
+}
+
+const struct bench_cmd sql_batch_bench = {
+	.name = "sql_batch",
+	.help = "Batched SQL writer against synchronous queries to a mock database",
+	.opts = opts,
+	.main = sql_batch_main,
+};
@@ -1,51 +1,665 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
 #include <sqlite3.h>
 
 #include "sqlite_api.h"
 #include "bit_func.h"
+#include "sms.h"
 
-static sqlite3 *meta_db;
+#include <osmocom/core/utils.h>
 
-void sqlite_api_query_cb(const char *input)
+enum sqlite_stmt {
+	STMT_SESSION = 0,
+	STMT_SMS,
+	STMT_APPID,
+	STMT_CELL_INSERT,
+	STMT_CELL_UPDATE,
+	STMT_ARFCN,
+	STMT_PAGING,
+
+	STMT_MAX
+};
+
+/* Prepared once per database, same columns as the *_make_sql() text */
+static const char *stmt_sql[STMT_MAX] = {
+	[STMT_SESSION] =
+		"INSERT INTO session_info (id,timestamp,rat,domain,mcc,mnc,lac,cid,arfcn,psc,cracked,neigh_count,"
+		"unenc,unenc_rand,enc,enc_rand,enc_null,enc_null_rand,enc_si,enc_si_rand,predict,"
+		"avg_power,uplink_avail,initial_seq,cipher_seq,auth,auth_req_fn,auth_resp_fn,auth_delta,"
+		"cipher_missing,cipher_comp_first,cipher_comp_last,cipher_comp_count,cipher_delta,cipher,"
+		"integrity,cmc_imeisv,first_fn,last_fn,duration,mobile_orig,mobile_term,paging_mi,"
+		"t_unknown,t_detach,t_locupd,lu_type,lu_acc,lu_reject,lu_rej_cause,lu_mcc,lu_mnc,lu_lac,"
+		"t_abort,t_raupd,t_attach,att_acc,t_pdp,pdp_ip,t_call,t_sms,t_ss,"
+		"t_tmsi_realloc,t_release,rr_cause,t_gprs,iden_imsi_ac,iden_imsi_bc,iden_imei_ac,iden_imei_bc,"
+		"assign,assign_cmpl,handover,forced_ho,a_timeslot,a_chan_type,a_tsc,"
+		"a_hopping,a_arfcn,a_hsn,a_maio,a_ma_len,a_chan_mode,a_multirate,"
+		"call_presence,sms_presence,service_req,"
+		"imsi,imei,tmsi,new_tmsi,tlli,msisdn,"
+		"ms_cipher_mask,ue_cipher_cap,ue_integrity_cap) VALUES "
+		"(?,datetime(?, 'unixepoch'),?,?,?,?,?,?,?,?,?,?,"
+		"?,?,?,?,?,?,?,?,?,"
+		"?,?,?,?,?,?,?,?,"
+		"?,?,?,?,?,?,"
+		"?,?,?,?,?,?,?,?,"
+		"?,?,?,?,?,?,?,?,?,?,"
+		"?,?,?,?,?,?,?,?,?,"
+		"?,?,?,?,?,?,?,?,"
+		"?,?,?,?,?,?,?,"
+		"?,?,?,?,?,?,?,"
+		"?,?,?,"
+		"?,?,?,?,?,?,"
+		"?,?,?)",
+	[STMT_SMS] =
+		"INSERT INTO sms_meta (id,sequence,from_network,pid,dcs,alphabet,"
+		"class,udhi,concat,concat_frag,concat_total,"
+		"src_port,dst_port,ota,ota_iei,ota_enc,ota_enc_algo,"
+		"ota_sign,ota_sign_algo,ota_counter,ota_counter_value,ota_tar,ota_por,"
+		"smsc,msisdn,info,length,udh_length,real_length,data)"
+		" VALUES (?,?,?,?,?,?,"
+		"?,?,?,?,?,"
+		"?,?,?,?,?,?,"
+		"?,?,?,?,?,?,"
+		"?,?,?,?,?,?,?)",
+	[STMT_APPID] =
+		"INSERT INTO sid_appid VALUES (?,?)",
+	[STMT_CELL_INSERT] =
+		"INSERT INTO cell_info ("
+		"id,first_seen,last_seen,"
+		"mcc,mnc,lac,cid,"
+		"msc_ver,combined,agch_blocks,pag_mframes,t3212,dtx,"
+		"cro,temp_offset,pen_time,pwr_offset,gprs,"
+		"ba_len,neigh_2,neigh_2b,neigh_2t,"
+		"neigh_2q,neigh_5,neigh_5b,neigh_5t,"
+		"count_si1,count_si2,count_si2b,"
+		"count_si2t,count_si2q,count_si3,"
+		"count_si4,count_si5,count_si5b,"
+		"count_si5t,count_si6,count_si13,"
+		"si1,si2,si2b,si2t,si2q,si3,si4,si5,si5b,si5t,si6,si13) VALUES ("
+		"?,datetime(?, 'unixepoch'),datetime(?, 'unixepoch'),?,?,?,?,"
+		"?,?,?,?,?,?,"
+		"?,?,?,?,?,"
+		"?,?,?,?,"
+		"?,?,?,?,"
+		"?,?,?,"
+		"?,?,?,"
+		"?,?,?,"
+		"?,?,?,"
+		"?,?,?,?,"
+		"?,?,?,?,"
+		"?,?,?,?)",
+	[STMT_CELL_UPDATE] =
+		"UPDATE cell_info SET "
+		"first_seen=datetime(?, 'unixepoch'),last_seen=datetime(?, 'unixepoch'),mcc=?,mnc=?,lac=?,cid=?,"
+		"msc_ver=?,combined=?,agch_blocks=?,pag_mframes=?,t3212=?,dtx=?,"
+		"cro=?,temp_offset=?,pen_time=?,pwr_offset=?,gprs=?,"
+		"ba_len=?,neigh_2=?,neigh_2b=?,neigh_2t=?,"
+		"neigh_2q=?,neigh_5=?,neigh_5b=?,neigh_5t=?,"
+		"count_si1=?,count_si2=?,count_si2b=?,"
+		"count_si2t=?,count_si2q=?,count_si3=?,"
+		"count_si4=?,count_si5=?,count_si5b=?,"
+		"count_si5t=?,count_si6=?,count_si13=?,"
+		"si1=?,si2=?,si2b=?,si2t=?,si2q=?,si3=?,"
+		"si4=?,si5=?,si5b=?,si5t=?,si6=?,si13=? "
+		"WHERE id = ?",
+	[STMT_ARFCN] =
+		"INSERT OR IGNORE INTO arfcn_list (id, source, arfcn) VALUES (?,?,?)",
+	[STMT_PAGING] =
+		"INSERT INTO paging_info VALUES (datetime(?, 'unixepoch'), ?, ?, ?, ?, ?)",
+};
+
+/*
+ * Connection of the process, shared by all contexts so that their rows
+ * go into one transaction instead of competing for the write lock.
+ * sqlite_lock is held while a row is bound and stepped.
+ */
+struct sqlite_api {
+	sqlite3 *db;
+	sqlite3_stmt *stmt[STMT_MAX];
+	unsigned batch_size;
+	unsigned batch_rows;
+	unsigned users;		/* contexts holding the connection */
+};
+
+static struct sqlite_api *sqlite_shared;
+static pthread_mutex_t sqlite_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Keep the rows stored before the failing one, as in autocommit mode */
+static void sqlite_api_fail(struct sqlite_api *api, const char *query)
 {
+	printf("Error executing query:\n%s\n", query);
+	printf("%s\n", sqlite3_errmsg(api->db));
+
+	sqlite3_exec(api->db, "COMMIT", 0, 0, 0);
+	sqlite3_close(api->db);
+	exit(1);
+}
+
+static void sqlite_api_exec(struct sqlite_api *api, const char *query)
+{
+	int ret;
+
+	ret = sqlite3_exec(api->db, query, 0, 0, 0);
+	if (ret != SQLITE_OK) {
+		sqlite_api_fail(api, query);
+	}
+}
+
+/* Close the running transaction after every batch_size rows */
+static void sqlite_api_row_done(struct sqlite_api *api)
+{
+	api->batch_rows++;
+
+	if (api->batch_size && api->batch_rows >= api->batch_size) {
+		sqlite_api_exec(api, "COMMIT");
+		sqlite_api_exec(api, "BEGIN");
+		api->batch_rows = 0;
+	}
+}
+
+/* Shared connection, allocated for the first context. Call with sqlite_lock held */
+static struct sqlite_api *sqlite_api_get(struct metagsm_ctx *ctx)
+{
+	if (!ctx->sqlite) {
+		if (!sqlite_shared) {
+			sqlite_shared = calloc(1, sizeof(struct sqlite_api));
+			if (!sqlite_shared) {
+				printf("Cannot allocate SQLite output\n");
+				exit(1);
+			}
+			sqlite_shared->batch_size = SQLITE_BATCH_ROWS;
+		}
+		sqlite_shared->users++;
+		ctx->sqlite = sqlite_shared;
+	}
+
+	return ctx->sqlite;
+}
+
+void sqlite_api_query_cb(struct metagsm_ctx *ctx, const char *input)
+{
+	struct sqlite_api *api = ctx->sqlite;
 	const char *ptr = input;
 	char query[4096];
-	int ret;
 
+	assert(api != NULL);
 	assert(input != NULL);
 
 	if (input[0] == 0) {
 		return;
 	}
 
+	pthread_mutex_lock(&sqlite_lock);
 	while (sgets(query, sizeof(query), &ptr)) {
-		ret = sqlite3_exec(meta_db, query, 0, 0, 0);
-		if (ret != SQLITE_OK) {
-			printf("Error executing query:\n%s\n", query);
-			exit(1);
+		sqlite_api_exec(api, query);
+		sqlite_api_row_done(api);
+	}
+	pthread_mutex_unlock(&sqlite_lock);
+}
+
+static void bind_int(sqlite3_stmt *stmt, int *col, int value)
+{
+	sqlite3_bind_int(stmt, ++*col, value);
+}
+
+static void bind_uint(sqlite3_stmt *stmt, int *col, unsigned value)
+{
+	sqlite3_bind_int64(stmt, ++*col, value);
+}
+
+/* Empty strings are stored as NULL, as with strescape_or_null() */
+static void bind_text(sqlite3_stmt *stmt, int *col, const char *str)
+{
+	if (str && str[0]) {
+		sqlite3_bind_text(stmt, ++*col, str, -1, SQLITE_TRANSIENT);
+	} else {
+		sqlite3_bind_null(stmt, ++*col);
+	}
+}
+
+static void bind_hex(sqlite3_stmt *stmt, int *col, const uint8_t *data, unsigned len, int present)
+{
+	if (present) {
+		bind_text(stmt, col, osmo_hexdump_nospc(data, len));
+	} else {
+		sqlite3_bind_null(stmt, ++*col);
+	}
+}
+
+static void step(struct sqlite_api *api, sqlite3_stmt *stmt, int col)
+{
+	int ret;
+
+	assert(col == sqlite3_bind_parameter_count(stmt));
+
+	ret = sqlite3_step(stmt);
+	if (ret != SQLITE_DONE) {
+		sqlite_api_fail(api, sqlite3_sql(stmt));
+	}
+
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	sqlite_api_row_done(api);
+}
+
+static void sqlite_api_sms(struct sqlite_api *api, int sid, struct sms_meta *sm)
+{
+	sqlite3_stmt *stmt = api->stmt[STMT_SMS];
+	int col = 0;
+
+	bind_int(stmt, &col, sid);
+	bind_int(stmt, &col, sm->sequence);
+	bind_int(stmt, &col, sm->from_network);
+	bind_int(stmt, &col, sm->pid);
+	bind_int(stmt, &col, sm->dcs);
+	bind_int(stmt, &col, sm->alphabet);
+	bind_int(stmt, &col, sm->class);
+	bind_int(stmt, &col, sm->udhi);
+	bind_int(stmt, &col, sm->concat);
+	bind_int(stmt, &col, sm->concat_frag);
+	bind_int(stmt, &col, sm->concat_total);
+	bind_int(stmt, &col, sm->src_port);
+	bind_int(stmt, &col, sm->dst_port);
+	bind_int(stmt, &col, sm->ota);
+	bind_int(stmt, &col, sm->ota_iei);
+	bind_int(stmt, &col, sm->ota_enc);
+	bind_int(stmt, &col, sm->ota_enc_algo);
+	bind_int(stmt, &col, sm->ota_sign);
+	bind_int(stmt, &col, sm->ota_sign_algo);
+	bind_int(stmt, &col, sm->ota_counter_type);
+	bind_text(stmt, &col, sm->ota_counter);
+	bind_text(stmt, &col, sm->ota_tar);
+	bind_int(stmt, &col, sm->ota_por);
+	bind_text(stmt, &col, sm->smsc);
+	bind_text(stmt, &col, sm->msisdn);
+	bind_text(stmt, &col, sm->info);
+	bind_int(stmt, &col, sm->length);
+	bind_int(stmt, &col, sm->udh_length);
+	bind_int(stmt, &col, sm->real_length);
+	if (sm->length) {
+		sqlite3_bind_blob(stmt, ++col, sm->data, sm->length, SQLITE_TRANSIENT);
+	} else {
+		bind_text(stmt, &col, "<NO DATA>");
+	}
+
+	step(api, stmt, col);
+}
+
+void sqlite_api_session(struct session_info *s)
+{
+	struct sqlite_api *api;
+	sqlite3_stmt *stmt;
+	struct sms_meta *sm;
+	char appid[9];
+	int col = 0;
+
+	assert(s != NULL);
+	assert(s->ctx->sqlite != NULL);
+
+	api = s->ctx->sqlite;
+	stmt = api->stmt[STMT_SESSION];
+
+	if (!s->started)
+		return;
+
+	if (s->closed)
+		return;
+
+	pthread_mutex_lock(&sqlite_lock);
+
+	if (s->id >= 0) {
+		bind_int(stmt, &col, s->id);
+	} else {
+		sqlite3_bind_null(stmt, ++col);
+	}
+	sqlite3_bind_int64(stmt, ++col, s->timestamp.tv_sec);
+	bind_int(stmt, &col, s->rat);
+	bind_int(stmt, &col, s->domain);
+	bind_int(stmt, &col, s->mcc);
+	bind_int(stmt, &col, s->mnc);
+	bind_int(stmt, &col, s->lac);
+	bind_int(stmt, &col, s->cid);
+	bind_int(stmt, &col, s->arfcn);
+	bind_int(stmt, &col, s->psc);
+	bind_int(stmt, &col, s->cracked);
+	bind_int(stmt, &col, s->neigh_count);
+	bind_int(stmt, &col, s->fc.unenc);
+	bind_int(stmt, &col, s->fc.unenc_rand);
+	bind_int(stmt, &col, s->fc.enc);
+	bind_int(stmt, &col, s->fc.enc_rand);
+	bind_int(stmt, &col, s->fc.enc_null);
+	bind_int(stmt, &col, s->fc.enc_null_rand);
+	bind_int(stmt, &col, s->fc.enc_si);
+	bind_int(stmt, &col, s->fc.enc_si_rand);
+	bind_int(stmt, &col, s->fc.predict);
+	bind_int(stmt, &col, s->avg_power);
+	bind_int(stmt, &col, s->uplink);
+	bind_int(stmt, &col, s->initial_seq);
+	bind_int(stmt, &col, s->cipher_seq);
+	bind_int(stmt, &col, s->auth);
+	bind_int(stmt, &col, s->auth_req_fn);
+	bind_int(stmt, &col, s->auth_resp_fn);
+	bind_int(stmt, &col, s->auth_delta);
+	bind_int(stmt, &col, s->cipher_missing);
+	bind_int(stmt, &col, s->cm_comp_first_fn);
+	bind_int(stmt, &col, s->cm_comp_last_fn);
+	bind_int(stmt, &col, s->cm_comp_count);
+	bind_int(stmt, &col, s->cipher_delta);
+	bind_int(stmt, &col, s->cipher);
+	bind_int(stmt, &col, s->integrity);
+	bind_int(stmt, &col, s->cmc_imeisv);
+	bind_int(stmt, &col, s->first_fn);
+	bind_int(stmt, &col, s->last_fn);
+	bind_int(stmt, &col, s->duration);
+	bind_int(stmt, &col, s->mo);
+	bind_int(stmt, &col, s->mt);
+	bind_int(stmt, &col, s->pag_mi);
+	bind_int(stmt, &col, s->unknown);
+	bind_int(stmt, &col, s->detach);
+	bind_int(stmt, &col, s->locupd);
+	bind_int(stmt, &col, s->lu_type);
+	bind_int(stmt, &col, s->lu_acc);
+	bind_int(stmt, &col, s->lu_reject);
+	bind_int(stmt, &col, s->lu_rej_cause);
+	bind_int(stmt, &col, s->lu_mcc);
+	bind_int(stmt, &col, s->lu_mnc);
+	bind_int(stmt, &col, s->lu_lac);
+	bind_int(stmt, &col, s->abort);
+	bind_int(stmt, &col, s->raupd);
+	bind_int(stmt, &col, s->attach);
+	bind_int(stmt, &col, s->att_acc);
+	bind_int(stmt, &col, s->pdp_activate);
+	bind_text(stmt, &col, s->pdp_ip);
+	bind_int(stmt, &col, s->call);
+	bind_int(stmt, &col, s->sms);
+	bind_int(stmt, &col, s->ssa);
+	bind_int(stmt, &col, s->tmsi_realloc);
+	bind_int(stmt, &col, s->release);
+	bind_int(stmt, &col, s->rr_cause);
+	bind_int(stmt, &col, s->have_gprs);
+	bind_int(stmt, &col, s->iden_imsi_ac);
+	bind_int(stmt, &col, s->iden_imsi_bc);
+	bind_int(stmt, &col, s->iden_imei_ac);
+	bind_int(stmt, &col, s->iden_imei_bc);
+	bind_int(stmt, &col, s->assignment);
+	bind_int(stmt, &col, s->assign_complete);
+	bind_int(stmt, &col, s->handover);
+	bind_int(stmt, &col, s->forced_ho);
+	bind_int(stmt, &col, s->ga.chan_nr&7);
+	bind_int(stmt, &col, s->ga.chan_nr>>3);
+	bind_int(stmt, &col, s->ga.tsc);
+	bind_int(stmt, &col, s->ga.h);
+	bind_int(stmt, &col, s->ga.h0.band_arfcn);
+	bind_int(stmt, &col, s->ga.h1.hsn);
+	bind_int(stmt, &col, s->ga.h1.maio);
+	bind_int(stmt, &col, s->ga.h1.ma_len);
+	bind_int(stmt, &col, s->ga.chan_mode);
+	bind_int(stmt, &col, s->ga.rate_conf);
+	bind_int(stmt, &col, s->call_presence);
+	bind_int(stmt, &col, s->sms_presence);
+	bind_int(stmt, &col, s->serv_req);
+	bind_text(stmt, &col, s->imsi);
+	bind_text(stmt, &col, s->imei);
+	bind_hex(stmt, &col, s->old_tmsi, 4, not_zero(s->old_tmsi, 4));
+	bind_hex(stmt, &col, s->new_tmsi, 4, not_zero(s->new_tmsi, 4));
+	bind_hex(stmt, &col, s->tlli, 4, not_zero(s->tlli, 4));
+	bind_text(stmt, &col, s->msisdn);
+	bind_int(stmt, &col, s->ms_cipher_mask);
+	bind_int(stmt, &col, s->ue_cipher_cap);
+	bind_int(stmt, &col, s->ue_integrity_cap);
+
+	step(api, stmt, col);
+
+	for (sm = s->sms_list; sm; sm = sm->next) {
+		sqlite_api_sms(api, s->id, sm);
+	}
+
+	if (s->appid) {
+		stmt = api->stmt[STMT_APPID];
+		col = 0;
+
+		snprintf(appid, sizeof(appid), "%08x", s->appid);
+		bind_int(stmt, &col, s->id);
+		bind_text(stmt, &col, appid);
+
+		step(api, stmt, col);
+	}
+	pthread_mutex_unlock(&sqlite_lock);
+}
+
+static void bind_cell(sqlite3_stmt *stmt, int *col, struct cell_info *ci)
+{
+	int i;
+
+	sqlite3_bind_int64(stmt, ++*col, ci->first_seen.tv_sec);
+	sqlite3_bind_int64(stmt, ++*col, ci->last_seen.tv_sec);
+	bind_int(stmt, col, ci->mcc);
+	bind_int(stmt, col, ci->mnc);
+	bind_int(stmt, col, ci->lac);
+	bind_int(stmt, col, ci->cid);
+	bind_int(stmt, col, ci->msc_ver);
+	bind_int(stmt, col, ci->combined);
+	bind_int(stmt, col, ci->agch_blocks);
+	bind_int(stmt, col, ci->pag_mframes);
+	bind_int(stmt, col, ci->t3212);
+	bind_int(stmt, col, ci->dtx);
+	bind_int(stmt, col, ci->cro);
+	bind_int(stmt, col, ci->temp_offset);
+	bind_int(stmt, col, ci->pen_time);
+	bind_int(stmt, col, ci->pwr_offset);
+	bind_int(stmt, col, ci->gprs);
+	bind_uint(stmt, col, ci->a_count[SI1]);
+	bind_uint(stmt, col, ci->a_count[SI2]);
+	bind_uint(stmt, col, ci->a_count[SI2b]);
+	bind_uint(stmt, col, ci->a_count[SI2t]);
+	bind_uint(stmt, col, ci->a_count[SI2q]);
+	bind_uint(stmt, col, ci->a_count[SI5]);
+	bind_uint(stmt, col, ci->a_count[SI5b]);
+	bind_uint(stmt, col, ci->a_count[SI5t]);
+	for (i = 0; i < SI_MAX; i++) {
+		bind_uint(stmt, col, ci->si_counter[i]);
+	}
+	for (i = 0; i < SI_MAX; i++) {
+		bind_hex(stmt, col, ci->si_data[i], 20, ci->si_counter[i]);
+	}
+}
+
+/* Only ARFCNs not stored before, see arfcn_list_make_sql() */
+static unsigned sqlite_api_arfcn_list(struct sqlite_api *api, struct cell_info *ci, enum si_index index)
+{
+	sqlite3_stmt *stmt = api->stmt[STMT_ARFCN];
+	struct arfcn_set *list, *stored;
+	unsigned rows = 0;
+	int col;
+	int src;
+	int i;
+
+	src = si_arfcn_source(index);
+	if (src < 0) {
+		return 0;
+	}
+	if (ci->si_counter[index] == 0) {
+		return 0;
+	}
+	if (ci->a_count[index] == 0) {
+		return 0;
+	}
+
+	list = &ci->arfcn_list[src];
+	stored = &ci->arfcn_stored[src];
+	for (i = arfcn_set_next(list, 0); i >= 0; i = arfcn_set_next(list, i + 1)) {
+		if (!arfcn_set_has(stored, i)) {
+			col = 0;
+			bind_int(stmt, &col, ci->id);
+			sqlite3_bind_text(stmt, ++col, si_name[index], -1, SQLITE_STATIC);
+			bind_int(stmt, &col, i);
+
+			step(api, stmt, col);
+			arfcn_set_add(stored, i);
+			rows++;
+		}
+	}
+
+	return rows;
+}
+
+/* Returns the number of rows written */
+unsigned sqlite_api_cell(struct metagsm_ctx *ctx, struct cell_info *ci)
+{
+	struct sqlite_api *api = ctx->sqlite;
+	sqlite3_stmt *stmt;
+	unsigned rows = 1;
+	int col = 0;
+	int i;
+
+	assert(api != NULL);
+	assert(ci != NULL);
+
+	pthread_mutex_lock(&sqlite_lock);
+	if (ci->stored == 0) {
+		stmt = api->stmt[STMT_CELL_INSERT];
+		bind_int(stmt, &col, ci->id);
+		bind_cell(stmt, &col, ci);
+	} else {
+		stmt = api->stmt[STMT_CELL_UPDATE];
+		bind_cell(stmt, &col, ci);
+		bind_int(stmt, &col, ci->id);
+	}
+
+	step(api, stmt, col);
+
+	for (i = 0; i < SI_MAX; i++) {
+		if (ci->si_dirty & (1 << i)) {
+			rows += sqlite_api_arfcn_list(api, ci, i);
 		}
 	}
+	pthread_mutex_unlock(&sqlite_lock);
+
+	return rows;
+}
+
+void sqlite_api_paging(struct metagsm_ctx *ctx, unsigned epoch_now)
+{
+	struct sqlite_api *api = ctx->sqlite;
+	sqlite3_stmt *stmt;
+	float time_delta;
+	int col = 0;
+
+	assert(api != NULL);
+
+	stmt = api->stmt[STMT_PAGING];
+
+	time_delta = (float) (epoch_now-ctx->previous_ts);
+
+	if (time_delta <= 0.0) {
+		return;
+	}
+
+	pthread_mutex_lock(&sqlite_lock);
+	sqlite3_bind_int64(stmt, ++col, epoch_now);
+	sqlite3_bind_double(stmt, ++col, (float)ctx->paging_count[0]/time_delta);
+	sqlite3_bind_double(stmt, ++col, (float)ctx->paging_count[1]/time_delta);
+	sqlite3_bind_double(stmt, ++col, (float)ctx->paging_count[2]/time_delta);
+	sqlite3_bind_double(stmt, ++col, (float)ctx->paging_imsi/time_delta);
+	sqlite3_bind_double(stmt, ++col, (float)ctx->paging_tmsi/time_delta);
+
+	step(api, stmt, col);
+	pthread_mutex_unlock(&sqlite_lock);
+}
+
+void sqlite_api_batch(struct metagsm_ctx *ctx, unsigned rows)
+{
+	pthread_mutex_lock(&sqlite_lock);
+	sqlite_api_get(ctx)->batch_size = rows;
+	pthread_mutex_unlock(&sqlite_lock);
 }
 
 void sqlite_api_init(struct session_info *s)
-{	
+{
+	struct sqlite_api *api;
 	int ret;
+	int i;
+
+	assert(s != NULL);
+	assert(s->ctx != NULL);
+
+	pthread_mutex_lock(&sqlite_lock);
+	api = sqlite_api_get(s->ctx);
+
+	/* All contexts share the connection */
+	if (api->db) {
+		goto out;
+	}
 
 	//TODO check if db file exists, init new db with schema
 
-	ret = sqlite3_open("metadata.db", &meta_db);
+	ret = sqlite3_open("metadata.db", &api->db);
 	if (ret) {
 		printf("Cannot open database\n");
-		sqlite3_close(meta_db);
+		sqlite3_close(api->db);
 		exit(1);
 	}
 
+	/* Wait for writers in other processes instead of failing */
+	sqlite3_busy_timeout(api->db, SQLITE_BUSY_MS);
+
+	sqlite_api_exec(api, "PRAGMA journal_mode=WAL");
+	sqlite_api_exec(api, "PRAGMA synchronous=NORMAL");
+
+	for (i = 0; i < STMT_MAX; i++) {
+		ret = sqlite3_prepare_v2(api->db, stmt_sql[i], -1, &api->stmt[i], NULL);
+		if (ret != SQLITE_OK) {
+			printf("Cannot prepare statement:\n%s\n", stmt_sql[i]);
+			printf("%s\n", sqlite3_errmsg(api->db));
+			exit(1);
+		}
+	}
+
+	sqlite_api_exec(api, "BEGIN");
+	api->batch_rows = 0;
+
+out:
+	pthread_mutex_unlock(&sqlite_lock);
 	s->sql_callback = sqlite_api_query_cb;
+	s->ctx->output_stmt = 1;
 }
 
-void sqlite_api_destroy()
+/* Commits the rows of all contexts, the last one closes the connection */
+void sqlite_api_destroy(struct metagsm_ctx *ctx)
 {
-	sqlite3_close(meta_db);
+	struct sqlite_api *api = ctx->sqlite;
+	int i;
+
+	if (!api) {
+		return;
+	}
+
+	pthread_mutex_lock(&sqlite_lock);
+	ctx->sqlite = NULL;
+
+	if (--api->users) {
+		if (api->db) {
+			sqlite_api_exec(api, "COMMIT");
+			sqlite_api_exec(api, "BEGIN");
+			api->batch_rows = 0;
+		}
+		pthread_mutex_unlock(&sqlite_lock);
+		return;
+	}
+
+	if (api->db) {
+		sqlite_api_exec(api, "COMMIT");
+
+		for (i = 0; i < STMT_MAX; i++) {
+			sqlite3_finalize(api->stmt[i]);
+		}
+
+		sqlite3_close(api->db);
+	}
+
+	free(api);
+	sqlite_shared = NULL;
+	pthread_mutex_unlock(&sqlite_lock);
 }
@@ -2,8 +2,30 @@
 #define META_SQLITE_API_H
 
 #include "session.h"
+#include "cell_info.h"
 
+/* Rows written per transaction, 0 keeps a single transaction */
+#ifndef SQLITE_BATCH_ROWS
+#define SQLITE_BATCH_ROWS 10000
+#endif
+
+/* Wait for the write lock held by another process, in ms */
+#ifndef SQLITE_BUSY_MS
+#define SQLITE_BUSY_MS 60000
+#endif
+
+/*
+ * All contexts of the process share one connection and transaction,
+ * the batch size set with sqlite_api_batch() applies to all of them.
+ */
 void sqlite_api_init(struct session_info *s);
-void sqlite_api_destroy();
+void sqlite_api_destroy(struct metagsm_ctx *ctx);
+void sqlite_api_batch(struct metagsm_ctx *ctx, unsigned rows);
+void sqlite_api_query_cb(struct metagsm_ctx *ctx, const char *input);
+
+/* Bind rows directly from the structures into prepared statements */
+void sqlite_api_session(struct session_info *s);
+unsigned sqlite_api_cell(struct metagsm_ctx *ctx, struct cell_info *ci);
+void sqlite_api_paging(struct metagsm_ctx *ctx, unsigned epoch_now);
 
 #endif
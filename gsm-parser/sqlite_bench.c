@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+#include <sqlite3.h>
+
+#include "session.h"
+#include "sqlite_api.h"
+#include "bench.h"
+
+/*
+ * Compares the SQL text path (session_make_sql() and one sqlite3_exec()
+ * per row in autocommit mode) with the prepared statement sink on the
+ * same synthetic sessions. Run it next to a metadata.db created with
+ * "make database", the session_info table is emptied before each run.
+ */
+
+static void make_session(struct session_info *s, int id)
+{
+	memset(s, 0, sizeof(struct session_info));
+
+	s->ctx = metagsm_default_ctx();
+	s->id = id;
+	s->started = 1;
+	s->timestamp.tv_sec = 1595964000 + id;
+	s->mcc = 262;
+	s->mnc = 1 + random() % 10;
+	s->lac = random() & 0xffff;
+	s->cid = random() & 0xffff;
+	s->arfcn = random() % 1024;
+	s->first_fn = random() % 2715648;
+	s->last_fn = s->first_fn + random() % 1000;
+	s->duration = random() % 10000;
+	s->cipher = random() % 4;
+	s->locupd = random() & 1;
+	s->fc.enc = random() % 100;
+	s->fc.unenc = random() % 100;
+	s->old_tmsi[0] = random();
+	s->old_tmsi[3] = random();
+	snprintf(s->imsi, sizeof(s->imsi), "26201%010ld", random() % 10000000000L);
+}
+
+static void clear_table(sqlite3 *db)
+{
+	if (sqlite3_exec(db, "DELETE FROM session_info", 0, 0, 0) != SQLITE_OK) {
+		errx(1, "Cannot clear session_info: %s", sqlite3_errmsg(db));
+	}
+}
+
+static double bench_text(unsigned rows)
+{
+	struct session_info s;
+	char query[8192];
+	sqlite3 *db;
+	double secs;
+	unsigned i;
+
+	if (sqlite3_open("metadata.db", &db) != SQLITE_OK) {
+		errx(1, "Cannot open metadata.db");
+	}
+	clear_table(db);
+
+	srandom(1);
+	secs = stats_secs();
+	for (i = 0; i < rows; i++) {
+		make_session(&s, i);
+		session_make_sql(&s, query, sizeof(query), 1);
+		if (sqlite3_exec(db, query, 0, 0, 0) != SQLITE_OK) {
+			errx(1, "Error executing query: %s", sqlite3_errmsg(db));
+		}
+	}
+	secs = stats_secs() - secs;
+
+	sqlite3_close(db);
+
+	return secs;
+}
+
+static double bench_stmt(unsigned rows, unsigned batch)
+{
+	struct session_info s;
+	sqlite3 *db;
+	double secs;
+	unsigned i;
+
+	if (sqlite3_open("metadata.db", &db) != SQLITE_OK) {
+		errx(1, "Cannot open metadata.db");
+	}
+	clear_table(db);
+	sqlite3_close(db);
+
+	srandom(1);
+	secs = stats_secs();
+	make_session(&s, 0);
+	sqlite_api_batch(s.ctx, batch);
+	sqlite_api_init(&s);
+	for (i = 0; i < rows; i++) {
+		make_session(&s, i);
+		sqlite_api_session(&s);
+	}
+	sqlite_api_destroy(s.ctx);
+	secs = stats_secs() - secs;
+
+	return secs;
+}
+
+static unsigned count_rows()
+{
+	sqlite3 *db;
+	sqlite3_stmt *stmt;
+	unsigned count = 0;
+
+	if (sqlite3_open("metadata.db", &db) != SQLITE_OK) {
+		errx(1, "Cannot open metadata.db");
+	}
+	if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM session_info", -1, &stmt, NULL) == SQLITE_OK) {
+		if (sqlite3_step(stmt) == SQLITE_ROW) {
+			count = sqlite3_column_int(stmt, 0);
+		}
+		sqlite3_finalize(stmt);
+	}
+	sqlite3_close(db);
+
+	return count;
+}
+
+static unsigned rows = 20000;
+static unsigned batch = SQLITE_BATCH_ROWS;
+
+static const struct bench_opt opts[] = {
+	{ 'n', BENCH_UINT, &rows, "<rows>", "Number of sessions to store" },
+	{ 'b', BENCH_UINT, &batch, "<batch>", "Rows per transaction" },
+	{ 0 }
+};
+
+static int sqlite_main(int argc, char *argv[])
+{
+	double old_secs, new_secs;
+
+	if (bench_getopt(&sqlite_bench, argc, argv) != argc || !rows) {
+		bench_usage(&sqlite_bench);
+	}
+
+	old_secs = bench_text(rows);
+	if (count_rows() != rows) {
+		errx(1, "Text path stored %u of %u rows", count_rows(), rows);
+	}
+	bench_print("sql text", rows, "rows", old_secs, 0);
+
+	new_secs = bench_stmt(rows, batch);
+	if (count_rows() != rows) {
+		errx(1, "Prepared path stored %u of %u rows", count_rows(), rows);
+	}
+	bench_print("prepared", rows, "rows", new_secs, old_secs);
+
+	return 0;
+}
+
+const struct bench_cmd sqlite_bench = {
+	.name = "sqlite",
+	.help = "SQLite output as SQL text and as prepared statements",
+	.opts = opts,
+	.main = sqlite_main,
+};
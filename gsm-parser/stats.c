@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#ifdef USE_RATE_CTR
+#include <osmocom/core/rate_ctr.h>
+#endif
+
+#include "stats.h"
+
+/* Output named on the command line, -1 if unknown */
+int stats_parse_output(const char *name)
+{
+	if (!strcmp(name, "text")) {
+		return STATS_TEXT;
+	}
+	if (!strcmp(name, "json")) {
+		return STATS_JSON;
+	}
+
+	return -1;
+}
+
+#ifndef NO_STATS
+
+static const char *stage_names[STAGES] = {
+	"input", "diag", "l1", "radio_msg", "l3", "asn1", "sql_format", "sql_sink"
+};
+
+volatile sig_atomic_t stats_dump_gen = 0;
+
+static void stats_sigusr1(int sig)
+{
+	(void) sig;
+
+	stats_dump_gen++;
+}
+
+void stats_signal_init()
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stats_sigusr1;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, NULL);
+}
+
+void stats_reset(struct metagsm_stats *st, const char *input)
+{
+	uint8_t output = st->output;
+#ifdef USE_RATE_CTR
+	struct rate_ctr_group *ctr_group = st->ctr_group;
+#endif
+
+	memset(st, 0, sizeof(*st));
+	st->output = output;
+	st->input = input;
+	st->dump_gen = stats_dump_gen;
+	st->start_ticks = stats_ticks();
+	st->start_secs = stats_secs();
+#ifdef USE_RATE_CTR
+	st->ctr_group = ctr_group;
+#endif
+}
+
+/* Upper bound of a bucket, in ticks */
+static uint64_t bucket_limit(unsigned b)
+{
+	unsigned e, sub;
+
+	if (b < (1 << STATS_SUB_BITS)) {
+		return b + 1;
+	}
+	e = (b >> STATS_SUB_BITS) + STATS_SUB_BITS - 1;
+	sub = b & ((1 << STATS_SUB_BITS) - 1);
+
+	return (uint64_t) ((1 << STATS_SUB_BITS) + sub + 1) << (e - STATS_SUB_BITS);
+}
+
+static uint64_t percentile(const struct stats_hist *h, double p)
+{
+	uint64_t want, seen = 0;
+	unsigned b;
+
+	if (!h->sampled) {
+		return 0;
+	}
+
+	want = h->sampled * p;
+	for (b = 0; b < STATS_BUCKETS; b++) {
+		seen += h->bucket[b];
+		if (seen > want) {
+			break;
+		}
+	}
+
+	if (b == STATS_BUCKETS || bucket_limit(b) > h->max) {
+		return h->max;
+	}
+
+	return bucket_limit(b);
+}
+
+static void print_hist(const char *name, const struct stats_hist *h, double us_per_tick, int json)
+{
+	double mean = h->sampled ? (double) h->sum / h->sampled : 0;
+
+	if (json) {
+		fprintf(stderr, "\"%s\": { \"count\": %llu, \"sampled\": %llu, \"mean_us\": %.3f, "
+			"\"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f }",
+			name, (unsigned long long) h->count, (unsigned long long) h->sampled,
+			mean * us_per_tick,
+			percentile(h, 0.50) * us_per_tick,
+			percentile(h, 0.90) * us_per_tick,
+			percentile(h, 0.99) * us_per_tick,
+			h->max * us_per_tick);
+	} else {
+		fprintf(stderr, "%-12s %12llu %10llu %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+			name, (unsigned long long) h->count, (unsigned long long) h->sampled,
+			mean * us_per_tick,
+			percentile(h, 0.50) * us_per_tick,
+			percentile(h, 0.90) * us_per_tick,
+			percentile(h, 0.99) * us_per_tick,
+			h->max * us_per_tick);
+	}
+}
+
+static void print_json_string(const char *str)
+{
+	fputc('"', stderr);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\') {
+			fprintf(stderr, "\\%c", *str);
+		} else if ((unsigned char) *str < 0x20) {
+			fprintf(stderr, "\\u%04x", *str);
+		} else {
+			fputc(*str, stderr);
+		}
+	}
+	fputc('"', stderr);
+}
+
+#ifdef USE_RATE_CTR
+static const struct rate_ctr_desc stage_ctr_desc[STAGES] = {
+	{ "stage.input", "Input frames read" },
+	{ "stage.diag", "DIAG log packets handled" },
+	{ "stage.l1", "Bursts handled" },
+	{ "stage.radio_msg", "Radio messages handled" },
+	{ "stage.l3", "L3 messages handled" },
+	{ "stage.asn1", "RRC messages ASN.1 decoded" },
+	{ "stage.sql_format", "Sessions formatted as SQL" },
+	{ "stage.sql_sink", "SQL statements written" },
+};
+
+static const struct rate_ctr_group_desc stage_ctr_group_desc = {
+	.group_name_prefix = "metagsm",
+	.group_description = "Parser pipeline stages",
+	.num_ctr = STAGES,
+	.ctr_desc = stage_ctr_desc,
+};
+
+/* Counts since the last call go to the rate_ctr group of the context */
+static void publish(struct metagsm_stats *st)
+{
+	static unsigned ctr_group_idx = 0;
+	unsigned i;
+
+	if (!st->ctr_group) {
+		st->ctr_group = rate_ctr_group_alloc(NULL, &stage_ctr_group_desc, ctr_group_idx++);
+		if (!st->ctr_group) {
+			return;
+		}
+	}
+
+	for (i = 0; i < STAGES; i++) {
+		rate_ctr_add(&st->ctr_group->ctr[i], st->stage[i].count - st->ctr_published[i]);
+		st->ctr_published[i] = st->stage[i].count;
+	}
+}
+#endif
+
+void stats_dump(struct metagsm_stats *st)
+{
+	double secs = stats_secs() - st->start_secs;
+	uint64_t ticks = stats_ticks() - st->start_ticks;
+	double us_per_tick = ticks ? secs * 1e6 / ticks : 0;
+	char name[8];
+	int json = st->output == STATS_JSON;
+	int first = 1;
+	unsigned i;
+
+#ifdef USE_RATE_CTR
+	publish(st);
+#endif
+
+	if (st->output == STATS_NONE) {
+		return;
+	}
+
+	if (json) {
+		fprintf(stderr, "{ \"input\": ");
+		print_json_string(st->input ? st->input : "");
+		fprintf(stderr, ", \"secs\": %.3f, \"sample\": %u, \"stages\": { ", secs, STATS_SAMPLE);
+	} else {
+		fprintf(stderr, "Stage statistics%s%s after %.3f s, 1 in %u timed\n",
+			st->input ? " of " : "", st->input ? st->input : "", secs, STATS_SAMPLE);
+		fprintf(stderr, "%-12s %12s %10s %10s %10s %10s %10s %10s\n",
+			"stage", "count", "sampled", "mean us", "p50 us", "p90 us", "p99 us", "max us");
+	}
+
+	for (i = 0; i < STAGES; i++) {
+		if (!st->stage[i].count) {
+			continue;
+		}
+		if (json && !first) {
+			fprintf(stderr, ", ");
+		}
+		print_hist(stage_names[i], &st->stage[i], us_per_tick, json);
+		first = 0;
+	}
+
+	if (json) {
+		fprintf(stderr, " }, \"protocols\": { ");
+	}
+
+	first = 1;
+	for (i = 0; i <= STATS_PROTOCOLS; i++) {
+		const struct stats_hist *h;
+
+		if (i < STATS_PROTOCOLS) {
+			if (!st->proto[i].used) {
+				continue;
+			}
+			snprintf(name, sizeof(name), "0x%04x", st->proto[i].protocol);
+			h = &st->proto[i].h;
+		} else {
+			if (!st->proto_other.count) {
+				continue;
+			}
+			snprintf(name, sizeof(name), "other");
+			h = &st->proto_other;
+		}
+		if (json && !first) {
+			fprintf(stderr, ", ");
+		} else if (!json && first) {
+			fprintf(stderr, "%-12s\n", "protocol");
+		}
+		print_hist(name, h, us_per_tick, json);
+		first = 0;
+	}
+
+	if (json) {
+		fprintf(stderr, " } }\n");
+	}
+	fflush(stderr);
+}
+
+#else
+
+void stats_signal_init()
+{
+}
+
+void stats_reset(struct metagsm_stats *st, const char *input)
+{
+	(void) st;
+	(void) input;
+}
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+
+/*
+ * Message counts and latency histograms per pipeline stage and per DIAG
+ * msg_protocol, kept in the parser context so that each input thread has
+ * its own. Stages nest, the time of a stage includes the stages it calls.
+ * Every event is counted, one in STATS_SAMPLE is timed. Building with
+ * NO_STATS leaves no trace of them in the parser.
+ */
+
+/* Pipeline stages */
+enum stats_stage {
+	STAGE_INPUT,		/* reading and unescaping input frames */
+	STAGE_DIAG,		/* handle_diag(), a whole DIAG log packet */
+	STAGE_L1,		/* process_handle_burst() */
+	STAGE_RADIO_MSG,	/* handle_radio_msg() */
+	STAGE_L3,		/* handle_dtap() */
+	STAGE_ASN1,		/* uper_decode() of RRC */
+	STAGE_SQL_FORMAT,	/* session_make_sql() */
+	STAGE_SQL_SINK,		/* SQL callbacks, the database or console */
+	STAGES
+};
+
+enum stats_output {
+	STATS_NONE,
+	STATS_TEXT,
+	STATS_JSON,
+};
+
+/* Timed events, a power of two */
+#define STATS_SAMPLE		16
+
+/* Log-linear buckets, 8 per power of two up to 2^40 ticks */
+#define STATS_SUB_BITS		3
+#define STATS_MAX_BITS		40
+#define STATS_BUCKETS		((STATS_MAX_BITS - STATS_SUB_BITS + 2) << STATS_SUB_BITS)
+
+/* DIAG msg_protocol values told apart, others are counted together */
+#define STATS_PROTOCOLS		64
+
+/* Monotonic time in seconds, also used by the tools and benchmarks */
+static inline double stats_secs()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#ifndef NO_STATS
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define stats_ticks()		__rdtsc()
+#else
+static inline uint64_t stats_ticks()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+#endif
+
+struct rate_ctr_group;
+
+struct stats_hist {
+	uint64_t count;
+	uint64_t sampled;
+	uint64_t sum;
+	uint64_t max;
+	uint32_t bucket[STATS_BUCKETS];
+};
+
+struct stats_proto {
+	uint16_t protocol;
+	uint8_t used;
+	struct stats_hist h;
+};
+
+struct metagsm_stats {
+	uint8_t output;
+	const char *input;
+	sig_atomic_t dump_gen;
+	uint64_t start_ticks;
+	double start_secs;
+	struct stats_hist stage[STAGES];
+	struct stats_proto proto[STATS_PROTOCOLS];
+	struct stats_hist proto_other;
+#ifdef USE_RATE_CTR
+	struct rate_ctr_group *ctr_group;
+	uint64_t ctr_published[STAGES];
+#endif
+};
+
+extern volatile sig_atomic_t stats_dump_gen;
+
+void stats_dump(struct metagsm_stats *st);
+
+static inline unsigned stats_bucket(uint64_t ticks)
+{
+	unsigned e;
+
+	if (ticks < (1 << STATS_SUB_BITS)) {
+		return ticks;
+	}
+	e = 63 - __builtin_clzll(ticks);
+	if (e > STATS_MAX_BITS) {
+		return STATS_BUCKETS - 1;
+	}
+
+	return ((e - STATS_SUB_BITS + 1) << STATS_SUB_BITS) +
+		((ticks >> (e - STATS_SUB_BITS)) & ((1 << STATS_SUB_BITS) - 1));
+}
+
+static inline void stats_record(struct stats_hist *h, uint64_t ticks)
+{
+	h->sampled++;
+	h->sum += ticks;
+	if (ticks > h->max) {
+		h->max = ticks;
+	}
+	h->bucket[stats_bucket(ticks)]++;
+}
+
+/* Start of an event, 0 if it is not timed */
+static inline uint64_t stats_begin(struct metagsm_stats *st, enum stats_stage stage)
+{
+	if (st->stage[stage].count++ & (STATS_SAMPLE - 1)) {
+		return 0;
+	}
+
+	return stats_ticks();
+}
+
+static inline void stats_end(struct metagsm_stats *st, enum stats_stage stage, uint64_t t)
+{
+	if (t) {
+		stats_record(&st->stage[stage], stats_ticks() - t);
+	}
+}
+
+/* Same event, counted and timed by protocol as well */
+static inline void stats_end_proto(struct metagsm_stats *st, enum stats_stage stage, uint16_t protocol, uint64_t t)
+{
+	struct stats_hist *h = &st->proto_other;
+	uint64_t ticks = 0;
+	unsigned i, p;
+
+	if (t) {
+		ticks = stats_ticks() - t;
+		stats_record(&st->stage[stage], ticks);
+	}
+
+	for (i = 0; i < STATS_PROTOCOLS; i++) {
+		p = (protocol + i) % STATS_PROTOCOLS;
+		if (!st->proto[p].used) {
+			st->proto[p].used = 1;
+			st->proto[p].protocol = protocol;
+		}
+		if (st->proto[p].protocol == protocol) {
+			h = &st->proto[p].h;
+			break;
+		}
+	}
+
+	h->count++;
+	if (t) {
+		stats_record(h, ticks);
+	}
+}
+
+/* Dump when asked to by SIGUSR1 */
+static inline void stats_poll(struct metagsm_stats *st)
+{
+	if (st->dump_gen != stats_dump_gen) {
+		st->dump_gen = stats_dump_gen;
+		stats_dump(st);
+	}
+}
+
+#else
+
+struct metagsm_stats {
+	uint8_t output;
+};
+
+#define stats_begin(st, stage)				0
+#define stats_end(st, stage, t)				((void) (t))
+#define stats_end_proto(st, stage, protocol, t)		((void) (t))
+#define stats_poll(st)					do { } while (0)
+#define stats_dump(st)					do { } while (0)
+
+#endif
+
+int stats_parse_output(const char *name);
+void stats_reset(struct metagsm_stats *st, const char *input);
+void stats_signal_init();
+
+#endif
@@ -1,19 +1,25 @@
 #include "cch.h"
+#include "ccch.h"
 #include "output.h"
 #include "bit_func.h"
 #include <osmocom/gsm/a5.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "gsm_interleave.h"
 #include "l3_handler.h"
 
+/* Hard bits as Viterbi input, 0 -> 127 and 1 -> -127 */
+static const int8_t hard_amp[8] = {127, 127, 127, 127, 127, 127, 127, 127};
+
 int process_tch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *msg)
 {
 	int ret, ul;
 	uint16_t arfcn;
 	uint32_t fn;
-	uint8_t conv_data[CONV_SIZE];
+	int8_t conv_data[CONV_SIZE];
+	uint8_t *bits;
 	struct burst_buf *bb;
 
 	arfcn = ntohs(bi->band_arfcn);
@@ -22,19 +28,22 @@ int process_tch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *msg
 
 	bb = &s->facch[ul];
 
-	/* append data to message buffer */
-	expand_msb(bi->bits, bb->data + bb->count * 114, 114);
-
+	/* decipher the packed burst and append it to message buffer */
+	bits = bb->data + bb->count * BURST_BYTES;
+	memcpy(bits, bi->bits, BURST_BYTES);
+	bits[BURST_BYTES - 1] &= 0xc0;
 	if(not_zero(s->key, 8)) {
+		const uint8_t *key = s->key;
+		uint8_t ks[BURST_BYTES];
 		int i;
-		uint8_t ks[114];
+
 		if (ul)
-			osmo_a5(1, s->key, fn, 0, ks);
+			osmo_a5_bulk(1, &key, &fn, 1, NULL, ks);
 		else
-			osmo_a5(1, s->key, fn, ks, 0);
+			osmo_a5_bulk(1, &key, &fn, 1, ks, NULL);
 
-		for (i=0; i<114; i++) {
-			bb->data[bb->count * 114 + i] ^= ks[i];
+		for (i=0; i<BURST_BYTES; i++) {
+			bits[i] ^= ks[i];
 		}
 	}
 
@@ -134,22 +143,27 @@ int process_tch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *msg
 
 		/* try to decode FACCH */
 
-		/* de-interleaving */
-		gsm_deinter_facch(bb->data, conv_data);
+		/* de-interleaving, hard bits as soft bits */
+		gsm_deinter_soft(DEINTER_FACCH, bb->data, hard_amp, conv_data);
 
 		ret = decode_signalling(conv_data, msg);
 		if (!ret) {
 			/* skip one burst and wait next */
 			// some circular buffer needed
-			memcpy(bb->data, bb->data + 114, 7 * 114);
+			memcpy(bb->data, bb->data + BURST_BYTES, 7 * BURST_BYTES);
 			memcpy(bb->sbit, bb->sbit + 2, 7 * 2);
 			bb->count = 7;
 			bb->errors /= 2; // approximated value
 			return 0;
 		}
 
-		m = malloc(sizeof(struct radio_message));
-		memcpy(&m->bb, bb, sizeof(*bb));
+		s->ctx->l1_facch++;
+
+		/* SACCH block of this session still waiting in the queue goes first */
+		ccch_flush_session(s);
+
+		m = radio_msg_alloc(s->ctx, 8 * BURST_BYTES);
+		memcpy(&m->bb, bb, offsetof(struct burst_buf, data) + 8 * BURST_BYTES);
 		m->chan_nr = bi->chan_nr;
 		m->flags = MSG_FACCH|MSG_DECODED;
 		if (s->have_key)
@@ -160,20 +174,21 @@ int process_tch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *msg
 		handle_lapdm(s, &s->chan_facch[ul], m->msg, m->msg_len, m->bb.fn[0], ul);
 
 		net_send_msg(m);
+		radio_msg_free(s->ctx, m);
 
 		/* check overlapping status */
 		if ((bi->bits[14] & 0x30) == 0x30) {
 			/* start subsequent message processing */
-			memcpy(bb->data, bb->data + 4 * 114, 4 * 114);
+			memcpy(bb->data, bb->data + 4 * BURST_BYTES, 4 * BURST_BYTES);
 			memcpy(bb->sbit, bb->sbit + 4 * 2, 4 * 2);
 			bb->count = 4;
 			bb->errors /= 2; // approximated value
-			memset(bb->data + bb->count*114, 0, sizeof(bb->data)/2);
+			memset(bb->data + bb->count * BURST_BYTES, 0, 4 * BURST_BYTES);
 		} else {
 			/* nothing else in the buffer, reset */
 			bb->count = 0;
 			bb->errors = 0;
-			memset(bb->data, 0, sizeof(bb->data));
+			memset(bb->data, 0, 8 * BURST_BYTES);
 		}
 
 		return 23;
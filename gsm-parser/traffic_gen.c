@@ -0,0 +1,2342 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <err.h>
+#include <assert.h>
+#include <arpa/inet.h>
+#include <osmocom/core/gsmtap.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/a5.h>
+#include <osmocom/gsm/gsm48.h>
+#include <osmocom/gsm/gsm_utils.h>
+#include <osmocom/gsm/protocol/gsm_04_08.h>
+#include <osmocom/gsm/protocol/gsm_04_11.h>
+
+#include "process.h"
+#include "cch.h"
+#include "gsm_interleave.h"
+#include "burst_desc.h"
+
+/*
+ * Generates synthetic captures for diag_import, gsmtap_import and
+ * burst_import: location updates, calls, SMS, GPRS attaches, 3G and LTE
+ * sessions on a set of cells, with BCCH and paging traffic in between.
+ * The output depends on the seed only, sessions are built one at a time
+ * and streamed, so files of any size can be written.
+ *
+ * DIAG frames carry the 0x512f, 0x713a, 0x412f and 0xb0e* log codes with
+ * CRC and HDLC escaping. The pcap has one GSMTAP packet per LAPDm frame.
+ * Burst files hold the SDCCH blocks of several sessions side by side, FIRE
+ * and convolutional coded, interleaved, enciphered after the Ciphering
+ * Mode Command and with random bit errors. Their Kc go to the key file.
+ */
+
+#define GEN_MSG_MAX	256
+#define GEN_MAX_MSGS	128
+#define GEN_MAX_FRAMES	256
+#define GEN_MAX_LANES	64
+#define GEN_SUBSCRIBERS	4096
+#define GEN_MAX_CELLS	4096
+
+/* 2021-01-01 00:00:00 UTC */
+#define GEN_START_TIME	1609459200ull
+#define GPS_EPOCH	315964800ull
+
+enum gen_format {
+	FMT_DIAG,
+	FMT_PCAP,
+	FMT_BURST,
+};
+
+enum gen_scenario {
+	SC_LU,
+	SC_CALL,
+	SC_SMS,
+	SC_GPRS,
+	SC_RRC,
+	SC_LTE,
+	SC_COUNT
+};
+
+static const char *scenario_names[SC_COUNT] = { "lu", "call", "sms", "gprs", "rrc", "lte" };
+
+enum gen_rat {
+	GEN_GSM,
+	GEN_UMTS,
+	GEN_LTE,
+};
+
+/* Where a message goes */
+enum gen_chan {
+	CH_BCCH,	/* 23 byte L2 frame */
+	CH_CCCH,	/* 23 byte L2 frame */
+	CH_RR,		/* RR L3 on the dedicated channel */
+	CH_DTAP,	/* MM, CC, SMS, GMM and SM L3 */
+	CH_SACCH,	/* RR L3 on the SACCH */
+	CH_RRC,		/* UMTS RRC PDU */
+	CH_EMM,		/* LTE NAS PDU */
+};
+
+/* Message flags */
+#define GEN_F_CMC	0x01	/* Ciphering Mode Command, start of ciphering */
+#define GEN_F_ASSIGN	0x02	/* Assignment Command, move to a TCH */
+#define GEN_F_AGCH	0x04	/* Immediate Assignment */
+#define GEN_F_CCCH	0x08	/* RRC on the CCCH rather than the DCCH */
+#define GEN_F_PROT	0x10	/* LTE NAS with security header */
+
+/* GMM and SM message types (3GPP TS 24.008) */
+#define GMM_ATTACH_REQ		0x01
+#define GMM_ATTACH_ACCEPT	0x02
+#define GMM_ATTACH_COMPLETE	0x03
+#define GMM_RA_UPD_REQ		0x08
+#define GMM_RA_UPD_ACCEPT	0x09
+#define GMM_RA_UPD_COMPLETE	0x0a
+#define GMM_AUTH_CIPH_REQ	0x12
+#define GMM_AUTH_CIPH_RESP	0x13
+#define SM_ACT_PDP_REQ		0x41
+#define SM_ACT_PDP_ACCEPT	0x42
+
+/* Kinds of L2 frames, as sent over GSMTAP */
+enum gen_kind {
+	K_BCCH,
+	K_PCH,
+	K_AGCH,
+	K_SDCCH,
+	K_SACCH,
+	K_FACCH,
+	K_RRC,
+};
+
+struct gen_buf {
+	unsigned len;
+	uint8_t data[GEN_MSG_MAX];
+};
+
+struct gen_msg {
+	uint8_t chan;
+	uint8_t ul;
+	uint8_t sapi;
+	uint8_t flags;
+	struct gen_buf b;
+};
+
+struct gen_cell {
+	uint16_t mcc;
+	uint16_t mnc;
+	uint16_t lac;
+	uint16_t cid;
+	uint16_t arfcn;
+	uint8_t bsic;
+	uint8_t rac;
+	uint16_t neigh[6];
+};
+
+struct gen_sub {
+	char imsi[16];
+	char imei[16];
+	char msisdn[16];
+	uint32_t tmsi;
+	uint32_t ptmsi;
+};
+
+struct gen_session {
+	uint32_t id;
+	unsigned scenario;
+	unsigned rat;
+	struct gen_cell *cell;
+	struct gen_sub *sub;
+	uint8_t kc[8];
+	uint8_t a5;		/* A5/n after the CMC, 0 if unciphered */
+	uint8_t ts;		/* dedicated channel */
+	uint8_t subch;
+	uint8_t integrity;	/* RRC integrity protection started */
+	uint8_t rrc_sn;
+	unsigned nas_count;
+	unsigned count;
+	struct gen_msg msgs[GEN_MAX_MSGS];
+};
+
+/* LAPDm state of one dedicated channel, [ul][sapi 3] */
+struct gen_lapdm {
+	uint8_t est[2];
+	uint8_t vs[2][2];
+	uint8_t facch;
+	uint8_t ciphered;
+};
+
+typedef void (*frame_cb)(void *arg, const struct gen_session *gs, const struct gen_msg *m,
+			 unsigned kind, uint8_t ul, const uint8_t *frame, unsigned len, int ciphered);
+
+/* Settings */
+static enum gen_format format = FMT_DIAG;
+static unsigned weights[SC_COUNT] = { 30, 20, 25, 10, 10, 5 };
+static unsigned a5_weights[4] = { 0, 50, 5, 45 };
+static unsigned cipher_pct = 90;
+static unsigned ber_permille = 0;
+static unsigned cell_count = 20;
+static unsigned lane_count = 8;
+
+static struct gen_cell cells[GEN_MAX_CELLS];
+static struct gen_sub subs[GEN_SUBSCRIBERS];
+
+/* Output */
+static FILE *out;
+static FILE *key_out;
+static uint64_t out_bytes = 0;
+static uint64_t out_frames = 0;
+static uint64_t now_us;
+static uint16_t ip_id = 0;
+static uint16_t crc_table[256];
+
+/* Statistics */
+static uint64_t scenario_count[SC_COUNT];
+static uint64_t ciphered_count = 0;
+static uint64_t bit_errors = 0;
+
+static void usage(const char *progname, const char *reason)
+{
+	printf("%s\n", reason);
+	printf("Usage: %s [-f diag|pcap|burst] [-w <file>] [-n <sessions>] [-s <size>] [options]\n", progname);
+	printf("	-f <format>   - Output DIAG (default), GSMTAP pcap or burst records\n");
+	printf("	-w <file>     - Write to <file>, - for stdout (default)\n");
+	printf("	-k <keyfile>  - Write <session> <Kc> lines for burst_import to <keyfile>\n");
+	printf("	-S <seed>     - Random seed (default 1)\n");
+	printf("	-n <sessions> - Number of sessions (default 1000, unlimited with -s)\n");
+	printf("	-s <size>     - Stop after <size> bytes, k, M and G suffixes allowed\n");
+	printf("	-i <id>       - First session ID (default 1)\n");
+	printf("	-C <cells>    - Number of cells (default %u)\n", cell_count);
+	printf("	-m <mix>      - Session weights, default lu=%u,call=%u,sms=%u,gprs=%u,rrc=%u,lte=%u\n",
+		weights[SC_LU], weights[SC_CALL], weights[SC_SMS], weights[SC_GPRS], weights[SC_RRC], weights[SC_LTE]);
+	printf("	-e <percent>  - Ciphered sessions (default %u)\n", cipher_pct);
+	printf("	-A <a,b,c>    - Weights of A5/1, A5/2 and A5/3 (default %u,%u,%u)\n",
+		a5_weights[1], a5_weights[2], a5_weights[3]);
+	printf("	-E <permille> - Bit errors per 1000 burst bits (default 0)\n");
+	printf("	-p <lanes>    - Sessions side by side in burst output (default %u, max %u)\n", lane_count, GEN_MAX_LANES);
+	printf("	Only GSM sessions go to bursts, no GPRS or LTE to pcap.\n");
+	exit(1);
+}
+
+/* xorshift64* */
+static uint64_t rng_state;
+
+static uint64_t rnd()
+{
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+
+	return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+static void rnd_seed(uint64_t seed)
+{
+	rng_state = (seed + 1) * 0x9e3779b97f4a7c15ull;
+	if (!rng_state) {
+		rng_state = 1;
+	}
+	rnd();
+	rnd();
+}
+
+static unsigned rnd_n(unsigned n)
+{
+	return (rnd() >> 16) % n;
+}
+
+static unsigned rnd_range(unsigned lo, unsigned hi)
+{
+	return lo + rnd_n(hi - lo + 1);
+}
+
+static int rnd_pct(unsigned pct)
+{
+	return rnd_n(100) < pct;
+}
+
+static unsigned rnd_weighted(const unsigned *w, unsigned n)
+{
+	unsigned i, total = 0, r;
+
+	for (i = 0; i < n; i++) {
+		total += w[i];
+	}
+	assert(total);
+
+	r = rnd_n(total);
+	for (i = 0; i < n; i++) {
+		if (r < w[i]) {
+			return i;
+		}
+		r -= w[i];
+	}
+
+	return n - 1;
+}
+
+static void rnd_digits(char *out, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		out[i] = '0' + rnd_n(10);
+	}
+	out[n] = 0;
+}
+
+/* Message buffers */
+
+static void put8(struct gen_buf *b, uint8_t v)
+{
+	assert(b->len < GEN_MSG_MAX);
+	b->data[b->len++] = v;
+}
+
+static void put16(struct gen_buf *b, uint16_t v)
+{
+	put8(b, v >> 8);
+	put8(b, v & 0xff);
+}
+
+static void put(struct gen_buf *b, const void *data, unsigned len)
+{
+	assert(b->len + len <= GEN_MSG_MAX);
+	memcpy(&b->data[b->len], data, len);
+	b->len += len;
+}
+
+static void put_rand(struct gen_buf *b, unsigned len)
+{
+	while (len--) {
+		put8(b, rnd());
+	}
+}
+
+static void put_lai(struct gen_buf *b, const struct gen_cell *c)
+{
+	struct gsm48_loc_area_id lai;
+
+	gsm48_generate_lai(&lai, c->mcc, c->mnc, c->lac);
+	put(b, &lai, sizeof(lai));
+}
+
+/* Mobile identities as LV */
+static void put_mi_imsi(struct gen_buf *b, const char *imsi)
+{
+	uint8_t mi[16];
+	int len;
+
+	len = gsm48_generate_mid_from_imsi(mi, imsi);
+	put(b, &mi[1], len - 1);
+}
+
+static void put_mi_imei(struct gen_buf *b, const char *imei, uint8_t type)
+{
+	uint8_t mi[16];
+	int len;
+
+	len = gsm48_generate_mid_from_imsi(mi, imei);
+	mi[2] = (mi[2] & ~GSM_MI_TYPE_MASK) | type;
+	put(b, &mi[1], len - 1);
+}
+
+static void put_mi_tmsi(struct gen_buf *b, uint32_t tmsi)
+{
+	uint8_t mi[8];
+	int len;
+
+	len = gsm48_generate_mid_from_tmsi(mi, tmsi);
+	put(b, &mi[1], len - 1);
+}
+
+static void put_mi_sub(struct gen_buf *b, const struct gen_sub *sub)
+{
+	if (sub->tmsi) {
+		put_mi_tmsi(b, sub->tmsi);
+	} else {
+		put_mi_imsi(b, sub->imsi);
+	}
+}
+
+/* Called/calling party or RP address, LV with type of number */
+static void put_bcd_lv(struct gen_buf *b, uint8_t ton, const char *digits)
+{
+	uint8_t lv[16];
+	int len;
+
+	len = gsm48_encode_bcd_number(lv, sizeof(lv) - 1, 1, digits);
+	assert(len > 0);
+	lv[1] = ton;
+	put(b, lv, len);
+}
+
+/* TP address, the length counts digits */
+static void put_tp_addr(struct gen_buf *b, uint8_t ton, const char *digits)
+{
+	uint8_t lv[16];
+	int len;
+
+	len = gsm48_encode_bcd_number(lv, sizeof(lv) - 1, 1, digits);
+	assert(len > 0);
+	lv[0] = strlen(digits);
+	lv[1] = ton;
+	put(b, lv, len);
+}
+
+/* Cell channel description in bit map 0 format, ARFCN 1..124 */
+static void put_bitmap0(struct gen_buf *b, const uint16_t *arfcn, unsigned count)
+{
+	uint8_t map[16] = {0};
+	unsigned i, k;
+
+	for (i = 0; i < count; i++) {
+		if (arfcn[i] < 1 || arfcn[i] > 124) {
+			continue;
+		}
+		k = arfcn[i] - 1;
+		map[15 - k/8] |= 1 << (k%8);
+	}
+
+	put(b, map, sizeof(map));
+}
+
+static void put_rach_control(struct gen_buf *b)
+{
+	put8(b, 0xb8);
+	put8(b, 0x00);
+	put8(b, 0x00);
+}
+
+/* L2 pseudo length of the L3 part so far, then rest octets */
+static void finish_l2(struct gen_buf *b, unsigned l3_len)
+{
+	b->data[0] = l3_len << 2 | 1;
+	while (b->len < 23) {
+		put8(b, 0x2b);
+	}
+}
+
+static uint8_t bcd_swap(unsigned v)
+{
+	return (v % 10) << 4 | (v / 10 % 10);
+}
+
+/* Sessions */
+
+static void add_msg(struct gen_session *gs, uint8_t chan, uint8_t ul, uint8_t sapi, uint8_t flags, const struct gen_buf *b)
+{
+	struct gen_msg *m;
+
+	if (gs->count == GEN_MAX_MSGS) {
+		errx(1, "Too many messages in session %u", gs->id);
+	}
+
+	m = &gs->msgs[gs->count++];
+	m->chan = chan;
+	m->ul = ul;
+	m->sapi = sapi;
+	m->flags = flags;
+	m->b = *b;
+}
+
+static void bcch_noise(struct gen_session *gs)
+{
+	const struct gen_cell *c = gs->cell;
+	struct gen_buf b;
+	unsigned i, n, mt;
+
+	n = rnd_n(5);
+	for (i = 0; i < n; i++) {
+		b.len = 1;
+		mt = 0x19 + rnd_n(4);
+		put8(&b, GSM48_PDISC_RR);
+		put8(&b, mt);
+		switch (mt) {
+		case GSM48_MT_RR_SYSINFO_1:
+			put_bitmap0(&b, &c->arfcn, 1);
+			put_rach_control(&b);
+			finish_l2(&b, b.len - 1);
+			break;
+		case GSM48_MT_RR_SYSINFO_2:
+			put_bitmap0(&b, c->neigh, 6);
+			put8(&b, 0xff);
+			put_rach_control(&b);
+			finish_l2(&b, b.len - 1);
+			break;
+		case GSM48_MT_RR_SYSINFO_3:
+			put16(&b, c->cid);
+			put_lai(&b, c);
+			put8(&b, 0x49);
+			put8(&b, 0x03);
+			put8(&b, 0x05);
+			put8(&b, 0x65);
+			put8(&b, 0x00);
+			put8(&b, 0x00);
+			put_rach_control(&b);
+			finish_l2(&b, b.len - 1);
+			break;
+		default:
+			put_lai(&b, c);
+			put8(&b, 0x00);
+			put8(&b, 0x00);
+			put_rach_control(&b);
+			finish_l2(&b, b.len - 1);
+		}
+		add_msg(gs, CH_BCCH, 0, 0, 0, &b);
+	}
+}
+
+static void paging(struct gen_session *gs, const struct gen_sub *sub)
+{
+	struct gen_buf b;
+
+	b.len = 1;
+	put8(&b, GSM48_PDISC_RR);
+	put8(&b, GSM48_MT_RR_PAG_REQ_1);
+	put8(&b, 0x00);
+	put_mi_sub(&b, sub);
+	finish_l2(&b, b.len - 1);
+	add_msg(gs, CH_CCCH, 0, 0, 0, &b);
+}
+
+static void paging_noise(struct gen_session *gs)
+{
+	unsigned i, n;
+
+	n = rnd_n(4);
+	for (i = 0; i < n; i++) {
+		paging(gs, &subs[rnd_n(GEN_SUBSCRIBERS)]);
+	}
+}
+
+static void sacch(struct gen_session *gs)
+{
+	const struct gen_cell *c = gs->cell;
+	struct gen_buf b;
+
+	if (gs->rat != GEN_GSM || !rnd_pct(30)) {
+		return;
+	}
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_RR);
+	switch (rnd_n(3)) {
+	case 0:
+		put8(&b, GSM48_MT_RR_SYSINFO_5);
+		put_bitmap0(&b, c->neigh, 6);
+		add_msg(gs, CH_SACCH, 0, 0, 0, &b);
+		break;
+	case 1:
+		put8(&b, GSM48_MT_RR_SYSINFO_6);
+		put16(&b, c->cid);
+		put_lai(&b, c);
+		put8(&b, 0x65);
+		put8(&b, 0xff);
+		add_msg(gs, CH_SACCH, 0, 0, 0, &b);
+		break;
+	default:
+		put8(&b, GSM48_MT_RR_MEAS_REP);
+		put8(&b, rnd_range(20, 50));
+		put8(&b, rnd_range(20, 50));
+		put_rand(&b, 14);
+		add_msg(gs, CH_SACCH, 1, 0, 0, &b);
+	}
+}
+
+/* Bit writer for UPER encoded RRC */
+struct gen_bits {
+	struct gen_buf *b;
+	unsigned pos;
+};
+
+static void put_bits(struct gen_bits *bw, uint32_t v, unsigned n)
+{
+	while (n--) {
+		if (!(bw->pos % 8)) {
+			put8(bw->b, 0);
+		}
+		if ((v >> n) & 1) {
+			bw->b->data[bw->pos / 8] |= 0x80 >> (bw->pos % 8);
+		}
+		bw->pos++;
+	}
+}
+
+/* integrityCheckInfo and the message type of a DCCH message */
+static void dcch_header(struct gen_session *gs, struct gen_bits *bw, unsigned type)
+{
+	if (gs->integrity) {
+		put_bits(bw, 1, 1);
+		put_bits(bw, rnd(), 32);
+		put_bits(bw, gs->rrc_sn++ & 0x0f, 4);
+	} else {
+		put_bits(bw, 0, 1);
+	}
+	put_bits(bw, type, 5);
+}
+
+/* Message type with random body, there is no RRC encoder at hand */
+static void rrc_opaque(struct gen_session *gs, uint8_t ul, int ccch, unsigned type, unsigned len)
+{
+	struct gen_buf b;
+	struct gen_bits bw = { &b, 0 };
+
+	b.len = 0;
+	if (ccch) {
+		put_bits(&bw, 0, 1);
+		put_bits(&bw, type, 3);
+	} else {
+		dcch_header(gs, &bw, type);
+	}
+	put_bits(&bw, rnd(), 8 - bw.pos % 8);
+	put_rand(&b, len);
+
+	add_msg(gs, CH_RRC, ul, 0, ccch ? GEN_F_CCCH : 0, &b);
+}
+
+/* DownlinkDirectTransfer and UplinkDirectTransfer r3 */
+static void rrc_direct_transfer(struct gen_session *gs, uint8_t ul, int ps, const struct gen_buf *nas)
+{
+	struct gen_buf b;
+	struct gen_bits bw = { &b, 0 };
+	unsigned i;
+
+	b.len = 0;
+	if (ul) {
+		dcch_header(gs, &bw, 27);
+		put_bits(&bw, 0, 1);	/* measuredResultsOnRACH */
+		put_bits(&bw, 0, 1);	/* laterNonCriticalExtensions */
+		put_bits(&bw, ps, 1);
+	} else {
+		dcch_header(gs, &bw, 5);
+		put_bits(&bw, 0, 1);	/* r3 */
+		put_bits(&bw, 0, 1);	/* laterNonCriticalExtensions */
+		put_bits(&bw, rnd_n(4), 2);
+		put_bits(&bw, ps, 1);
+	}
+	put_bits(&bw, nas->len - 1, 12);
+	for (i = 0; i < nas->len; i++) {
+		put_bits(&bw, nas->data[i], 8);
+	}
+
+	add_msg(gs, CH_RRC, ul, 0, 0, &b);
+}
+
+/* InitialDirectTransfer with the RACH measurements and START of the UE */
+static void rrc_initial_direct_transfer(struct gen_session *gs, int ps, const struct gen_buf *nas)
+{
+	struct gen_buf b;
+	struct gen_bits bw = { &b, 0 };
+	unsigned i, cells = rnd_n(4);
+
+	b.len = 0;
+	dcch_header(gs, &bw, 5);
+	put_bits(&bw, 1, 1);	/* measuredResultsOnRACH */
+	put_bits(&bw, 1, 1);	/* v3a0NonCriticalExtensions */
+	put_bits(&bw, ps, 1);
+
+	/* intraDomainNasNodeSelector, release 99 GSM-MAP */
+	put_bits(&bw, 0, 2);
+	put_bits(&bw, rnd_n(6), 3);
+	put_bits(&bw, rnd(), 10);
+	put_bits(&bw, 0, 1);
+
+	put_bits(&bw, nas->len - 1, 12);
+	for (i = 0; i < nas->len; i++) {
+		put_bits(&bw, nas->data[i], 8);
+	}
+
+	/* CPICH Ec/N0 of the FDD cell and of up to 3 monitored cells */
+	put_bits(&bw, cells > 0, 1);
+	put_bits(&bw, 0, 1);
+	put_bits(&bw, 0, 2);
+	put_bits(&bw, rnd_range(20, 49), 6);
+	if (cells) {
+		put_bits(&bw, cells - 1, 3);
+		for (i = 0; i < cells; i++) {
+			put_bits(&bw, 0, 1);	/* sfn-SFN-ObsTimeDifference */
+			put_bits(&bw, 0, 1);
+			put_bits(&bw, 1, 1);	/* measurementQuantity */
+			put_bits(&bw, rnd_n(512), 9);
+			put_bits(&bw, 0, 2);
+			put_bits(&bw, rnd_range(10, 40), 6);
+		}
+	}
+
+	put_bits(&bw, 0, 1);	/* laterNonCriticalExtensions */
+	put_bits(&bw, 1, 1);	/* start-Value */
+	put_bits(&bw, rnd(), 20);
+
+	add_msg(gs, CH_RRC, 1, 0, 0, &b);
+}
+
+/* SecurityModeCommand starting ciphering and integrity protection,
+ * r3 with UEA1/UIA1 or r7 with UEA2/UIA2 */
+static void rrc_security_mode_command(struct gen_session *gs, int ps, int r7)
+{
+	struct gen_buf b;
+	struct gen_bits bw = { &b, 0 };
+	unsigned i, rbs = rnd_range(1, 4);
+
+	b.len = 0;
+	dcch_header(gs, &bw, 16);
+	put_bits(&bw, r7, 1);
+	if (r7) {
+		put_bits(&bw, rnd_n(4), 2);
+		put_bits(&bw, 0, 1);	/* r7 */
+		put_bits(&bw, 0, 1);	/* nonCriticalExtensions */
+		put_bits(&bw, 6, 3);	/* no ue-SystemSpecificSecurityCap */
+	} else {
+		put_bits(&bw, 0, 1);	/* laterNonCriticalExtensions */
+		put_bits(&bw, 7, 3);
+		put_bits(&bw, rnd_n(4), 2);
+	}
+
+	/* securityCapability, UEA0-2 and UIA1-2 */
+	put_bits(&bw, 0x0007, 16);
+	put_bits(&bw, 0x0003, 16);
+
+	/* cipheringModeInfo, activation times of the DL radio bearers */
+	put_bits(&bw, 1, 2);
+	if (r7) {
+		put_bits(&bw, 2, 2);
+	} else {
+		put_bits(&bw, 0, 1);
+		put_bits(&bw, 1, 1);
+	}
+	put_bits(&bw, rbs - 1, 5);
+	for (i = 0; i < rbs; i++) {
+		put_bits(&bw, i, 5);
+		put_bits(&bw, rnd_n(4096), 12);
+	}
+
+	/* integrityProtectionModeInfo, startIntegrityProtection */
+	put_bits(&bw, 1, 2);
+	put_bits(&bw, 0, 1);
+	put_bits(&bw, rnd(), 32);
+	put_bits(&bw, r7, 1);
+
+	put_bits(&bw, ps, 1);
+	if (!r7) {
+		/* GSM security capability, A5/1 and A5/3 */
+		put_bits(&bw, 0, 2);
+		put_bits(&bw, 0x05, 7);
+	}
+
+	add_msg(gs, CH_RRC, 0, 0, 0, &b);
+}
+
+/* NAS message, in a 3G session logged before (UL) or after (DL) its RRC PDU */
+static void nas(struct gen_session *gs, uint8_t ul, uint8_t sapi, const struct gen_buf *b)
+{
+	int ps = gs->scenario == SC_GPRS;
+
+	if (gs->rat != GEN_UMTS) {
+		add_msg(gs, CH_DTAP, ul, sapi, 0, b);
+		return;
+	}
+
+	if (ul) {
+		add_msg(gs, CH_DTAP, ul, sapi, 0, b);
+		if (!gs->nas_count) {
+			rrc_initial_direct_transfer(gs, ps, b);
+		} else {
+			rrc_direct_transfer(gs, 1, ps, b);
+		}
+	} else {
+		rrc_direct_transfer(gs, 0, ps, b);
+		add_msg(gs, CH_DTAP, ul, sapi, 0, b);
+	}
+	gs->nas_count++;
+}
+
+static void rr(struct gen_session *gs, uint8_t ul, uint8_t flags, const struct gen_buf *b)
+{
+	add_msg(gs, CH_RR, ul, 0, flags, b);
+	sacch(gs);
+}
+
+static void dtap(struct gen_session *gs, uint8_t ul, uint8_t sapi, const struct gen_buf *b)
+{
+	nas(gs, ul, sapi, b);
+	sacch(gs);
+}
+
+/* Short DTAP messages */
+static void dtap2(struct gen_session *gs, uint8_t ul, uint8_t pd, uint8_t mt)
+{
+	struct gen_buf b;
+
+	b.len = 0;
+	put8(&b, pd);
+	put8(&b, mt);
+	dtap(gs, ul, 0, &b);
+}
+
+static void put_classmark2(struct gen_buf *b)
+{
+	put8(b, 3);
+	put8(b, 0x57);
+	put8(b, 0x18);
+	put8(b, 0x81);
+}
+
+/* Channel request until the first UL message, RA establishment cause ra */
+static void establish(struct gen_session *gs, uint8_t ra, int paged)
+{
+	const struct gen_cell *c = gs->cell;
+	struct gen_buf b;
+
+	if (gs->rat == GEN_UMTS) {
+		rrc_opaque(gs, 1, 1, 3, rnd_range(8, 14));
+		rrc_opaque(gs, 0, 1, 3, rnd_range(30, 80));
+		rrc_opaque(gs, 1, 0, 18, rnd_range(20, 40));
+		return;
+	}
+
+	bcch_noise(gs);
+	paging_noise(gs);
+	if (paged) {
+		paging(gs, gs->sub);
+	}
+
+	b.len = 1;
+	put8(&b, GSM48_PDISC_RR);
+	put8(&b, GSM48_MT_RR_IMM_ASS);
+	put8(&b, 0x00);
+	put8(&b, 0x40 | gs->subch << 3 | gs->ts);
+	put8(&b, (c->bsic & 7) << 5 | c->arfcn >> 8);
+	put8(&b, c->arfcn & 0xff);
+	put8(&b, ra | rnd_n(32));
+	put16(&b, rnd());
+	put8(&b, rnd_n(64));
+	put8(&b, 0);
+	finish_l2(&b, b.len - 1);
+	add_msg(gs, CH_CCCH, 0, 0, GEN_F_AGCH, &b);
+}
+
+static void release(struct gen_session *gs)
+{
+	struct gen_buf b;
+
+	if (gs->rat == GEN_UMTS) {
+		rrc_opaque(gs, 0, 0, 15, rnd_range(4, 12));
+		rrc_opaque(gs, 1, 0, 17, rnd_range(2, 6));
+		return;
+	}
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_RR);
+	put8(&b, GSM48_MT_RR_CHAN_REL);
+	put8(&b, 0x00);
+	rr(gs, 0, 0, &b);
+}
+
+/* Authentication, then ciphering or security mode */
+static void security(struct gen_session *gs)
+{
+	struct gen_buf b;
+	uint8_t imeisv = rnd_pct(50);
+
+	if (rnd_pct(80)) {
+		b.len = 0;
+		put8(&b, GSM48_PDISC_MM);
+		put8(&b, GSM48_MT_MM_AUTH_REQ);
+		put8(&b, rnd_n(7));
+		put_rand(&b, 16);
+		if (gs->rat == GEN_UMTS) {
+			put8(&b, 0x20);
+			put8(&b, 16);
+			put_rand(&b, 16);
+		}
+		dtap(gs, 0, 0, &b);
+
+		b.len = 0;
+		put8(&b, GSM48_PDISC_MM);
+		put8(&b, GSM48_MT_MM_AUTH_RESP);
+		put_rand(&b, 4);
+		dtap(gs, 1, 0, &b);
+	}
+
+	if (!gs->a5) {
+		return;
+	}
+
+	if (gs->rat == GEN_UMTS) {
+		gs->integrity = 1;
+		rrc_security_mode_command(gs, gs->scenario == SC_GPRS, gs->a5 == 3);
+		rrc_opaque(gs, 1, 0, 20, rnd_range(2, 6));
+		return;
+	}
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_RR);
+	put8(&b, GSM48_MT_RR_CIPH_M_CMD);
+	put8(&b, imeisv << 4 | (gs->a5 - 1) << 1 | 1);
+	rr(gs, 0, GEN_F_CMC, &b);
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_RR);
+	put8(&b, GSM48_MT_RR_CIPH_M_COMPL);
+	if (imeisv) {
+		put8(&b, GSM48_IE_MOBILE_ID);
+		put_mi_imei(&b, gs->sub->imei, GSM_MI_TYPE_IMEISV);
+	}
+	rr(gs, 1, 0, &b);
+}
+
+static void assignment(struct gen_session *gs)
+{
+	const struct gen_cell *c = gs->cell;
+	struct gen_buf b;
+
+	if (gs->rat != GEN_GSM) {
+		return;
+	}
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_RR);
+	put8(&b, GSM48_MT_RR_ASS_CMD);
+	put8(&b, 0x08 | rnd_range(1, 7));
+	put8(&b, (c->bsic & 7) << 5 | c->arfcn >> 8);
+	put8(&b, c->arfcn & 0xff);
+	put8(&b, 0x00);
+	put8(&b, GSM48_IE_CHANMODE_1);
+	put8(&b, 0x01);
+	rr(gs, 0, GEN_F_ASSIGN, &b);
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_RR);
+	put8(&b, GSM48_MT_RR_ASS_COMPL);
+	put8(&b, 0x00);
+	rr(gs, 1, 0, &b);
+}
+
+static void cm_service_request(struct gen_session *gs, uint8_t type)
+{
+	struct gen_buf b;
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_MM);
+	put8(&b, GSM48_MT_MM_CM_SERV_REQ);
+	put8(&b, rnd_n(7) << 4 | type);
+	put_classmark2(&b);
+	put_mi_sub(&b, gs->sub);
+	dtap(gs, 1, 0, &b);
+}
+
+static void paging_response(struct gen_session *gs)
+{
+	struct gen_buf b;
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_RR);
+	put8(&b, GSM48_MT_RR_PAG_RESP);
+	put8(&b, rnd_n(7));
+	put_classmark2(&b);
+	put_mi_sub(&b, gs->sub);
+	if (gs->rat == GEN_GSM) {
+		rr(gs, 1, 0, &b);
+	} else {
+		dtap(gs, 1, 0, &b);
+	}
+}
+
+/* Mobile originated or terminated connection up to ciphering */
+static void cs_connect(struct gen_session *gs, uint8_t serv_type, uint8_t ra, int mt)
+{
+	establish(gs, ra, mt);
+
+	if (mt) {
+		paging_response(gs);
+	} else {
+		cm_service_request(gs, serv_type);
+	}
+
+	security(gs);
+
+	if (!mt && !gs->a5) {
+		dtap2(gs, 0, GSM48_PDISC_MM, GSM48_MT_MM_CM_SERV_ACC);
+	}
+}
+
+static void scenario_lu(struct gen_session *gs)
+{
+	struct gen_sub *sub = gs->sub;
+	struct gen_buf b;
+	uint32_t tmsi = 0;
+
+	establish(gs, 0x00, 0);
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_MM);
+	put8(&b, GSM48_MT_MM_LOC_UPD_REQUEST);
+	put8(&b, rnd_n(8) << 4 | rnd_n(3));
+	put_lai(&b, &cells[rnd_n(cell_count)]);
+	put8(&b, 0x57);
+	put_mi_sub(&b, sub);
+	dtap(gs, 1, 0, &b);
+
+	if (!sub->tmsi && rnd_pct(50)) {
+		b.len = 0;
+		put8(&b, GSM48_PDISC_MM);
+		put8(&b, GSM48_MT_MM_ID_REQ);
+		put8(&b, GSM_MI_TYPE_IMSI);
+		dtap(gs, 0, 0, &b);
+
+		b.len = 0;
+		put8(&b, GSM48_PDISC_MM);
+		put8(&b, GSM48_MT_MM_ID_RESP);
+		put_mi_imsi(&b, sub->imsi);
+		dtap(gs, 1, 0, &b);
+	}
+
+	if (rnd_pct(5)) {
+		b.len = 0;
+		put8(&b, GSM48_PDISC_MM);
+		put8(&b, GSM48_MT_MM_LOC_UPD_REJECT);
+		put8(&b, GSM48_REJECT_LOC_NOT_ALLOWED);
+		dtap(gs, 0, 0, &b);
+		release(gs);
+		return;
+	}
+
+	security(gs);
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_MM);
+	put8(&b, GSM48_MT_MM_LOC_UPD_ACCEPT);
+	put_lai(&b, gs->cell);
+	if (rnd_pct(70)) {
+		tmsi = rnd() | 1;
+		put8(&b, GSM48_IE_MOBILE_ID);
+		put_mi_tmsi(&b, tmsi);
+	}
+	dtap(gs, 0, 0, &b);
+
+	if (tmsi) {
+		dtap2(gs, 1, GSM48_PDISC_MM, GSM48_MT_MM_TMSI_REALL_COMPL);
+		sub->tmsi = tmsi;
+	}
+
+	release(gs);
+}
+
+static void scenario_call(struct gen_session *gs)
+{
+	struct gen_buf b;
+	char number[16];
+	uint8_t ti = rnd_n(7) << 4;
+	int mt = rnd_pct(50);
+	/* TI flag of the messages of either side */
+	uint8_t ti_ms = mt ? ti | 0x80 : ti;
+	uint8_t ti_net = mt ? ti : ti | 0x80;
+
+	cs_connect(gs, GSM48_CMSERV_MO_CALL_PACKET, 0xe0, mt);
+
+	rnd_digits(number, rnd_range(9, 12));
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_CC | (mt ? ti_net : ti_ms));
+	put8(&b, GSM48_MT_CC_SETUP);
+	put8(&b, GSM48_IE_BEARER_CAP);
+	put8(&b, 1);
+	put8(&b, 0xa0);
+	if (mt) {
+		put8(&b, GSM48_IE_CALLING_BCD);
+		put_bcd_lv(&b, 0x91, number);
+	} else {
+		put8(&b, GSM48_IE_CALLED_BCD);
+		put_bcd_lv(&b, 0x81, number);
+	}
+	dtap(gs, !mt, 0, &b);
+
+	if (mt) {
+		dtap2(gs, 1, GSM48_PDISC_CC | ti_ms, GSM48_MT_CC_CALL_CONF);
+	} else {
+		dtap2(gs, 0, GSM48_PDISC_CC | ti_net, GSM48_MT_CC_CALL_PROC);
+	}
+
+	assignment(gs);
+
+	dtap2(gs, mt, GSM48_PDISC_CC | (mt ? ti_ms : ti_net), GSM48_MT_CC_ALERTING);
+	dtap2(gs, mt, GSM48_PDISC_CC | (mt ? ti_ms : ti_net), GSM48_MT_CC_CONNECT);
+	dtap2(gs, !mt, GSM48_PDISC_CC | (mt ? ti_net : ti_ms), GSM48_MT_CC_CONNECT_ACK);
+
+	/* Either side hangs up */
+	if (rnd_pct(50)) {
+		b.len = 0;
+		put8(&b, GSM48_PDISC_CC | ti_ms);
+		put8(&b, GSM48_MT_CC_DISCONNECT);
+		put8(&b, 2);
+		put8(&b, 0xe0);
+		put8(&b, 0x90);
+		dtap(gs, 1, 0, &b);
+		dtap2(gs, 0, GSM48_PDISC_CC | ti_net, GSM48_MT_CC_RELEASE);
+		dtap2(gs, 1, GSM48_PDISC_CC | ti_ms, GSM48_MT_CC_RELEASE_COMPL);
+	} else {
+		b.len = 0;
+		put8(&b, GSM48_PDISC_CC | ti_net);
+		put8(&b, GSM48_MT_CC_DISCONNECT);
+		put8(&b, 2);
+		put8(&b, 0xe0);
+		put8(&b, 0x90);
+		dtap(gs, 0, 0, &b);
+		dtap2(gs, 1, GSM48_PDISC_CC | ti_ms, GSM48_MT_CC_RELEASE);
+		dtap2(gs, 0, GSM48_PDISC_CC | ti_net, GSM48_MT_CC_RELEASE_COMPL);
+	}
+
+	release(gs);
+}
+
+static const char *words[] = {
+	"ok", "see", "you", "at", "home", "later", "call", "me", "when", "you",
+	"are", "back", "the", "meeting", "is", "moved", "to", "tomorrow", "thanks",
+	"on", "my", "way", "running", "late", "sorry", "dinner", "tonight", "?",
+};
+
+static void put_user_data(struct gen_buf *b)
+{
+	char text[161];
+	uint8_t ud[140];
+	unsigned len = 0, target = rnd_range(10, 150), w;
+	int octets, septets;
+
+	text[0] = 0;
+	while (len < target) {
+		w = rnd_n(sizeof(words) / sizeof(words[0]));
+		if (len + strlen(words[w]) + 1 > 160) {
+			break;
+		}
+		if (len) {
+			text[len++] = ' ';
+		}
+		strcpy(&text[len], words[w]);
+		len += strlen(words[w]);
+	}
+
+	septets = gsm_7bit_encode_n(ud, sizeof(ud), text, &octets);
+	put8(b, septets);
+	put(b, ud, octets);
+}
+
+/* OTA command for the SIM, class 2 with a security header */
+static void put_ota_data(struct gen_buf *b)
+{
+	unsigned len = rnd_range(24, 100);
+
+	put8(b, len + 3);
+	put8(b, 0x02);		/* UDH length */
+	put8(b, 0x70);		/* command packet */
+	put8(b, 0x00);
+	put16(b, len - 2);
+	put8(b, 0x15);
+	put8(b, 0x16);
+	put8(b, 0x21);
+	put8(b, 0x25);
+	put8(b, 0x25);
+	put_rand(b, len - 7);
+}
+
+static void put_tpdu(struct gen_buf *b, int mt, const char *addr)
+{
+	struct gen_buf tpdu;
+	int ota = mt && rnd_pct(10);
+
+	tpdu.len = 0;
+	if (mt) {
+		put8(&tpdu, ota ? 0x44 : 0x04);
+		put_tp_addr(&tpdu, 0x91, addr);
+		put8(&tpdu, ota ? 0x7f : 0x00);
+		put8(&tpdu, ota ? 0xf6 : 0x00);
+		put8(&tpdu, bcd_swap(21));
+		put8(&tpdu, bcd_swap(rnd_range(1, 12)));
+		put8(&tpdu, bcd_swap(rnd_range(1, 28)));
+		put8(&tpdu, bcd_swap(rnd_n(24)));
+		put8(&tpdu, bcd_swap(rnd_n(60)));
+		put8(&tpdu, bcd_swap(rnd_n(60)));
+		put8(&tpdu, 0x40);
+	} else {
+		put8(&tpdu, 0x11);
+		put8(&tpdu, rnd());
+		put_tp_addr(&tpdu, 0x91, addr);
+		put8(&tpdu, 0x00);
+		put8(&tpdu, 0x00);
+		put8(&tpdu, 0xa7);
+	}
+	if (ota) {
+		put_ota_data(&tpdu);
+	} else {
+		put_user_data(&tpdu);
+	}
+
+	put8(b, tpdu.len);
+	put(b, tpdu.data, tpdu.len);
+}
+
+static void scenario_sms(struct gen_session *gs)
+{
+	struct gen_buf b, rp;
+	char smsc[16], addr[16];
+	uint8_t ti = rnd_n(7) << 4;
+	uint8_t ref = rnd();
+	int mt = rnd_pct(50);
+	uint8_t ti_ms = mt ? ti | 0x80 : ti;
+	uint8_t ti_net = mt ? ti : ti | 0x80;
+
+	cs_connect(gs, GSM48_CMSERV_SMS, 0x10, mt);
+
+	rnd_digits(smsc, 11);
+	rnd_digits(addr, rnd_range(9, 12));
+
+	/* RP-DATA */
+	rp.len = 0;
+	if (mt) {
+		put8(&rp, GSM411_MT_RP_DATA_MT);
+		put8(&rp, ref);
+		put_bcd_lv(&rp, 0x91, smsc);
+		put8(&rp, 0);
+	} else {
+		put8(&rp, GSM411_MT_RP_DATA_MO);
+		put8(&rp, ref);
+		put8(&rp, 0);
+		put_bcd_lv(&rp, 0x91, smsc);
+	}
+	put_tpdu(&rp, mt, addr);
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_SMS | (mt ? ti_net : ti_ms));
+	put8(&b, GSM411_MT_CP_DATA);
+	put8(&b, rp.len);
+	put(&b, rp.data, rp.len);
+	dtap(gs, !mt, 3, &b);
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_SMS | (mt ? ti_ms : ti_net));
+	put8(&b, GSM411_MT_CP_ACK);
+	dtap(gs, mt, 3, &b);
+
+	/* RP-ACK */
+	b.len = 0;
+	put8(&b, GSM48_PDISC_SMS | (mt ? ti_ms : ti_net));
+	put8(&b, GSM411_MT_CP_DATA);
+	put8(&b, 2);
+	put8(&b, mt ? GSM411_MT_RP_ACK_MO : GSM411_MT_RP_ACK_MT);
+	put8(&b, ref);
+	dtap(gs, mt, 3, &b);
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_SMS | (mt ? ti_net : ti_ms));
+	put8(&b, GSM411_MT_CP_ACK);
+	dtap(gs, !mt, 3, &b);
+
+	release(gs);
+}
+
+static void put_rai(struct gen_buf *b, const struct gen_cell *c)
+{
+	put_lai(b, c);
+	put8(b, c->rac);
+}
+
+static void scenario_gprs(struct gen_session *gs)
+{
+	struct gen_sub *sub = gs->sub;
+	struct gen_buf b;
+	uint8_t ref = rnd_n(16);
+	uint8_t ti = rnd_n(7) << 4;
+	/* Routing area update once there is a P-TMSI */
+	int rau = sub->ptmsi && rnd_pct(50);
+	uint32_t ptmsi;
+
+	bcch_noise(gs);
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_MM_GPRS);
+	if (rau) {
+		put8(&b, GMM_RA_UPD_REQ);
+		put8(&b, rnd_n(8) << 4 | rnd_n(2));
+		put_rai(&b, &cells[rnd_n(cell_count)]);
+		put8(&b, 8);
+		put_rand(&b, 8);
+	} else {
+		put8(&b, GMM_ATTACH_REQ);
+		put8(&b, 2);
+		put8(&b, 0xe5);
+		put8(&b, 0xe0);
+		put8(&b, rnd_n(8) << 4 | (rnd_pct(50) ? 1 : 3));
+		put16(&b, 0x0a00);
+		if (sub->ptmsi) {
+			put_mi_tmsi(&b, sub->ptmsi);
+		} else {
+			put_mi_imsi(&b, sub->imsi);
+		}
+		put_rai(&b, &cells[rnd_n(cell_count)]);
+		put8(&b, 8);
+		put_rand(&b, 8);
+	}
+	dtap(gs, 1, 0, &b);
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_MM_GPRS);
+	put8(&b, GMM_AUTH_CIPH_REQ);
+	put8(&b, 0x10 | gs->a5);
+	put8(&b, ref);
+	put8(&b, 0x21);
+	put_rand(&b, 16);
+	put8(&b, 0x80 | rnd_n(7));
+	dtap(gs, 0, 0, &b);
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_MM_GPRS);
+	put8(&b, GMM_AUTH_CIPH_RESP);
+	put8(&b, ref);
+	put8(&b, 0x22);
+	put_rand(&b, 4);
+	put8(&b, 0x23);
+	put_mi_imei(&b, sub->imei, GSM_MI_TYPE_IMEISV);
+	dtap(gs, 1, 0, &b);
+
+	ptmsi = rnd() | 0xc0000000;
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_MM_GPRS);
+	if (rau) {
+		put8(&b, GMM_RA_UPD_ACCEPT);
+		put8(&b, 0x00);
+		put8(&b, 0x49);
+	} else {
+		put8(&b, GMM_ATTACH_ACCEPT);
+		put8(&b, 0x01);
+		put8(&b, 0x49);
+		put8(&b, 0x44);
+	}
+	put_rai(&b, gs->cell);
+	put8(&b, 0x18);
+	put_mi_tmsi(&b, ptmsi);
+	dtap(gs, 0, 0, &b);
+
+	dtap2(gs, 1, GSM48_PDISC_MM_GPRS, rau ? GMM_RA_UPD_COMPLETE : GMM_ATTACH_COMPLETE);
+	sub->ptmsi = ptmsi;
+
+	if (rau || !rnd_pct(50)) {
+		return;
+	}
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_SM_GPRS | ti);
+	put8(&b, SM_ACT_PDP_REQ);
+	put8(&b, 0x05);
+	put8(&b, 0x03);
+	put8(&b, 3);
+	put8(&b, 0x13);
+	put8(&b, 0x92);
+	put8(&b, 0x1f);
+	put8(&b, 2);
+	put8(&b, 0x01);
+	put8(&b, 0x21);
+	put8(&b, 0x28);
+	put8(&b, 9);
+	put8(&b, 8);
+	put(&b, "internet", 8);
+	dtap(gs, 1, 0, &b);
+
+	b.len = 0;
+	put8(&b, GSM48_PDISC_SM_GPRS | ti | 0x80);
+	put8(&b, SM_ACT_PDP_ACCEPT);
+	put8(&b, 0x03);
+	put8(&b, 3);
+	put8(&b, 0x13);
+	put8(&b, 0x92);
+	put8(&b, 0x1f);
+	put8(&b, 0x04);
+	put8(&b, 0x2b);
+	put8(&b, 6);
+	put8(&b, 0x01);
+	put8(&b, 0x21);
+	put8(&b, 10);
+	put_rand(&b, 3);
+	dtap(gs, 0, 0, &b);
+}
+
+/* LTE NAS, plain or with security header and sequence number */
+static void emm(struct gen_session *gs, uint8_t ul, uint8_t sec, const struct gen_buf *inner)
+{
+	static uint8_t sqn[2];
+	struct gen_buf b;
+
+	b.len = 0;
+	if (sec) {
+		put8(&b, sec << 4 | 0x07);
+		put_rand(&b, 4);
+		put8(&b, sqn[ul]++);
+	}
+	put(&b, inner->data, inner->len);
+
+	add_msg(gs, CH_EMM, ul, 0, sec ? GEN_F_PROT : 0, &b);
+}
+
+static void scenario_lte(struct gen_session *gs)
+{
+	struct gen_buf b;
+	uint8_t eea = gs->a5 ? rnd_range(1, 2) : 0;
+	uint8_t sec;
+
+	b.len = 0;
+	put8(&b, 0x07);
+	put8(&b, 0x41);
+	put8(&b, 0x71);
+	put_mi_imsi(&b, gs->sub->imsi);
+	put8(&b, 2);
+	put8(&b, 0xe0);
+	put8(&b, 0xe0);
+	put16(&b, 4);
+	put8(&b, 0x02);
+	put8(&b, 0x01);
+	put8(&b, 0xd0);
+	put8(&b, 0x11);
+	emm(gs, 1, 0, &b);
+
+	b.len = 0;
+	put8(&b, 0x07);
+	put8(&b, 0x52);
+	put8(&b, rnd_n(7));
+	put_rand(&b, 16);
+	put8(&b, 16);
+	put_rand(&b, 16);
+	emm(gs, 0, 0, &b);
+
+	b.len = 0;
+	put8(&b, 0x07);
+	put8(&b, 0x53);
+	put8(&b, 8);
+	put_rand(&b, 8);
+	emm(gs, 1, 0, &b);
+
+	b.len = 0;
+	put8(&b, 0x07);
+	put8(&b, 0x5d);
+	put8(&b, eea << 4 | 2);
+	put8(&b, rnd_n(7));
+	put8(&b, 2);
+	put8(&b, 0xe0);
+	put8(&b, 0xe0);
+	emm(gs, 0, 3, &b);
+
+	b.len = 0;
+	put8(&b, 0x07);
+	put8(&b, 0x5e);
+	emm(gs, 1, 4, &b);
+
+	/* Attach accept and complete, ciphered unless EEA0 */
+	sec = 2;
+	b.len = 0;
+	if (!eea) {
+		put8(&b, 0x07);
+		put8(&b, 0x42);
+	}
+	put_rand(&b, rnd_range(40, 90));
+	emm(gs, 0, sec, &b);
+
+	b.len = 0;
+	if (!eea) {
+		put8(&b, 0x07);
+		put8(&b, 0x43);
+	}
+	put_rand(&b, rnd_range(8, 12));
+	emm(gs, 1, sec, &b);
+}
+
+static int scenario_allowed(unsigned sc)
+{
+	switch (format) {
+	case FMT_PCAP:
+		return sc != SC_GPRS && sc != SC_LTE;
+	case FMT_BURST:
+		return sc == SC_LU || sc == SC_CALL || sc == SC_SMS;
+	default:
+		return 1;
+	}
+}
+
+static void build_session(struct gen_session *gs, uint32_t id)
+{
+	unsigned w[SC_COUNT];
+	unsigned i, inner;
+
+	for (i = 0; i < SC_COUNT; i++) {
+		w[i] = scenario_allowed(i) ? weights[i] : 0;
+	}
+
+	gs->id = id;
+	gs->scenario = rnd_weighted(w, SC_COUNT);
+	gs->cell = &cells[rnd_n(cell_count)];
+	gs->sub = &subs[rnd_n(GEN_SUBSCRIBERS)];
+	gs->ts = rnd_range(1, 7);
+	gs->subch = rnd_n(8);
+	gs->integrity = 0;
+	gs->rrc_sn = rnd_n(16);
+	gs->nas_count = 0;
+	gs->count = 0;
+	for (i = 0; i < 8; i++) {
+		gs->kc[i] = rnd();
+	}
+
+	gs->a5 = 0;
+	if (rnd_pct(cipher_pct)) {
+		gs->a5 = 1 + rnd_weighted(&a5_weights[1], 3);
+		/* No A5/3 keystream for bursts */
+		if (format == FMT_BURST && gs->a5 == 3) {
+			gs->a5 = 1;
+		}
+		ciphered_count++;
+	}
+
+	scenario_count[gs->scenario]++;
+
+	switch (gs->scenario) {
+	case SC_LU:
+		gs->rat = GEN_GSM;
+		scenario_lu(gs);
+		break;
+	case SC_CALL:
+		gs->rat = GEN_GSM;
+		scenario_call(gs);
+		break;
+	case SC_SMS:
+		gs->rat = GEN_GSM;
+		scenario_sms(gs);
+		break;
+	case SC_GPRS:
+		gs->rat = GEN_GSM;
+		scenario_gprs(gs);
+		break;
+	case SC_RRC:
+		gs->rat = GEN_UMTS;
+		inner = (weights[SC_LU] + weights[SC_CALL] + weights[SC_SMS]) ? rnd_weighted(weights, 3) : SC_LU;
+		switch (inner) {
+		case SC_CALL:
+			scenario_call(gs);
+			break;
+		case SC_SMS:
+			scenario_sms(gs);
+			break;
+		default:
+			scenario_lu(gs);
+		}
+		break;
+	default:
+		gs->rat = GEN_LTE;
+		scenario_lte(gs);
+	}
+}
+
+/* L2 framing of a session's messages as the phone's L1 sees them */
+
+static void lapdm_iframes(struct gen_lapdm *l, const struct gen_session *gs, const struct gen_msg *m,
+			  frame_cb cb, void *arg)
+{
+	uint8_t frame[23];
+	unsigned kind = l->facch ? K_FACCH : K_SDCCH;
+	unsigned off = 0, seg;
+	uint8_t ul = m->ul;
+	uint8_t sapi = m->sapi == 3;
+	uint8_t addr = m->sapi << 2 | (ul ? 0x01 : 0x03);
+
+	/* SABM with the first L3 message for SAPI 0, else empty, and UA */
+	if (!l->est[sapi]) {
+		l->est[sapi] = 1;
+		l->vs[0][sapi] = l->vs[1][sapi] = 0;
+
+		seg = sapi ? 0 : m->b.len;
+		if (seg > 20) {
+			seg = 20;
+		}
+		memset(frame, 0x2b, sizeof(frame));
+		frame[0] = addr;
+		frame[1] = 0x3f;
+		frame[2] = seg << 2 | 1;
+		memcpy(&frame[3], m->b.data, seg);
+		cb(arg, gs, m, kind, ul, frame, 23, l->ciphered);
+
+		memset(frame, 0x2b, sizeof(frame));
+		frame[0] = m->sapi << 2 | 0x01;
+		frame[1] = 0x73;
+		frame[2] = 0x01;
+		cb(arg, gs, m, kind, !ul, frame, 23, l->ciphered);
+
+		if (seg == m->b.len) {
+			return;
+		}
+	}
+
+	while (off < m->b.len) {
+		seg = m->b.len - off;
+		if (seg > 20) {
+			seg = 20;
+		}
+		memset(frame, 0x2b, sizeof(frame));
+		frame[0] = addr;
+		frame[1] = l->vs[!ul][sapi] << 5 | l->vs[ul][sapi] << 1;
+		frame[2] = seg << 2 | (off + seg < m->b.len) << 1 | 1;
+		memcpy(&frame[3], &m->b.data[off], seg);
+		cb(arg, gs, m, kind, ul, frame, 23, l->ciphered);
+
+		l->vs[ul][sapi] = (l->vs[ul][sapi] + 1) % 8;
+		off += seg;
+	}
+}
+
+static void session_frames(const struct gen_session *gs, frame_cb cb, void *arg)
+{
+	struct gen_lapdm l;
+	const struct gen_msg *m;
+	uint8_t frame[23];
+	unsigned i;
+
+	memset(&l, 0, sizeof(l));
+
+	for (i = 0; i < gs->count; i++) {
+		m = &gs->msgs[i];
+
+		switch (m->chan) {
+		case CH_BCCH:
+			cb(arg, gs, m, K_BCCH, 0, m->b.data, m->b.len, 0);
+			break;
+		case CH_CCCH:
+			cb(arg, gs, m, (m->flags & GEN_F_AGCH) ? K_AGCH : K_PCH, 0, m->b.data, m->b.len, 0);
+			break;
+		case CH_SACCH:
+			memset(frame, 0x2b, sizeof(frame));
+			frame[0] = 0x05;
+			frame[1] = rnd_n(64);
+			frame[2] = m->ul ? 0x01 : 0x03;
+			frame[3] = 0x03;
+			frame[4] = m->b.len << 2 | 1;
+			memcpy(&frame[5], m->b.data, m->b.len);
+			cb(arg, gs, m, K_SACCH, m->ul, frame, 23, l.ciphered);
+			break;
+		case CH_RR:
+		case CH_DTAP:
+			if (gs->rat != GEN_GSM) {
+				break;
+			}
+			lapdm_iframes(&l, gs, m, cb, arg);
+			if (m->flags & GEN_F_CMC) {
+				l.ciphered = 1;
+			}
+			if (m->flags & GEN_F_ASSIGN) {
+				memset(l.est, 0, sizeof(l.est));
+				l.facch = 1;
+			}
+			break;
+		case CH_RRC:
+			cb(arg, gs, m, K_RRC, m->ul, m->b.data, m->b.len, 0);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/* Output */
+
+static void write_out(const void *data, size_t len)
+{
+	if (fwrite(data, 1, len, out) != len) {
+		err(1, "Cannot write output");
+	}
+	out_bytes += len;
+}
+
+static void advance_time(unsigned min_ms, unsigned max_ms)
+{
+	now_us += rnd_range(min_ms * 1000, max_ms * 1000);
+}
+
+static uint32_t now_fn()
+{
+	return (now_us / 4615) % GSM_MAX_FN;
+}
+
+/* DIAG */
+
+static void crc_init()
+{
+	unsigned i, j;
+	uint16_t crc;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++) {
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+		}
+		crc_table[i] = crc;
+	}
+}
+
+static uint16_t crc16(const uint8_t *data, unsigned len)
+{
+	uint16_t crc = 0xffff;
+
+	while (len--) {
+		crc = (crc >> 8) ^ crc_table[(crc ^ *data++) & 0xff];
+	}
+
+	return crc ^ 0xffff;
+}
+
+static void diag_frame(uint16_t proto, uint8_t type, uint8_t subtype, uint8_t data_len,
+		       unsigned pad, const uint8_t *data, unsigned len)
+{
+	uint8_t raw[32 + 2 * GEN_MSG_MAX];
+	uint8_t esc[2 * sizeof(raw) + 1];
+	uint64_t ts;
+	uint16_t crc;
+	unsigned n = 0, i, e = 0, inner;
+
+	/* 1.25 ms ticks since the GPS epoch, above 16 bits of chips */
+	ts = ((now_us / 1000 - (GPS_EPOCH * 1000)) * 4 / 5) << 16;
+	inner = 15 + pad + len;
+
+	raw[n++] = 0x10;
+	raw[n++] = 0x00;
+	raw[n++] = inner & 0xff;
+	raw[n++] = inner >> 8;
+	raw[n++] = inner & 0xff;
+	raw[n++] = inner >> 8;
+	raw[n++] = proto & 0xff;
+	raw[n++] = proto >> 8;
+	for (i = 0; i < 8; i++) {
+		raw[n++] = ts >> (8 * i);
+	}
+	raw[n++] = type;
+	raw[n++] = subtype;
+	raw[n++] = data_len;
+	memset(&raw[n], 0, pad);
+	n += pad;
+	memcpy(&raw[n], data, len);
+	n += len;
+
+	crc = crc16(raw, n);
+	raw[n++] = crc & 0xff;
+	raw[n++] = crc >> 8;
+
+	for (i = 0; i < n; i++) {
+		if (raw[i] == 0x7e || raw[i] == 0x7d) {
+			esc[e++] = 0x7d;
+			esc[e++] = raw[i] ^ 0x20;
+		} else {
+			esc[e++] = raw[i];
+		}
+	}
+	esc[e++] = 0x7e;
+
+	write_out(esc, e);
+	out_frames++;
+}
+
+static void write_diag_session(const struct gen_session *gs)
+{
+	const struct gen_msg *m;
+	unsigned i;
+
+	for (i = 0; i < gs->count; i++) {
+		m = &gs->msgs[i];
+		advance_time(20, 400);
+
+		switch (m->chan) {
+		case CH_BCCH:
+			diag_frame(0x512f, 129, m->b.data[2], 23, 0, m->b.data, m->b.len);
+			break;
+		case CH_CCCH:
+			diag_frame(0x512f, 131, m->b.data[2], 23, 0, m->b.data, m->b.len);
+			break;
+		case CH_RR:
+			diag_frame(0x512f, m->ul ? 0 : 128, m->b.data[1], m->b.len, 0, m->b.data, m->b.len);
+			break;
+		case CH_SACCH:
+			diag_frame(0x512f, m->ul ? 4 : 132, m->b.data[1], m->b.len, 0, m->b.data, m->b.len);
+			break;
+		case CH_DTAP:
+			diag_frame(0x713a, m->ul, m->b.len, 0, 2, m->b.data, m->b.len);
+			break;
+		case CH_RRC:
+			diag_frame(0x412f, ((m->flags & GEN_F_CCCH) ? 0 : 1) + (m->ul ? 0 : 2), 0, 0, 1, m->b.data, m->b.len);
+			break;
+		case CH_EMM:
+			diag_frame(0xb0e0 + ((m->flags & GEN_F_PROT) ? 0x0a : 0x0c) + m->ul, 0, 0, 0, 1, m->b.data, m->b.len);
+			break;
+		}
+	}
+}
+
+/* GSMTAP pcap */
+
+static void pcap_header()
+{
+	uint32_t hdr[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1 };
+
+	write_out(hdr, sizeof(hdr));
+}
+
+static uint16_t ip_checksum(const uint8_t *data, unsigned len)
+{
+	uint32_t sum = 0;
+	unsigned i;
+
+	for (i = 0; i < len; i += 2) {
+		sum += data[i] << 8 | data[i+1];
+	}
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+
+	return ~sum;
+}
+
+static void pcap_frame(void *arg __attribute__((unused)), const struct gen_session *gs,
+		       const struct gen_msg *m, unsigned kind, uint8_t ul, const uint8_t *frame,
+		       unsigned len, int ciphered __attribute__((unused)))
+{
+	uint8_t pkt[14 + 20 + 8 + sizeof(struct gsmtap_hdr) + GEN_MSG_MAX];
+	uint32_t rec[4];
+	struct gsmtap_hdr *gh;
+	uint8_t *ip = &pkt[14], *udp = &pkt[34];
+	unsigned n = 14 + 20 + 8 + sizeof(*gh) + len;
+	uint16_t csum;
+
+	advance_time(20, 400);
+
+	memset(pkt, 0, 42);
+	pkt[12] = 0x08;
+
+	ip[0] = 0x45;
+	ip[2] = (n - 14) >> 8;
+	ip[3] = (n - 14) & 0xff;
+	ip[4] = ip_id >> 8;
+	ip[5] = ip_id++ & 0xff;
+	ip[6] = 0x40;
+	ip[8] = 64;
+	ip[9] = 0x11;
+	ip[12] = ip[16] = 127;
+	ip[15] = ip[19] = 1;
+	csum = ip_checksum(ip, 20);
+	ip[10] = csum >> 8;
+	ip[11] = csum & 0xff;
+
+	udp[0] = 0xc3;
+	udp[1] = 0x50;
+	udp[2] = GSMTAP_UDP_PORT >> 8;
+	udp[3] = GSMTAP_UDP_PORT & 0xff;
+	udp[4] = (n - 34) >> 8;
+	udp[5] = (n - 34) & 0xff;
+
+	gh = (struct gsmtap_hdr *) &pkt[42];
+	memset(gh, 0, sizeof(*gh));
+	gh->version = GSMTAP_VERSION;
+	gh->hdr_len = sizeof(*gh) / 4;
+	gh->type = GSMTAP_TYPE_UM;
+	gh->arfcn = htons(gs->cell->arfcn | (ul ? GSMTAP_ARFCN_F_UPLINK : 0));
+	gh->signal_dbm = -50 - (int) rnd_n(50);
+	gh->frame_number = htonl(now_fn());
+
+	switch (kind) {
+	case K_BCCH:
+		gh->sub_type = GSMTAP_CHANNEL_BCCH;
+		break;
+	case K_PCH:
+		gh->sub_type = GSMTAP_CHANNEL_PCH;
+		break;
+	case K_AGCH:
+		gh->sub_type = GSMTAP_CHANNEL_AGCH;
+		break;
+	case K_SDCCH:
+		gh->sub_type = GSMTAP_CHANNEL_SDCCH8;
+		gh->timeslot = gs->ts;
+		gh->sub_slot = gs->subch;
+		break;
+	case K_SACCH:
+		gh->sub_type = GSMTAP_CHANNEL_SDCCH8 | GSMTAP_CHANNEL_ACCH;
+		gh->timeslot = gs->ts;
+		gh->sub_slot = gs->subch;
+		break;
+	case K_FACCH:
+		gh->sub_type = GSMTAP_CHANNEL_TCH_F;
+		gh->timeslot = gs->ts;
+		break;
+	default:
+		gh->type = GSMTAP_TYPE_UMTS_RRC;
+		gh->arfcn = htons(gs->cell->arfcn * 5 + 10000);
+		if (m->flags & GEN_F_CCCH) {
+			gh->sub_type = ul ? GSMTAP_RRC_SUB_UL_CCCH_Message : GSMTAP_RRC_SUB_DL_CCCH_Message;
+		} else {
+			gh->sub_type = ul ? GSMTAP_RRC_SUB_UL_DCCH_Message : GSMTAP_RRC_SUB_DL_DCCH_Message;
+		}
+	}
+
+	memcpy(&pkt[42 + sizeof(*gh)], frame, len);
+
+	rec[0] = now_us / 1000000;
+	rec[1] = now_us % 1000000;
+	rec[2] = rec[3] = n;
+	write_out(rec, sizeof(rec));
+	write_out(pkt, n);
+	out_frames++;
+}
+
+/* Bursts, SDCCH frames of lane_count sessions side by side */
+
+struct lane {
+	struct gen_session s;
+	int active;
+	uint8_t chan_nr;
+	unsigned count;
+	unsigned next;
+	uint8_t ul[GEN_MAX_FRAMES];
+	uint8_t ciphered[GEN_MAX_FRAMES];
+	uint8_t frame[GEN_MAX_FRAMES][23];
+};
+
+static void lane_frame(void *arg, const struct gen_session *gs,
+		       const struct gen_msg *m __attribute__((unused)), unsigned kind, uint8_t ul,
+		       const uint8_t *frame, unsigned len __attribute__((unused)), int ciphered)
+{
+	struct lane *l = arg;
+
+	/* Calls stay on the SDCCH, bursts of SACCH and TCH are not generated */
+	if (kind != K_SDCCH && kind != K_FACCH) {
+		return;
+	}
+
+	if (l->count == GEN_MAX_FRAMES) {
+		errx(1, "Too many frames in session %u", gs->id);
+	}
+
+	memcpy(l->frame[l->count], frame, 23);
+	l->ul[l->count] = ul;
+	l->ciphered[l->count] = ciphered;
+	l->count++;
+}
+
+static void write_key(const struct gen_session *gs)
+{
+	if (!key_out || !gs->a5) {
+		return;
+	}
+
+	fprintf(key_out, "%u %s\n", gs->id, osmo_hexdump_nospc(gs->kc, 8));
+}
+
+/* Flip bits at geometric distances, ber_permille on average */
+static uint64_t next_error;
+
+static uint64_t error_gap()
+{
+	double u = (rnd() >> 11) * (1.0 / 9007199254740992.0);
+
+	if (u <= 0) {
+		u = 1e-300;
+	}
+
+	return log(u) / log(1.0 - ber_permille / 1000.0);
+}
+
+static void add_bit_errors(uint8_t *bits)
+{
+	unsigned i = 0;
+
+	if (!ber_permille) {
+		return;
+	}
+
+	while (i + next_error < BURST_BITS) {
+		i += next_error;
+		bits[i / 8] ^= 0x80 >> (i % 8);
+		bit_errors++;
+		i++;
+		next_error = error_gap();
+	}
+	next_error -= BURST_BITS - i;
+}
+
+static void write_bursts(uint32_t *next_id, uint64_t max_sessions, uint64_t max_bytes)
+{
+	static struct lane lanes[GEN_MAX_LANES];
+	static uint8_t bursts[GEN_MAX_LANES][4*BURST_BYTES];
+	const uint8_t *keys[4*GEN_MAX_LANES];
+	uint32_t fns[4*GEN_MAX_LANES];
+	uint8_t dl[4*GEN_MAX_LANES*BURST_BYTES], ul[4*GEN_MAX_LANES*BURST_BYTES];
+	unsigned lane_idx[4*GEN_MAX_LANES];
+	struct burst_record rec;
+	uint64_t sessions = 0;
+	uint32_t fn;
+	unsigned i, j, k, n, a5, active;
+	struct lane *l;
+
+	fn = rnd_n(GSM_MAX_FN / 51) * 51;
+	next_error = ber_permille ? error_gap() : 0;
+
+	for (i = 0; i < lane_count; i++) {
+		lanes[i].active = 0;
+		lanes[i].chan_nr = 0x40 | (i % 8) << 3 | (i / 8) % 8;
+	}
+
+	do {
+		/* Sessions for free lanes */
+		for (i = 0; i < lane_count; i++) {
+			l = &lanes[i];
+			while (!l->active && sessions < max_sessions && out_bytes < max_bytes) {
+				build_session(&l->s, (*next_id)++);
+				sessions++;
+				write_key(&l->s);
+				l->count = l->next = 0;
+				session_frames(&l->s, lane_frame, l);
+				l->active = l->count > 0;
+			}
+		}
+
+		/* Encode one block per lane */
+		active = 0;
+		for (i = 0; i < lane_count; i++) {
+			l = &lanes[i];
+			if (l->active) {
+				encode_signalling_packed(l->frame[l->next], bursts[i]);
+				active++;
+			}
+		}
+		if (!active) {
+			break;
+		}
+
+		/* Keystreams of the ciphered blocks, one run per algorithm */
+		for (a5 = 1; a5 <= 2; a5++) {
+			n = 0;
+			for (i = 0; i < lane_count; i++) {
+				l = &lanes[i];
+				if (!l->active || !l->ciphered[l->next] || l->s.a5 != a5) {
+					continue;
+				}
+				for (j = 0; j < 4; j++) {
+					keys[n] = l->s.kc;
+					fns[n] = (fn + (i % 8) * 4 + j) % GSM_MAX_FN;
+					lane_idx[n] = i;
+					n++;
+				}
+			}
+			if (!n) {
+				continue;
+			}
+			osmo_a5_bulk(a5, keys, fns, n, dl, ul);
+			for (k = 0; k < n; k++) {
+				i = lane_idx[k];
+				l = &lanes[i];
+				for (j = 0; j < BURST_BYTES; j++) {
+					bursts[i][(k % 4) * BURST_BYTES + j] ^=
+						(l->ul[l->next] ? ul : dl)[k * BURST_BYTES + j];
+				}
+			}
+		}
+
+		/* Burst by burst, lanes side by side */
+		for (j = 0; j < 4; j++) {
+			for (i = 0; i < lane_count; i++) {
+				l = &lanes[i];
+				if (!l->active) {
+					continue;
+				}
+
+				memset(&rec, 0, sizeof(rec));
+				rec.session = htonl(l->s.id);
+				rec.bi.frame_nr = htonl((fn + (i % 8) * 4 + j) % GSM_MAX_FN);
+				rec.bi.band_arfcn = htons(l->s.cell->arfcn | (l->ul[l->next] ? ARFCN_UPLINK : 0));
+				rec.bi.chan_nr = l->chan_nr;
+				rec.bi.rx_level = rnd_range(20, 60);
+				rec.bi.snr = rnd_range(128, 255);
+				memcpy(rec.bi.bits, &bursts[i][j * BURST_BYTES], BURST_BYTES);
+				add_bit_errors(rec.bi.bits);
+				rec.bi.bits[BURST_BYTES - 1] &= 0xc0;
+
+				write_out(&rec, sizeof(rec));
+				out_frames++;
+			}
+		}
+
+		for (i = 0; i < lane_count; i++) {
+			l = &lanes[i];
+			if (l->active && ++l->next == l->count) {
+				l->active = 0;
+			}
+		}
+
+		fn = (fn + 51) % GSM_MAX_FN;
+	} while (1);
+}
+
+/* Setup */
+
+static void make_cells()
+{
+	static const uint16_t plmns[][2] = {
+		{ 262, 1 }, { 262, 2 }, { 262, 3 }, { 234, 10 }, { 234, 15 },
+		{ 208, 1 }, { 222, 10 }, { 310, 260 },
+	};
+	unsigned i, j, p;
+
+	for (i = 0; i < cell_count; i++) {
+		p = rnd_n(sizeof(plmns) / sizeof(plmns[0]));
+		cells[i].mcc = plmns[p][0];
+		cells[i].mnc = plmns[p][1];
+		cells[i].lac = rnd_range(1, 0xfffe);
+		cells[i].cid = rnd_range(1, 0xfffe);
+		cells[i].arfcn = rnd_range(1, 124);
+		cells[i].bsic = rnd_n(64);
+		cells[i].rac = rnd();
+		for (j = 0; j < 6; j++) {
+			cells[i].neigh[j] = rnd_range(1, 124);
+		}
+	}
+}
+
+static void make_subscribers()
+{
+	const struct gen_cell *c;
+	unsigned i;
+
+	for (i = 0; i < GEN_SUBSCRIBERS; i++) {
+		c = &cells[rnd_n(cell_count)];
+		if (c->mnc > 99) {
+			snprintf(subs[i].imsi, sizeof(subs[i].imsi), "%03u%03u", c->mcc, c->mnc);
+		} else {
+			snprintf(subs[i].imsi, sizeof(subs[i].imsi), "%03u%02u", c->mcc, c->mnc);
+		}
+		rnd_digits(&subs[i].imsi[strlen(subs[i].imsi)], 15 - strlen(subs[i].imsi));
+		rnd_digits(subs[i].imei, 16);
+		rnd_digits(subs[i].msisdn, 11);
+		subs[i].tmsi = rnd_pct(50) ? rnd() | 1 : 0;
+		subs[i].ptmsi = 0;
+	}
+}
+
+static void parse_mix(char *arg, const char *progname)
+{
+	char *tok, *val;
+	unsigned i;
+
+	memset(weights, 0, sizeof(weights));
+
+	for (tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+		val = strchr(tok, '=');
+		if (!val) {
+			usage(progname, "Invalid session mix");
+		}
+		*val++ = 0;
+		for (i = 0; i < SC_COUNT; i++) {
+			if (!strcmp(tok, scenario_names[i])) {
+				weights[i] = atoi(val);
+				break;
+			}
+		}
+		if (i == SC_COUNT) {
+			usage(progname, "Unknown session type");
+		}
+	}
+}
+
+static uint64_t parse_size(const char *arg)
+{
+	char *end;
+	uint64_t size = strtoull(arg, &end, 10);
+
+	switch (*end) {
+	case 'k':
+	case 'K':
+		size <<= 10;
+		break;
+	case 'm':
+	case 'M':
+		size <<= 20;
+		break;
+	case 'g':
+	case 'G':
+		size <<= 30;
+		break;
+	}
+
+	return size;
+}
+
+int main(int argc, char *argv[])
+{
+	static struct gen_session gs;
+	char *out_file = NULL;
+	char *key_file = NULL;
+	uint64_t seed = 1;
+	uint64_t max_sessions = 0;
+	uint64_t max_bytes = 0;
+	uint64_t sessions = 0;
+	uint32_t id = 1;
+	unsigned i, allowed;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "f:w:k:S:n:s:i:C:m:e:A:E:p:")) != -1) {
+		switch (ch) {
+			case 'f':
+				if (!strcmp(optarg, "diag")) {
+					format = FMT_DIAG;
+				} else if (!strcmp(optarg, "pcap")) {
+					format = FMT_PCAP;
+				} else if (!strcmp(optarg, "burst")) {
+					format = FMT_BURST;
+				} else {
+					usage(argv[0], "Unknown format");
+				}
+				break;
+			case 'w':
+				out_file = strdup(optarg);
+				break;
+			case 'k':
+				key_file = strdup(optarg);
+				break;
+			case 'S':
+				seed = strtoull(optarg, NULL, 0);
+				break;
+			case 'n':
+				max_sessions = strtoull(optarg, NULL, 0);
+				break;
+			case 's':
+				max_bytes = parse_size(optarg);
+				break;
+			case 'i':
+				id = atol(optarg);
+				break;
+			case 'C':
+				cell_count = atoi(optarg);
+				if (!cell_count || cell_count > GEN_MAX_CELLS) {
+					usage(argv[0], "Invalid number of cells");
+				}
+				break;
+			case 'm':
+				parse_mix(optarg, argv[0]);
+				break;
+			case 'e':
+				cipher_pct = atoi(optarg);
+				break;
+			case 'A':
+				if (sscanf(optarg, "%u,%u,%u", &a5_weights[1], &a5_weights[2], &a5_weights[3]) != 3 ||
+				    !(a5_weights[1] + a5_weights[2] + a5_weights[3])) {
+					usage(argv[0], "Invalid A5 weights");
+				}
+				break;
+			case 'E':
+				ber_permille = atoi(optarg);
+				if (ber_permille >= 1000) {
+					usage(argv[0], "Invalid bit error rate");
+				}
+				break;
+			case 'p':
+				lane_count = atoi(optarg);
+				if (!lane_count || lane_count > GEN_MAX_LANES) {
+					usage(argv[0], "Invalid number of lanes");
+				}
+				break;
+			case '?':
+			default:
+				usage(argv[0], "Invalid arguments");
+		}
+	}
+
+	if (optind != argc) {
+		usage(argv[0], "Invalid arguments");
+	}
+
+	allowed = 0;
+	for (i = 0; i < SC_COUNT; i++) {
+		if (scenario_allowed(i)) {
+			allowed += weights[i];
+		}
+	}
+	if (!allowed) {
+		usage(argv[0], "No session type for this format");
+	}
+
+	if (!max_sessions) {
+		max_sessions = max_bytes ? UINT64_MAX : 1000;
+	}
+	if (!max_bytes) {
+		max_bytes = UINT64_MAX;
+	}
+
+	if (!out_file || !strcmp(out_file, "-")) {
+		out = stdout;
+	} else {
+		out = fopen(out_file, "wb");
+		if (!out) {
+			err(1, "Cannot open output file: %s", out_file);
+		}
+	}
+	setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+	if (key_file) {
+		key_out = fopen(key_file, "w");
+		if (!key_out) {
+			err(1, "Cannot open key file: %s", key_file);
+		}
+	}
+
+	rnd_seed(seed);
+	crc_init();
+	gsm_interleave_init();
+	make_cells();
+	make_subscribers();
+
+	now_us = GEN_START_TIME * 1000000;
+
+	if (format == FMT_BURST) {
+		write_bursts(&id, max_sessions, max_bytes);
+		for (i = 0; i < SC_COUNT; i++) {
+			sessions += scenario_count[i];
+		}
+	} else {
+		if (format == FMT_PCAP) {
+			pcap_header();
+		}
+
+		while (sessions < max_sessions && out_bytes < max_bytes) {
+			build_session(&gs, id++);
+			sessions++;
+			write_key(&gs);
+			if (format == FMT_DIAG) {
+				write_diag_session(&gs);
+			} else {
+				session_frames(&gs, pcap_frame, NULL);
+			}
+			advance_time(1000, 30000);
+		}
+	}
+
+	if (fflush(out)) {
+		err(1, "Cannot write output");
+	}
+	if (out != stdout) {
+		fclose(out);
+	}
+	if (key_out) {
+		fclose(key_out);
+	}
+
+	fprintf(stderr, "%llu sessions,", (unsigned long long) sessions);
+	for (i = 0; i < SC_COUNT; i++) {
+		fprintf(stderr, " %s %llu", scenario_names[i], (unsigned long long) scenario_count[i]);
+	}
+	fprintf(stderr, ", %llu ciphered\n", (unsigned long long) ciphered_count);
+	fprintf(stderr, "%llu frames, %llu bytes", (unsigned long long) out_frames, (unsigned long long) out_bytes);
+	if (format == FMT_BURST && ber_permille) {
+		fprintf(stderr, ", %llu bit errors", (unsigned long long) bit_errors);
+	}
+	fprintf(stderr, "\n");
+
+	return 0;
+}
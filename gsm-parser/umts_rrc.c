@@ -1,4 +1,7 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <asn_arena.h>
 #include <osmocom/rrc/UL-DCCH-Message.h>
 #include <osmocom/rrc/DL-DCCH-Message.h>
 #include <osmocom/rrc/UL-CCCH-Message.h>
@@ -8,13 +11,91 @@
 #include "l3_handler.h"
 #include "session.h"
 
+/* Stack limit of uper_decode() without a codec context */
+#define RRC_STACK_MAX 30000
+
+/* Chunks of the arena, a decoded message takes up to a few kB */
+#define RRC_ARENA_CHUNK 16384
+
+/* Members of the DCCH messages read below, the rest is skipped
+ * by the decoder. Names are the ASN.1 identifiers of the members. */
+const asn_per_select_t rrc_nas_select[] = {
+	{ "cn-DomainIdentity", NULL },
+	{ "nas-Message", NULL },
+	{ NULL, NULL }
+};
+
+static const asn_per_select_t ul_dcch_type_select[] = {
+	{ "initialDirectTransfer", rrc_nas_select },
+	{ "uplinkDirectTransfer", rrc_nas_select },
+	{ NULL, NULL }
+};
+
+const asn_per_select_t ul_dcch_select[] = {
+	{ "message", ul_dcch_type_select },
+	{ NULL, NULL }
+};
+
+static const asn_per_select_t ddt_r3_select[] = {
+	{ "downlinkDirectTransfer-r3", rrc_nas_select },
+	{ NULL, NULL }
+};
+
+static const asn_per_select_t ddt_select[] = {
+	{ "r3", ddt_r3_select },
+	{ "later-than-r3", NULL },
+	{ NULL, NULL }
+};
+
+static const asn_per_select_t dl_dcch_type_select[] = {
+	{ "securityModeCommand", NULL },
+	{ "downlinkDirectTransfer", ddt_select },
+	{ NULL, NULL }
+};
+
+const asn_per_select_t dl_dcch_select[] = {
+	{ "message", dl_dcch_type_select },
+	{ NULL, NULL }
+};
+
+/* Codec context decoding the selected members into the RRC arena of
+ * the parser context, asn_arena_reset() releases the decoded message.
+ * Strings that are octet aligned in the input are left there, the NAS
+ * message of an r3 DirectTransfer never is and is shifted into the arena
+ * in one go. */
+static void rrc_codec_init(struct metagsm_ctx *ctx, asn_codec_ctx_t *codec,
+			   const asn_per_select_t *select)
+{
+	if (!ctx->rrc_arena) {
+		ctx->rrc_arena = asn_arena_new(RRC_ARENA_CHUNK);
+		if (!ctx->rrc_arena) {
+			printf("Cannot allocate RRC arena\n");
+			exit(1);
+		}
+	}
+
+	memset(codec, 0, sizeof(*codec));
+	codec->max_stack_size = RRC_STACK_MAX;
+	codec->arena = ctx->rrc_arena;
+	codec->select = select;
+	codec->zero_copy = 1;
+}
+
+void umts_rrc_free(struct metagsm_ctx *ctx)
+{
+	asn_arena_free(ctx->rrc_arena);
+	ctx->rrc_arena = NULL;
+}
+
 int handle_dcch_ul(struct session_info *s, uint8_t *msg, size_t len)
 {
 	uint8_t msg_type;
 	int need_to_parse = 0;
 
 	UL_DCCH_Message_t *dcch = NULL;
+	asn_codec_ctx_t codec;
 	asn_dec_rval_t rv;
+	uint64_t t;
 	//MessageAuthenticationCode_t *mac;
 
 	uint8_t *nas = NULL;
@@ -92,8 +173,12 @@ int handle_dcch_ul(struct session_info *s, uint8_t *msg, size_t len)
 
 	/* Apply ASN.1 decoder to extract needed information */
 	if (need_to_parse) {
-		rv = uper_decode(NULL, &asn_DEF_UL_DCCH_Message, (void **) &dcch, msg, len, 0, 0);
+		rrc_codec_init(s->ctx, &codec, ul_dcch_select);
+		t = stats_begin(&s->ctx->stats, STAGE_ASN1);
+		rv = uper_decode(&codec, &asn_DEF_UL_DCCH_Message, (void **) &dcch, msg, len, 0, 0);
+		stats_end(&s->ctx->stats, STAGE_ASN1, t);
 		if ((rv.code != RC_OK) || !dcch) {
+			asn_arena_reset(s->ctx->rrc_arena);
 			SET_MSG_INFO(s, "ASN.1 PARSING ERROR");
 			return 1;
 		}
@@ -124,7 +209,7 @@ int handle_dcch_ul(struct session_info *s, uint8_t *msg, size_t len)
 			handle_dtap(s, nas, nas_len, 0, 1);
 		}
 
-		ASN_STRUCT_FREE(asn_DEF_UL_DCCH_Message, dcch);
+		asn_arena_reset(s->ctx->rrc_arena);
 	}
 
 #if 0
@@ -144,7 +229,9 @@ int handle_dcch_dl(struct session_info *s, uint8_t *msg, size_t len)
 	int need_to_parse = 0;
 	int error = 0;
 	DL_DCCH_Message_t *dcch = NULL;
+	asn_codec_ctx_t codec;
 	asn_dec_rval_t rv;
+	uint64_t t;
 	//MessageAuthenticationCode_t *mac = NULL;
 	//SecurityCapability_t *cap = NULL; 
 	CipheringModeInfo_t *cipher = NULL;
@@ -225,8 +312,12 @@ int handle_dcch_dl(struct session_info *s, uint8_t *msg, size_t len)
 
 	if (need_to_parse) {
 		/* Call ASN.1 decoder */
-		rv = uper_decode(NULL, &asn_DEF_DL_DCCH_Message, (void **) &dcch, msg, len, 0, 0);
+		rrc_codec_init(s->ctx, &codec, dl_dcch_select);
+		t = stats_begin(&s->ctx->stats, STAGE_ASN1);
+		rv = uper_decode(&codec, &asn_DEF_DL_DCCH_Message, (void **) &dcch, msg, len, 0, 0);
+		stats_end(&s->ctx->stats, STAGE_ASN1, t);
 		if ((rv.code != RC_OK) || !dcch) {
+			asn_arena_reset(s->ctx->rrc_arena);
 			SET_MSG_INFO(s, "ASN.1 PARSING ERROR");
 			return 1;
 		}
@@ -311,7 +402,7 @@ int handle_dcch_dl(struct session_info *s, uint8_t *msg, size_t len)
 		}
 
 dl_end:
-		ASN_STRUCT_FREE(asn_DEF_DL_DCCH_Message, dcch);
+		asn_arena_reset(s->ctx->rrc_arena);
 	}
 
 	#if 0
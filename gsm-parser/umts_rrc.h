@@ -2,11 +2,18 @@
 #define UMTS_RRC_H
 
 #include <stdint.h>
+#include <asn_application.h>
 #include "session.h"
 
 int handle_dcch_ul(struct session_info *s, uint8_t *msg, size_t len);
 int handle_dcch_dl(struct session_info *s, uint8_t *msg, size_t len);
 int handle_ccch_ul(struct session_info *s, uint8_t *msg, size_t len);
 int handle_ccch_dl(struct session_info *s, uint8_t *msg, size_t len);
+void umts_rrc_free(struct metagsm_ctx *ctx);
+
+/* Members of the DCCH messages the handlers above decode */
+extern const asn_per_select_t rrc_nas_select[];
+extern const asn_per_select_t ul_dcch_select[];
+extern const asn_per_select_t dl_dcch_select[];
 
 #endif
@@ -20,6 +20,12 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CONV_CCH_X86 1
+#include <immintrin.h>
+#endif
 
 #include "viterbi.h"
 
@@ -29,6 +35,16 @@
 
 #define MAX_AE			0x00ffffff
 
+/* Longest input for the table driven decoders, survivors on the stack */
+#define CONV_CCH_MAX_N		1024
+
+/* Longest input and most blocks per pass of the batch decoders */
+#define CONV_CCH_BATCH_N	512
+#define CONV_CCH_LANES_MAX	16
+
+/* Start value of the invalid states for 16-bit path metrics */
+#define MAX_AE16		0x7000
+
 
 static const uint8_t conv_cch_next_output[CONV_N_STATES][2] = {
         {0, 3}, {3, 0}, {3, 0}, {0, 3},
@@ -58,7 +74,7 @@ int conv_cch_encode(const uint8_t *in, uint8_t *out, unsigned size)
 	return 0;
 }
 
-int conv_cch_decode(int8_t *input, uint8_t *output, int n)
+int conv_cch_decode_ref(int8_t *input, uint8_t *output, int n)
 {
 	int i, s, b;
 	unsigned int ae[CONV_N_STATES];
@@ -147,3 +163,594 @@ int conv_cch_decode(int8_t *input, uint8_t *output, int n)
 
 	return 0;
 }
+
+/*
+ * Table driven decoders
+ *
+ * State ns is reached from states 2*(ns&7) and 2*(ns&7)+1 with input bit
+ * ns>>3, so every step is 8 butterflies. The odd predecessor survives only
+ * if its path error is strictly lower, as in conv_cch_decode_ref(), and
+ * one bit per state records the choice. Branch errors come from a table
+ * indexed by the soft bit instead of squaring the difference.
+ */
+
+/* Branch error of a soft bit against an expected 0 (127) or 1 (-127) */
+static uint8_t conv_cch_bit_err[2][256];
+/* Output of the even predecessor with input bit 0 */
+static uint8_t conv_cch_even_out[CONV_N_STATES/2];
+
+typedef int (*conv_cch_decoder)(const int8_t *input, uint8_t *output, int n);
+typedef void (*conv_cch_lane_decoder)(const int8_t *in, int stride, uint8_t **output, int valid, int n);
+
+static conv_cch_decoder conv_cch_impl_func;
+static conv_cch_lane_decoder conv_cch_lanes_func;
+static int conv_cch_lanes;
+static enum conv_cch_impl conv_cch_impl_cur;
+static pthread_once_t conv_cch_once = PTHREAD_ONCE_INIT;
+
+static inline void conv_cch_branch_err(const int8_t *in, uint16_t *err)
+{
+	uint8_t s0 = in[0], s1 = in[1];
+	int out;
+
+	for (out = 0; out < 4; out++) {
+		err[out] = conv_cch_bit_err[out >> 1][s0] + conv_cch_bit_err[out & 1][s1];
+	}
+}
+
+/* Lowest state with the least error, then follow the survivors back */
+static void conv_cch_traceback(const uint16_t *surv, const int *ae, uint8_t *output, int n)
+{
+	int i, s;
+	int min_state = 0;
+
+	for (s = 1; s < CONV_N_STATES; s++) {
+		if (ae[s] < ae[min_state]) {
+			min_state = s;
+		}
+	}
+
+	s = min_state;
+	for (i = n-1; i >= 0; i--) {
+		output[i] = s >> 3;
+		s = ((s & 7) << 1) | ((surv[i+1] >> s) & 1);
+	}
+}
+
+static int conv_cch_decode_scalar(const int8_t *input, uint8_t *output, int n)
+{
+	uint16_t surv[CONV_CCH_MAX_N+1];
+	unsigned ae[CONV_N_STATES];
+	unsigned ae_next[CONV_N_STATES];
+	uint16_t err[4];
+	unsigned x, y, c0, c1;
+	int final[CONV_N_STATES];
+	uint16_t d;
+	int i, j;
+
+	ae[0] = 0;
+	for (j = 1; j < CONV_N_STATES; j++) {
+		ae[j] = MAX_AE;
+	}
+
+	for (i = 0; i < n; i++) {
+		conv_cch_branch_err(&input[2*i], err);
+
+		d = 0;
+		for (j = 0; j < CONV_N_STATES/2; j++) {
+			x = err[conv_cch_even_out[j]];
+			y = err[3 - conv_cch_even_out[j]];
+
+			/* Input bit 0 */
+			c0 = ae[2*j] + x;
+			c1 = ae[2*j+1] + y;
+			if (c1 < c0) {
+				c0 = c1;
+				d |= 1 << j;
+			}
+			ae_next[j] = c0;
+
+			/* Input bit 1 */
+			c0 = ae[2*j] + y;
+			c1 = ae[2*j+1] + x;
+			if (c1 < c0) {
+				c0 = c1;
+				d |= 1 << (j+8);
+			}
+			ae_next[j+8] = c0;
+		}
+		surv[i+1] = d;
+
+		memcpy(ae, ae_next, sizeof(ae));
+	}
+
+	for (j = 0; j < CONV_N_STATES; j++) {
+		final[j] = ae[j];
+	}
+	conv_cch_traceback(surv, final, output, n);
+
+	return 0;
+}
+
+#ifdef CONV_CCH_X86
+/*
+ * All 16 path errors as 16-bit lanes, in two SSE registers or one AVX2
+ * register. The lowest error is subtracted every 8 steps. Errors of
+ * reachable states stay within 4 steps of branch errors (1016) of the
+ * lowest, so they stay far below saturation and the result matches the
+ * 32-bit decoder. All states are reachable after 4 steps.
+ */
+#define CONV_CCH_NORM_MASK	7
+
+/* Even states into the low 64 bits, odd states into the high 64 bits */
+#define CONV_CCH_SPLIT_EVEN_ODD \
+	0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15
+
+__attribute__((target("sse4.1")))
+static inline __m128i conv_cch_err_index(int odd)
+{
+	uint8_t idx[16];
+	int j, out;
+
+	for (j = 0; j < CONV_N_STATES/2; j++) {
+		out = odd ? 3 - conv_cch_even_out[j] : conv_cch_even_out[j];
+		idx[2*j] = 2*out;
+		idx[2*j+1] = 2*out + 1;
+	}
+
+	return _mm_loadu_si128((__m128i *) idx);
+}
+
+__attribute__((target("sse4.1")))
+static int conv_cch_decode_sse41(const int8_t *input, uint8_t *output, int n)
+{
+	uint16_t surv[CONV_CCH_MAX_N+1];
+	const __m128i split = _mm_setr_epi8(CONV_CCH_SPLIT_EVEN_ODD);
+	const __m128i bcast = _mm_setr_epi8(0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1);
+	const __m128i x_idx = conv_cch_err_index(0);
+	const __m128i y_idx = conv_cch_err_index(1);
+	__m128i lo, hi, l, h, e, o, x, y, errv;
+	__m128i c0_lo, c1_lo, c0_hi, c1_hi, d_lo, d_hi, m;
+	int16_t ae[CONV_N_STATES];
+	int final[CONV_N_STATES];
+	uint16_t err[4];
+	int i, j;
+
+	lo = _mm_setr_epi16(0, MAX_AE16, MAX_AE16, MAX_AE16, MAX_AE16, MAX_AE16, MAX_AE16, MAX_AE16);
+	hi = _mm_set1_epi16(MAX_AE16);
+
+	for (i = 0; i < n; i++) {
+		conv_cch_branch_err(&input[2*i], err);
+		errv = _mm_loadl_epi64((__m128i *) err);
+		x = _mm_shuffle_epi8(errv, x_idx);
+		y = _mm_shuffle_epi8(errv, y_idx);
+
+		l = _mm_shuffle_epi8(lo, split);
+		h = _mm_shuffle_epi8(hi, split);
+		e = _mm_unpacklo_epi64(l, h);
+		o = _mm_unpackhi_epi64(l, h);
+
+		c0_lo = _mm_adds_epi16(e, x);
+		c1_lo = _mm_adds_epi16(o, y);
+		c0_hi = _mm_adds_epi16(e, y);
+		c1_hi = _mm_adds_epi16(o, x);
+
+		d_lo = _mm_cmpgt_epi16(c0_lo, c1_lo);
+		d_hi = _mm_cmpgt_epi16(c0_hi, c1_hi);
+		lo = _mm_min_epi16(c0_lo, c1_lo);
+		hi = _mm_min_epi16(c0_hi, c1_hi);
+
+		surv[i+1] = _mm_movemask_epi8(_mm_packs_epi16(d_lo, d_hi));
+
+		if ((i & CONV_CCH_NORM_MASK) == CONV_CCH_NORM_MASK) {
+			m = _mm_minpos_epu16(_mm_min_epi16(lo, hi));
+			m = _mm_shuffle_epi8(m, bcast);
+			lo = _mm_subs_epi16(lo, m);
+			hi = _mm_subs_epi16(hi, m);
+		}
+	}
+
+	_mm_storeu_si128((__m128i *) &ae[0], lo);
+	_mm_storeu_si128((__m128i *) &ae[8], hi);
+	for (j = 0; j < CONV_N_STATES; j++) {
+		final[j] = ae[j];
+	}
+	conv_cch_traceback(surv, final, output, n);
+
+	return 0;
+}
+
+__attribute__((target("avx2")))
+static int conv_cch_decode_avx2(const int8_t *input, uint8_t *output, int n)
+{
+	uint16_t surv[CONV_CCH_MAX_N+1];
+	const __m256i split = _mm256_setr_epi8(CONV_CCH_SPLIT_EVEN_ODD, CONV_CCH_SPLIT_EVEN_ODD);
+	const __m256i xy_idx = _mm256_setr_m128i(conv_cch_err_index(0), conv_cch_err_index(1));
+	const __m256i yx_idx = _mm256_setr_m128i(conv_cch_err_index(1), conv_cch_err_index(0));
+	__m256i a, s, e, o, errv, xy, yx, c0, c1, d;
+	__m128i m;
+	int16_t ae[CONV_N_STATES];
+	int final[CONV_N_STATES];
+	uint16_t err[4];
+	unsigned mask;
+	int i, j;
+
+	a = _mm256_set1_epi16(MAX_AE16);
+	a = _mm256_insert_epi16(a, 0, 0);
+
+	for (i = 0; i < n; i++) {
+		conv_cch_branch_err(&input[2*i], err);
+		errv = _mm256_broadcastq_epi64(_mm_loadl_epi64((__m128i *) err));
+		xy = _mm256_shuffle_epi8(errv, xy_idx);
+		yx = _mm256_shuffle_epi8(errv, yx_idx);
+
+		/* Even and odd predecessors of states 0-7, again for 8-15 */
+		s = _mm256_shuffle_epi8(a, split);
+		e = _mm256_permute4x64_epi64(s, _MM_SHUFFLE(2, 0, 2, 0));
+		o = _mm256_permute4x64_epi64(s, _MM_SHUFFLE(3, 1, 3, 1));
+
+		c0 = _mm256_adds_epi16(e, xy);
+		c1 = _mm256_adds_epi16(o, yx);
+		d = _mm256_cmpgt_epi16(c0, c1);
+		a = _mm256_min_epi16(c0, c1);
+
+		/* Decisions of states 0-7 in bits 0-7, 8-15 in bits 16-23 */
+		mask = _mm256_movemask_epi8(_mm256_packs_epi16(d, d));
+		surv[i+1] = (mask & 0xff) | ((mask >> 8) & 0xff00);
+
+		if ((i & CONV_CCH_NORM_MASK) == CONV_CCH_NORM_MASK) {
+			m = _mm_min_epi16(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+			m = _mm_minpos_epu16(m);
+			a = _mm256_subs_epi16(a, _mm256_broadcastw_epi16(m));
+		}
+	}
+
+	_mm256_storeu_si256((__m256i *) ae, a);
+	for (j = 0; j < CONV_N_STATES; j++) {
+		final[j] = ae[j];
+	}
+	conv_cch_traceback(surv, final, output, n);
+
+	return 0;
+}
+
+/*
+ * Batch decoders, one block per 16-bit lane: 8 blocks in SSE registers,
+ * 16 in AVX2 registers, one register per state. Soft bit k of lane b is
+ * in[k*stride + b]. Survivor bits are kept per state with one bit per
+ * lane. Same ties and normalization as above.
+ */
+
+/* Lowest state with the least error of every lane, then follow back */
+static void conv_cch_traceback_lanes(uint16_t (*surv)[CONV_N_STATES], const int16_t *ae, int lanes,
+				     uint8_t **output, int valid, int n)
+{
+	int b, i, s, min_state;
+
+	for (b = 0; b < valid; b++) {
+		min_state = 0;
+		for (s = 1; s < CONV_N_STATES; s++) {
+			if (ae[s*lanes+b] < ae[min_state*lanes+b]) {
+				min_state = s;
+			}
+		}
+
+		s = min_state;
+		for (i = n-1; i >= 0; i--) {
+			output[b][i] = s >> 3;
+			s = ((s & 7) << 1) | ((surv[i+1][s] >> b) & 1);
+		}
+	}
+}
+
+__attribute__((target("sse4.1")))
+static void conv_cch_lanes_sse41(const int8_t *in, int stride, uint8_t **output, int valid, int n)
+{
+	uint16_t surv[CONV_CCH_BATCH_N+1][CONV_N_STATES];
+	const __m128i pos = _mm_set1_epi16(127);
+	const __m128i neg = _mm_set1_epi16(-127);
+	__m128i ae[CONV_N_STATES], nx[CONV_N_STATES], d[CONV_N_STATES];
+	__m128i err[4], s0, s1, e00, e01, e10, e11, t, x, y, c0, c1, m;
+	int16_t final[CONV_N_STATES*8];
+	unsigned mask;
+	int i, j;
+
+	ae[0] = _mm_setzero_si128();
+	for (j = 1; j < CONV_N_STATES; j++) {
+		ae[j] = _mm_set1_epi16(MAX_AE16);
+	}
+
+	for (i = 0; i < n; i++) {
+		s0 = _mm_cvtepi8_epi16(_mm_loadl_epi64((__m128i *) &in[(2*i)*stride]));
+		s1 = _mm_cvtepi8_epi16(_mm_loadl_epi64((__m128i *) &in[(2*i+1)*stride]));
+
+		/* Squares fit 16 bits unsigned */
+		t = _mm_sub_epi16(pos, s0);
+		e00 = _mm_srli_epi16(_mm_mullo_epi16(t, t), 9);
+		t = _mm_sub_epi16(neg, s0);
+		e01 = _mm_srli_epi16(_mm_mullo_epi16(t, t), 9);
+		t = _mm_sub_epi16(pos, s1);
+		e10 = _mm_srli_epi16(_mm_mullo_epi16(t, t), 9);
+		t = _mm_sub_epi16(neg, s1);
+		e11 = _mm_srli_epi16(_mm_mullo_epi16(t, t), 9);
+
+		err[0] = _mm_add_epi16(e00, e10);
+		err[1] = _mm_add_epi16(e00, e11);
+		err[2] = _mm_add_epi16(e01, e10);
+		err[3] = _mm_add_epi16(e01, e11);
+
+		for (j = 0; j < CONV_N_STATES/2; j++) {
+			x = err[conv_cch_even_out[j]];
+			y = err[3 - conv_cch_even_out[j]];
+
+			c0 = _mm_adds_epi16(ae[2*j], x);
+			c1 = _mm_adds_epi16(ae[2*j+1], y);
+			d[j] = _mm_cmpgt_epi16(c0, c1);
+			nx[j] = _mm_min_epi16(c0, c1);
+
+			c0 = _mm_adds_epi16(ae[2*j], y);
+			c1 = _mm_adds_epi16(ae[2*j+1], x);
+			d[j+8] = _mm_cmpgt_epi16(c0, c1);
+			nx[j+8] = _mm_min_epi16(c0, c1);
+		}
+
+		for (j = 0; j < CONV_N_STATES; j += 2) {
+			mask = _mm_movemask_epi8(_mm_packs_epi16(d[j], d[j+1]));
+
+			surv[i+1][j] = mask & 0xff;
+			surv[i+1][j+1] = mask >> 8;
+		}
+
+		memcpy(ae, nx, sizeof(ae));
+
+		if ((i & CONV_CCH_NORM_MASK) == CONV_CCH_NORM_MASK) {
+			m = ae[0];
+			for (j = 1; j < CONV_N_STATES; j++) {
+				m = _mm_min_epi16(m, ae[j]);
+			}
+			for (j = 0; j < CONV_N_STATES; j++) {
+				ae[j] = _mm_subs_epi16(ae[j], m);
+			}
+		}
+	}
+
+	for (j = 0; j < CONV_N_STATES; j++) {
+		_mm_storeu_si128((__m128i *) &final[j*8], ae[j]);
+	}
+	conv_cch_traceback_lanes(surv, final, 8, output, valid, n);
+}
+
+__attribute__((target("avx2")))
+static void conv_cch_lanes_avx2(const int8_t *in, int stride, uint8_t **output, int valid, int n)
+{
+	uint16_t surv[CONV_CCH_BATCH_N+1][CONV_N_STATES];
+	const __m256i pos = _mm256_set1_epi16(127);
+	const __m256i neg = _mm256_set1_epi16(-127);
+	__m256i ae[CONV_N_STATES], nx[CONV_N_STATES], d[CONV_N_STATES];
+	__m256i err[4], s0, s1, e00, e01, e10, e11, t, x, y, c0, c1, m;
+	int16_t final[CONV_N_STATES*16];
+	unsigned mask;
+	int i, j;
+
+	ae[0] = _mm256_setzero_si256();
+	for (j = 1; j < CONV_N_STATES; j++) {
+		ae[j] = _mm256_set1_epi16(MAX_AE16);
+	}
+
+	for (i = 0; i < n; i++) {
+		s0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((__m128i *) &in[(2*i)*stride]));
+		s1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((__m128i *) &in[(2*i+1)*stride]));
+
+		t = _mm256_sub_epi16(pos, s0);
+		e00 = _mm256_srli_epi16(_mm256_mullo_epi16(t, t), 9);
+		t = _mm256_sub_epi16(neg, s0);
+		e01 = _mm256_srli_epi16(_mm256_mullo_epi16(t, t), 9);
+		t = _mm256_sub_epi16(pos, s1);
+		e10 = _mm256_srli_epi16(_mm256_mullo_epi16(t, t), 9);
+		t = _mm256_sub_epi16(neg, s1);
+		e11 = _mm256_srli_epi16(_mm256_mullo_epi16(t, t), 9);
+
+		err[0] = _mm256_add_epi16(e00, e10);
+		err[1] = _mm256_add_epi16(e00, e11);
+		err[2] = _mm256_add_epi16(e01, e10);
+		err[3] = _mm256_add_epi16(e01, e11);
+
+		for (j = 0; j < CONV_N_STATES/2; j++) {
+			x = err[conv_cch_even_out[j]];
+			y = err[3 - conv_cch_even_out[j]];
+
+			c0 = _mm256_adds_epi16(ae[2*j], x);
+			c1 = _mm256_adds_epi16(ae[2*j+1], y);
+			d[j] = _mm256_cmpgt_epi16(c0, c1);
+			nx[j] = _mm256_min_epi16(c0, c1);
+
+			c0 = _mm256_adds_epi16(ae[2*j], y);
+			c1 = _mm256_adds_epi16(ae[2*j+1], x);
+			d[j+8] = _mm256_cmpgt_epi16(c0, c1);
+			nx[j+8] = _mm256_min_epi16(c0, c1);
+		}
+
+		/* Lanes of state j in the low 16 bits, of state j+1 in the high */
+		for (j = 0; j < CONV_N_STATES; j += 2) {
+			t = _mm256_packs_epi16(d[j], d[j+1]);
+			t = _mm256_permute4x64_epi64(t, _MM_SHUFFLE(3, 1, 2, 0));
+			mask = _mm256_movemask_epi8(t);
+
+			surv[i+1][j] = mask & 0xffff;
+			surv[i+1][j+1] = mask >> 16;
+		}
+
+		memcpy(ae, nx, sizeof(ae));
+
+		if ((i & CONV_CCH_NORM_MASK) == CONV_CCH_NORM_MASK) {
+			m = ae[0];
+			for (j = 1; j < CONV_N_STATES; j++) {
+				m = _mm256_min_epi16(m, ae[j]);
+			}
+			for (j = 0; j < CONV_N_STATES; j++) {
+				ae[j] = _mm256_subs_epi16(ae[j], m);
+			}
+		}
+	}
+
+	for (j = 0; j < CONV_N_STATES; j++) {
+		_mm256_storeu_si256((__m256i *) &final[j*16], ae[j]);
+	}
+	conv_cch_traceback_lanes(surv, final, 16, output, valid, n);
+}
+#endif
+
+static void conv_cch_init()
+{
+	int b, x, j;
+
+	for (b = 0; b < 2; b++) {
+		for (x = 0; x < 256; x++) {
+			int ev = b ? -127 : 127;
+			int in = (int8_t) x;
+
+			conv_cch_bit_err[b][x] = ((ev - in) * (ev - in)) >> 9;
+		}
+	}
+
+	for (j = 0; j < CONV_N_STATES/2; j++) {
+		conv_cch_even_out[j] = conv_cch_next_output[2*j][0];
+	}
+
+	conv_cch_impl_cur = CONV_CCH_SCALAR;
+	conv_cch_impl_func = conv_cch_decode_scalar;
+	conv_cch_lanes_func = NULL;
+	conv_cch_lanes = 1;
+#ifdef CONV_CCH_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		conv_cch_impl_cur = CONV_CCH_AVX2;
+		conv_cch_impl_func = conv_cch_decode_avx2;
+		conv_cch_lanes_func = conv_cch_lanes_avx2;
+		conv_cch_lanes = 16;
+	} else if (__builtin_cpu_supports("sse4.1")) {
+		conv_cch_impl_cur = CONV_CCH_SSE41;
+		conv_cch_impl_func = conv_cch_decode_sse41;
+		conv_cch_lanes_func = conv_cch_lanes_sse41;
+		conv_cch_lanes = 8;
+	}
+#endif
+}
+
+/* Not thread safe, meant for tests and benchmarks */
+int conv_cch_select(enum conv_cch_impl impl)
+{
+	pthread_once(&conv_cch_once, conv_cch_init);
+
+	switch (impl) {
+	case CONV_CCH_SCALAR:
+		conv_cch_impl_func = conv_cch_decode_scalar;
+		conv_cch_lanes_func = NULL;
+		conv_cch_lanes = 1;
+		break;
+#ifdef CONV_CCH_X86
+	case CONV_CCH_SSE41:
+		if (!__builtin_cpu_supports("sse4.1")) {
+			return -1;
+		}
+		conv_cch_impl_func = conv_cch_decode_sse41;
+		conv_cch_lanes_func = conv_cch_lanes_sse41;
+		conv_cch_lanes = 8;
+		break;
+	case CONV_CCH_AVX2:
+		if (!__builtin_cpu_supports("avx2")) {
+			return -1;
+		}
+		conv_cch_impl_func = conv_cch_decode_avx2;
+		conv_cch_lanes_func = conv_cch_lanes_avx2;
+		conv_cch_lanes = 16;
+		break;
+#endif
+	default:
+		return -1;
+	}
+	conv_cch_impl_cur = impl;
+
+	return 0;
+}
+
+const char *conv_cch_impl_name()
+{
+	pthread_once(&conv_cch_once, conv_cch_init);
+
+	switch (conv_cch_impl_cur) {
+	case CONV_CCH_SCALAR:
+		return "scalar";
+	case CONV_CCH_SSE41:
+		return "sse4.1";
+	case CONV_CCH_AVX2:
+		return "avx2";
+	}
+
+	return "unknown";
+}
+
+int conv_cch_decode(int8_t *input, uint8_t *output, int n)
+{
+	pthread_once(&conv_cch_once, conv_cch_init);
+
+	if (n > CONV_CCH_MAX_N) {
+		return conv_cch_decode_ref(input, output, n);
+	}
+
+	return conv_cch_impl_func(input, output, n);
+}
+
+/*
+ * Decodes count blocks of n bits each. Soft bit k of block b is
+ * input[k*count + b], the bits of block b go to output[b]. Full groups of
+ * lanes are decoded in place, the rest is copied into a padded buffer.
+ */
+int conv_cch_decode_batch(const int8_t *input, uint8_t **output, int n, int count)
+{
+	int8_t soft[2*CONV_CCH_MAX_N];
+	int8_t pad[2*CONV_CCH_BATCH_N*CONV_CCH_LANES_MAX];
+	conv_cch_lane_decoder lanes_func;
+	int lanes, valid;
+	int b, i, k;
+
+	pthread_once(&conv_cch_once, conv_cch_init);
+
+	for (b = 0; b < count; b += valid) {
+		lanes_func = conv_cch_lanes_func;
+		lanes = conv_cch_lanes;
+		valid = count - b < lanes ? count - b : lanes;
+
+#ifdef CONV_CCH_X86
+		/* Half an AVX2 pass is faster in SSE registers */
+		if (lanes == 16 && valid <= 8) {
+			lanes_func = conv_cch_lanes_sse41;
+			lanes = 8;
+		}
+#endif
+
+		/* Few blocks left, or too long for the lane decoders */
+		if (!lanes_func || valid <= 2 || n > CONV_CCH_BATCH_N) {
+			for (i = b; i < b + valid; i++) {
+				for (k = 0; k < 2*n; k++) {
+					soft[k] = input[k*count + i];
+				}
+				conv_cch_decode(soft, output[i], n);
+			}
+			continue;
+		}
+
+		if (valid == lanes) {
+			lanes_func(&input[b], count, &output[b], valid, n);
+			continue;
+		}
+
+		for (k = 0; k < 2*n; k++) {
+			memcpy(&pad[k*lanes], &input[k*count + b], valid);
+			memset(&pad[k*lanes + valid], 0, lanes - valid);
+		}
+		lanes_func(pad, lanes, &output[b], valid, n);
+	}
+
+	return 0;
+}
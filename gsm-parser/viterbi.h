@@ -1,7 +1,21 @@
 #ifndef VITERBI_H
 #define VITERBI_H
 
+enum conv_cch_impl {
+	CONV_CCH_SCALAR,
+	CONV_CCH_SSE41,
+	CONV_CCH_AVX2,
+};
+
 int conv_cch_encode(const uint8_t *in, uint8_t *out, unsigned size);
 int conv_cch_decode(int8_t *input, uint8_t *output, int n);
 
+/* Decodes many blocks in parallel, see viterbi.c for the input layout */
+int conv_cch_decode_batch(const int8_t *input, uint8_t **output, int n, int count);
+
+/* The decoder is picked at runtime, the original one is kept as reference */
+int conv_cch_decode_ref(int8_t *input, uint8_t *output, int n);
+int conv_cch_select(enum conv_cch_impl impl);
+const char *conv_cch_impl_name();
+
 #endif
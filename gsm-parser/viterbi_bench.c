@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <err.h>
+
+#include "viterbi.h"
+#include "bench.h"
+
+/*
+ * Encodes random blocks, adds Gaussian noise and punctured (zero) soft
+ * bits, and checks that every available decoder, alone and in batches,
+ * gives the same output as the reference decoder. Then times each decoder
+ * on xCCH sized blocks, and the batch decoder at several batch sizes.
+ */
+
+#define MAX_BITS	338
+
+static const int block_bits[] = { 228, 294, 338, 1, 2, 3, 4, 5, 17 };
+#define BLOCK_SIZES	(sizeof(block_bits) / sizeof(block_bits[0]))
+
+static const int batch_sizes[] = { 1, 8, 16, 32 };
+#define BATCH_SIZES	(sizeof(batch_sizes) / sizeof(batch_sizes[0]))
+#define BATCH_MAX	32
+
+static const enum conv_cch_impl impls[] = { CONV_CCH_SCALAR, CONV_CCH_SSE41, CONV_CCH_AVX2 };
+#define IMPLS		(sizeof(impls) / sizeof(impls[0]))
+
+static double gauss()
+{
+	double u1 = (random() + 1.0) / (RAND_MAX + 2.0);
+	double u2 = (random() + 1.0) / (RAND_MAX + 2.0);
+
+	return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+static void make_block(int8_t *soft, int bits, double sigma, int punct)
+{
+	uint8_t data[MAX_BITS] = { 0 };
+	uint8_t coded[2*MAX_BITS];
+	double v;
+	int i;
+
+	for (i = 0; i < bits; i++) {
+		data[i] = random() & 1;
+	}
+	conv_cch_encode(data, coded, bits);
+
+	for (i = 0; i < 2*bits; i++) {
+		if (random() % 100 < punct) {
+			soft[i] = 0;
+			continue;
+		}
+		v = (coded[i] ? -127 : 127) + sigma * gauss();
+		if (v > 127) {
+			v = 127;
+		}
+		if (v < -128) {
+			v = -128;
+		}
+		soft[i] = (int8_t) lrint(v);
+	}
+}
+
+/* Soft bit k of block b goes to batch[k*count + b] */
+static void interleave(const int8_t *soft, int8_t *batch, int bits, int count)
+{
+	int b, k;
+
+	for (b = 0; b < count; b++) {
+		for (k = 0; k < 2*bits; k++) {
+			batch[k*count + b] = soft[b*2*bits + k];
+		}
+	}
+}
+
+static int check_batch(const int8_t *soft, int8_t *batch, int bits, int count)
+{
+	uint8_t ref[BATCH_MAX][MAX_BITS];
+	uint8_t out[BATCH_MAX][MAX_BITS];
+	uint8_t *outp[BATCH_MAX];
+	int b;
+
+	interleave(soft, batch, bits, count);
+	for (b = 0; b < count; b++) {
+		conv_cch_decode_ref((int8_t *) &soft[b*2*bits], ref[b], bits);
+		outp[b] = out[b];
+	}
+	memset(out, 0xff, sizeof(out));
+	conv_cch_decode_batch(batch, outp, bits, count);
+
+	for (b = 0; b < count; b++) {
+		if (memcmp(ref[b], out[b], bits)) {
+			printf("MISMATCH in batch of %d (%d bits), block %d with %s\n",
+				count, bits, b, conv_cch_impl_name());
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static unsigned blocks = 100000;
+static double sigma = 80;
+static unsigned punct = 5;
+static unsigned bits = 228;
+
+static const struct bench_opt opts[] = {
+	{ 'n', BENCH_UINT, &blocks, "<blocks>", "Number of blocks per decoder" },
+	{ 's', BENCH_DOUBLE, &sigma, "<sigma>", "Noise on the soft bits" },
+	{ 'p', BENCH_UINT, &punct, "<percent>", "Soft bits set to zero" },
+	{ 'l', BENCH_UINT, &bits, "<bits>", "Decoded bits per timed block" },
+	{ 0 }
+};
+
+static int viterbi_main(int argc, char *argv[])
+{
+	int8_t *soft, *batch;
+	uint8_t ref[MAX_BITS];
+	uint8_t out[MAX_BITS];
+	uint8_t *outp[BATCH_MAX];
+	uint8_t (*batch_out)[MAX_BITS];
+	double secs, ref_secs;
+	unsigned i, j, k, b, count;
+
+	if (bench_getopt(&viterbi_bench, argc, argv) != argc || !blocks || !bits || bits > MAX_BITS) {
+		bench_usage(&viterbi_bench);
+	}
+
+	soft = malloc(blocks * 2 * MAX_BITS);
+	batch = malloc(blocks * 2 * MAX_BITS);
+	batch_out = malloc(BATCH_MAX * MAX_BITS);
+	if (!soft || !batch || !batch_out) {
+		errx(1, "Cannot allocate %u blocks", blocks);
+	}
+
+	/* Same output as the reference decoder */
+	srandom(1);
+	for (i = 0; i < blocks; i++) {
+		b = block_bits[i % BLOCK_SIZES];
+		make_block(soft, b, sigma * (i % 4) / 2, punct);
+		conv_cch_decode_ref(soft, ref, b);
+
+		for (k = 0; k < IMPLS; k++) {
+			if (conv_cch_select(impls[k])) {
+				continue;
+			}
+			memset(out, 0xff, sizeof(out));
+			conv_cch_decode(soft, out, b);
+			if (memcmp(ref, out, b)) {
+				printf("MISMATCH in block %u (%u bits) with %s\n", i, b, conv_cch_impl_name());
+				return 1;
+			}
+		}
+	}
+	printf("%u blocks checked\n", blocks);
+
+	/* Batches of every size, same length within a batch */
+	for (i = 0, j = 0; i < blocks; i += count, j++) {
+		b = block_bits[j % BLOCK_SIZES];
+		count = 1 + j % BATCH_MAX;
+		if (count > blocks - i) {
+			count = blocks - i;
+		}
+		for (k = 0; k < count; k++) {
+			make_block(&soft[k * 2 * b], b, sigma * (j % 4) / 2, punct);
+		}
+		for (k = 0; k < IMPLS; k++) {
+			if (conv_cch_select(impls[k])) {
+				continue;
+			}
+			if (check_batch(soft, batch, b, count)) {
+				return 1;
+			}
+		}
+	}
+	printf("%u blocks checked in batches\n", blocks);
+
+	/* Blocks per second */
+	for (i = 0; i < blocks; i++) {
+		make_block(&soft[i * 2 * bits], bits, sigma, punct);
+	}
+
+	ref_secs = stats_secs();
+	for (i = 0; i < blocks; i++) {
+		conv_cch_decode_ref(&soft[i * 2 * bits], out, bits);
+	}
+	ref_secs = stats_secs() - ref_secs;
+	bench_print("reference", blocks, "blocks", ref_secs, 0);
+
+	for (k = 0; k < IMPLS; k++) {
+		if (conv_cch_select(impls[k])) {
+			continue;
+		}
+		secs = stats_secs();
+		for (i = 0; i < blocks; i++) {
+			conv_cch_decode(&soft[i * 2 * bits], out, bits);
+		}
+		secs = stats_secs() - secs;
+		bench_print(conv_cch_impl_name(), blocks, "blocks", secs, ref_secs);
+	}
+
+	/* Batch sizes, same blocks as above */
+	for (k = 0; k < IMPLS; k++) {
+		if (conv_cch_select(impls[k])) {
+			continue;
+		}
+		for (j = 0; j < BATCH_SIZES; j++) {
+			count = batch_sizes[j];
+			for (i = 0; i + count <= blocks; i += count) {
+				interleave(&soft[i * 2 * bits], &batch[i * 2 * bits], bits, count);
+			}
+			for (b = 0; b < count; b++) {
+				outp[b] = batch_out[b];
+			}
+
+			secs = stats_secs();
+			for (i = 0; i + count <= blocks; i += count) {
+				conv_cch_decode_batch(&batch[i * 2 * bits], outp, bits, count);
+			}
+			secs = stats_secs() - secs;
+			printf("%-8s batch %-3u %10u blocks %8.3f s %10.0f blocks/s %6.1fx\n",
+				conv_cch_impl_name(), count, i, secs, i / secs, (ref_secs / blocks) / (secs / i));
+		}
+	}
+
+	free(soft);
+	free(batch);
+	free(batch_out);
+
+	return 0;
+}
+
+const struct bench_cmd viterbi_bench = {
+	.name = "viterbi",
+	.help = "Viterbi decoders of xCCH blocks, alone and in batches",
+	.opts = opts,
+	.main = viterbi_main,
+};
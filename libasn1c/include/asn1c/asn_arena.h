@@ -0,0 +1,84 @@
+/*
+ * Redistribution and modifications are permitted subject to BSD license.
+ */
+/*
+ * Bump allocator for the decoders.
+ */
+#ifndef	_ASN_ARENA_H_
+#define	_ASN_ARENA_H_
+
+#include "asn_system.h"		/* for platform-dependent types */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An arena hands out memory from a chain of large chunks and never
+ * frees it piecewise. Pointing asn_codec_ctx_t::arena at one makes
+ * uper_decode() take every allocation of the decoded structure from it:
+ *
+ *	asn_codec_ctx_t ctx = { 0, arena };
+ *	rv = uper_decode(&ctx, &asn_DEF_Foo, (void **)&foo, buf, size, 0, 0);
+ *	... use foo ...
+ *	asn_arena_reset(arena);		(instead of ASN_STRUCT_FREE())
+ *
+ * A structure decoded into an arena must not be passed to ASN_STRUCT_FREE()
+ * outside of the decoder, it is released by asn_arena_reset() or
+ * asn_arena_free() as a whole, also when the decoding failed half way.
+ * The reset is O(1) and keeps the chunks for the next message.
+ *
+ * An arena must be used by one thread at a time. The arena of the running
+ * decode is kept per thread, several threads may decode into their own
+ * arenas at once.
+ */
+typedef struct asn_arena_chunk_s asn_arena_chunk_t;
+
+typedef struct asn_arena_s {
+	asn_arena_chunk_t *head;	/* First chunk, kept over resets */
+	asn_arena_chunk_t *cur;		/* Chunk allocated from */
+	size_t chunk_size;		/* Payload of a regular chunk */
+	void *last;			/* Latest allocation, grows in place */
+	size_t used;			/* Bytes in use */
+
+	/* Statistics, since asn_arena_new() */
+	size_t allocs;			/* Allocations and reallocations */
+	size_t resets;			/* asn_arena_reset() calls */
+	size_t chunks;			/* Chunks malloc()ed */
+	size_t peak;			/* Most bytes in use between resets */
+} asn_arena_t;
+
+/*
+ * Create an arena of chunks of chunk_size bytes, 0 picks a default.
+ * Returns NULL if out of memory.
+ */
+asn_arena_t *asn_arena_new(size_t chunk_size);
+
+/*
+ * Release everything allocated from the arena. The memory is kept.
+ */
+void asn_arena_reset(asn_arena_t *arena);
+
+/*
+ * Release the arena and its memory.
+ */
+void asn_arena_free(asn_arena_t *arena);
+
+/*
+ * Allocation routines behind the CALLOC(), MALLOC(), REALLOC() and
+ * FREEMEM() macros while a decoder runs on an arena.
+ */
+void *asn_arena_alloc(asn_arena_t *arena, size_t size, int zero);
+void *asn_arena_realloc(asn_arena_t *arena, void *ptr, size_t size);
+int asn_arena_owns(asn_arena_t *arena, const void *ptr);
+
+/*
+ * The arena of the decoder running in this thread, NULL if none.
+ */
+extern __thread asn_arena_t *asn_arena_current;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _ASN_ARENA_H_ */
@@ -34,6 +34,28 @@ typedef struct asn_codec_ctx_s {
 	 * stack size is rather limited.
 	 */
 	size_t  max_stack_size; /* 0 disables stack bounds checking */
+
+	/*
+	 * Take the memory of the decoded structure from this arena instead
+	 * of talloc_asn1_ctx, see asn_arena.h. Only uper_decode() honours it.
+	 */
+	struct asn_arena_s *arena;	/* NULL allocates with talloc */
+
+	/*
+	 * Decode only the members named in this selection and skip the
+	 * others, see per_decoder.h. Only the PER decoders honour it.
+	 */
+	const struct asn_per_select_s *select;	/* NULL decodes all */
+
+	/*
+	 * Let OCTET STRING and BIT STRING values that are whole octets at
+	 * an octet boundary of the input point into it instead of being
+	 * copied. Such values are not nul-terminated and live as long as
+	 * the input buffer. Whole octets off a boundary are shifted once
+	 * into an arena block of their size. Only uper_decode() into an
+	 * arena honours it, as the arena never frees them.
+	 */
+	int zero_copy;			/* 0 copies every string */
 } asn_codec_ctx_t;
 
 /*
@@ -10,6 +10,7 @@
 #define	_ASN_INTERNAL_H_
 
 #include "asn_application.h"	/* Application-visible API */
+#include "asn_arena.h"		/* Decoding into an arena */
 
 #ifndef	__NO_ASSERT_H__		/* Include assert.h only for internal use. */
 #include <assert.h>		/* for assert() macro */
@@ -27,10 +28,40 @@ int get_asn1c_environment_version(void);	/* Run-time version */
 
 extern void *talloc_asn1_ctx;
 
-#define	CALLOC(nmemb, size)	talloc_zero_size(talloc_asn1_ctx, (nmemb) * (size))
-#define	MALLOC(size)		talloc_size(talloc_asn1_ctx, size)
-#define	REALLOC(oldptr, size)	talloc_realloc_size(talloc_asn1_ctx, oldptr, size)
-#define	FREEMEM(ptr)		talloc_free(ptr)
+/*
+ * Memory comes from talloc_asn1_ctx, or from the arena of the running
+ * decoder (see asn_arena.h). Nothing is freed while the arena is in use:
+ * its memory goes as a whole, and strings decoded with zero_copy point
+ * into the input.
+ */
+static inline void *
+_asn_alloc(size_t size, int zero) {
+	if(asn_arena_current)
+		return asn_arena_alloc(asn_arena_current, size, zero);
+	if(zero)
+		return talloc_zero_size(talloc_asn1_ctx, size);
+	return talloc_size(talloc_asn1_ctx, size);
+}
+
+static inline void *
+_asn_realloc(void *ptr, size_t size) {
+	if(asn_arena_current
+	&& (!ptr || asn_arena_owns(asn_arena_current, ptr)))
+		return asn_arena_realloc(asn_arena_current, ptr, size);
+	return talloc_realloc_size(talloc_asn1_ctx, ptr, size);
+}
+
+static inline void
+_asn_free(void *ptr) {
+	if(asn_arena_current)
+		return;
+	talloc_free(ptr);
+}
+
+#define	CALLOC(nmemb, size)	_asn_alloc((nmemb) * (size), 1)
+#define	MALLOC(size)		_asn_alloc(size, 0)
+#define	REALLOC(oldptr, size)	_asn_realloc(oldptr, size)
+#define	FREEMEM(ptr)		_asn_free(ptr)
 
 /*
  * A macro for debugging the ASN.1 internals.
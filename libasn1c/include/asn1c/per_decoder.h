@@ -13,6 +13,31 @@ extern "C" {
 #endif
 
 struct asn_TYPE_descriptor_s;	/* Forward declaration */
+struct asn_TYPE_member_s;	/* Forward declaration */
+
+/*
+ * Selection of the members to decode, for reading a few fields of a large
+ * message. An array of these names the members of a SEQUENCE or the
+ * alternatives of a CHOICE to decode, each with the selection applying to
+ * its own members, or NULL to decode it whole. The array ends with a NULL
+ * name. Members not named are skipped in the bit stream without being
+ * decoded, allocated or validated: they are left zero, or NULL if they are
+ * pointers. A skipped CHOICE alternative still sets the presence value.
+ * SEQUENCE OF and SET OF apply the selection to their elements.
+ *
+ *	static const asn_per_select_t nas[] = {
+ *		{ "cn-DomainIdentity", 0 }, { "nas-Message", 0 }, { 0, 0 } };
+ *	static const asn_per_select_t transfer[] = {
+ *		{ "initialDirectTransfer", nas }, { 0, 0 } };
+ *	static const asn_per_select_t message[] = {
+ *		{ "message", transfer }, { 0, 0 } };
+ *
+ *	asn_codec_ctx_t ctx = { 0, 0, message };
+ */
+typedef struct asn_per_select_s {
+	const char *name;		/* Member name, as in elements[] */
+	const struct asn_per_select_s *members;	/* NULL decodes all */
+} asn_per_select_t;
 
 /*
  * Unaligned PER decoder of a "complete encoding" as per X.691#10.1.
@@ -39,6 +64,27 @@ asn_dec_rval_t uper_decode(struct asn_codec_ctx_s *opt_codec_ctx,
 	);
 
 
+/*
+ * Decode a member of a SEQUENCE or CHOICE, or an open type if open_type
+ * is set, when the selection of the codec context includes it, otherwise
+ * skip it.
+ */
+asn_dec_rval_t uper_decode_member(struct asn_codec_ctx_s *opt_codec_ctx,
+	struct asn_TYPE_member_s *elm,	/* Member to decode */
+	void **memb_ptr2,	/* Pointer to the member's pointer */
+	asn_per_data_t *per_data,
+	int open_type		/* Member is encoded as an open type */
+	);
+
+/*
+ * Skip an encoding of the type without decoding it.
+ */
+asn_dec_rval_t uper_skip(struct asn_codec_ctx_s *opt_codec_ctx,
+	struct asn_TYPE_descriptor_s *type_descriptor,
+	asn_per_constraints_t *constraints,
+	asn_per_data_t *per_data
+	);
+
 /*
  * Type of the type-specific PER decoder function.
  */
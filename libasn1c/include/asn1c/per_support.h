@@ -64,6 +64,13 @@ void per_get_undo(asn_per_data_t *per_data, int get_nbits);
 int per_get_many_bits(asn_per_data_t *pd, uint8_t *dst, int right_align,
 			int get_nbits);
 
+/*
+ * Skip a number of bits in the specified PER data pointer.
+ * This function returns -1 if the specified number of bits could not be
+ * skipped due to EOD or other conditions.
+ */
+int per_skip_many_bits(asn_per_data_t *pd, size_t skip_nbits);
+
 /*
  * Get the length "n" from the Unaligned PER stream.
  */
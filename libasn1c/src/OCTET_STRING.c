@@ -1320,6 +1320,35 @@ OCTET_STRING_per_put_characters(asn_per_outp_t *po, const uint8_t *buf,
 	return 0;
 }
 
+/*
+ * Take whole octets out of the input without a staging copy, see
+ * asn_codec_ctx_t::zero_copy. At an octet boundary they are referenced
+ * in place, off one they are shifted once into an arena block of their
+ * size. NULL if they are not whole octets or not all in this stream.
+ */
+static uint8_t *
+OCTET_STRING_per_borrow(asn_per_data_t *pd, size_t nbits) {
+	const uint8_t *ptr;
+	uint8_t *buf;
+
+	if(!nbits || (nbits & 0x07) || nbits > pd->nbits - pd->nboff)
+		return NULL;
+
+	if(pd->nboff & 0x07) {
+		buf = (uint8_t *)MALLOC((nbits >> 3) + 1);
+		if(!buf || per_get_many_bits(pd, buf, 0, nbits))
+			return NULL;
+		buf[nbits >> 3] = 0;
+		return buf;
+	}
+
+	ptr = pd->buffer + (pd->nboff >> 3);
+	pd->nboff += nbits;
+	pd->moved += nbits;
+
+	return (uint8_t *)ptr;
+}
+
 asn_dec_rval_t
 OCTET_STRING_decode_uper(asn_codec_ctx_t *opt_codec_ctx,
 	asn_TYPE_descriptor_t *td, asn_per_constraints_t *constraints,
@@ -1344,8 +1373,7 @@ OCTET_STRING_decode_uper(asn_codec_ctx_t *opt_codec_ctx,
 	} bpc;	/* Bytes per character */
 	unsigned int unit_bits;
 	unsigned int canonical_unit_bits;
-
-	(void)opt_codec_ctx;
+	int borrow;	/* Octets are taken without a staging copy */
 
 	if(pc) {
 		cval = &pc->value;
@@ -1406,7 +1434,27 @@ OCTET_STRING_decode_uper(asn_codec_ctx_t *opt_codec_ctx,
 		}
 	}
 
-	if(csiz->effective_bits >= 0) {
+	/* Octets in the input as they are in the string, see 27.5.4 */
+	borrow = opt_codec_ctx && opt_codec_ctx->zero_copy
+		&& asn_arena_current && opt_codec_ctx->arena == asn_arena_current
+		&& !st->buf
+		&& (bpc == OS__BPC_BIT || (bpc == OS__BPC_CHAR && unit_bits == 8
+			&& (unsigned long)cval->upper_bound <= 256));
+
+	if(borrow && csiz->effective_bits == 0) {
+		size_t nbits = unit_bits * csiz->upper_bound;
+		uint8_t *ptr = OCTET_STRING_per_borrow(pd, nbits);
+		if(ptr) {
+			st->buf = ptr;
+			st->size = nbits >> 3;
+			consumed_myself += nbits;
+			RETURN(RC_OK);
+		}
+	}
+
+	/* Borrowed octets bring their own room, others get it per chunk */
+	if(csiz->effective_bits >= 0
+	&& !(borrow && csiz->effective_bits > 0)) {
 		FREEMEM(st->buf);
 		if(bpc) {
 			st->size = csiz->upper_bound * bpc;
@@ -1471,6 +1519,13 @@ OCTET_STRING_decode_uper(asn_codec_ctx_t *opt_codec_ctx,
 				st->bits_unused = 8 - (len_bits & 0x7);
 			/* len_bits be multiple of 16K if repeat is set */
 		}
+		if(borrow && !repeat && !st->buf) {
+			st->buf = OCTET_STRING_per_borrow(pd, len_bits);
+			if(st->buf) {
+				st->size = len_bytes;
+				return rval;
+			}
+		}
 		p = REALLOC(st->buf, st->size + len_bytes + 1);
 		if(!p) RETURN(RC_FAIL);
 		st->buf = (uint8_t *)p;
@@ -0,0 +1,174 @@
+/*
+ * Redistribution and modifications are permitted subject to BSD license.
+ */
+#include <asn_internal.h>
+#include <asn_arena.h>
+
+#define	ARENA_ALIGN		16
+#define	ARENA_ROUND(n)		(((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define	ARENA_DEFAULT_CHUNK	16384
+
+/*
+ * Each allocation is preceded by its size, for REALLOC().
+ */
+#define	ARENA_HDR		ARENA_ROUND(sizeof(size_t))
+
+struct asn_arena_chunk_s {
+	asn_arena_chunk_t *next;
+	size_t size;		/* Payload bytes */
+	size_t used;		/* Payload bytes handed out */
+	/* Payload follows, ARENA_ALIGN aligned */
+};
+
+#define	CHUNK_DATA(c)	((char *)(c) + ARENA_ROUND(sizeof(asn_arena_chunk_t)))
+
+__thread asn_arena_t *asn_arena_current;
+
+static asn_arena_chunk_t *
+arena_chunk_new(asn_arena_t *arena, size_t size) {
+	asn_arena_chunk_t *c;
+
+	c = (asn_arena_chunk_t *)malloc(ARENA_ROUND(sizeof(*c)) + size);
+	if(!c) return NULL;
+	c->next = NULL;
+	c->size = size;
+	c->used = 0;
+	arena->chunks++;
+
+	return c;
+}
+
+asn_arena_t *
+asn_arena_new(size_t chunk_size) {
+	asn_arena_t *arena;
+
+	if(!chunk_size)
+		chunk_size = ARENA_DEFAULT_CHUNK;
+
+	arena = (asn_arena_t *)calloc(1, sizeof(*arena));
+	if(!arena) return NULL;
+
+	arena->chunk_size = ARENA_ROUND(chunk_size);
+	arena->head = arena_chunk_new(arena, arena->chunk_size);
+	if(!arena->head) {
+		free(arena);
+		return NULL;
+	}
+	arena->cur = arena->head;
+
+	return arena;
+}
+
+void
+asn_arena_reset(asn_arena_t *arena) {
+	/*
+	 * Chunks after the current one are stale, they are
+	 * cleared when the allocator steps into them.
+	 */
+	arena->cur = arena->head;
+	arena->head->used = 0;
+	arena->last = NULL;
+	arena->used = 0;
+	arena->resets++;
+}
+
+void
+asn_arena_free(asn_arena_t *arena) {
+	asn_arena_chunk_t *c, *next;
+
+	if(!arena) return;
+
+	if(asn_arena_current == arena)
+		asn_arena_current = NULL;
+
+	for(c = arena->head; c; c = next) {
+		next = c->next;
+		free(c);
+	}
+	free(arena);
+}
+
+void *
+asn_arena_alloc(asn_arena_t *arena, size_t size, int zero) {
+	asn_arena_chunk_t *c = arena->cur;
+	size_t need = ARENA_HDR + ARENA_ROUND(size);
+	char *p;
+
+	while(c->used + need > c->size) {
+		if(c->next && c->next->size >= need) {
+			c = c->next;
+			c->used = 0;
+		} else {
+			/* Oversized requests get a chunk of their own */
+			asn_arena_chunk_t *n = arena_chunk_new(arena,
+				need > arena->chunk_size ? need : arena->chunk_size);
+			if(!n) return NULL;
+			n->next = c->next;
+			c->next = n;
+			c = n;
+		}
+	}
+	arena->cur = c;
+
+	p = CHUNK_DATA(c) + c->used;
+	c->used += need;
+	*(size_t *)p = size;
+	p += ARENA_HDR;
+	if(zero)
+		memset(p, 0, size);
+
+	arena->last = p;
+	arena->allocs++;
+	arena->used += need;
+	if(arena->used > arena->peak)
+		arena->peak = arena->used;
+
+	return p;
+}
+
+void *
+asn_arena_realloc(asn_arena_t *arena, void *ptr, size_t size) {
+	asn_arena_chunk_t *c = arena->cur;
+	size_t *hdr;
+	size_t old;
+	void *p;
+
+	if(!ptr)
+		return asn_arena_alloc(arena, size, 0);
+
+	hdr = (size_t *)((char *)ptr - ARENA_HDR);
+	old = ARENA_ROUND(*hdr);
+
+	/* The latest allocation may grow or shrink in place */
+	if(ptr == arena->last
+	&& c->used - old + ARENA_ROUND(size) <= c->size) {
+		c->used = c->used - old + ARENA_ROUND(size);
+		arena->used = arena->used - old + ARENA_ROUND(size);
+		if(arena->used > arena->peak)
+			arena->peak = arena->used;
+		*hdr = size;
+		arena->allocs++;
+		return ptr;
+	}
+
+	p = asn_arena_alloc(arena, size, 0);
+	if(p)
+		memcpy(p, ptr, *hdr < size ? *hdr : size);
+
+	return p;
+}
+
+int
+asn_arena_owns(asn_arena_t *arena, const void *ptr) {
+	asn_arena_chunk_t *c;
+
+	for(c = arena->head; c; c = c->next) {
+		if((const char *)ptr >= CHUNK_DATA(c)
+		&& (const char *)ptr < CHUNK_DATA(c) + c->used)
+			return 1;
+		if(c == arena->cur)
+			break;
+	}
+
+	return 0;
+}
@@ -891,13 +891,9 @@ CHOICE_decode_uper(asn_codec_ctx_t *opt_codec_ctx, asn_TYPE_descriptor_t *td,
 	}
 	ASN_DEBUG("Discovered CHOICE %s encodes %s", td->name, elm->name);
 
-	if(ct && ct->range_bits >= 0) {
-		rv = elm->type->uper_decoder(opt_codec_ctx, elm->type,
-			elm->per_constraints, memb_ptr2, pd);
-	} else {
-		rv = uper_open_type_get(opt_codec_ctx, elm->type,
-			elm->per_constraints, memb_ptr2, pd);
-	}
+	/* Extension alternatives are open types */
+	rv = uper_decode_member(opt_codec_ctx, elm, memb_ptr2, pd,
+		!(ct && ct->range_bits >= 0));
 
 	if(rv.code != RC_OK)
 		ASN_DEBUG("Failed to decode %s in %s (CHOICE) %d",
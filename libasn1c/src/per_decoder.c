@@ -41,6 +41,7 @@ uper_decode(asn_codec_ctx_t *opt_codec_ctx, asn_TYPE_descriptor_t *td, void **sp
 	asn_codec_ctx_t s_codec_ctx;
 	asn_dec_rval_t rval;
 	asn_per_data_t pd;
+	asn_arena_t *arena;
 
 	if(skip_bits < 0 || skip_bits > 7
 	|| unused_bits < 0 || unused_bits > 7
@@ -76,7 +77,11 @@ uper_decode(asn_codec_ctx_t *opt_codec_ctx, asn_TYPE_descriptor_t *td, void **sp
 	 */
 	if(!td->uper_decoder)
 		_ASN_DECODE_FAILED;	/* PER is not compiled in */
+	arena = asn_arena_current;
+	if(opt_codec_ctx->arena)
+		asn_arena_current = opt_codec_ctx->arena;
 	rval = td->uper_decoder(opt_codec_ctx, td, 0, sptr, &pd);
+	asn_arena_current = arena;
 	if(rval.code == RC_OK) {
 		/* Return the number of consumed bits */
 		rval.consumed = ((pd.buffer - (const uint8_t *)buffer) << 3)
@@ -16,7 +16,6 @@ typedef struct uper_ugot_key {
 
 static int uper_ugot_refill(asn_per_data_t *pd);
 static int per_skip_bits(asn_per_data_t *pd, int skip_nbits);
-static asn_dec_rval_t uper_sot_suck(asn_codec_ctx_t *, asn_TYPE_descriptor_t *td, asn_per_constraints_t *constraints, void **sptr, asn_per_data_t *pd);
 
 int asn_debug_indent;
 
@@ -250,41 +249,27 @@ uper_open_type_get(asn_codec_ctx_t *ctx, asn_TYPE_descriptor_t *td,
 
 int
 uper_open_type_skip(asn_codec_ctx_t *ctx, asn_per_data_t *pd) {
-	asn_TYPE_descriptor_t s_td;
-	asn_dec_rval_t rv;
+	ssize_t chunk_bytes;
+	int repeat;
 
-	s_td.name = "<unknown extension>";
-	s_td.uper_decoder = uper_sot_suck;
+	(void)ctx;
 
-	rv = uper_open_type_get(ctx, &s_td, 0, 0, pd);
-	if(rv.code != RC_OK)
-		return -1;
-	else
-		return 0;
+	/* Step over the length-prefixed chunks, nothing is decoded */
+	do {
+		chunk_bytes = uper_get_length(pd, -1, &repeat);
+		if(chunk_bytes < 0)
+			return -1;
+		if(per_skip_many_bits(pd, 8 * chunk_bytes))
+			return -1;
+	} while(repeat);
+
+	return 0;
 }
 
 /*
  * Internal functions.
  */
 
-static asn_dec_rval_t
-uper_sot_suck(asn_codec_ctx_t *ctx, asn_TYPE_descriptor_t *td,
-	asn_per_constraints_t *constraints, void **sptr, asn_per_data_t *pd) {
-	asn_dec_rval_t rv;
-
-	(void)ctx;
-	(void)td;
-	(void)constraints;
-	(void)sptr;
-
-	while(per_get_few_bits(pd, 24) >= 0);
-
-	rv.code = RC_OK;
-	rv.consumed = pd->moved;
-
-	return rv;
-}
-
 static int
 uper_ugot_refill(asn_per_data_t *pd) {
 	uper_ugot_key *arg = pd->refill_key;
@@ -0,0 +1,417 @@
+/*
+ * Redistribution and modifications are permitted subject to BSD license.
+ */
+#include <asn_internal.h>
+#include <per_decoder.h>
+#include <per_opentype.h>
+#include <constr_SEQUENCE.h>
+#include <constr_CHOICE.h>
+#include <constr_SET_OF.h>
+#include <NativeInteger.h>
+#include <NativeEnumerated.h>
+#include <ENUMERATED.h>
+#include <BOOLEAN.h>
+#include <NULL.h>
+#include <OCTET_STRING.h>
+
+/*
+ * Skipping follows the PER layout of the decoders named in uper_skip(),
+ * reading only the lengths, presence bits and indices that tell where
+ * the next component starts.
+ */
+
+#define	IN_EXTENSION_GROUP(specs, memb_idx)	\
+	( ((memb_idx) > (specs)->ext_after)	\
+	&&((memb_idx) < (specs)->ext_before))
+
+#define	SKIP_OK		do {			\
+		asn_dec_rval_t tmprval;		\
+		tmprval.code = RC_OK;		\
+		tmprval.consumed = 0;		\
+		return tmprval;			\
+	} while(0)
+
+/* Longest presence bitmap read on the stack */
+#define	SKIP_MAX_ROMS	256
+
+/* As the defaults of OCTET_STRING.c */
+static asn_per_constraints_t skip_OCTET_STRING_constraints = {
+	{ APC_CONSTRAINED, 8, 8, 0, 255 },
+	{ APC_SEMI_CONSTRAINED, -1, -1, 0, 0 },
+	0, 0
+};
+
+asn_dec_rval_t
+uper_decode_member(asn_codec_ctx_t *ctx, asn_TYPE_member_t *elm,
+	void **memb_ptr2, asn_per_data_t *pd, int open_type) {
+	const asn_per_select_t *select = ctx ? ctx->select : 0;
+	const asn_per_select_t *sel;
+	asn_dec_rval_t rv;
+
+	if(select) {
+		for(sel = select; sel->name; sel++)
+			if(!strcmp(sel->name, elm->name))
+				break;
+		if(!sel->name) {
+			ASN_DEBUG("Skipping %s", elm->name);
+			if(!open_type)
+				return uper_skip(ctx, elm->type,
+					elm->per_constraints, pd);
+			if(uper_open_type_skip(ctx, pd))
+				_ASN_DECODE_STARVED;
+			SKIP_OK;
+		}
+		ctx->select = sel->members;
+	}
+
+	if(open_type)
+		rv = uper_open_type_get(ctx, elm->type,
+			elm->per_constraints, memb_ptr2, pd);
+	else
+		rv = elm->type->uper_decoder(ctx, elm->type,
+			elm->per_constraints, memb_ptr2, pd);
+
+	if(select)
+		ctx->select = select;
+
+	return rv;
+}
+
+static asn_dec_rval_t
+SEQUENCE_skip(asn_codec_ctx_t *ctx, asn_TYPE_descriptor_t *td,
+		asn_per_data_t *pd) {
+	asn_SEQUENCE_specifics_t *specs = (asn_SEQUENCE_specifics_t *)td->specifics;
+	uint8_t opres[(SKIP_MAX_ROMS >> 3) + 1];
+	asn_per_data_t opmd;
+	asn_dec_rval_t rv;
+	int extpresent;
+	int edx;
+
+	if(specs->ext_before >= 0) {
+		extpresent = per_get_few_bits(pd, 1);
+		if(extpresent < 0) _ASN_DECODE_STARVED;
+	} else {
+		extpresent = 0;
+	}
+
+	memset(&opmd, 0, sizeof(opmd));
+	if(specs->roms_count) {
+		if(specs->roms_count > SKIP_MAX_ROMS)
+			_ASN_DECODE_FAILED;
+		if(per_get_many_bits(pd, opres, 0, specs->roms_count))
+			_ASN_DECODE_STARVED;
+		opmd.buffer = opres;
+		opmd.nbits = specs->roms_count;
+	}
+
+	for(edx = 0; edx < td->elements_count; edx++) {
+		asn_TYPE_member_t *elm = &td->elements[edx];
+
+		if(IN_EXTENSION_GROUP(specs, edx))
+			continue;
+		if(elm->optional && per_get_few_bits(&opmd, 1) == 0)
+			continue;
+
+		rv = uper_skip(ctx, elm->type, elm->per_constraints, pd);
+		if(rv.code != RC_OK)
+			return rv;
+	}
+
+	if(extpresent) {
+		ssize_t bmlength;
+		ssize_t present = 0;
+
+		bmlength = uper_get_nslength(pd);
+		if(bmlength < 0) _ASN_DECODE_STARVED;
+
+		/* The bitmap comes first, then an open type per set bit */
+		while(bmlength--) {
+			int bit = per_get_few_bits(pd, 1);
+			if(bit < 0) _ASN_DECODE_STARVED;
+			present += bit;
+		}
+		while(present--)
+			if(uper_open_type_skip(ctx, pd))
+				_ASN_DECODE_STARVED;
+	}
+
+	SKIP_OK;
+}
+
+static asn_dec_rval_t
+CHOICE_skip(asn_codec_ctx_t *ctx, asn_TYPE_descriptor_t *td,
+		asn_per_constraints_t *constraints, asn_per_data_t *pd) {
+	asn_CHOICE_specifics_t *specs = (asn_CHOICE_specifics_t *)td->specifics;
+	asn_per_constraint_t *ct;
+	asn_TYPE_member_t *elm;
+	int value;
+
+	if(constraints) ct = &constraints->value;
+	else if(td->per_constraints) ct = &td->per_constraints->value;
+	else ct = 0;
+
+	if(ct && ct->flags & APC_EXTENSIBLE) {
+		value = per_get_few_bits(pd, 1);
+		if(value < 0) _ASN_DECODE_STARVED;
+		if(value) ct = 0;
+	}
+
+	if(ct && ct->range_bits >= 0) {
+		value = per_get_few_bits(pd, ct->range_bits);
+		if(value < 0) _ASN_DECODE_STARVED;
+		if(value > ct->upper_bound)
+			_ASN_DECODE_FAILED;
+	} else {
+		if(specs->ext_start == -1)
+			_ASN_DECODE_FAILED;
+		/* Extension alternatives are open types */
+		value = uper_get_nsnnwn(pd);
+		if(value < 0) _ASN_DECODE_STARVED;
+		if(value + specs->ext_start >= td->elements_count)
+			_ASN_DECODE_FAILED;
+		if(uper_open_type_skip(ctx, pd))
+			_ASN_DECODE_STARVED;
+		SKIP_OK;
+	}
+
+	if(specs->canonical_order)
+		value = specs->canonical_order[value];
+
+	elm = &td->elements[value];
+	return uper_skip(ctx, elm->type, elm->per_constraints, pd);
+}
+
+static asn_dec_rval_t
+SET_OF_skip(asn_codec_ctx_t *ctx, asn_TYPE_descriptor_t *td,
+		asn_per_constraints_t *constraints, asn_per_data_t *pd) {
+	asn_TYPE_member_t *elm = td->elements;	/* Single one */
+	asn_per_constraint_t *ct;
+	asn_dec_rval_t rv;
+	ssize_t nelems;
+	int repeat = 0;
+
+	if(constraints) ct = &constraints->size;
+	else if(td->per_constraints) ct = &td->per_constraints->size;
+	else ct = 0;
+
+	if(ct && ct->flags & APC_EXTENSIBLE) {
+		int value = per_get_few_bits(pd, 1);
+		if(value < 0) _ASN_DECODE_STARVED;
+		if(value) ct = 0;
+	}
+
+	if(ct && ct->effective_bits >= 0) {
+		nelems = per_get_few_bits(pd, ct->effective_bits);
+		if(nelems < 0) _ASN_DECODE_STARVED;
+		nelems += ct->lower_bound;
+	} else {
+		nelems = -1;
+	}
+
+	do {
+		if(nelems < 0) {
+			nelems = uper_get_length(pd,
+				ct ? ct->effective_bits : -1, &repeat);
+			if(nelems < 0) _ASN_DECODE_STARVED;
+		}
+
+		for(; nelems > 0; nelems--) {
+			rv = uper_skip(ctx, elm->type, elm->per_constraints, pd);
+			if(rv.code != RC_OK)
+				return rv;
+		}
+
+		nelems = -1;
+	} while(repeat);
+
+	SKIP_OK;
+}
+
+static asn_dec_rval_t
+INTEGER_skip(asn_TYPE_descriptor_t *td,
+		asn_per_constraints_t *constraints, asn_per_data_t *pd) {
+	asn_per_constraint_t *ct;
+	int repeat;
+
+	if(!constraints) constraints = td->per_constraints;
+	ct = constraints ? &constraints->value : 0;
+
+	if(ct && ct->flags & APC_EXTENSIBLE) {
+		int inext = per_get_few_bits(pd, 1);
+		if(inext < 0) _ASN_DECODE_STARVED;
+		if(inext) ct = 0;
+	}
+
+	/* X.691, #12.2.2 */
+	if(ct && ct->flags != APC_UNCONSTRAINED && ct->range_bits >= 0) {
+		if(per_skip_many_bits(pd, ct->range_bits))
+			_ASN_DECODE_STARVED;
+		SKIP_OK;
+	}
+
+	/* X.691, #12.2.3, #12.2.4 */
+	do {
+		ssize_t len = uper_get_length(pd, -1, &repeat);
+		if(len < 0) _ASN_DECODE_STARVED;
+		if(per_skip_many_bits(pd, 8 * len))
+			_ASN_DECODE_STARVED;
+	} while(repeat);
+
+	SKIP_OK;
+}
+
+static asn_dec_rval_t
+ENUMERATED_skip(asn_TYPE_descriptor_t *td,
+		asn_per_constraints_t *constraints, asn_per_data_t *pd) {
+	asn_per_constraint_t *ct;
+
+	if(constraints) ct = &constraints->value;
+	else if(td->per_constraints) ct = &td->per_constraints->value;
+	else _ASN_DECODE_FAILED;	/* Mandatory! */
+
+	if(ct->flags & APC_EXTENSIBLE) {
+		int inext = per_get_few_bits(pd, 1);
+		if(inext < 0) _ASN_DECODE_STARVED;
+		if(inext) ct = 0;
+	}
+
+	if(ct && ct->range_bits >= 0) {
+		if(per_skip_many_bits(pd, ct->range_bits))
+			_ASN_DECODE_STARVED;
+	} else {
+		if(uper_get_nsnnwn(pd) < 0)
+			_ASN_DECODE_STARVED;
+	}
+
+	SKIP_OK;
+}
+
+static asn_dec_rval_t
+OCTET_STRING_skip(asn_TYPE_descriptor_t *td,
+		asn_per_constraints_t *constraints, asn_per_data_t *pd) {
+	asn_OCTET_STRING_specifics_t *specs = td->specifics
+		? (asn_OCTET_STRING_specifics_t *)td->specifics
+		: (asn_OCTET_STRING_specifics_t *)asn_DEF_OCTET_STRING.specifics;
+	asn_per_constraints_t *pc = constraints ? constraints
+				: td->per_constraints;
+	asn_per_constraint_t *cval;
+	asn_per_constraint_t *csiz;
+	unsigned int unit_bits;
+	unsigned int canonical_unit_bits;
+	int repeat;
+
+	if(pc) {
+		cval = &pc->value;
+		csiz = &pc->size;
+	} else {
+		cval = &skip_OCTET_STRING_constraints.value;
+		csiz = &skip_OCTET_STRING_constraints.size;
+	}
+
+	switch(specs->subvariant) {
+	default:
+	case ASN_OSUBV_ANY:
+		_ASN_DECODE_FAILED;
+	case ASN_OSUBV_BIT:
+		canonical_unit_bits = unit_bits = 1;
+		break;
+	case ASN_OSUBV_STR:
+		canonical_unit_bits = unit_bits = 8;
+		if(cval->flags & APC_CONSTRAINED)
+			unit_bits = cval->range_bits;
+		break;
+	case ASN_OSUBV_U16:
+		canonical_unit_bits = unit_bits = 16;
+		if(cval->flags & APC_CONSTRAINED)
+			unit_bits = cval->range_bits;
+		break;
+	case ASN_OSUBV_U32:
+		canonical_unit_bits = unit_bits = 32;
+		if(cval->flags & APC_CONSTRAINED)
+			unit_bits = cval->range_bits;
+		break;
+	}
+
+	if(csiz->flags & APC_EXTENSIBLE) {
+		int inext = per_get_few_bits(pd, 1);
+		if(inext < 0) _ASN_DECODE_STARVED;
+		if(inext) {
+			csiz = &skip_OCTET_STRING_constraints.size;
+			unit_bits = canonical_unit_bits;
+		}
+	}
+
+	/* X.691, #16.5, #16.6, #16.7: fixed size */
+	if(csiz->effective_bits == 0) {
+		if(per_skip_many_bits(pd, unit_bits * csiz->upper_bound))
+			_ASN_DECODE_STARVED;
+		SKIP_OK;
+	}
+
+	do {
+		ssize_t raw_len;
+
+		raw_len = uper_get_length(pd, csiz->effective_bits, &repeat);
+		if(raw_len < 0) _ASN_DECODE_STARVED;
+		raw_len += csiz->lower_bound;
+		if(per_skip_many_bits(pd, unit_bits * raw_len))
+			_ASN_DECODE_STARVED;
+	} while(repeat);
+
+	SKIP_OK;
+}
+
+/*
+ * Types are told apart by their decoder. Others, and types generated
+ * with a decoder of their own, are decoded and thrown away. Generated
+ * types take on the decoder of their base type when they are decoded
+ * the first time, and are skipped from then on.
+ */
+asn_dec_rval_t
+uper_skip(asn_codec_ctx_t *ctx, asn_TYPE_descriptor_t *td,
+		asn_per_constraints_t *constraints, asn_per_data_t *pd) {
+	per_type_decoder_f *decoder = td->uper_decoder;
+	const asn_per_select_t *select;
+	asn_dec_rval_t rv;
+	void *st = 0;
+
+	if(_ASN_STACK_OVERFLOW_CHECK(ctx))
+		_ASN_DECODE_FAILED;
+
+	if(decoder == SEQUENCE_decode_uper)
+		return SEQUENCE_skip(ctx, td, pd);
+	if(decoder == CHOICE_decode_uper)
+		return CHOICE_skip(ctx, td, constraints, pd);
+	if(decoder == SET_OF_decode_uper)
+		return SET_OF_skip(ctx, td, constraints, pd);
+	if(decoder == NativeInteger_decode_uper
+	|| decoder == INTEGER_decode_uper)
+		return INTEGER_skip(td, constraints, pd);
+	if(decoder == NativeEnumerated_decode_uper
+	|| decoder == ENUMERATED_decode_uper)
+		return ENUMERATED_skip(td, constraints, pd);
+	if(decoder == OCTET_STRING_decode_uper)
+		return OCTET_STRING_skip(td, constraints, pd);
+	if(decoder == BOOLEAN_decode_uper) {
+		if(per_skip_many_bits(pd, 1))
+			_ASN_DECODE_STARVED;
+		SKIP_OK;
+	}
+	if(decoder == NULL_decode_uper)
+		SKIP_OK;
+
+	if(!decoder)
+		_ASN_DECODE_FAILED;
+
+	ASN_DEBUG("Skipping %s by decoding it", td->name);
+	select = ctx ? ctx->select : 0;
+	if(ctx) ctx->select = 0;
+	rv = decoder(ctx, td, constraints, &st, pd);
+	if(ctx) ctx->select = select;
+
+	/* Memory of an arena goes with the arena */
+	if(!asn_arena_current)
+		ASN_STRUCT_FREE(*td, st);
+
+	return rv;
+}
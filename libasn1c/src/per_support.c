@@ -31,14 +31,51 @@ per_get_undo(asn_per_data_t *pd, int nbits) {
 	}
 }
 
+/*
+ * Load 8 octets as a big-endian word, regardless of their alignment.
+ */
+static inline uint64_t
+per_load_be64(const uint8_t *buf) {
+#if	defined(__GNUC__) && defined(__BYTE_ORDER__) \
+	&& (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	uint64_t word;
+	memcpy(&word, buf, sizeof(word));
+	return __builtin_bswap64(word);
+#elif	defined(__GNUC__) && defined(__BYTE_ORDER__) \
+	&& (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	uint64_t word;
+	memcpy(&word, buf, sizeof(word));
+	return word;
+#else
+	return ((uint64_t)buf[0] << 56) | ((uint64_t)buf[1] << 48)
+	     | ((uint64_t)buf[2] << 40) | ((uint64_t)buf[3] << 32)
+	     | ((uint64_t)buf[4] << 24) | ((uint64_t)buf[5] << 16)
+	     | ((uint64_t)buf[6] << 8) | (uint64_t)buf[7];
+#endif
+}
+
+/*
+ * Load the first octets of a big-endian word, when fewer than 8 remain.
+ */
+static inline uint64_t
+per_load_be64_tail(const uint8_t *buf, size_t octets) {
+	uint64_t word = 0;
+	size_t i;
+
+	for(i = 0; i < octets; i++)
+		word |= (uint64_t)buf[i] << (56 - 8 * i);
+
+	return word;
+}
+
 /*
  * Extract a small number of bits (<= 31) from the specified PER data pointer.
  */
 int32_t
 per_get_few_bits(asn_per_data_t *pd, int nbits) {
-	size_t off;	/* Next after last bit offset */
+	size_t off;	/* Bit offset in the first octet */
 	ssize_t nleft;	/* Number of bits left in this stream */
-	uint32_t accum;
+	uint64_t accum;
 	const uint8_t *buf;
 
 	if(nbits < 0)
@@ -62,6 +99,9 @@ per_get_few_bits(asn_per_data_t *pd, int nbits) {
 		return tailv;
 	}
 
+	if(nbits > 31)
+		return -1;
+
 	/*
 	 * Normalize position indicator.
 	 */
@@ -70,38 +110,23 @@ per_get_few_bits(asn_per_data_t *pd, int nbits) {
 		pd->nbits  -= (pd->nboff & ~0x07);
 		pd->nboff  &= 0x07;
 	}
-	pd->moved += nbits;
-	pd->nboff += nbits;
+	if(!nbits)
+		return 0;
+
 	off = pd->nboff;
 	buf = pd->buffer;
+	pd->moved += nbits;
+	pd->nboff += nbits;
 
 	/*
-	 * Extract specified number of bits.
+	 * Extract specified number of bits with one load of the
+	 * (at most 5) octets they span, a whole word if it fits.
 	 */
-	if(off <= 8)
-		accum = nbits ? (buf[0]) >> (8 - off) : 0;
-	else if(off <= 16)
-		accum = ((buf[0] << 8) + buf[1]) >> (16 - off);
-	else if(off <= 24)
-		accum = ((buf[0] << 16) + (buf[1] << 8) + buf[2]) >> (24 - off);
-	else if(off <= 31)
-		accum = ((buf[0] << 24) + (buf[1] << 16)
-			+ (buf[2] << 8) + (buf[3])) >> (32 - off);
-	else if(nbits <= 31) {
-		asn_per_data_t tpd = *pd;
-		/* Here are we with our 31-bits limit plus 1..7 bits offset. */
-		per_get_undo(&tpd, nbits);
-		/* The number of available bits in the stream allow
-		 * for the following operations to take place without
-		 * invoking the ->refill() function */
-		accum  = per_get_few_bits(&tpd, nbits - 24) << 24;
-		accum |= per_get_few_bits(&tpd, 24);
-	} else {
-		per_get_undo(pd, nbits);
-		return -1;
-	}
-
-	accum &= (((uint32_t)1 << nbits) - 1);
+	if(pd->nbits >= 64)
+		accum = per_load_be64(buf);
+	else
+		accum = per_load_be64_tail(buf, (off + nbits + 7) >> 3);
+	accum = (accum << off) >> (64 - nbits);
 
 	ASN_DEBUG("  [PER got %2d<=%2d bits => span %d %+d[%d..%d]:%02x (%d) => 0x%x]",
 		nbits, nleft,
@@ -112,7 +137,7 @@ per_get_few_bits(asn_per_data_t *pd, int nbits) {
 		pd->nbits - pd->nboff,
 		(int)accum);
 
-	return accum;
+	return (int32_t)accum;
 }
 
 /*
@@ -130,6 +155,41 @@ per_get_many_bits(asn_per_data_t *pd, uint8_t *dst, int alright, int nbits) {
 		nbits &= ~7;
 	}
 
+	/*
+	 * Whole octets in this stream are copied as is if aligned,
+	 * otherwise shifted out of words of 8 octets, 7 at a time.
+	 */
+	if(nbits >= 8 && (size_t)nbits <= pd->nbits - pd->nboff) {
+		const uint8_t *buf = pd->buffer + (pd->nboff >> 3);
+		const uint8_t *end = pd->buffer + ((pd->nbits + 7) >> 3);
+		size_t off = pd->nboff & 0x07;
+		size_t octets = nbits >> 3;
+		size_t i = 0;
+
+		if(!off) {
+			memcpy(dst, buf, octets);
+		} else {
+			for(; octets - i >= 7 && end - buf >= 8; i += 7, buf += 7) {
+				uint64_t word = per_load_be64(buf) << off;
+				dst[i] = word >> 56;
+				dst[i + 1] = word >> 48;
+				dst[i + 2] = word >> 40;
+				dst[i + 3] = word >> 32;
+				dst[i + 4] = word >> 24;
+				dst[i + 5] = word >> 16;
+				dst[i + 6] = word >> 8;
+			}
+			for(; i < octets; i++, buf++)
+				dst[i] = (buf[0] << off) | (buf[1] >> (8 - off));
+		}
+
+		dst += octets;
+		pd->nboff += octets << 3;
+		pd->moved += octets << 3;
+		nbits &= 0x07;
+	}
+
+	/* The rest, and streams continued by refill() */
 	while(nbits) {
 		if(nbits >= 24) {
 			value = per_get_few_bits(pd, 24);
@@ -159,6 +219,26 @@ per_get_many_bits(asn_per_data_t *pd, uint8_t *dst, int alright, int nbits) {
 	return 0;
 }
 
+/*
+ * Skip a number of bits without extracting them.
+ */
+int
+per_skip_many_bits(asn_per_data_t *pd, size_t nbits) {
+
+	if(nbits > pd->nbits - pd->nboff) {
+		/* Cross refills piecewise */
+		if(!pd->refill) return -1;
+		for(; nbits > 24; nbits -= 24)
+			if(per_get_few_bits(pd, 24) < 0) return -1;
+		return per_get_few_bits(pd, nbits) < 0 ? -1 : 0;
+	}
+
+	pd->nboff += nbits;
+	pd->moved += nbits;
+
+	return 0;
+}
+
 /*
  * Get the length "n" from the stream.
  */
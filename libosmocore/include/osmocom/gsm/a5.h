@@ -57,4 +57,12 @@ int osmo_a5(int n, const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul);
 void osmo_a5_1(const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul);
 void osmo_a5_2(const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul);
 
+	/* Notes:
+	 *  - keys and fn hold count entries, stream i uses keys[i] and fn[i]
+	 *  - the dl and ul pointers must be either NULL or count * 15 bytes,
+	 *    each stream being 114 packed bits (as osmo_ubit2pbit())
+	 */
+int osmo_a5_bulk(int n, const uint8_t **keys, const uint32_t *fn, unsigned int count,
+		 pbit_t *dl, pbit_t *ul);
+
 /*! @} */
@@ -373,4 +373,351 @@ osmo_a5_2(const uint8_t *key, uint32_t fn, ubit_t *dl, ubit_t *ul)
 	}
 }
 
+/* ------------------------------------------------------------------------ */
+/* Bitsliced A5/1&2                                                         */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Many instances of the generator run at once, one per bit of a 64 bit
+ * word: r1[j][w] holds bit j of R1 for instances 64*w .. 64*w+63. Clocking
+ * is a masked move of every register bit, so instances with different keys
+ * and frame numbers clock independently. Streams are transposed back into
+ * packed bits at the end.
+ */
+
+#define A5_SLICE_WORDS	4	/* 256 instances with AVX2, 64 otherwise */
+
+/* Below this many streams the generators above are faster */
+#define A5_BULK_MIN	4
+
+#define A5_STREAM_BYTES	15	/* 114 packed bits */
+
+typedef uint64_t a5_slice_t[A5_SLICE_WORDS];
+
+struct a5_sliced {
+	a5_slice_t r1[A5_R1_LEN];
+	a5_slice_t r2[A5_R2_LEN];
+	a5_slice_t r3[A5_R3_LEN];
+	a5_slice_t r4[A5_R4_LEN];
+};
+
+#define A5_INLINE	static inline __attribute__((always_inline))
+
+/*! \brief Transpose a 64x64 bit matrix, bit 63 of a[0] being the top left
+ *  \param[inout] a 64 rows of 64 bits
+ */
+static void
+_a5_transpose64(uint64_t a[64])
+{
+	uint64_t m, t;
+	int j, k;
+
+	for (j = 32, m = 0x00000000ffffffffULL; j; j >>= 1, m ^= m << j) {
+		for (k = 0; k < 64; k = (k + j + 1) & ~j) {
+			t = (a[k] ^ (a[k + j] >> j)) & m;
+			a[k] ^= t;
+			a[k + j] ^= t << j;
+		}
+	}
+}
+
+/*! \brief Clock one register of all instances
+ *  \param[inout] r Register bits
+ *  \param[in] len Register length
+ *  \param[in] fb Feedback bit
+ *  \param[in] clk Instances to clock
+ *  \param[in] W Lane words in use
+ */
+A5_INLINE void
+_a5_sliced_clock(a5_slice_t *r, int len, const uint64_t *fb, const uint64_t *clk, int W)
+{
+	int j, w;
+
+	for (j = len - 1; j > 0; j--)
+		for (w = 0; w < W; w++)
+			r[j][w] ^= (r[j][w] ^ r[j-1][w]) & clk[w];
+
+	for (w = 0; w < W; w++)
+		r[0][w] ^= (r[0][w] ^ fb[w]) & clk[w];
+}
+
+A5_INLINE uint64_t
+_a5_sliced_majority(uint64_t a, uint64_t b, uint64_t c)
+{
+	return (a & b) | (a & c) | (b & c);
+}
+
+/*! \brief Clock R1 to R3 (and R4 for A5/2) of all instances
+ *  \param[inout] s State
+ *  \param[in] n 1 for A5/1, 2 for A5/2
+ *  \param[in] force All ones to disable conditional clocking
+ *  \param[in] W Lane words in use
+ */
+A5_INLINE void
+_a5_sliced_step(struct a5_sliced *s, int n, uint64_t force, int W)
+{
+	uint64_t clk[3][A5_SLICE_WORDS], fb[4][A5_SLICE_WORDS];
+	uint64_t cb0, cb1, cb2, maj;
+	int w;
+
+	for (w = 0; w < W; w++) {
+		if (n == 1) {
+			cb0 = s->r1[8][w];
+			cb1 = s->r2[10][w];
+			cb2 = s->r3[10][w];
+		} else {
+			cb0 = s->r4[10][w];
+			cb1 = s->r4[3][w];
+			cb2 = s->r4[7][w];
+		}
+		maj = _a5_sliced_majority(cb0, cb1, cb2);
+		clk[0][w] = force | ~(cb0 ^ maj);
+		clk[1][w] = force | ~(cb1 ^ maj);
+		clk[2][w] = force | ~(cb2 ^ maj);
+
+		fb[0][w] = s->r1[13][w] ^ s->r1[16][w] ^ s->r1[17][w] ^ s->r1[18][w];
+		fb[1][w] = s->r2[20][w] ^ s->r2[21][w];
+		fb[2][w] = s->r3[7][w] ^ s->r3[20][w] ^ s->r3[21][w] ^ s->r3[22][w];
+		fb[3][w] = s->r4[11][w] ^ s->r4[16][w];
+	}
+
+	_a5_sliced_clock(s->r1, A5_R1_LEN, fb[0], clk[0], W);
+	_a5_sliced_clock(s->r2, A5_R2_LEN, fb[1], clk[1], W);
+	_a5_sliced_clock(s->r3, A5_R3_LEN, fb[2], clk[2], W);
+
+	if (n == 2) {
+		uint64_t all[A5_SLICE_WORDS] = { ~0ULL, ~0ULL, ~0ULL, ~0ULL };
+
+		_a5_sliced_clock(s->r4, A5_R4_LEN, fb[3], all, W);
+	}
+}
+
+A5_INLINE uint64_t
+_a5_sliced_output(struct a5_sliced *s, int n, int w)
+{
+	uint64_t b;
+
+	b = s->r1[A5_R1_LEN-1][w] ^ s->r2[A5_R2_LEN-1][w] ^ s->r3[A5_R3_LEN-1][w];
+
+	if (n == 2) {
+		b ^= _a5_sliced_majority( s->r1[15][w], ~s->r1[14][w],  s->r1[12][w]) ^
+		     _a5_sliced_majority(~s->r2[16][w],  s->r2[13][w],  s->r2[9][w]) ^
+		     _a5_sliced_majority( s->r3[18][w],  s->r3[16][w], ~s->r3[13][w]);
+	}
+
+	return b;
+}
+
+/*! \brief Turn one bit per instance and clock into packed streams
+ *  \param[in] o 128 clocks of output bits, 114 used
+ *  \param[in] count Number of instances
+ *  \param[out] out count streams of 15 bytes
+ *  \param[in] W Lane words in use
+ */
+static void
+_a5_sliced_store(a5_slice_t *o, int count, pbit_t *out, int W)
+{
+	uint64_t a[64], v;
+	int w, h, i, l, lane;
+
+	for (w = 0; w < W; w++) {
+		for (h = 0; h < 2; h++) {
+			for (i = 0; i < 64; i++)
+				a[i] = o[h*64 + i][w];
+
+			_a5_transpose64(a);
+
+			for (l = 0; l < 64; l++) {
+				lane = w*64 + l;
+				if (lane >= count)
+					break;
+
+				v = a[63 - l];
+				for (i = 0; i < (h ? A5_STREAM_BYTES - 8 : 8); i++)
+					out[lane*A5_STREAM_BYTES + h*8 + i] = v >> (56 - 8*i);
+			}
+		}
+	}
+}
+
+/*! \brief Generate up to 64*W A5/1 or A5/2 cipher streams
+ *  \param[in] n 1 for A5/1, 2 for A5/2
+ *  \param[in] keys count pointers to 8 byte keys
+ *  \param[in] fn count frame numbers
+ *  \param[in] count Number of streams
+ *  \param[out] dl count packed downlink streams of 15 bytes, or NULL
+ *  \param[out] ul count packed uplink streams of 15 bytes, or NULL
+ *  \param[in] W Lane words in use
+ */
+A5_INLINE void
+_a5_sliced(int n, const uint8_t **keys, const uint32_t *fn, int count,
+	   pbit_t *dl, pbit_t *ul, int W)
+{
+	struct a5_sliced s;
+	a5_slice_t k[64], f[22], o[128];
+	uint64_t a[64], kw;
+	int w, l, lane, i;
+
+	/* Key and frame count bit i of instance l is bit l of slice i */
+	for (w = 0; w < W; w++) {
+		memset(a, 0, sizeof(a));
+		for (l = 0; l < 64 && (lane = w*64 + l) < count; l++) {
+			for (i = 0, kw = 0; i < 8; i++)
+				kw = kw << 8 | keys[lane][i];
+			a[63 - l] = kw;
+		}
+		_a5_transpose64(a);
+		for (i = 0; i < 64; i++)
+			k[i][w] = a[63 - i];
+
+		memset(a, 0, sizeof(a));
+		for (l = 0; l < 64 && (lane = w*64 + l) < count; l++)
+			a[63 - l] = osmo_a5_fn_count(fn[lane]);
+		_a5_transpose64(a);
+		for (i = 0; i < 22; i++)
+			f[i][w] = a[63 - i];
+	}
+
+	memset(&s, 0, sizeof(s));
+
+	/* Key load, then frame count load */
+	for (i = 0; i < 64 + 22; i++) {
+		_a5_sliced_step(&s, n, ~0ULL, W);
+
+		for (w = 0; w < W; w++) {
+			kw = i < 64 ? k[i][w] : f[i - 64][w];
+			s.r1[0][w] ^= kw;
+			s.r2[0][w] ^= kw;
+			s.r3[0][w] ^= kw;
+			s.r4[0][w] ^= kw;
+		}
+	}
+
+	if (n == 2) {
+		for (w = 0; w < W; w++) {
+			s.r1[15][w] = ~0ULL;
+			s.r2[16][w] = ~0ULL;
+			s.r3[18][w] = ~0ULL;
+			s.r4[10][w] = ~0ULL;
+		}
+	}
+
+	/* Mix */
+	for (i = 0; i < (n == 1 ? 100 : 99); i++)
+		_a5_sliced_step(&s, n, 0, W);
+
+	/* Output */
+	memset(o, 0, sizeof(o));
+
+	for (i = 0; i < 114; i++) {
+		_a5_sliced_step(&s, n, 0, W);
+		for (w = 0; w < W; w++)
+			o[i][w] = _a5_sliced_output(&s, n, w);
+	}
+	if (dl)
+		_a5_sliced_store(o, count, dl, W);
+
+	if (!ul)
+		return;
+
+	for (i = 0; i < 114; i++) {
+		_a5_sliced_step(&s, n, 0, W);
+		for (w = 0; w < W; w++)
+			o[i][w] = _a5_sliced_output(&s, n, w);
+	}
+	_a5_sliced_store(o, count, ul, W);
+}
+
+static void
+_a5_sliced_64(int n, const uint8_t **keys, const uint32_t *fn, int count,
+	      pbit_t *dl, pbit_t *ul)
+{
+	_a5_sliced(n, keys, fn, count, dl, ul, 1);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define A5_SLICED_AVX2
+
+__attribute__((target("avx2"))) static void
+_a5_sliced_256(int n, const uint8_t **keys, const uint32_t *fn, int count,
+	       pbit_t *dl, pbit_t *ul)
+{
+	_a5_sliced(n, keys, fn, count, dl, ul, A5_SLICE_WORDS);
+}
+#endif
+
+/*! \brief Generate many A5/x cipher streams at once
+ *  \param[in] n Which A5/x method to use
+ *  \param[in] keys count pointers to 8 byte keys (they may all be the same)
+ *  \param[in] fn count frame numbers
+ *  \param[in] count Number of cipher streams
+ *  \param[out] dl count packed downlink cipher streams of 15 bytes, or NULL
+ *  \param[out] ul count packed uplink cipher streams of 15 bytes, or NULL
+ *  \returns 0 for success, -ENOTSUP for invalid cipher selection.
+ *
+ * Stream i is the one osmo_a5() gives for keys[i] and fn[i], packed as by
+ * osmo_ubit2pbit() so it can be XORed with a packed burst. A5/1 and A5/2
+ * streams are generated 64 at a time (256 with AVX2) by bitslicing.
+ */
+int
+osmo_a5_bulk(int n, const uint8_t **keys, const uint32_t *fn, unsigned int count,
+	     pbit_t *dl, pbit_t *ul)
+{
+	ubit_t dl_bits[114], ul_bits[114];
+	unsigned int i, c, lanes;
+
+	switch (n)
+	{
+	case 0:
+		if (dl)
+			memset(dl, 0x00, count * A5_STREAM_BYTES);
+		if (ul)
+			memset(ul, 0x00, count * A5_STREAM_BYTES);
+		return 0;
+
+	case 1:
+	case 2:
+		break;
+
+	default:
+		/* a5/[3..7] not supported here/yet */
+		return -ENOTSUP;
+	}
+
+	lanes = 64;
+#ifdef A5_SLICED_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		lanes = 64 * A5_SLICE_WORDS;
+#endif
+
+	for (i = 0; i < count; i += c) {
+		c = count - i < lanes ? count - i : lanes;
+
+		if (c < A5_BULK_MIN) {
+			for (c = 0; i + c < count; c++) {
+				osmo_a5(n, keys[i + c], fn[i + c], dl ? dl_bits : NULL, ul ? ul_bits : NULL);
+				if (dl)
+					osmo_ubit2pbit(&dl[(i + c) * A5_STREAM_BYTES], dl_bits, 114);
+				if (ul)
+					osmo_ubit2pbit(&ul[(i + c) * A5_STREAM_BYTES], ul_bits, 114);
+			}
+			break;
+		}
+
+#ifdef A5_SLICED_AVX2
+		if (c > 64) {
+			_a5_sliced_256(n, &keys[i], &fn[i], c,
+				       dl ? &dl[i * A5_STREAM_BYTES] : NULL,
+				       ul ? &ul[i * A5_STREAM_BYTES] : NULL);
+			continue;
+		}
+#endif
+		_a5_sliced_64(n, &keys[i], &fn[i], c,
+			      dl ? &dl[i * A5_STREAM_BYTES] : NULL,
+			      ul ? &ul[i * A5_STREAM_BYTES] : NULL);
+	}
+
+	return 0;
+}
+
 /*! @} */
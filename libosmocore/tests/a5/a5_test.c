@@ -50,6 +50,65 @@ binstr(ubit_t *d, int n)
 	return str;
 }
 
+#define BULK_MAX	300
+
+static const unsigned int bulk_counts[] = { 1, 8, 64, 65, BULK_MAX };
+
+/* Bulk streams against osmo_a5(), every third one with the test vector */
+static void
+test_bulk(int n)
+{
+	static uint8_t keys[BULK_MAX][8];
+	const uint8_t *kp[BULK_MAX];
+	uint32_t fns[BULK_MAX];
+	pbit_t bdl[BULK_MAX * 15], bul[BULK_MAX * 15];
+	pbit_t edl[15], eul[15];
+	ubit_t sdl[114], sul[114];
+	unsigned int c, i, j;
+
+	for (i=0; i<BULK_MAX; i++) {
+		for (j=0; j<8; j++)
+			keys[i][j] = i * 8 + j;
+		kp[i] = (i % 3) ? keys[i] : key;
+		fns[i] = (i % 3) ? fn + i * 1429 : fn;
+	}
+
+	for (c=0; c<sizeof(bulk_counts)/sizeof(bulk_counts[0]); c++) {
+		unsigned int count = bulk_counts[c];
+
+		memset(bdl, 0xaa, sizeof(bdl));
+		memset(bul, 0xaa, sizeof(bul));
+
+		osmo_a5_bulk(n, kp, fns, count, bdl, bul);
+
+		for (i=0; i<count; i++) {
+			osmo_a5(n, kp[i], fns[i], sdl, sul);
+			osmo_ubit2pbit(edl, sdl, 114);
+			osmo_ubit2pbit(eul, sul, 114);
+
+			if (memcmp(edl, &bdl[i * 15], 15) || memcmp(eul, &bul[i * 15], 15) ||
+			    (!(i % 3) && (memcmp(&dl[15*n], &bdl[i * 15], 15) ||
+					  memcmp(&ul[15*n], &bul[i * 15], 15)))) {
+				printf("A5/%d - bulk %d: stream %d => BAD\n", n, count, i);
+				fprintf(stderr, "[!] A5/%d bulk failed", n);
+				exit(1);
+			}
+		}
+
+		/* Downlink only */
+		memcpy(bul, bdl, count * 15);
+		memset(bdl, 0xaa, sizeof(bdl));
+		osmo_a5_bulk(n, kp, fns, count, bdl, NULL);
+		if (memcmp(bul, bdl, count * 15)) {
+			printf("A5/%d - bulk %d DL => BAD\n", n, count);
+			fprintf(stderr, "[!] A5/%d bulk failed", n);
+			exit(1);
+		}
+
+		printf("A5/%d - bulk %d => OK\n", n, count);
+	}
+}
+
 int main(int argc, char **argv)
 {
 	ubit_t exp[114];
@@ -94,5 +153,8 @@ int main(int argc, char **argv)
 		}
 	}
 
+	for (n=0; n<3; n++)
+		test_bulk(n);
+
 	return 0;
 }